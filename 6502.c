@@ -1,10 +1,16 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdatomic.h>
 
 #include "6502.h"
 #include "lib/lib.h"
 
+#ifdef JIT
+#include <sys/mman.h>
+#endif
+
 /* load_bytecode
  *      DESCRIPTION: loads bytecode at passed address in memory
  *      INPUTS: sf -- pointer to 6502 struct with memory to use
@@ -12,7 +18,7 @@
  *              load_address -- address to load bytecode at
  *              num_bytes -- number of bytes to load from start of bytecode
  *      OUTPUTS: none
- *      SIDE EFFECTS: fills 6502 memory with bytecode
+ *      SIDE EFFECTS: fills 6502 memory with bytecode, invalidates code engines decoded from it
  */
 void load_bytecode(sf_t *sf, Bytecode_t *bc, uint16_t load_address, uint32_t num_bytes) {
     if(load_address + num_bytes > MEMORY_SIZE) {
@@ -20,6 +26,7 @@ void load_bytecode(sf_t *sf, Bytecode_t *bc, uint16_t load_address, uint32_t num
         exit(ERR_NO_MEM);
     }
     memcpy(sf->memory + load_address, bc->start, num_bytes);
+    invalidate_code(sf);
 }
 
 /* initialize_regs
@@ -27,17 +34,60 @@ void load_bytecode(sf_t *sf, Bytecode_t *bc, uint16_t load_address, uint32_t num
  *      INPUTS: sf -- pointer to 6502 whose registers we wish to modify
  *              pc_init -- value to set pc to initially
  *      OUTPUTS: none
- *      SIDE EFFECTS: modifies register values
+ *      SIDE EFFECTS: modifies register values, builds ADC/SBC lookup tables on first call, maps every page as RAM,
+ *                    invalidates code engines decoded from memory
  */
 void initialize_regs(sf_t *sf, uint16_t pc_init) {
+    build_arithmetic_tables();
+#ifdef MEMORY_BUS
+    initialize_bus(sf);
+#endif
     sf->esp = STACK_START; // stack grows down
     sf->pc = pc_init;
     sf->accumulator = 0;
     sf->x_index = 0;
     sf->y_index = 0;
     sf->status = 0;
+    sf->cycles = 0;
+    sf->next_event = UINT64_MAX;
+    sf->nz_pending = 0;
+    invalidate_code(sf);
+}
+
+#ifdef LAZY_FLAGS
+/* check_negative_and_zero
+ *      DESCRIPTION: records operand as the value negative and zero flags are to be built from when next needed
+ *      INPUTS: sf -- 6502 whose flags we wish to modify
+ *              operand -- operand whose negative or zero status we want to check
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: marks negative and zero flag of 6502 as pending
+ */
+static inline void check_negative_and_zero(sf_t *sf, uint8_t operand) {
+    sf->nz_result = operand;
+    sf->nz_pending = 1;
 }
 
+/* sync_negative_and_zero
+ *      DESCRIPTION: builds negative and zero flags in status from pending result, if there is one
+ *      INPUTS: sf -- 6502 whose flags we wish to bring up to date
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies negative and zero flag of 6502, clears pending result
+ */
+static inline void sync_negative_and_zero(sf_t *sf) {
+    if (sf->nz_pending) {
+        sf->status = (sf->status & ~((1 << NEGATIVE_INDEX)|(1 << ZERO_INDEX))) |
+                     (sf->nz_result & (1 << NEGATIVE_INDEX)) |
+                     ((sf->nz_result == 0x00) << ZERO_INDEX);
+        sf->nz_pending = 0;
+    }
+}
+
+// read negative/zero flag without building status
+#define NEGATIVE_FLAG(sf)   ((sf)->nz_pending ? ((sf)->nz_result & 0x80) : ((sf)->status & (1 << NEGATIVE_INDEX)))
+#define ZERO_FLAG(sf)       ((sf)->nz_pending ? ((sf)->nz_result == 0x00) : ((sf)->status & (1 << ZERO_INDEX)))
+// status is about to be overwritten, so pending result must not be applied over it later
+#define DISCARD_NEGATIVE_AND_ZERO(sf)   ((sf)->nz_pending = 0)
+#else
 /* check_negative_and_zero
  *      DESCRIPTION: checks if operand is negative or zero and sets flags accordingly
  *      INPUTS: sf -- 6502 whose flags we wish to modify
@@ -59,6 +109,12 @@ static void check_negative_and_zero(sf_t *sf, uint8_t operand) {
     }
 }
 
+#define sync_negative_and_zero(sf)
+#define NEGATIVE_FLAG(sf)   ((sf)->status & (1 << NEGATIVE_INDEX))
+#define ZERO_FLAG(sf)       ((sf)->status & (1 << ZERO_INDEX))
+#define DISCARD_NEGATIVE_AND_ZERO(sf)
+#endif
+
 /* hex_to_bcd
  *      DESCRIPTION: converts passed hex number to decimal WITHOUT PRESERVING VALUE, i.e. 0x99 -> 99
  *      INPUTS: hex -- the number to convert to decimal
@@ -126,6 +182,7 @@ static void ASL_operation(sf_t *sf, uint8_t *operand) {
  *      SIDE EFFECTS: sets zero flag if result of AND is zero, sets negative/overflow flag if result of and has bit 7/6 set
  */
 static void BIT_operation(sf_t *sf, uint8_t *operand) {
+    sync_negative_and_zero(sf); // negative flag is only ever set here, so it must be current
     if ((sf->accumulator & (*operand)) == 0x00) {
         sf->status |= (1 << ZERO_INDEX);
     } else {
@@ -202,14 +259,15 @@ static void LSR_operation(sf_t *sf, uint8_t *operand) {
     check_negative_and_zero(sf, *operand);
 }
 
-/* ADC_operation
+/* ADC_arithmetic
  *      DESCRIPTION: adds operand to accumulator with carry, storing result in accumulator; works with BCD and hex
+ *                   (reference implementation, ADC instructions use adc_table built from it)
  *      INPUTS: sf -- 6502 struct
  *              operand -- operand to add to accumulator
  *      OUTPUTS: none
  *      SIDE EFFECTS: modifies accumulator; overflow, negative, zero and carry flags
  */
-static void ADC_operation(sf_t *sf, uint8_t *operand) {
+void ADC_arithmetic(sf_t *sf, uint8_t *operand) {
     if (sf->status & (1 << DECIMAL_INDEX)) {
         uint8_t temp = hex_to_bcd(sf->accumulator) + hex_to_bcd(*operand) + ((sf->status & (1 << CARRY_INDEX)) >> (CARRY_INDEX));
         
@@ -413,14 +471,15 @@ static void CPX_operation(sf_t *sf, uint8_t *operand) {
     check_negative_and_zero(sf, temp);
 }
 
-/* SBC_operation
+/* SBC_arithmetic
  *      DESCRIPTION: subtracts memory from accumulator (with carry) and stores the result in accumulator, expects carry to be set for normal operation
+ *                   (reference implementation, SBC instructions use sbc_table built from it)
  *      INPUTS: sf -- 6502 stryuct
  *              operand -- memory with value to subtract from accumulator
  *      OUTPUTS: none
  *      SIDE EFFECTS: modifies accumulator; carry, overflow, negative, and zero flags
  */
-static void SBC_operation(sf_t *sf, uint8_t *operand) {
+void SBC_arithmetic(sf_t *sf, uint8_t *operand) {
     if (sf->status & (1 << DECIMAL_INDEX)) {
         uint8_t temp;
         if (hex_to_bcd(sf->accumulator) < (hex_to_bcd(*operand) + (((sf->status & (1 << CARRY_INDEX)) ^ (1 << CARRY_INDEX)) >> CARRY_INDEX))) {
@@ -482,842 +541,2652 @@ static void INC_operation(sf_t *sf, uint8_t *operand) {
     check_negative_and_zero(sf, *operand);
 }
 
-/* process_line
- *      DESCRIPTION: runs line of bytecode beginning at location of PC
- *      INPUTS: sf -- 6502 struct
+/* ADC/SBC LOOKUP TABLES
+ * indexed by decimal flag, carry flag, accumulator and operand (see ARITHMETIC_INDEX); each entry holds the
+ * result in its low byte and the resulting N, V, Z and C flags, in their status bit positions, in its high byte
+ */
+#define ARITHMETIC_TABLE_SIZE   (2 * 2 * 256 * 256)
+#define ARITHMETIC_FLAGS        ((1 << NEGATIVE_INDEX)|(1 << OVERFLOW_INDEX)|(1 << ZERO_INDEX)|(1 << CARRY_INDEX))
+#define ARITHMETIC_INDEX(status, accumulator, operand)      \
+    (((((status) >> DECIMAL_INDEX) & 1) << 17) |            \
+     ((((status) >> CARRY_INDEX) & 1) << 16) |              \
+     ((accumulator) << 8) |                                 \
+     (operand))
+
+static uint16_t adc_table[ARITHMETIC_TABLE_SIZE];
+static uint16_t sbc_table[ARITHMETIC_TABLE_SIZE];
+static uint8_t arithmetic_tables_built = 0;
+
+/* build_arithmetic_table
+ *      DESCRIPTION: fills passed table by running passed reference operation on every input combination
+ *      INPUTS: table -- table to fill
+ *              operation -- reference implementation (ADC_arithmetic or SBC_arithmetic)
+ *              scratch -- 6502 used to run operation
  *      OUTPUTS: none
- *      SIDE EFFECTS: may modify status, accumulator, x_index, y_index, and pc depending on instruction
+ *      SIDE EFFECTS: fills table, clobbers registers of scratch
  */
-void process_line (sf_t *sf) {
-    switch (sf->memory[sf->pc]) { 
-        case OP_BRK:
-            sf->memory[sf->esp--] = (sf->pc+1) & 0x00FF; // push low byte of PC for next instruction
-            sf->memory[sf->esp--] = (sf->pc+1) >> 8; // push high byte of PC for next instruction
-            sf->memory[sf->esp--] = sf->status; // push flags
-            sf->status |= (1 << INTERRUPT_INDEX);
-            sf->status |= (1 << BREAK_INDEX);
-            sf->pc = IRQ_ADDRESS;
-            break;
-        
-        case OP_PHP:
-            sf->memory[sf->esp--] = sf->status;
-            sf->pc++;
-            break;
-        
-        case OP_BPL:
-            sf->pc += 2;
-            if (!(sf->status & (1 << NEGATIVE_INDEX))) {
-                sf->pc += (int8_t) sf->memory[sf->pc - 1]; // offset is stored in previous byte
-            }
-            break;
-        
-        case OP_CLC:
-            sf->status &= ~(1 << CARRY_INDEX);
-            sf->pc++;
-            break;
-        
-        case OP_JSR:
-            // push return address to stack
-            sf->memory[sf->esp--] = (sf->pc + 3) & 0x00FF;
-            sf->memory[sf->esp--] = (sf->pc + 3) >> 8;
-            // set pc to address provided to jump instruction
-            sf->pc = (sf->memory[sf->pc+2] << 8)|sf->memory[sf->pc+1];
-            break;
-
-        case OP_PLP:
-            sf->status = sf->memory[++sf->esp];
-            sf->pc++;
-            break;
+static void build_arithmetic_table(uint16_t *table, void (*operation)(sf_t *sf, uint8_t *operand), sf_t *scratch) {
+    for (uint32_t i = 0; i < ARITHMETIC_TABLE_SIZE; i++) {
+        uint8_t operand = i & 0xFF;
+        scratch->accumulator = (i >> 8) & 0xFF;
+        scratch->status = (((i >> 16) & 1) << CARRY_INDEX) | (((i >> 17) & 1) << DECIMAL_INDEX);
+        (*operation)(scratch, &operand);
+
+        uint8_t flags = scratch->status & ((1 << OVERFLOW_INDEX)|(1 << CARRY_INDEX));
+        flags |= scratch->accumulator & (1 << NEGATIVE_INDEX);
+        flags |= (scratch->accumulator == 0x00) << ZERO_INDEX;
+        table[i] = (flags << 8) | scratch->accumulator;
+    }
+}
 
-        case OP_BMI:
-            sf->pc += 2;
-            if (sf->status & (1 << NEGATIVE_INDEX)) {
-                sf->pc += (int8_t)sf->memory[sf->pc - 1];
-            }
-            break;
+/* build_arithmetic_tables
+ *      DESCRIPTION: builds ADC and SBC lookup tables from reference implementations, if not built already
+ *      INPUTS: none
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: fills adc_table and sbc_table
+ */
+void build_arithmetic_tables(void) {
+    if (arithmetic_tables_built) {
+        return;
+    }
+    sf_t *scratch = (sf_t *)malloc(sizeof(sf_t));
+    if (scratch == NULL) {
+        fprintf(stderr, "Failed to allocate memory for arithmetic tables\n");
+        exit(ERR_NO_MEM);
+    }
+    build_arithmetic_table(adc_table, ADC_arithmetic, scratch);
+    build_arithmetic_table(sbc_table, SBC_arithmetic, scratch);
+    free(scratch);
+    arithmetic_tables_built = 1;
+}
 
-        case OP_SEC:
-            sf->status |= (1 << CARRY_INDEX);
-            sf->pc++;
-            break;
+/* apply_arithmetic_entry
+ *      DESCRIPTION: loads result and flags from ADC/SBC lookup table entry
+ *      INPUTS: sf -- 6502 struct
+ *              entry -- table entry to apply
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies accumulator; overflow, negative, zero and carry flags
+ */
+static inline void apply_arithmetic_entry(sf_t *sf, uint16_t entry) {
+    sf->accumulator = entry & 0xFF;
+#ifdef LAZY_FLAGS
+    sf->status = (sf->status & ~((1 << OVERFLOW_INDEX)|(1 << CARRY_INDEX))) | ((entry >> 8) & ((1 << OVERFLOW_INDEX)|(1 << CARRY_INDEX)));
+    check_negative_and_zero(sf, sf->accumulator);
+#else
+    sf->status = (sf->status & ~ARITHMETIC_FLAGS) | (entry >> 8);
+#endif
+}
 
-        case OP_RTI:
-            sf->status = sf->memory[++sf->esp];
-            sf->pc = sf->memory[++sf->esp] << 8;
-            sf->pc |= sf->memory[++sf->esp];
-            // don't increment PC after this because in BRK we push PC for next instruction
-            break;
+/* ADC_lookup
+ *      DESCRIPTION: adds operand to accumulator with carry using adc_table; works with BCD and hex
+ *      INPUTS: sf -- 6502 struct
+ *              operand -- operand to add to accumulator
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies accumulator; overflow, negative, zero and carry flags
+ */
+void ADC_lookup(sf_t *sf, uint8_t *operand) {
+    apply_arithmetic_entry(sf, adc_table[ARITHMETIC_INDEX(sf->status, sf->accumulator, *operand)]);
+}
 
-        case OP_PHA:
-            sf->memory[sf->esp--] = sf->accumulator;
-            sf->pc++;
-            break;
+/* SBC_lookup
+ *      DESCRIPTION: subtracts operand from accumulator with borrow using sbc_table; works with BCD and hex
+ *      INPUTS: sf -- 6502 struct
+ *              operand -- operand to subtract from accumulator
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies accumulator; overflow, negative, zero and carry flags
+ */
+void SBC_lookup(sf_t *sf, uint8_t *operand) {
+    apply_arithmetic_entry(sf, sbc_table[ARITHMETIC_INDEX(sf->status, sf->accumulator, *operand)]);
+}
 
-        case OP_JMP:
-            sf->pc = (sf->memory[sf->pc + 2] << 8)|sf->memory[sf->pc + 1];
-            break;
+// ADC and SBC instructions run through the lookup tables
+#define ADC_operation   ADC_lookup
+#define SBC_operation   SBC_lookup
 
-        case OP_BVC:
-            sf->pc += 2;
-            if (!(sf->status & (1 << OVERFLOW_INDEX))) {
-                sf->pc += (int8_t)sf->memory[sf->pc - 1];
-            }
-            break;
+/* CODE VERSIONS
+ * engines that keep code decoded or translated from one run to the next record which 6502, and which version of
+ * its code, they took it from; invalidate_code gives sf a version no engine has seen, so the next run of sf on any
+ * engine starts from scratch, while stores the CPU itself makes reach the engines through note_store
+ */
 
-        case OP_CLI:
-            sf->status &= ~(1 << INTERRUPT_INDEX);
-            sf->pc++;
-            break;
+// 6502 and version of its code an engine's decoded or translated code was taken from
+typedef struct {
+    const sf_t *sf;
+    uint64_t version;
+} CodeOwner_t;
 
-        case OP_RTS:
-            sf->pc = sf->memory[++sf->esp] << 8;
-            sf->pc |= sf->memory[++sf->esp];
-            // don't increment PC after this because in JSR we push PC for next instruction
-            break;
+static _Atomic uint64_t last_code_version = 0; // version most recently handed out by invalidate_code
 
-        case OP_PLA:
-            sf->accumulator = sf->memory[++sf->esp];
-            sf->pc++;
-            break;
-        
-        case OP_JI:
-            sf->pc = ((sf->memory[((sf->memory[sf->pc + 2] << 8)|sf->memory[sf->pc + 1]) + 1]) << 8) |
-                        (sf->memory[(sf->memory[sf->pc + 2] << 8)|sf->memory[sf->pc + 1]]);
-            break;
+/* invalidate_code
+ *      DESCRIPTION: tells every engine that memory of sf may have been changed by something other than the CPU
+ *                   running on this thread (a loader, a snapshot restore, a struct copy, another thread), so code
+ *                   they decoded or translated from it must not be run again
+ *      INPUTS: sf -- 6502 struct whose memory was written
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies sf->code_version
+ */
+void invalidate_code(sf_t *sf) {
+    sf->code_version = ++last_code_version;
+}
 
-        case OP_BVS:
-            sf->pc += 2;
-            if (sf->status & (1 << OVERFLOW_INDEX)) {
-                sf->pc += (int8_t)sf->memory[sf->pc - 1];
-            }
-            break;
+/* claim_code
+ *      DESCRIPTION: records sf as the 6502 an engine's code is about to be taken from
+ *      INPUTS: owner -- owner recorded by the engine
+ *              sf -- 6502 struct about to run
+ *      OUTPUTS: nonzero if the engine's code came from another 6502 or an older version of this one's, and must be
+ *               flushed
+ *      SIDE EFFECTS: modifies owner
+ */
+static int claim_code(CodeOwner_t *owner, const sf_t *sf) {
+    if (owner->sf == sf && owner->version == sf->code_version) {
+        return 0;
+    }
+    owner->sf = sf;
+    owner->version = sf->code_version;
+    return 1;
+}
 
-        case OP_SEI:
-            sf->status |= (1 << INTERRUPT_INDEX);
-            sf->pc++;
-            break;
+/* BLOCK CACHE
+ * block_at maps the address of a block's first instruction to the block; every instruction in it is decoded once,
+ * with its operand byte, the address its addressing mode resolves to when that doesn't depend on registers or
+ * memory, and the address of the next instruction, so running it never fetches from sf->memory again
+ * code_byte marks every byte some block was decoded from; a store to one drops each block covering it and ends
+ * the block being run right after the store, so self-modifying code is decoded again before it runs
+ * blocks come from a fixed pool that is emptied when full or when another 6502 (or version of its code) runs
+ */
+#define BLOCK_MAX_INSTRUCTIONS  32
+#define BLOCK_MAX_BYTES         (BLOCK_MAX_INSTRUCTIONS * 3)
+#define BLOCK_CACHE_BLOCKS      1024
+
+// one pre-decoded instruction; its handler returns the next instruction of the block, or NULL once sf->pc is set
+typedef struct DecodedOp {
+    const struct DecodedOp *(*handler)(sf_t *sf, const struct DecodedOp *op);
+    uint16_t address; // resolved zero page or absolute operand address, or branch target
+    uint16_t next_pc; // address of the instruction after this one
+    uint8_t operand; // first operand byte (immediate value, zero page address, low byte of absolute address)
+    uint8_t opcode;
+    uint8_t cycles_through; // base cycles of the block up to and including this instruction
+    uint8_t index; // position in the block
+} DecodedOp_t;
+
+typedef struct {
+    uint16_t start; // address of first instruction
+    uint16_t bytes; // length of code the block was decoded from
+    uint16_t num_instr;
+    uint16_t cycles; // base cycles of every instruction
+    uint8_t ends_in_brk;
+    DecodedOp_t ops[BLOCK_MAX_INSTRUCTIONS + 1]; // + the op ending blocks cut short at BLOCK_MAX_INSTRUCTIONS
+} Block_t;
+
+typedef struct {
+    CodeOwner_t owner;
+    const DecodedOp_t *stopped; // instruction whose store stopped the block running, NULL if none did
+    uint32_t num_blocks;
+    Block_t *block_at[MEMORY_SIZE];
+    uint8_t code_byte[MEMORY_SIZE];
+    Block_t blocks[BLOCK_CACHE_BLOCKS];
+} BlockCache_t;
+
+static _Thread_local BlockCache_t *thread_blocks = NULL; // cache owned by this thread, allocated on first run
+static _Thread_local uint8_t blocks_dropped = 0; // set by drop_blocks, cleared once the block running stops for it
+
+/* drop_blocks
+ *      DESCRIPTION: unlinks every cached block decoded from the byte at passed address
+ *      INPUTS: cache -- block cache to modify
+ *              address -- byte about to be written
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies block_at, sets blocks_dropped if a block was unlinked
+ */
+static void drop_blocks(BlockCache_t *cache, uint16_t address) {
+    for (int i = 0; i < BLOCK_MAX_BYTES; i++) {
+        Block_t *block = cache->block_at[(uint16_t)(address - i)];
+        if (block != NULL && i < block->bytes) {
+            cache->block_at[block->start] = NULL;
+            blocks_dropped = 1;
+        }
+    }
+}
 
-        case OP_DEY:
-            sf->y_index--;
-            check_negative_and_zero(sf, sf->y_index);
-            sf->pc++;
-            break;
+#ifdef JIT
+/* JIT STATE
+ * per-thread state of the x86-64 translator; code_at maps the address of a block's first instruction to its
+ * translation, code_page marks pages holding translated code and no_jit_page marks pages written while
+ * translated, which are left to the interpreter until the translations are thrown away for another 6502 or
+ * version of its code (see claim_code); translations otherwise stay from one run to the next
+ * the code buffer is never writable and executable at once: it is mapped read/write while code is emitted or
+ * patched and read/execute while translated code runs
+ */
+#define JIT_CODE_SIZE       (4 << 20)
+#define JIT_MAX_CHAINS      8192
+
+// jump in translated code still waiting for its target block to be translated
+typedef struct {
+    uint8_t *site; // rel32 field of the jump
+    uint16_t target; // 6502 address the jump continues at
+} JitChain_t;
+
+typedef struct {
+    uint64_t remaining; // instruction budget left when translated code returns (kept first, the exit code stores it at offset 0)
+    uint8_t flush_pending; // set by note_store when translated code was overwritten
+    uint8_t code_page[NUM_PAGES];
+    uint8_t no_jit_page[NUM_PAGES];
+    uint16_t hits[MEMORY_SIZE]; // times the interpreter started a block at address
+    uint8_t *code_at[MEMORY_SIZE];
+    uint16_t block_start[MEMORY_SIZE]; // addresses with an entry in code_at, for flushing
+    uint32_t num_blocks;
+    JitChain_t chains[JIT_MAX_CHAINS];
+    uint32_t num_chains;
+    CodeOwner_t owner; // 6502 the translations were made from
+    uint8_t writable; // set while code is mapped read/write, clear while it is mapped read/execute
+    uint8_t *code; // mmap'd code buffer
+    uint8_t *code_free; // first unused byte of code
+    uint8_t *code_blocks; // first byte after the fixed entry/exit code, where blocks start
+    uint8_t *exit_cold; // exits to dispatcher because the next block has no translation
+    uint8_t *exit_budget; // exits to dispatcher because the budget can't cover the next block
+    uint8_t *exit_common; // saves budget, restores host registers and returns exit code in eax
+    int (*enter)(sf_t *sf, uint64_t remaining, void *jit, uint8_t *block); // entry trampoline
+} JitState_t;
+
+static _Thread_local JitState_t *thread_jit = NULL; // translator owned by this thread, allocated on first run
+#endif
+
+/* THREADED CODE
+ * the threaded engine keeps one entry per address: the handler to run for the instruction there (or for it and
+ * the one after it, as a superinstruction), its base cycles and how many instructions it covers; entries are
+ * translated the first time they run and kept from one run to the next, a store resets the entries that could
+ * include the byte written
+ */
+typedef struct {
+    void (*handler)(sf_t *sf);
+    uint8_t cycles; // base cycles of every instruction covered
+    uint8_t num_instr; // 1, 2 for superinstructions, 0 if not translated yet
+    uint8_t is_brk; // set for BRK, which ends the run
+} ThreadedOp_t;
+
+typedef struct {
+    CodeOwner_t owner; // 6502 the entries were translated from
+    uint8_t translated_page[NUM_PAGES]; // set for pages holding translated entries
+    ThreadedOp_t ops[MEMORY_SIZE]; // entry for instruction at every address
+} ThreadedCode_t;
+
+static _Thread_local ThreadedCode_t *thread_threaded = NULL; // threaded code owned by this thread
+
+static _Thread_local StoreLog_t *active_store_log = NULL; // log set by log_stores on this thread, if any
+static _Thread_local uint32_t device_accesses = 0; // calls made into device callbacks on this thread, wraps around
+
+/* log_stores
+ *      DESCRIPTION: makes every store the CPU makes on the calling thread append its address and the byte it
+ *                   overwrites to log, until called again
+ *      INPUTS: log -- log to append to (its count is left to the caller), NULL to stop logging
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: changes logging of the calling thread
+ */
+void log_stores(StoreLog_t *log) {
+    active_store_log = log;
+}
 
-        case OP_TXA:
-            sf->accumulator = sf->x_index;
-            check_negative_and_zero(sf, sf->accumulator);
-            sf->pc++;
-            break;
+/* note_store
+ *      DESCRIPTION: called just before the CPU writes memory; logs the byte about to be overwritten, marks the page
+ *                   dirty for the next snapshot, resets threaded code entries, drops cached blocks and flags
+ *                   translated code for flushing if the write may hit code
+ *      INPUTS: sf -- 6502 struct about to write
+ *              address -- offset in sf->memory about to be written
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: may append to the active store log, modifies sf->dirty, may reset entries of this thread's
+ *                    threaded code, drop blocks of its block cache and set flush_pending of its JIT if they were
+ *                    taken from sf
+ */
+static inline void note_store(sf_t *sf, uint16_t address) {
+    StoreLog_t *log = active_store_log;
+    if (log != NULL && log->count < MAX_LOGGED_STORES) {
+        log->addresses[log->count] = address;
+        log->old_values[log->count++] = sf->memory[address];
+    }
+    MARK_DIRTY(sf, address);
+    ThreadedCode_t *threaded = thread_threaded;
+    // a superinstruction of two 3 byte instructions covers the 5 bytes after its own address
+    if (threaded != NULL && (threaded->translated_page[address >> 8] ||
+                             threaded->translated_page[(uint16_t)(address - 5) >> 8]) && threaded->owner.sf == sf) {
+        for (int i = 0; i <= 5; i++) {
+            threaded->ops[(uint16_t)(address - i)].num_instr = 0;
+        }
+    }
+    BlockCache_t *blocks = thread_blocks;
+    if (blocks != NULL && blocks->code_byte[address] && blocks->owner.sf == sf) {
+        drop_blocks(blocks, address);
+    }
+#ifdef JIT
+    JitState_t *jit = thread_jit;
+    if (jit != NULL && jit->code_page[address >> 8] && jit->owner.sf == sf) {
+        jit->no_jit_page[address >> 8] = 1;
+        jit->flush_pending = 1;
+    }
+#endif
+}
 
-        case OP_BCC:
-            sf->pc += 2;
-            if (!(sf->status & (1 << CARRY_INDEX))) {
-                sf->pc += (int8_t)sf->memory[sf->pc - 1];
-            }
-            break;
+/* record_stores
+ *      DESCRIPTION: note_store for engines outside this file that write memory for the CPU themselves (the lockstep
+ *                   engine, a store per lane); called just before the writes
+ *      INPUTS: sfs -- 6502 structs about to write, one per store
+ *              addresses -- offset in each one's sf->memory about to be written
+ *              num_stores -- number of stores
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: same as note_store for every store
+ */
+void record_stores(sf_t *const *sfs, const uint16_t *addresses, uint32_t num_stores) {
+    const sf_t *threaded = thread_threaded != NULL ? thread_threaded->owner.sf : NULL;
+    const sf_t *blocks = thread_blocks != NULL ? thread_blocks->owner.sf : NULL;
+#ifdef JIT
+    const sf_t *jit = thread_jit != NULL ? thread_jit->owner.sf : NULL;
+#else
+    const sf_t *jit = NULL;
+#endif
+    for (uint32_t i = 0; i < num_stores; i++) {
+        sf_t *sf = sfs[i];
+        // most stores are to 6502s no code or log on this thread was taken from, which only need their page marked
+        if (active_store_log == NULL && sf != threaded && sf != blocks && sf != jit) {
+            MARK_DIRTY(sf, addresses[i]);
+        } else {
+            note_store(sf, addresses[i]);
+        }
+    }
+}
 
-        case OP_TYA:
-            sf->accumulator = sf->y_index;
-            check_negative_and_zero(sf, sf->accumulator);
-            sf->pc++;
-            break;
+#ifdef MEMORY_BUS
+/* MEMORY BUS
+ * handlers find the page of every operand in sf->bus: reads and writes of pages mapped to memory index
+ * sf->memory directly, other pages go through their device's callbacks (a byte on the handler's stack stands in
+ * for the operand while the operation runs)
+ */
 
-        case OP_TXS:
-            sf->esp = sf->x_index;
-            sf->pc++;
-            break;
+// operand of each addressing mode as a pointer the operation can read and modify, scratch holds callback reads
+#define IND_X_OPERAND   (read_operand(sf, IND_X_ADDRESS, &scratch))
+#define ZPG_OPERAND     (read_operand(sf, ZPG_ADDRESS, &scratch))
+#define IMM_OPERAND     ((void)scratch, &IMM_MEM_ACCESS) // fetched with the instruction, so never goes through the bus
+#define ABS_OPERAND     (read_operand(sf, ABS_ADDRESS, &scratch))
+#define IND_Y_OPERAND   (read_operand(sf, IND_Y_ADDRESS, &scratch))
+#define ZPG_X_OPERAND   (read_operand(sf, ZPG_X_ADDRESS, &scratch))
+#define ZPG_Y_OPERAND   (read_operand(sf, ZPG_Y_ADDRESS, &scratch))
+#define ABS_Y_OPERAND   (read_operand(sf, ABS_Y_ADDRESS, &scratch))
+#define ABS_X_OPERAND   (read_operand(sf, ABS_X_ADDRESS, &scratch))
+#define READ_ACCESS(address_expr)   (read_operand(sf, address_expr, &scratch)) // operand at any address
+
+/* read_operand
+ *      DESCRIPTION: returns pointer to the byte at passed address for an operation that only reads it
+ *      INPUTS: sf -- 6502 struct
+ *              address -- address of operand
+ *              scratch -- byte to hold the value when the page is a device
+ *      OUTPUTS: pointer into sf->memory, or scratch holding the byte the device returned
+ *      SIDE EFFECTS: may call read callback of page
+ */
+static inline uint8_t *read_operand(sf_t *sf, uint16_t address, uint8_t *scratch) {
+    const BusPage_t *page = &sf->bus[address >> 8];
+    if (page->read_base != BUS_CALLBACK) {
+        return &sf->memory[page->read_base + (address & 0xFF)];
+    }
+    device_accesses++;
+    *scratch = (*page->read_callback)(page->context, address);
+    return scratch;
+}
 
-        case OP_TAY:
-            sf->y_index = sf->accumulator;
-            check_negative_and_zero(sf, sf->y_index);
-            sf->pc++;
-            break;
+/* ignore_write
+ *      DESCRIPTION: write callback of read-only pages, drops the write
+ */
+static void ignore_write(void *context, uint16_t address, uint8_t value) {
+}
 
-        case OP_TAX:
-            sf->x_index = sf->accumulator;
-            check_negative_and_zero(sf, sf->x_index);
-            sf->pc++;
-            break;
+/* read_open_bus
+ *      DESCRIPTION: read callback of devices mapped without one, reads as 0
+ */
+static uint8_t read_open_bus(void *context, uint16_t address) {
+    return 0;
+}
 
-        case OP_BCS:
-            sf->pc += 2;
-            if (sf->status & (1 << CARRY_INDEX)) {
-                sf->pc += (int8_t)sf->memory[sf->pc - 1];
-            }
-            break;
+/* initialize_bus
+ *      DESCRIPTION: maps every page to the matching page of sf->memory as RAM
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: overwrites all of sf->bus, clears sf->mapped_pages
+ */
+void initialize_bus(sf_t *sf) {
+    bus_map_memory(sf, 0x00, NUM_PAGES - 1, 0x00, 1);
+    sf->mapped_pages = 0; // counted from whatever bus held before
+}
 
-        case OP_CLV:
-            sf->status &= ~(1 << OVERFLOW_INDEX);
-            sf->pc++;
-            break;
+/* plain_page
+ *      DESCRIPTION: returns nonzero if entry maps page as RAM to the same page of sf->memory
+ */
+static int plain_page(const BusPage_t *entry, int page) {
+    return entry->read_base == (page << 8) && entry->write_base == (page << 8);
+}
 
-        case OP_TSX:
-            sf->x_index = sf->esp;
-            check_negative_and_zero(sf, sf->x_index);
-            sf->pc++;
-            break;
+/* bus_map_memory
+ *      DESCRIPTION: maps a range of pages to pages of sf->memory, which the CPU then reads and writes with no call
+ *      INPUTS: sf -- 6502 struct
+ *              first_page -- high byte of first address mapped
+ *              last_page -- high byte of last address mapped
+ *              target_page -- page of sf->memory backing first_page (first_page itself for plain RAM/ROM, another
+ *                             page to mirror it); the range must fit in sf->memory
+ *              writable -- 0 to map the range as ROM, whose writes are dropped
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies sf->bus and sf->mapped_pages
+ */
+void bus_map_memory(sf_t *sf, uint8_t first_page, uint8_t last_page, uint8_t target_page, int writable) {
+    for (int page = first_page; page <= last_page; page++) {
+        BusPage_t *entry = &sf->bus[page];
+        sf->mapped_pages += plain_page(entry, page);
+        entry->read_base = (target_page + page - first_page) << 8;
+        entry->write_base = writable ? entry->read_base : BUS_CALLBACK;
+        entry->read_callback = read_open_bus;
+        entry->write_callback = ignore_write;
+        entry->context = NULL;
+        sf->mapped_pages -= plain_page(entry, page);
+    }
+}
 
-        case OP_INY:
-            sf->y_index++;
-            check_negative_and_zero(sf, sf->y_index);
-            sf->pc++;
-            break;
+/* bus_map_device
+ *      DESCRIPTION: maps a range of pages to a device, whose callbacks then handle every operand access to it
+ *      INPUTS: sf -- 6502 struct
+ *              first_page -- high byte of first address mapped
+ *              last_page -- high byte of last address mapped
+ *              read -- called with full address for every read, NULL for pages that read as 0
+ *              write -- called with full address and value for every write, NULL to drop writes
+ *              context -- passed to both callbacks
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies sf->bus and sf->mapped_pages
+ */
+void bus_map_device(sf_t *sf, uint8_t first_page, uint8_t last_page, BusRead_t read, BusWrite_t write, void *context) {
+    for (int page = first_page; page <= last_page; page++) {
+        BusPage_t *entry = &sf->bus[page];
+        sf->mapped_pages += plain_page(entry, page);
+        entry->read_base = BUS_CALLBACK;
+        entry->write_base = BUS_CALLBACK;
+        entry->read_callback = read != NULL ? read : read_open_bus;
+        entry->write_callback = write != NULL ? write : ignore_write;
+        entry->context = context;
+    }
+}
 
-        case OP_DEX:
-            sf->x_index--;
-            check_negative_and_zero(sf, sf->x_index);
-            sf->pc++;
-            break;
+/* bus_read
+ *      DESCRIPTION: reads a byte the way the CPU reads its operands
+ *      INPUTS: sf -- 6502 struct
+ *              address -- address to read
+ *      OUTPUTS: byte at address
+ *      SIDE EFFECTS: may call read callback of page
+ */
+uint8_t bus_read(sf_t *sf, uint16_t address) {
+    uint8_t scratch;
+    return *read_operand(sf, address, &scratch);
+}
 
-        case OP_BNE:
-            sf->pc += 2;
-            if (!(sf->status & (1 << ZERO_INDEX))) {
-                sf->pc += (int8_t)sf->memory[sf->pc - 1];
-            }
-            break;
+/* bus_write
+ *      DESCRIPTION: writes a byte the way the CPU writes its operands
+ *      INPUTS: sf -- 6502 struct
+ *              address -- address to write
+ *              value -- byte to write
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: may modify memory mapped at address or call write callback of page
+ */
+void bus_write(sf_t *sf, uint16_t address, uint8_t value) {
+    const BusPage_t *page = &sf->bus[address >> 8];
+    if (page->write_base != BUS_CALLBACK) {
+        note_store(sf, page->write_base + (address & 0xFF));
+        sf->memory[page->write_base + (address & 0xFF)] = value;
+    } else {
+        device_accesses++;
+        (*page->write_callback)(page->context, address, value);
+    }
+}
+#endif
 
-        case OP_CLD:
-            sf->status &= ~(1 << DECIMAL_INDEX);
-            sf->pc++;
-            break;
+/* OPCODE HANDLERS
+ * each handler runs one fully decoded opcode: the operation and the addressing mode are fixed when the
+ * handler is generated, so running an instruction is a single indexed call into opcode_jumptable
+ * base cycles are added by the caller from opcode_cycles, handlers only add page crossing/branch penalties
+ */
 
-        case OP_INX:
-            sf->x_index++;
-            check_negative_and_zero(sf, sf->x_index);
-            sf->pc++;
-            break;
+#ifdef MEMORY_BUS
+/* READ_HANDLER
+ *      DESCRIPTION: generates handler that runs operation on memory selected by addressing mode, adds a cycle
+ *                   if indexing crosses a page and the opcode pays for it, then advances pc
+ *      INPUTS: operation -- mnemonic whose _operation function is run (e.g. ORA)
+ *              mode -- addressing mode whose _OPERAND macro selects the operand (e.g. IND_X)
+ *              length -- number of bytes in opcode + operand
+ *              penalty -- 1 if the opcode takes a cycle more when indexing crosses a page, 0 otherwise
+ */
+#define READ_HANDLER(operation, mode, length, penalty)  \
+    static void operation##_##mode(sf_t *sf) {          \
+        uint8_t scratch;                                \
+        if (penalty) {                                  \
+            sf->cycles += mode##_PAGE_PENALTY;          \
+        }                                               \
+        operation##_operation(sf, mode##_OPERAND);      \
+        sf->pc += length;                               \
+    }
 
-        case OP_NOP:
-            sf->pc++;
-            break;
+/* STORE_ACCESS
+ *      DESCRIPTION: runs store operation on the byte the CPU writes at passed address, reporting the write with
+ *                   note_store; devices only see the write
+ *      INPUTS: operation -- mnemonic whose _operation function is run (e.g. STA)
+ *              address_expr -- expression giving the address written
+ */
+#define STORE_ACCESS(operation, address_expr)                               \
+    do {                                                                    \
+        uint16_t address = address_expr;                                    \
+        const BusPage_t *page = &sf->bus[address >> 8];                     \
+        if (page->write_base != BUS_CALLBACK) {                             \
+            uint16_t target = page->write_base + (address & 0xFF);          \
+            note_store(sf, target);                                         \
+            operation##_operation(sf, &sf->memory[target]);                 \
+        } else {                                                            \
+            uint8_t value;                                                  \
+            operation##_operation(sf, &value);                              \
+            device_accesses++;                                              \
+            (*page->write_callback)(page->context, address, value);         \
+        }                                                                   \
+    } while (0)
+
+/* MEMORY_ACCESS
+ *      DESCRIPTION: runs read-modify-write operation on the byte at passed address, reporting the write with
+ *                   note_store
+ *      INPUTS: operation -- mnemonic whose _operation function is run (e.g. ASL)
+ *              address_expr -- expression giving the address read and written
+ */
+#define MEMORY_ACCESS(operation, address_expr)                              \
+    do {                                                                    \
+        uint16_t address = address_expr;                                    \
+        const BusPage_t *page = &sf->bus[address >> 8];                     \
+        if (page->write_base != BUS_CALLBACK && page->write_base == page->read_base) { \
+            uint16_t target = page->write_base + (address & 0xFF);          \
+            note_store(sf, target);                                         \
+            operation##_operation(sf, &sf->memory[target]);                 \
+        } else {                                                            \
+            uint8_t scratch;                                                \
+            uint8_t value = *read_operand(sf, address, &scratch);           \
+            operation##_operation(sf, &value);                              \
+            bus_write(sf, address, value);                                  \
+        }                                                                   \
+    } while (0)
+#else
+/* READ_HANDLER
+ *      DESCRIPTION: generates handler that runs operation on memory selected by addressing mode, adds a cycle
+ *                   if indexing crosses a page and the opcode pays for it, then advances pc
+ *      INPUTS: operation -- mnemonic whose _operation function is run (e.g. ORA)
+ *              mode -- addressing mode whose _MEM_ACCESS macro selects the operand (e.g. IND_X)
+ *              length -- number of bytes in opcode + operand
+ *              penalty -- 1 if the opcode takes a cycle more when indexing crosses a page, 0 otherwise
+ */
+#define READ_HANDLER(operation, mode, length, penalty)  \
+    static void operation##_##mode(sf_t *sf) {          \
+        if (penalty) {                                  \
+            sf->cycles += mode##_PAGE_PENALTY;          \
+        }                                               \
+        operation##_operation(sf, &mode##_MEM_ACCESS);  \
+        sf->pc += length;                               \
+    }
 
-        case OP_BEQ:
-            sf->pc += 2;
-            if (sf->status & (1 << ZERO_INDEX)) {
-                sf->pc += (int8_t)sf->memory[sf->pc - 1];
-            }
-            break;
+// operand at any address as a pointer into sf->memory, scratch is left for the caller's use
+#define READ_ACCESS(address_expr)   ((void)scratch, &sf->memory[address_expr])
 
-        case OP_SED:
-            sf->status |= (1 << DECIMAL_INDEX);
-            sf->pc++;
-            break;
+/* MEMORY_ACCESS
+ *      DESCRIPTION: runs store/read-modify-write operation on the byte at passed address, reporting the write with
+ *                   note_store
+ *      INPUTS: operation -- mnemonic whose _operation function is run (e.g. ASL)
+ *              address_expr -- expression giving the address read and written
+ */
+#define MEMORY_ACCESS(operation, address_expr)          \
+    do {                                                \
+        uint8_t *operand = &sf->memory[address_expr];   \
+        note_store(sf, operand - sf->memory);           \
+        operation##_operation(sf, operand);             \
+    } while (0)
+
+// without the bus, stores and read-modify-writes both work on sf->memory in place
+#define STORE_ACCESS MEMORY_ACCESS
+#endif
+
+/* STORE_HANDLER
+ *      DESCRIPTION: generates handler that runs store operation on memory selected by addressing mode (these take
+ *                   a fixed number of cycles) through STORE_ACCESS, then advances pc
+ *      INPUTS: operation -- mnemonic whose _operation function is run (e.g. STA)
+ *              mode -- addressing mode whose _ADDRESS macro selects the operand (e.g. IND_X)
+ *              length -- number of bytes in opcode + operand
+ */
+#define STORE_HANDLER(operation, mode, length)          \
+    static void operation##_##mode(sf_t *sf) {          \
+        STORE_ACCESS(operation, mode##_ADDRESS);        \
+        sf->pc += length;                               \
+    }
 
-        default:
-            // non special-case operations
-            switch (((sf->memory[sf->pc] & AAA_BITMASK) >> 3) | (sf->memory[sf->pc] & CC_BITMASK)) {
-                case ((OP_ORA & AAA_BITMASK) >> 3) | (OP_ORA & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_IND_X:
-                            ORA_operation(sf, &IND_X_MEM_ACCESS);                 
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG:
-                            ORA_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_IMM:
-                            ORA_operation(sf, &IMM_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            ORA_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_IND_Y:
-                            ORA_operation(sf, &IND_Y_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            ORA_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS_Y:
-                            ORA_operation(sf, &ABS_Y_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ABS_X:
-                            ORA_operation(sf, &ABS_X_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    check_negative_and_zero(sf, sf->accumulator);
-                    break;
+/* MEMORY_HANDLER
+ *      DESCRIPTION: generates handler that runs read-modify-write operation on memory selected by addressing mode
+ *                   (these take a fixed number of cycles) through MEMORY_ACCESS, then advances pc
+ *      INPUTS: operation -- mnemonic whose _operation function is run (e.g. ASL)
+ *              mode -- addressing mode whose _ADDRESS macro selects the operand (e.g. IND_X)
+ *              length -- number of bytes in opcode + operand
+ */
+#define MEMORY_HANDLER(operation, mode, length)         \
+    static void operation##_##mode(sf_t *sf) {          \
+        MEMORY_ACCESS(operation, mode##_ADDRESS);       \
+        sf->pc += length;                               \
+    }
 
-                case ((OP_ASL & AAA_BITMASK) >> 3) | (OP_ASL & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_ZPG:
-                            ASL_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ACCUM:
-                            ASL_operation(sf, &sf->accumulator);
-                            sf->pc += 1;
-                            break;
-                        case ADDR_MODE_ABS:
-                            ASL_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            ASL_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS_X:
-                            ASL_operation(sf, &ABS_X_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* ACCUM_HANDLER
+ *      DESCRIPTION: generates handler that runs operation on the accumulator, then advances pc
+ *      INPUTS: operation -- mnemonic whose _operation function is run (e.g. ASL)
+ */
+#define ACCUM_HANDLER(operation)                        \
+    static void operation##_ACCUM(sf_t *sf) {           \
+        operation##_operation(sf, &sf->accumulator);    \
+        sf->pc += 1;                                    \
+    }
 
-                case ((OP_BIT & AAA_BITMASK) >> 3) | (OP_BIT & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_ZPG:
-                            BIT_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            BIT_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* BRANCH_HANDLER
+ *      DESCRIPTION: generates handler that adds signed offset to pc for next instruction if condition holds;
+ *                   a taken branch costs one cycle, plus one more if it lands on a different page
+ *      INPUTS: mnemonic -- name of branch instruction (e.g. BPL)
+ *              condition -- expression on sf that is nonzero when branch is taken
+ */
+#define BRANCH_HANDLER(mnemonic, condition)                                         \
+    static void mnemonic##_REL(sf_t *sf) {                                          \
+        sf->pc += 2;                                                                \
+        if (condition) {                                                            \
+            uint16_t target = sf->pc + (int8_t)sf->memory[sf->pc - 1]; /* offset is stored in previous byte */ \
+            sf->cycles += 1 + ((target ^ sf->pc) >> 8 != 0);                        \
+            sf->pc = target;                                                        \
+        }                                                                           \
+    }
 
-                case ((OP_AND & AAA_BITMASK) >> 3) | (OP_AND & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_IND_X:
-                            AND_operation(sf, &IND_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG:
-                            AND_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_IMM:
-                            AND_operation(sf, &IMM_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            AND_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_IND_Y:
-                            AND_operation(sf, &IND_Y_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            AND_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS_Y:
-                            AND_operation(sf, &ABS_Y_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ABS_X:
-                            AND_operation(sf, &ABS_X_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* FLAG_HANDLER
+ *      DESCRIPTION: generates handler that applies passed update to status register, then advances pc
+ *      INPUTS: mnemonic -- name of flag instruction (e.g. CLC)
+ *              update -- compound assignment applied to sf->status
+ */
+#define FLAG_HANDLER(mnemonic, update)                  \
+    static void mnemonic##_IMP(sf_t *sf) {              \
+        sf->status update;                              \
+        sf->pc++;                                       \
+    }
 
-                case ((OP_ROL & AAA_BITMASK) >> 3) | (OP_ROL & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_ZPG:
-                            ROL_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ACCUM:
-                            ROL_operation(sf, &sf->accumulator);
-                            sf->pc += 1;
-                            break;
-                        case ADDR_MODE_ABS:
-                            ROL_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            ROL_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS_X:
-                            ROL_operation(sf, &ABS_X_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* REGISTER_HANDLER
+ *      DESCRIPTION: generates handler that applies passed expression to register, sets negative and zero flags, then advances pc
+ *      INPUTS: mnemonic -- name of register instruction (e.g. TAX)
+ *              reg -- register modified by instruction
+ *              expr -- expression modifying reg (e.g. = sf->accumulator, or ++)
+ */
+#define REGISTER_HANDLER(mnemonic, reg, expr)           \
+    static void mnemonic##_IMP(sf_t *sf) {              \
+        sf->reg expr;                                   \
+        check_negative_and_zero(sf, sf->reg);           \
+        sf->pc++;                                       \
+    }
 
-                case ((OP_EOR & AAA_BITMASK) >> 3) | (OP_EOR & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_IND_X:
-                            EOR_operation(sf, &IND_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG:
-                            EOR_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_IMM:
-                            EOR_operation(sf, &IMM_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            EOR_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_IND_Y:
-                            EOR_operation(sf, &IND_Y_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            EOR_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS_Y:
-                            EOR_operation(sf, &ABS_Y_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ABS_X:
-                            EOR_operation(sf, &ABS_X_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* GENERATE_HANDLER
+ *      DESCRIPTION: generates the handler of an OPCODE_TABLE row from the macro its handler column names; CUSTOM
+ *                   rows are written out below
+ */
+#define GENERATE_HANDLER(mnemonic, mode, opcode, length, cycles, penalty, handler) \
+    GENERATE_##handler(mnemonic, mode, length, penalty)
+#define GENERATE_READ(mnemonic, mode, length, penalty)      READ_HANDLER(mnemonic, mode, length, penalty)
+#define GENERATE_STORE(mnemonic, mode, length, penalty)     STORE_HANDLER(mnemonic, mode, length)
+#define GENERATE_MEMORY(mnemonic, mode, length, penalty)    MEMORY_HANDLER(mnemonic, mode, length)
+#define GENERATE_ACCUM(mnemonic, mode, length, penalty)     ACCUM_HANDLER(mnemonic)
+#define GENERATE_CUSTOM(mnemonic, mode, length, penalty)
+
+OPCODE_TABLE(GENERATE_HANDLER)
+
+// the rows of BRANCH_HANDLER, FLAG_HANDLER and REGISTER_HANDLER; the block engine generates its handlers from them too
+#define BRANCH_TABLE(X)                                 \
+    X(BPL, !NEGATIVE_FLAG(sf))                          \
+    X(BMI, NEGATIVE_FLAG(sf))                           \
+    X(BVC, !(sf->status & (1 << OVERFLOW_INDEX)))       \
+    X(BVS, sf->status & (1 << OVERFLOW_INDEX))          \
+    X(BCC, !(sf->status & (1 << CARRY_INDEX)))          \
+    X(BCS, sf->status & (1 << CARRY_INDEX))             \
+    X(BNE, !ZERO_FLAG(sf))                              \
+    X(BEQ, ZERO_FLAG(sf))
+#define FLAG_TABLE(X)                                   \
+    X(CLC, &= ~(1 << CARRY_INDEX))                      \
+    X(SEC, |= (1 << CARRY_INDEX))                       \
+    X(CLI, &= ~(1 << INTERRUPT_INDEX))                  \
+    X(SEI, |= (1 << INTERRUPT_INDEX))                   \
+    X(CLV, &= ~(1 << OVERFLOW_INDEX))                   \
+    X(CLD, &= ~(1 << DECIMAL_INDEX))                    \
+    X(SED, |= (1 << DECIMAL_INDEX))
+#define REGISTER_TABLE(X)                               \
+    X(DEY, y_index, --)                                 \
+    X(TXA, accumulator, = sf->x_index)                  \
+    X(TYA, accumulator, = sf->y_index)                  \
+    X(TAY, y_index, = sf->accumulator)                  \
+    X(TAX, x_index, = sf->accumulator)                  \
+    X(TSX, x_index, = sf->esp)                          \
+    X(INY, y_index, ++)                                 \
+    X(DEX, x_index, --)                                 \
+    X(INX, x_index, ++)
+
+BRANCH_TABLE(BRANCH_HANDLER)
+FLAG_TABLE(FLAG_HANDLER)
+REGISTER_TABLE(REGISTER_HANDLER)
+
+/* BRK_IMP
+ *      DESCRIPTION: forced interrupt; pushes pc for next instruction and status, then jumps to IRQ_ADDRESS
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: pushes to stack, sets interrupt and break flags, modifies pc
+ */
+static void BRK_IMP(sf_t *sf) {
+    note_store(sf, sf->esp);
+    sf->memory[sf->esp--] = (sf->pc+1) & 0x00FF; // push low byte of PC for next instruction
+    note_store(sf, sf->esp);
+    sf->memory[sf->esp--] = (sf->pc+1) >> 8; // push high byte of PC for next instruction
+    sync_negative_and_zero(sf);
+    note_store(sf, sf->esp);
+    sf->memory[sf->esp--] = sf->status; // push flags
+    sf->status |= (1 << INTERRUPT_INDEX);
+    sf->status |= (1 << BREAK_INDEX);
+    sf->pc = IRQ_ADDRESS;
+}
 
-                case ((OP_LSR & AAA_BITMASK) >> 3) | (OP_LSR & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_ZPG:
-                            LSR_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ACCUM:
-                            LSR_operation(sf, &sf->accumulator);
-                            sf->pc += 1;
-                            break;
-                        case ADDR_MODE_ABS:
-                            LSR_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            LSR_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS_X:
-                            LSR_operation(sf, &ABS_X_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* raise_interrupt
+ *      DESCRIPTION: takes a hardware interrupt between instructions: pushes pc and status the way BRK does (with the
+ *                   break flag clear), then jumps to the address held in the vector; takes 7 cycles
+ *      INPUTS: sf -- 6502 struct, not in the middle of a run_* call
+ *              vector -- IRQ_ADDRESS or NMI_ADDRESS; whether the interrupt is masked is up to the caller
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: pushes to stack, sets interrupt flag, modifies pc and cycles
+ */
+void raise_interrupt(sf_t *sf, uint16_t vector) {
+    note_store(sf, sf->esp);
+    sf->memory[sf->esp--] = sf->pc & 0x00FF; // RTI resumes at the instruction that was interrupted
+    note_store(sf, sf->esp);
+    sf->memory[sf->esp--] = sf->pc >> 8;
+    note_store(sf, sf->esp);
+    sf->memory[sf->esp--] = sf->status & ~(1 << BREAK_INDEX);
+    sf->status |= (1 << INTERRUPT_INDEX);
+    sf->pc = sf->memory[vector] | (sf->memory[vector + 1] << 8);
+    sf->cycles += 7;
+}
 
-                case ((OP_ADC & AAA_BITMASK) >> 3) | (OP_ADC & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_IND_X:
-                            ADC_operation(sf, &IND_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG:
-                            ADC_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_IMM:
-                            ADC_operation(sf, &IMM_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            ADC_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_IND_Y:
-                            ADC_operation(sf, &IND_Y_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            ADC_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS_Y:
-                            ADC_operation(sf, &ABS_Y_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ABS_X:
-                            ADC_operation(sf, &ABS_X_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* reset_cpu
+ *      DESCRIPTION: takes the reset sequence: the stack pointer moves down three bytes with nothing written,
+ *                   interrupts are disabled and pc is loaded from the reset vector; takes 7 cycles
+ *      INPUTS: sf -- 6502 struct, not in the middle of a run_* call
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies esp, status, pc and cycles
+ */
+void reset_cpu(sf_t *sf) {
+    sf->esp -= 3;
+    sf->status |= (1 << INTERRUPT_INDEX);
+    sf->pc = sf->memory[RESET_ADDRESS] | (sf->memory[RESET_ADDRESS + 1] << 8);
+    sf->cycles += 7;
+}
 
-                case ((OP_ROR & AAA_BITMASK) >> 3) | (OP_ROR & CC_BITMASK):
-                    uint8_t temp_ROR;
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_ZPG:
-                            ROR_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ACCUM:
-                            ROR_operation(sf, &sf->accumulator);
-                            sf->pc += 1;
-                            break;
-                        case ADDR_MODE_ABS:
-                            ROR_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            ROR_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS_X:
-                            ROR_operation(sf, &ABS_X_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* PHP_IMP
+ *      DESCRIPTION: pushes status to stack
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: pushes to stack, advances pc
+ */
+static void PHP_IMP(sf_t *sf) {
+    sync_negative_and_zero(sf);
+    note_store(sf, sf->esp);
+    sf->memory[sf->esp--] = sf->status;
+    sf->pc++;
+}
 
-                case ((OP_STY & AAA_BITMASK) >> 3)|(OP_STY & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_ZPG:
-                            STY_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            STY_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            STY_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* JSR_ABS
+ *      DESCRIPTION: pushes return address to stack and jumps to subroutine
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: pushes to stack, modifies pc
+ */
+static void JSR_ABS(sf_t *sf) {
+    // push return address to stack
+    note_store(sf, sf->esp);
+    sf->memory[sf->esp--] = (sf->pc + 3) & 0x00FF;
+    note_store(sf, sf->esp);
+    sf->memory[sf->esp--] = (sf->pc + 3) >> 8;
+    // set pc to address provided to jump instruction
+    sf->pc = (sf->memory[sf->pc+2] << 8)|sf->memory[sf->pc+1];
+}
 
-                case ((OP_STA & AAA_BITMASK) >> 3)|(OP_STA & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_IND_X:
-                            STA_operation(sf, &IND_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG:
-                            STA_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2; 
-                            break;
-                        case ADDR_MODE_ABS:
-                            STA_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_IND_Y:
-                            STA_operation(sf, &IND_Y_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            STA_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2; 
-                            break;
-                        case ADDR_MODE_ABS_Y:
-                            STA_operation(sf, &ABS_Y_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ABS_X:
-                            STA_operation(sf, &ABS_X_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* PLP_IMP
+ *      DESCRIPTION: pulls status from stack
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: pops from stack, modifies status, advances pc
+ */
+static void PLP_IMP(sf_t *sf) {
+    DISCARD_NEGATIVE_AND_ZERO(sf);
+    sf->status = sf->memory[++sf->esp];
+    sf->pc++;
+}
 
-                case ((OP_STX & AAA_BITMASK) >> 3)|(OP_STX & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_ZPG:
-                            STX_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            STX_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ZPG_Y:
-                            STX_operation(sf, &ZPG_Y_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* RTI_IMP
+ *      DESCRIPTION: returns from interrupt, pulling status and pc from stack
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: pops from stack, modifies status and pc
+ */
+static void RTI_IMP(sf_t *sf) {
+    DISCARD_NEGATIVE_AND_ZERO(sf);
+    sf->status = sf->memory[++sf->esp];
+    sf->pc = sf->memory[++sf->esp] << 8;
+    sf->pc |= sf->memory[++sf->esp];
+    // don't increment PC after this because in BRK we push PC for next instruction
+}
 
-                case ((OP_LDY & AAA_BITMASK) >> 3)|(OP_LDY & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_ZPG:
-                            LDY_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case 0x00: // special case, this is immediate
-                            LDY_operation(sf, &IMM_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            LDY_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            LDY_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS_X:
-                            LDY_operation(sf, &ABS_X_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* PHA_IMP
+ *      DESCRIPTION: pushes accumulator to stack
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: pushes to stack, advances pc
+ */
+static void PHA_IMP(sf_t *sf) {
+    note_store(sf, sf->esp);
+    sf->memory[sf->esp--] = sf->accumulator;
+    sf->pc++;
+}
 
-                case ((OP_LDA & AAA_BITMASK) >> 3)|(OP_LDA & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_IND_X:
-                            LDA_operation(sf, &IND_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG:
-                            LDA_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_IMM:
-                            LDA_operation(sf, &IMM_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            LDA_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_IND_Y:
-                            LDA_operation(sf, &IND_Y_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            LDA_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS_Y:
-                            LDA_operation(sf, &ABS_Y_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ABS_X:
-                            LDA_operation(sf, &ABS_X_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* JMP_ABS
+ *      DESCRIPTION: jumps to absolute address
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies pc
+ */
+static void JMP_ABS(sf_t *sf) {
+    sf->pc = (sf->memory[sf->pc + 2] << 8)|sf->memory[sf->pc + 1];
+}
 
-                case ((OP_LDX & AAA_BITMASK) >> 3)|(OP_LDX & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_ZPG:
-                            LDX_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case 0x00: // special case, this is immediate
-                            LDX_operation(sf, &IMM_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            LDX_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ZPG_Y:
-                            LDX_operation(sf, &ZPG_Y_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS_X: // special case, we use y_index for indexing here
-                            LDX_operation(sf, &ABS_Y_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* RTS_IMP
+ *      DESCRIPTION: returns from subroutine, pulling pc from stack
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: pops from stack, modifies pc
+ */
+static void RTS_IMP(sf_t *sf) {
+    sf->pc = sf->memory[++sf->esp] << 8;
+    sf->pc |= sf->memory[++sf->esp];
+    // don't increment PC after this because in JSR we push PC for next instruction
+}
 
-                case ((OP_CPY & AAA_BITMASK) >> 3)|(OP_CPY & CC_BITMASK):
-                    uint8_t temp_CPY;
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case 0x00: // special case: immediate
-                            CPY_operation(sf, &IMM_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG:
-                            CPY_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            CPY_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* PLA_IMP
+ *      DESCRIPTION: pulls accumulator from stack
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: pops from stack, modifies accumulator, advances pc
+ */
+static void PLA_IMP(sf_t *sf) {
+    sf->accumulator = sf->memory[++sf->esp];
+    sf->pc++;
+}
 
-                case ((OP_CMP & AAA_BITMASK) >> 3)|(OP_CMP & CC_BITMASK):
-                    uint8_t temp_CMP;
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_IND_X:
-                            CMP_operation(sf, &IND_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG:
-                            CMP_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_IMM:
-                            CMP_operation(sf, &IMM_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            CMP_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_IND_Y:
-                            CMP_operation(sf, &IND_Y_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            CMP_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS_Y:
-                            CMP_operation(sf, &ABS_Y_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ABS_X:
-                            CMP_operation(sf, &ABS_X_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* JMP_IND
+ *      DESCRIPTION: jumps to address stored at absolute address
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies pc
+ */
+static void JMP_IND(sf_t *sf) {
+    sf->pc = ((sf->memory[((sf->memory[sf->pc + 2] << 8)|sf->memory[sf->pc + 1]) + 1]) << 8) |
+                (sf->memory[(sf->memory[sf->pc + 2] << 8)|sf->memory[sf->pc + 1]]);
+}
 
-                case ((OP_DEC & AAA_BITMASK) >> 3)|(OP_DEC & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_ZPG:
-                            DEC_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            DEC_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            DEC_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS_X:
-                            DEC_operation(sf, &ABS_X_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* TXS_IMP
+ *      DESCRIPTION: transfers x_index to stack pointer
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies stack pointer, advances pc
+ */
+static void TXS_IMP(sf_t *sf) {
+    sf->esp = sf->x_index;
+    sf->pc++;
+}
 
-                case ((OP_CPX & AAA_BITMASK) >> 3)|(OP_CPX & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case 0x00: // special case: immediate
-                            CPX_operation(sf, &IMM_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG:
-                            CPX_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            CPX_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* NOP_IMP
+ *      DESCRIPTION: no operation
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: advances pc
+ */
+static void NOP_IMP(sf_t *sf) {
+    sf->pc++;
+}
 
-                case ((OP_SBC & AAA_BITMASK) >> 3)|(OP_SBC & CC_BITMASK):
-                    uint8_t temp_SBC;
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_IND_X:
-                            SBC_operation(sf, &IND_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG:
-                            SBC_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_IMM:
-                            SBC_operation(sf, &IMM_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            SBC_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_IND_Y:
-                            SBC_operation(sf, &IND_Y_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            SBC_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS_Y:
-                            SBC_operation(sf, &ABS_Y_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ABS_X:
-                            SBC_operation(sf, &ABS_X_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
+/* invalid_opcode
+ *      DESCRIPTION: placeholder for opcodes with no instruction; leaves 6502 untouched
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: none
+ */
+static void invalid_opcode(sf_t *sf) {
+}
+
+/* OPCODE TABLES
+ * generated from OPCODE_TABLE: opcodes with no row keep the invalid_opcode handler, 2 cycles and length 1
+ */
+
+// each generates the designated initializer of an OPCODE_TABLE row in one of the tables below
+#define HANDLER_ENTRY(mnemonic, mode, opcode, length, cycles, penalty, handler)    [opcode] = mnemonic##_##mode,
+#define CYCLES_ENTRY(mnemonic, mode, opcode, length, cycles, penalty, handler)     [opcode] = cycles,
+#define LENGTH_ENTRY(mnemonic, mode, opcode, length, cycles, penalty, handler)     [opcode] = length,
+#define MNEMONIC_ENTRY(mnemonic, mode, opcode, length, cycles, penalty, handler)   [opcode] = #mnemonic,
+#define MODE_ENTRY(mnemonic, mode, opcode, length, cycles, penalty, handler)       [opcode] = OPCODE_MODE_##mode,
+
+// handler for every opcode, indexed by opcode byte
+static void (* const opcode_jumptable[256])(sf_t *sf) = {
+    [0 ... 255] = invalid_opcode,
+    OPCODE_TABLE(HANDLER_ENTRY)
+};
+
+// base clock cycles for every opcode, indexed by opcode byte (opcodes with no instruction count as 2)
+const uint8_t opcode_cycles[256] = {
+    [0 ... 255] = 2,
+    OPCODE_TABLE(CYCLES_ENTRY)
+};
+
+// length in bytes of every opcode, indexed by opcode byte (opcodes with no instruction count as 1, but end their block)
+const uint8_t opcode_length[256] = {
+    [0 ... 255] = 1,
+    OPCODE_TABLE(LENGTH_ENTRY)
+};
+
+// mnemonic of every opcode, indexed by opcode byte
+const char * const opcode_mnemonic[256] = {
+    OPCODE_TABLE(MNEMONIC_ENTRY)
+};
+
+// addressing mode of every opcode, indexed by opcode byte
+const uint8_t opcode_mode[256] = {
+    [0 ... 255] = OPCODE_MODE_NONE,
+    OPCODE_TABLE(MODE_ENTRY)
+};
+
+// nonzero if opcode may transfer control somewhere other than the next instruction; all 8 branches share the low
+// 5 bits of BPL
+#define ENDS_BLOCK(opcode)  (((opcode) & 0x1F) == OP_BPL || (opcode) == OP_BRK || (opcode) == OP_JSR || \
+                             (opcode) == OP_RTI || (opcode) == OP_RTS || (opcode) == OP_JMP || (opcode) == OP_JI)
+#define ENDS_BLOCK_ENTRY(mnemonic, mode, opcode, length, cycles, penalty, handler) [opcode] = ENDS_BLOCK(opcode),
+
+// nonzero for every opcode that is the last instruction of a basic block, indexed by opcode byte (opcodes with no
+// instruction end their block, as pc doesn't advance past them)
+static const uint8_t opcode_ends_block[256] = {
+    [0 ... 255] = 1,
+    OPCODE_TABLE(ENDS_BLOCK_ENTRY)
+};
+
+/* ends_block
+ *      DESCRIPTION: checks whether opcode may transfer control somewhere other than the next instruction
+ *      INPUTS: opcode -- opcode to check
+ *      OUTPUTS: nonzero if opcode is the last instruction of a basic block
+ *      SIDE EFFECTS: none
+ */
+static int ends_block(uint8_t opcode) {
+    return opcode_ends_block[opcode];
+}
+
+// whether each kind of generated handler writes its operand; of the CUSTOM ones only BRK, PHP, PHA and JSR write
+// (they push)
+#define STORES_READ     0
+#define STORES_STORE    1
+#define STORES_MEMORY   1
+#define STORES_ACCUM    0
+#define STORES_CUSTOM   0
+#define STORES_ENTRY(mnemonic, mode, opcode, length, cycles, penalty, handler)     [opcode] = STORES_##handler,
+
+// nonzero for every opcode whose generated handler writes memory, indexed by opcode byte
+static const uint8_t opcode_stores[256] = {
+    OPCODE_TABLE(STORES_ENTRY)
+};
+
+/* stores_memory
+ *      DESCRIPTION: checks whether opcode may write memory (stores, read-modify-writes and pushes)
+ *      INPUTS: opcode -- opcode to check
+ *      OUTPUTS: nonzero if instruction may write memory
+ *      SIDE EFFECTS: none
+ */
+static int stores_memory(uint8_t opcode) {
+    return opcode_stores[opcode] || opcode == OP_BRK || opcode == OP_PHP || opcode == OP_PHA || opcode == OP_JSR;
+}
+
+/* process_line
+ *      DESCRIPTION: runs line of bytecode beginning at location of PC
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: may modify status, accumulator, x_index, y_index, and pc depending on instruction
+ */
+void process_line (sf_t *sf) {
+    uint8_t opcode = sf->memory[sf->pc];
+    sf->cycles += opcode_cycles[opcode];
+    (*opcode_jumptable[opcode])(sf);
+    sync_negative_and_zero(sf);
+}
+
+/* run_loop
+ *      DESCRIPTION: runs instructions back to back until a budget is exhausted, BRK is executed, or (if check_pc) pc reaches stop_pc
+ *      INPUTS: sf -- 6502 struct
+ *              stop_pc -- address to stop at once pc reaches it after an instruction
+ *              max_instr -- maximum number of instructions to run
+ *              check_pc -- compile-time constant, 0 to skip the stop_pc comparison entirely
+ *              check_cycles -- compile-time constant, 0 to skip the sf->next_event comparison entirely; it is reread
+ *                              after every instruction, as a device may bring it forward during the run
+ *              local_pc -- compile-time constant, nonzero to fetch opcodes through a copy of pc kept in a local,
+ *                          advanced by the opcode's length and reloaded from sf->pc only after opcodes that end a
+ *                          block (handlers still keep sf->pc up to date); only local_pc_run_instructions sets it
+ *      OUTPUTS: reason the loop returned
+ *      SIDE EFFECTS: same as running process_line up to max_instr times
+ */
+static inline RunExit_t run_loop(sf_t *sf, uint16_t stop_pc, uint64_t max_instr, const int check_pc,
+                                 const int check_cycles, const int local_pc) {
+    RunExit_t exit_reason = RUN_BUDGET;
+
+    // handlers work on the register file in sf, so keep everything else the loop touches in locals; pc stays in sf
+    // too, as predicting it in a local (local_pc, the bench's local-pc engine) runs no faster
+    void (* const *jumptable)(sf_t *sf) = opcode_jumptable;
+    const uint8_t *cycles = opcode_cycles;
+    const uint8_t *memory = sf->memory;
+    uint16_t pc = sf->pc;
+
+    for (uint64_t remaining = max_instr; remaining; remaining--) {
+        uint8_t opcode = memory[local_pc ? pc : sf->pc];
+        sf->cycles += cycles[opcode];
+        (*jumptable[opcode])(sf);
+        if (local_pc) {
+            pc = opcode_ends_block[opcode] ? sf->pc : (uint16_t)(pc + opcode_length[opcode]);
+        }
+        if (opcode == OP_BRK) {
+            exit_reason = RUN_BRK;
+            break;
+        }
+        if (check_pc && sf->pc == stop_pc) {
+            exit_reason = RUN_STOP_PC;
+            break;
+        }
+        if (check_cycles && sf->cycles >= sf->next_event) {
+            break;
+        }
+    }
+
+    sync_negative_and_zero(sf);
+    return exit_reason;
+}
+
+/* BREAKPOINTS
+ * while a set armed with use_breakpoints has anything in it, runs on that thread take a loop of their own, so
+ * run_loop stays free of checks; before each instruction its operand address is worked out from the addressing
+ * mode of its opcode and looked up in the read and write bitmaps, after it the new pc is looked up in the execute
+ * bitmap, so a run stops right after the access to a watched address or right before the instruction a breakpoint
+ * is on, and running again continues from there
+ * pushes and pulls of the stack and the pointers indirect modes fetch from the zero page aren't watched
+ */
+
+static _Thread_local Breakpoints_t *active_breakpoints = NULL; // set by use_breakpoints on this thread, if any
+
+// accesses each kind of generated handler makes to its operand; CUSTOM ones are pushes, pulls and jumps
+#define WATCH_READ      BREAK_READ
+#define WATCH_STORE     BREAK_WRITE
+#define WATCH_MEMORY    (BREAK_READ | BREAK_WRITE)
+#define WATCH_ACCUM     0
+#define WATCH_CUSTOM    0
+#define WATCH_ENTRY(mnemonic, mode, opcode, length, cycles, penalty, handler)      [opcode] = WATCH_##handler,
+
+// BREAK_READ and BREAK_WRITE accesses every opcode makes to its operand, indexed by opcode byte
+static const uint8_t watch_kinds[256] = {
+    OPCODE_TABLE(WATCH_ENTRY)
+};
+
+/* watched_access
+ *      DESCRIPTION: returns the BREAK_READ and BREAK_WRITE watchpoints the instruction at pc is about to hit, sets
+ *                   address to its operand address if it has one
+ */
+static inline uint8_t watched_access(const Breakpoints_t *breakpoints, const sf_t *sf, uint16_t *address) {
+    uint8_t opcode = sf->memory[sf->pc];
+    uint8_t kinds = watch_kinds[opcode];
+    if (kinds == 0) {
+        return 0;
+    }
+    switch (opcode_mode[opcode]) {
+        case OPCODE_MODE_IND_X: *address = IND_X_ADDRESS; break;
+        case OPCODE_MODE_ZPG: *address = ZPG_ADDRESS; break;
+        case OPCODE_MODE_ABS: *address = ABS_ADDRESS; break;
+        case OPCODE_MODE_IND_Y: *address = IND_Y_ADDRESS; break;
+        case OPCODE_MODE_ZPG_X: *address = ZPG_X_ADDRESS; break;
+        case OPCODE_MODE_ZPG_Y: *address = ZPG_Y_ADDRESS; break;
+        case OPCODE_MODE_ABS_Y: *address = ABS_Y_ADDRESS; break;
+        case OPCODE_MODE_ABS_X: *address = ABS_X_ADDRESS; break;
+        default: return 0; // immediate operands aren't in memory
+    }
+    return ((kinds & BREAK_READ) && BREAKPOINT_SET(breakpoints->read, *address) ? BREAK_READ : 0) |
+           ((kinds & BREAK_WRITE) && BREAKPOINT_SET(breakpoints->write, *address) ? BREAK_WRITE : 0);
+}
+
+/* armed_breakpoints
+ *      DESCRIPTION: returns the breakpoints armed on this thread if any are set, NULL otherwise
+ */
+static inline Breakpoints_t *armed_breakpoints(void) {
+    Breakpoints_t *breakpoints = active_breakpoints;
+    return breakpoints != NULL && (breakpoints->num_execute || breakpoints->num_watch) ? breakpoints : NULL;
+}
+
+/* checked_step
+ *      DESCRIPTION: runs one instruction, then returns RUN_BRK if it was BRK, RUN_BREAKPOINT (filling in the hit
+ *                   fields of breakpoints) if it hit a watchpoint or landed on a breakpoint, RUN_BUDGET otherwise
+ */
+static inline RunExit_t checked_step(sf_t *sf, Breakpoints_t *breakpoints) {
+    uint16_t pc = sf->pc;
+    uint16_t address = 0;
+    uint8_t opcode = sf->memory[pc];
+    uint8_t watched = breakpoints->num_watch ? watched_access(breakpoints, sf, &address) : 0;
+    sf->cycles += opcode_cycles[opcode];
+    (*opcode_jumptable[opcode])(sf);
+    if (opcode == OP_BRK) {
+        return RUN_BRK;
+    }
+    if (watched) {
+        breakpoints->hit_kind = watched;
+        breakpoints->hit_address = address;
+        breakpoints->hit_pc = pc;
+        return RUN_BREAKPOINT;
+    }
+    if (BREAKPOINT_SET(breakpoints->execute, sf->pc)) {
+        breakpoints->hit_kind = BREAK_EXECUTE;
+        breakpoints->hit_address = sf->pc;
+        breakpoints->hit_pc = sf->pc;
+        return RUN_BREAKPOINT;
+    }
+    return RUN_BUDGET;
+}
+
+/* breakpoint_loop
+ *      DESCRIPTION: same as run_loop, but every instruction is checked against breakpoints
+ *      INPUTS: sf -- 6502 struct
+ *              breakpoints -- breakpoints to check, at least one set
+ *              stop_pc, max_instr, check_pc, check_cycles -- same as run_loop
+ *      OUTPUTS: reason the loop returned
+ *      SIDE EFFECTS: same as running process_line up to max_instr times, may fill in hit fields of breakpoints
+ */
+static RunExit_t breakpoint_loop(sf_t *sf, Breakpoints_t *breakpoints, uint16_t stop_pc, uint64_t max_instr,
+                                 const int check_pc, const int check_cycles) {
+    RunExit_t exit_reason = RUN_BUDGET;
+    for (uint64_t remaining = max_instr; remaining; remaining--) {
+        exit_reason = checked_step(sf, breakpoints);
+        if (exit_reason != RUN_BUDGET) {
+            break;
+        }
+        if (check_pc && sf->pc == stop_pc) {
+            exit_reason = RUN_STOP_PC;
+            break;
+        }
+        if (check_cycles && sf->cycles >= sf->next_event) {
+            break;
+        }
+    }
+    sync_negative_and_zero(sf);
+    return exit_reason;
+}
+
+/* use_breakpoints
+ *      DESCRIPTION: makes run_instructions, run_until, run_cycles and step_instruction on the calling thread stop at
+ *                   the breakpoints and watchpoints in passed set, until called again; threaded and JIT runs don't
+ *                   check them
+ *      INPUTS: breakpoints -- breakpoints to check (changes to it apply from the next run), NULL to stop checking
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: changes checking of the calling thread
+ */
+void use_breakpoints(Breakpoints_t *breakpoints) {
+    active_breakpoints = breakpoints;
+}
+
+/* step_instruction
+ *      DESCRIPTION: same as process_line, but reports BRK and the breakpoints armed on this thread
+ *      INPUTS: sf -- 6502 struct
+ *      OUTPUTS: RUN_BRK if the instruction was BRK, RUN_BREAKPOINT if it hit a breakpoint, RUN_BUDGET otherwise
+ *      SIDE EFFECTS: same as process_line, may fill in hit fields of the armed breakpoints
+ */
+RunExit_t step_instruction(sf_t *sf) {
+    Breakpoints_t *breakpoints = armed_breakpoints();
+    if (breakpoints == NULL) {
+        uint8_t opcode = sf->memory[sf->pc];
+        process_line(sf);
+        return opcode == OP_BRK ? RUN_BRK : RUN_BUDGET;
+    }
+    RunExit_t exit_reason = checked_step(sf, breakpoints);
+    sync_negative_and_zero(sf);
+    return exit_reason;
+}
+
+/* run_instructions
+ *      DESCRIPTION: runs up to num_instr instructions, returning early if BRK is executed
+ *      INPUTS: sf -- 6502 struct
+ *              num_instr -- maximum number of instructions to run
+ *      OUTPUTS: RUN_BRK if BRK was executed, RUN_BREAKPOINT if an armed breakpoint was hit, RUN_BUDGET otherwise
+ *      SIDE EFFECTS: same as running process_line up to num_instr times
+ */
+RunExit_t run_instructions(sf_t *sf, uint64_t num_instr) {
+    Breakpoints_t *breakpoints = armed_breakpoints();
+    if (breakpoints != NULL) {
+        return breakpoint_loop(sf, breakpoints, 0, num_instr, 0, 0);
+    }
+    return run_loop(sf, 0, num_instr, 0, 0, 0);
+}
+
+/* local_pc_run_instructions
+ *      DESCRIPTION: same as run_instructions, but fetches opcodes through a copy of pc kept in a local (see run_loop)
+ *                   and doesn't check breakpoints; the bench runs it next to run_instructions to measure what
+ *                   keeping pc in sf costs
+ *      INPUTS: sf -- 6502 struct
+ *              num_instr -- maximum number of instructions to run
+ *      OUTPUTS: RUN_BRK if BRK was executed, RUN_BUDGET otherwise
+ *      SIDE EFFECTS: same as running process_line up to num_instr times
+ */
+RunExit_t local_pc_run_instructions(sf_t *sf, uint64_t num_instr) {
+    return run_loop(sf, 0, num_instr, 0, 0, 1);
+}
+
+/* run_until
+ *      DESCRIPTION: runs instructions until pc reaches stop_pc, BRK is executed, or max_instr instructions have run;
+ *                   at least one instruction is run, so calling again from stop_pc continues past it
+ *      INPUTS: sf -- 6502 struct
+ *              stop_pc -- address at which to stop
+ *              max_instr -- maximum number of instructions to run
+ *      OUTPUTS: RUN_STOP_PC, RUN_BRK, RUN_BREAKPOINT or RUN_BUDGET depending on which condition ended the run
+ *      SIDE EFFECTS: same as running process_line up to max_instr times
+ */
+RunExit_t run_until(sf_t *sf, uint16_t stop_pc, uint64_t max_instr) {
+    Breakpoints_t *breakpoints = armed_breakpoints();
+    if (breakpoints != NULL) {
+        return breakpoint_loop(sf, breakpoints, stop_pc, max_instr, 1, 0);
+    }
+    return run_loop(sf, stop_pc, max_instr, 1, 0, 0);
+}
+
+/* run_cycles
+ *      DESCRIPTION: runs instructions until at least max_cycles clock cycles have elapsed or BRK is executed;
+ *                   the last instruction may overshoot the budget by its own length in cycles
+ *      INPUTS: sf -- 6502 struct
+ *              max_cycles -- number of clock cycles to run for
+ *      OUTPUTS: RUN_BRK if BRK was executed, RUN_BREAKPOINT if an armed breakpoint was hit, RUN_BUDGET otherwise
+ *      SIDE EFFECTS: same as running process_line until cycle budget is spent, sets sf->next_event to the end of
+ *                    the budget (a device lowering it during the run ends the run early)
+ */
+RunExit_t run_cycles(sf_t *sf, uint64_t max_cycles) {
+    if (max_cycles == 0) {
+        return RUN_BUDGET;
+    }
+    sf->next_event = sf->cycles + max_cycles;
+    Breakpoints_t *breakpoints = armed_breakpoints();
+    if (breakpoints != NULL) {
+        return breakpoint_loop(sf, breakpoints, 0, UINT64_MAX, 0, 1);
+    }
+    return run_loop(sf, 0, UINT64_MAX, 0, 1, 0);
+}
 
-                case ((OP_INC & AAA_BITMASK) >> 3)|(OP_INC & CC_BITMASK):
-                    switch((sf->memory[sf->pc] & BBB_BITMASK) >> 2) {
-                        case ADDR_MODE_ZPG:
-                            INC_operation(sf, &ZPG_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS:
-                            INC_operation(sf, &ABS_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        case ADDR_MODE_ZPG_X:
-                            INC_operation(sf, &ZPG_X_MEM_ACCESS);
-                            sf->pc += 2;
-                            break;
-                        case ADDR_MODE_ABS_X:
-                            INC_operation(sf, &ABS_X_MEM_ACCESS);
-                            sf->pc += 3;
-                            break;
-                        default:
-                            break;
-                    }
+/* record_loop
+ *      DESCRIPTION: runs instructions back to back like run_loop, filling in a span at the start of every basic block
+ *      INPUTS: sf, max_instr, spans, max_spans, num_spans, stores -- same as record_run_instructions
+ *              breakpoints -- armed breakpoints, only used if checked
+ *              checked -- compile-time constant, nonzero to check every instruction against breakpoints
+ *      OUTPUTS: reason the loop returned
+ *      SIDE EFFECTS: same as record_run_instructions
+ */
+static inline RunExit_t record_loop(sf_t *sf, uint64_t max_instr, RunSpan_t *spans, uint32_t max_spans,
+                                    uint32_t *num_spans, StoreLog_t *stores, Breakpoints_t *breakpoints,
+                                    const int checked) {
+    RunExit_t exit_reason = RUN_BUDGET;
+    StoreLog_t *outer_log = active_store_log;
+    active_store_log = stores;
+    uint64_t remaining = max_instr;
+    uint32_t count = 0;
+
+    while (remaining && count < max_spans && exit_reason == RUN_BUDGET &&
+           stores->count <= MAX_LOGGED_STORES - SPAN_MAX_INSTRUCTIONS * MAX_INSTRUCTION_STORES) {
+        RunSpan_t *span = &spans[count++];
+        sync_negative_and_zero(sf);
+        span->pc = sf->pc;
+        span->esp = sf->esp;
+        span->accumulator = sf->accumulator;
+        span->x_index = sf->x_index;
+        span->y_index = sf->y_index;
+        span->status = sf->status;
+        span->cycles = sf->cycles;
+        uint32_t first_store = stores->count;
+
+        uint32_t limit = remaining < SPAN_MAX_INSTRUCTIONS ? (uint32_t)remaining : SPAN_MAX_INSTRUCTIONS;
+        uint32_t ran = 0;
+        uint8_t opcode;
+        do {
+            opcode = sf->memory[sf->pc];
+            ran++;
+            if (checked) {
+                exit_reason = checked_step(sf, breakpoints);
+                if (exit_reason != RUN_BUDGET) {
                     break;
+                }
+            } else {
+                sf->cycles += opcode_cycles[opcode];
+                (*opcode_jumptable[opcode])(sf);
             }
+        } while (ran < limit && !opcode_ends_block[opcode]);
+        if (!checked && opcode == OP_BRK) {
+            exit_reason = RUN_BRK; // BRK ends its block, so it can only be the last instruction
+        }
+        span->num_instr = ran;
+        span->num_stores = stores->count - first_store;
+        remaining -= ran;
+    }
+
+    active_store_log = outer_log;
+    sync_negative_and_zero(sf);
+    *num_spans = count;
+    return exit_reason;
+}
+
+/* record_run_instructions
+ *      DESCRIPTION: same as run_instructions, but records the run as it goes: every basic block (cut short after
+ *                   SPAN_MAX_INSTRUCTIONS) gets a span holding the registers before it, and the stores made in it
+ *                   are appended to a log through log_stores; stops early once every span has been filled in or
+ *                   the log might not have room for the stores of another one
+ *      INPUTS: sf -- 6502 struct
+ *              num_instr -- maximum number of instructions to run
+ *              spans -- spans to fill in, in the order they ran
+ *              max_spans -- number of spans
+ *              num_spans -- set to the number of spans filled in, whose num_instr add up to the instructions run
+ *              stores -- log to append the stores of the spans to, one span's after the other
+ *      OUTPUTS: RUN_BRK if BRK was executed, RUN_BREAKPOINT if an armed breakpoint was hit, RUN_BUDGET otherwise
+ *      SIDE EFFECTS: same as running process_line up to num_instr times, stores go to passed log instead of any
+ *                    log set with log_stores
+ */
+RunExit_t record_run_instructions(sf_t *sf, uint64_t num_instr, RunSpan_t *spans, uint32_t max_spans,
+                                  uint32_t *num_spans, StoreLog_t *stores) {
+    Breakpoints_t *breakpoints = armed_breakpoints();
+    if (breakpoints != NULL) {
+        return record_loop(sf, num_instr, spans, max_spans, num_spans, stores, breakpoints, 1);
+    }
+    return record_loop(sf, num_instr, spans, max_spans, num_spans, stores, NULL, 0);
+}
+
+/* skip_idle_loop
+ *      DESCRIPTION: runs sf until pc comes back round to a point (where the run started, or the first backward jump
+ *                   if that lands elsewhere, or after a store that changed memory or a device access the next
+ *                   backward jump) with the same registers and no byte
+ *                   of memory changed (stores may write back the byte already there) and no device touched on the
+ *                   way, at most IDLE_MAX_INSTRUCTIONS instructions and stopping short of BRK; sf would then
+ *                   repeat that pass until interrupted, so sf->cycles is advanced by as many more passes as end at
+ *                   or before cycle_limit, leaving sf as running up to there would; nothing is run while
+ *                   breakpoints are armed, as the probe and the skipped passes would run past them
+ *      INPUTS: sf -- 6502 struct
+ *              cycle_limit -- value of sf->cycles the skipped passes may not pass, more than IDLE_MAX_CYCLES ahead
+ *      OUTPUTS: number of cycles skipped, 0 if sf isn't idling or breakpoints are armed
+ *      SIDE EFFECTS: same as running process_line up to IDLE_MAX_INSTRUCTIONS times, may advance sf->cycles
+ */
+uint64_t skip_idle_loop(sf_t *sf, uint64_t cycle_limit) {
+    if (armed_breakpoints() != NULL) {
+        return 0;
+    }
+    uint8_t accumulator = sf->accumulator, x_index = sf->x_index, y_index = sf->y_index, status = sf->status;
+    uint16_t esp = sf->esp, pc = sf->pc;
+    uint64_t cycles = sf->cycles;
+    int anchored = 1; // registers above hold the point the pass started at
+    int at_start = 1; // that point is where the run started, which may not be in the loop
+    uint32_t accesses = device_accesses;
+    // stores are logged to tell the ones that change memory from the ones writing back what was there, and passed
+    // on to any log already set
+    StoreLog_t *outer_log = active_store_log;
+    StoreLog_t log;
+
+    int idle = 0;
+    for (int i = 0; i < IDLE_MAX_INSTRUCTIONS && sf->memory[sf->pc] != OP_BRK; i++) {
+        uint16_t last_pc = sf->pc;
+        log.count = 0;
+        active_store_log = &log;
+        process_line(sf);
+        active_store_log = outer_log;
+        int changed = 0;
+        for (uint32_t j = 0; j < log.count; j++) {
+            changed |= sf->memory[log.addresses[j]] != log.old_values[j];
+            if (outer_log != NULL && outer_log->count < MAX_LOGGED_STORES) {
+                outer_log->addresses[outer_log->count] = log.addresses[j];
+                outer_log->old_values[outer_log->count++] = log.old_values[j];
+            }
+        }
+        if (changed || accesses != device_accesses) {
+            anchored = 0;
+            accesses = device_accesses;
+        } else if (anchored && sf->pc == pc) {
+            idle = sf->accumulator == accumulator && sf->x_index == x_index && sf->y_index == y_index &&
+                   sf->status == status && sf->esp == esp;
+            if (idle) {
+                break;
+            }
+        } else if ((!anchored || at_start) && sf->pc <= last_pc) {
+            accumulator = sf->accumulator;
+            x_index = sf->x_index;
+            y_index = sf->y_index;
+            status = sf->status;
+            esp = sf->esp;
+            pc = sf->pc;
+            cycles = sf->cycles;
+            anchored = 1;
+            at_start = 0;
+        }
+    }
+    if (!idle) {
+        return 0;
+    }
+    uint64_t pass = sf->cycles - cycles;
+    uint64_t skipped = (cycle_limit - sf->cycles) / pass * pass;
+    sf->cycles += skipped;
+    return skipped;
+}
+
+/* THREADED ENGINE
+ * threaded_run_instructions dispatches straight through the per-address entries of ThreadedCode_t instead of
+ * decoding every opcode, and runs the pairs listed in superinstructions as a single handler
+ */
+#define PAIR_INDEX(first, second) (((first) << 8) | (second))
+
+/* SUPER_HANDLER
+ *      DESCRIPTION: generates handler that runs two handlers back to back, so the pair costs one dispatch
+ *      INPUTS: first -- handler of first instruction (e.g. DEX_IMP)
+ *              second -- handler of instruction following it (e.g. BNE_REL)
+ */
+#define SUPER_HANDLER(first, second)                    \
+    static void first##__##second(sf_t *sf) {           \
+        first(sf);                                      \
+        second(sf);                                     \
+    }
+
+SUPER_HANDLER(DEX_IMP, BNE_REL)
+SUPER_HANDLER(DEY_IMP, BNE_REL)
+SUPER_HANDLER(INX_IMP, BNE_REL)
+SUPER_HANDLER(INY_IMP, BNE_REL)
+SUPER_HANDLER(CPX_IMM, BNE_REL)
+SUPER_HANDLER(CPY_IMM, BNE_REL)
+SUPER_HANDLER(CMP_IMM, BNE_REL)
+SUPER_HANDLER(CMP_IMM, BEQ_REL)
+SUPER_HANDLER(CMP_IMM, BCC_REL)
+SUPER_HANDLER(CMP_IMM, BCS_REL)
+SUPER_HANDLER(LDA_IND_Y, BEQ_REL)
+SUPER_HANDLER(LDA_IND_Y, CMP_IMM)
+SUPER_HANDLER(LDA_ABS_Y, CMP_IMM)
+SUPER_HANDLER(LDX_IMM, BEQ_REL)
+SUPER_HANDLER(ADC_ABS, DEX_IMP)
+SUPER_HANDLER(CLC_IMP, ADC_IMM)
+SUPER_HANDLER(CLC_IMP, ADC_ZPG)
+SUPER_HANDLER(LSR_ACCUM, BCC_REL)
+SUPER_HANDLER(ASL_ACCUM, BCC_REL)
+
+// pairs run by a single superinstruction handler: loop counters and compares feeding a branch, plus the most
+// frequent pairs profile_pairs reports for the programs in test_code
+static const struct {
+    uint8_t first; // opcode of first instruction
+    uint8_t second; // opcode of instruction following it
+    void (*handler)(sf_t *sf);
+} superinstructions[] = {
+    {0xCA, 0xD0, DEX_IMP__BNE_REL},
+    {0x88, 0xD0, DEY_IMP__BNE_REL},
+    {0xE8, 0xD0, INX_IMP__BNE_REL},
+    {0xC8, 0xD0, INY_IMP__BNE_REL},
+    {0xE0, 0xD0, CPX_IMM__BNE_REL},
+    {0xC0, 0xD0, CPY_IMM__BNE_REL},
+    {0xC9, 0xD0, CMP_IMM__BNE_REL},
+    {0xC9, 0xF0, CMP_IMM__BEQ_REL},
+    {0xC9, 0x90, CMP_IMM__BCC_REL},
+    {0xC9, 0xB0, CMP_IMM__BCS_REL},
+    {0xB1, 0xF0, LDA_IND_Y__BEQ_REL},
+    {0xB1, 0xC9, LDA_IND_Y__CMP_IMM},
+    {0xB9, 0xC9, LDA_ABS_Y__CMP_IMM},
+    {0xA2, 0xF0, LDX_IMM__BEQ_REL},
+    {0x6D, 0xCA, ADC_ABS__DEX_IMP},
+    {0x18, 0x69, CLC_IMP__ADC_IMM},
+    {0x18, 0x65, CLC_IMP__ADC_ZPG},
+    {0x4A, 0x90, LSR_ACCUM__BCC_REL},
+    {0x0A, 0x90, ASL_ACCUM__BCC_REL},
+};
+
+#define NUM_SUPERINSTRUCTIONS (sizeof(superinstructions) / sizeof(superinstructions[0]))
+
+/* find_superinstruction
+ *      DESCRIPTION: looks up the superinstruction handler for a pair of opcodes
+ *      INPUTS: first -- opcode of first instruction
+ *              second -- opcode of instruction following it
+ *      OUTPUTS: handler running both instructions, or NULL if the pair isn't fused
+ *      SIDE EFFECTS: none
+ */
+static void (*find_superinstruction(uint8_t first, uint8_t second))(sf_t *sf) {
+    for (size_t i = 0; i < NUM_SUPERINSTRUCTIONS; i++) {
+        if (superinstructions[i].first == first && superinstructions[i].second == second) {
+            return superinstructions[i].handler;
+        }
+    }
+    return NULL;
+}
+
+/* can_fuse
+ *      DESCRIPTION: checks whether a pair of instructions can safely run as one superinstruction: the first must
+ *                   fall through to the second and can't write memory (it could rewrite the second), and the
+ *                   second can't be BRK, which has to end the run on its own
+ *      INPUTS: first -- opcode of first instruction
+ *              second -- opcode of instruction following it
+ *      OUTPUTS: nonzero if pair can be fused
+ *      SIDE EFFECTS: none
+ */
+static int can_fuse(uint8_t first, uint8_t second) {
+    return !ends_block(first) && !stores_memory(first) && second != OP_BRK;
+}
+
+/* get_threaded_code
+ *      DESCRIPTION: returns threaded code of calling thread, allocating it on first use
+ *      INPUTS: none
+ *      OUTPUTS: threaded code of calling thread
+ *      SIDE EFFECTS: may allocate memory
+ */
+static ThreadedCode_t *get_threaded_code(void) {
+    if (thread_threaded == NULL) {
+        thread_threaded = (ThreadedCode_t *)calloc(1, sizeof(ThreadedCode_t));
+        if (thread_threaded == NULL) {
+            fprintf(stderr, "Failed to allocate memory for threaded code\n");
+            exit(ERR_NO_MEM);
+        }
+    }
+    return thread_threaded;
+}
+
+/* flush_threaded_code
+ *      DESCRIPTION: marks every entry as not translated
+ *      INPUTS: threaded -- threaded code to flush
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies threaded
+ */
+static void flush_threaded_code(ThreadedCode_t *threaded) {
+    for (int page = 0; page < NUM_PAGES; page++) {
+        if (threaded->translated_page[page]) {
+            threaded->translated_page[page] = 0;
+            for (int i = 0; i < 0x100; i++) {
+                threaded->ops[(page << 8) | i].num_instr = 0;
+            }
+        }
+    }
+}
+
+/* translate_op
+ *      DESCRIPTION: fills in the entry for the instruction at passed address, fusing it with the next instruction
+ *                   if the pair has a superinstruction
+ *      INPUTS: threaded -- threaded code to translate into
+ *              memory -- memory holding the code
+ *              address -- address of instruction
+ *      OUTPUTS: translated entry
+ *      SIDE EFFECTS: modifies threaded
+ */
+static const ThreadedOp_t *translate_op(ThreadedCode_t *threaded, const uint8_t *memory, uint16_t address) {
+    ThreadedOp_t *op = &threaded->ops[address];
+    uint8_t first = memory[address];
+    uint8_t second = memory[(uint16_t)(address + opcode_length[first])];
+    void (*super)(sf_t *sf) = can_fuse(first, second) ? find_superinstruction(first, second) : NULL;
+
+    if (super != NULL) {
+        op->handler = super;
+        op->cycles = opcode_cycles[first] + opcode_cycles[second];
+        op->num_instr = 2;
+    } else {
+        op->handler = opcode_jumptable[first];
+        op->cycles = opcode_cycles[first];
+        op->num_instr = 1;
+    }
+    op->is_brk = first == OP_BRK;
+    threaded->translated_page[address >> 8] = 1;
+    return op;
+}
+
+/* threaded_run_instructions
+ *      DESCRIPTION: runs up to num_instr instructions through threaded code, returning early if BRK is executed;
+ *                   behaves exactly like run_instructions
+ *      INPUTS: sf -- 6502 struct
+ *              num_instr -- maximum number of instructions to run
+ *      OUTPUTS: RUN_BRK if BRK was executed, RUN_BUDGET otherwise
+ *      SIDE EFFECTS: same as running process_line up to num_instr times, translates code of calling thread;
+ *                    entries stay from one call to the next, so memory written other than by the CPU on this thread
+ *                    needs invalidate_code
+ */
+RunExit_t threaded_run_instructions(sf_t *sf, uint64_t num_instr) {
+    ThreadedCode_t *threaded = get_threaded_code();
+    const ThreadedOp_t *ops = threaded->ops;
+    const uint8_t *memory = sf->memory;
+    RunExit_t exit_reason = RUN_BUDGET;
+    if (claim_code(&threaded->owner, sf)) {
+        flush_threaded_code(threaded);
+    }
+
+    // no entry covers more than 2 instructions, so the budget check is left to the loop condition
+    uint64_t remaining = num_instr;
+    while (remaining >= 2) {
+        const ThreadedOp_t *op = &ops[sf->pc];
+        if (op->num_instr == 0) {
+            op = translate_op(threaded, memory, sf->pc);
+        }
+        uint8_t op_instr = op->num_instr; // read before the handler, whose stores may reset the entry
+        uint8_t is_brk = op->is_brk;
+        sf->cycles += op->cycles;
+        (*op->handler)(sf);
+        remaining -= op_instr;
+        if (is_brk) {
+            exit_reason = RUN_BRK;
             break;
+        }
+    }
+
+    if (exit_reason == RUN_BUDGET && remaining) {
+        return run_instructions(sf, remaining); // last instruction of the budget
     }
+    sync_negative_and_zero(sf);
+    return exit_reason;
+}
+
+/* BLOCK ENGINE
+ * block_run_instructions runs the blocks of BlockCache_t; every instruction has a handler of its own generated
+ * from OPCODE_TABLE that takes its operand and resolved address from the decoded instruction rather than from
+ * memory, and only the instruction ending a block sets sf->pc
+ * base cycles are charged for the whole block before it runs, instructions that don't run (after a store drops a
+ * block) are taken back afterwards
+ */
+
+// effective address of each addressing mode, from a decoded instruction (same arithmetic as the _ADDRESS macros)
+#define DECODED_IND_X_ADDRESS   ((sf->memory[((sf->x_index + op->operand) + 1) % 0xFF] << 8) | (sf->memory[(sf->x_index + op->operand) % 0xFF]))
+#define DECODED_ZPG_ADDRESS     (op->address)
+#define DECODED_ABS_ADDRESS     (op->address)
+#define DECODED_IND_Y_ADDRESS   (((sf->memory[op->operand + 1] << 8)|sf->memory[op->operand]) + sf->y_index)
+#define DECODED_ZPG_X_ADDRESS   ((op->operand + sf->x_index) % 0xFF)
+#define DECODED_ZPG_Y_ADDRESS   ((op->operand + sf->y_index) % 0xFF)
+#define DECODED_ABS_Y_ADDRESS   ((op->address + sf->y_index) % 0xFFFF)
+#define DECODED_ABS_X_ADDRESS   ((op->address + sf->x_index) % 0xFFFF)
+
+// operand of each addressing mode as a pointer the operation can read, from a decoded instruction
+#define DECODED_IND_X_OPERAND   READ_ACCESS(DECODED_IND_X_ADDRESS)
+#define DECODED_ZPG_OPERAND     READ_ACCESS(DECODED_ZPG_ADDRESS)
+#define DECODED_IMM_OPERAND     (scratch = op->operand, &scratch)
+#define DECODED_ABS_OPERAND     READ_ACCESS(DECODED_ABS_ADDRESS)
+#define DECODED_IND_Y_OPERAND   READ_ACCESS(DECODED_IND_Y_ADDRESS)
+#define DECODED_ZPG_X_OPERAND   READ_ACCESS(DECODED_ZPG_X_ADDRESS)
+#define DECODED_ZPG_Y_OPERAND   READ_ACCESS(DECODED_ZPG_Y_ADDRESS)
+#define DECODED_ABS_Y_OPERAND   READ_ACCESS(DECODED_ABS_Y_ADDRESS)
+#define DECODED_ABS_X_OPERAND   READ_ACCESS(DECODED_ABS_X_ADDRESS)
+
+// cycle added when indexing crosses a page, from a decoded instruction (operand is the low byte of ABS addresses)
+#define DECODED_IND_X_PAGE_PENALTY  (0)
+#define DECODED_ZPG_PAGE_PENALTY    (0)
+#define DECODED_IMM_PAGE_PENALTY    (0)
+#define DECODED_ABS_PAGE_PENALTY    (0)
+#define DECODED_IND_Y_PAGE_PENALTY  ((sf->memory[op->operand] + sf->y_index) >> 8)
+#define DECODED_ZPG_X_PAGE_PENALTY  (0)
+#define DECODED_ZPG_Y_PAGE_PENALTY  (0)
+#define DECODED_ABS_Y_PAGE_PENALTY  ((op->operand + sf->y_index) >> 8)
+#define DECODED_ABS_X_PAGE_PENALTY  ((op->operand + sf->x_index) >> 8)
+
+/* stop_block
+ *      DESCRIPTION: ends the running block after passed instruction, whose store dropped cached blocks
+ *      INPUTS: sf -- 6502 struct
+ *              op -- instruction that just ran
+ *      OUTPUTS: NULL, to end the block
+ *      SIDE EFFECTS: sets pc to the next instruction, records op as where the block stopped
+ */
+static const DecodedOp_t *stop_block(sf_t *sf, const DecodedOp_t *op) {
+    sf->pc = op->next_pc;
+    thread_blocks->stopped = op;
+    return NULL;
+}
+
+// next instruction to run after one that may have stored to cached code
+#define DECODED_NEXT    (blocks_dropped ? stop_block(sf, op) : op + 1)
+
+/* DECODED_READ_HANDLER
+ *      DESCRIPTION: generates decoded handler that runs operation on memory selected by addressing mode and adds a
+ *                   cycle if indexing crosses a page and the opcode pays for it
+ *      INPUTS: operation -- mnemonic whose _operation function is run (e.g. ORA)
+ *              mode -- addressing mode whose DECODED_ macros select the operand (e.g. IND_X)
+ *              penalty -- 1 if the opcode takes a cycle more when indexing crosses a page, 0 otherwise
+ */
+#define DECODED_READ_HANDLER(operation, mode, penalty)                                          \
+    static const DecodedOp_t *decoded_##operation##_##mode(sf_t *sf, const DecodedOp_t *op) {   \
+        uint8_t scratch;                                                                        \
+        if (penalty) {                                                                          \
+            sf->cycles += DECODED_##mode##_PAGE_PENALTY;                                        \
+        }                                                                                       \
+        operation##_operation(sf, DECODED_##mode##_OPERAND);                                    \
+        return op + 1;                                                                          \
+    }
+
+/* DECODED_STORE_HANDLER
+ *      DESCRIPTION: generates decoded handler that runs store operation on memory selected by addressing mode
+ *                   through STORE_ACCESS, ending the block if the store dropped cached code
+ *      INPUTS: operation -- mnemonic whose _operation function is run (e.g. STA)
+ *              mode -- addressing mode whose DECODED_ macros select the operand (e.g. IND_X)
+ */
+#define DECODED_STORE_HANDLER(operation, mode)                                                  \
+    static const DecodedOp_t *decoded_##operation##_##mode(sf_t *sf, const DecodedOp_t *op) {   \
+        STORE_ACCESS(operation, DECODED_##mode##_ADDRESS);                                      \
+        return DECODED_NEXT;                                                                    \
+    }
+
+/* DECODED_MEMORY_HANDLER
+ *      DESCRIPTION: generates decoded handler that runs read-modify-write operation on memory selected by
+ *                   addressing mode through MEMORY_ACCESS, ending the block if the store dropped cached code
+ *      INPUTS: operation -- mnemonic whose _operation function is run (e.g. ASL)
+ *              mode -- addressing mode whose DECODED_ macros select the operand (e.g. IND_X)
+ */
+#define DECODED_MEMORY_HANDLER(operation, mode)                                                 \
+    static const DecodedOp_t *decoded_##operation##_##mode(sf_t *sf, const DecodedOp_t *op) {   \
+        MEMORY_ACCESS(operation, DECODED_##mode##_ADDRESS);                                     \
+        return DECODED_NEXT;                                                                    \
+    }
+
+/* DECODED_ACCUM_HANDLER
+ *      DESCRIPTION: generates decoded handler that runs operation on the accumulator
+ *      INPUTS: operation -- mnemonic whose _operation function is run (e.g. ASL)
+ */
+#define DECODED_ACCUM_HANDLER(operation)                                                        \
+    static const DecodedOp_t *decoded_##operation##_ACCUM(sf_t *sf, const DecodedOp_t *op) {    \
+        operation##_operation(sf, &sf->accumulator);                                            \
+        return op + 1;                                                                          \
+    }
+
+/* DECODED_BRANCH_HANDLER
+ *      DESCRIPTION: generates decoded handler that ends the block at the decoded target if condition holds and at
+ *                   the next instruction otherwise; a taken branch costs one cycle, plus one more if it lands on a
+ *                   different page
+ *      INPUTS: mnemonic -- name of branch instruction (e.g. BPL)
+ *              condition -- expression on sf that is nonzero when branch is taken
+ */
+#define DECODED_BRANCH_HANDLER(mnemonic, condition)                                             \
+    static const DecodedOp_t *decoded_##mnemonic##_REL(sf_t *sf, const DecodedOp_t *op) {      \
+        if (condition) {                                                                        \
+            sf->cycles += 1 + ((op->address ^ op->next_pc) >> 8 != 0);                          \
+            sf->pc = op->address;                                                               \
+        } else {                                                                                \
+            sf->pc = op->next_pc;                                                               \
+        }                                                                                       \
+        return NULL;                                                                            \
+    }
+
+/* DECODED_FLAG_HANDLER
+ *      DESCRIPTION: generates decoded handler that applies passed update to status register
+ *      INPUTS: mnemonic -- name of flag instruction (e.g. CLC)
+ *              update -- compound assignment applied to sf->status
+ */
+#define DECODED_FLAG_HANDLER(mnemonic, update)                                                  \
+    static const DecodedOp_t *decoded_##mnemonic##_IMP(sf_t *sf, const DecodedOp_t *op) {      \
+        sf->status update;                                                                      \
+        return op + 1;                                                                          \
+    }
+
+/* DECODED_REGISTER_HANDLER
+ *      DESCRIPTION: generates decoded handler that applies passed expression to register and sets negative and
+ *                   zero flags
+ *      INPUTS: mnemonic -- name of register instruction (e.g. TAX)
+ *              reg -- register modified by instruction
+ *              expr -- expression modifying reg (e.g. = sf->accumulator, or ++)
+ */
+#define DECODED_REGISTER_HANDLER(mnemonic, reg, expr)                                           \
+    static const DecodedOp_t *decoded_##mnemonic##_IMP(sf_t *sf, const DecodedOp_t *op) {      \
+        sf->reg expr;                                                                           \
+        check_negative_and_zero(sf, sf->reg);                                                   \
+        return op + 1;                                                                          \
+    }
+
+#define GENERATE_DECODED(mnemonic, mode, opcode, length, cycles, penalty, handler) \
+    GENERATE_DECODED_##handler(mnemonic, mode, penalty)
+#define GENERATE_DECODED_READ(mnemonic, mode, penalty)      DECODED_READ_HANDLER(mnemonic, mode, penalty)
+#define GENERATE_DECODED_STORE(mnemonic, mode, penalty)     DECODED_STORE_HANDLER(mnemonic, mode)
+#define GENERATE_DECODED_MEMORY(mnemonic, mode, penalty)    DECODED_MEMORY_HANDLER(mnemonic, mode)
+#define GENERATE_DECODED_ACCUM(mnemonic, mode, penalty)     DECODED_ACCUM_HANDLER(mnemonic)
+#define GENERATE_DECODED_CUSTOM(mnemonic, mode, penalty)
+
+OPCODE_TABLE(GENERATE_DECODED)
+BRANCH_TABLE(DECODED_BRANCH_HANDLER)
+FLAG_TABLE(DECODED_FLAG_HANDLER)
+REGISTER_TABLE(DECODED_REGISTER_HANDLER)
+
+/* decoded_JMP_ABS
+ *      DESCRIPTION: ends the block at the decoded jump target
+ */
+static const DecodedOp_t *decoded_JMP_ABS(sf_t *sf, const DecodedOp_t *op) {
+    sf->pc = op->address;
+    return NULL;
+}
+
+/* decoded_stack
+ *      DESCRIPTION: runs the handler of a one byte stack or NOP instruction (PHA, PHP, PLA, PLP, TXS, NOP) from pc,
+ *                   ending the block if a push dropped cached code
+ */
+static const DecodedOp_t *decoded_stack(sf_t *sf, const DecodedOp_t *op) {
+    sf->pc = op->next_pc - 1;
+    (*opcode_jumptable[op->opcode])(sf);
+    return DECODED_NEXT;
+}
+
+/* decoded_jump
+ *      DESCRIPTION: runs the handler of an instruction that ends the block and leaves pc wherever it goes (JSR,
+ *                   RTS, RTI, JMP indirect, BRK and opcodes with no instruction)
+ */
+static const DecodedOp_t *decoded_jump(sf_t *sf, const DecodedOp_t *op) {
+    sf->pc = op->next_pc - opcode_length[op->opcode];
+    (*opcode_jumptable[op->opcode])(sf);
+    return NULL;
+}
+
+/* decoded_end
+ *      DESCRIPTION: ends a block cut short at BLOCK_MAX_INSTRUCTIONS at the instruction after its last one
+ */
+static const DecodedOp_t *decoded_end(sf_t *sf, const DecodedOp_t *op) {
+    sf->pc = op->next_pc;
+    return NULL;
+}
+
+// each generates the designated initializer of a row in decoded_jumptable
+#define DECODED_ENTRY(mnemonic, mode, opcode, length, cycles, penalty, handler) \
+    DECODED_ENTRY_##handler(mnemonic, mode, opcode)
+#define DECODED_ENTRY_READ(mnemonic, mode, opcode)      [opcode] = decoded_##mnemonic##_##mode,
+#define DECODED_ENTRY_STORE(mnemonic, mode, opcode)     [opcode] = decoded_##mnemonic##_##mode,
+#define DECODED_ENTRY_MEMORY(mnemonic, mode, opcode)    [opcode] = decoded_##mnemonic##_##mode,
+#define DECODED_ENTRY_ACCUM(mnemonic, mode, opcode)     [opcode] = decoded_##mnemonic##_##mode,
+#define DECODED_ENTRY_CUSTOM(mnemonic, mode, opcode)
+#define DECODED_BRANCH_ENTRY(mnemonic, condition)       [OP_##mnemonic] = decoded_##mnemonic##_REL,
+#define DECODED_FLAG_ENTRY(mnemonic, update)            [OP_##mnemonic] = decoded_##mnemonic##_IMP,
+#define DECODED_REGISTER_ENTRY(mnemonic, reg, expr)     [OP_##mnemonic] = decoded_##mnemonic##_IMP,
+
+// decoded handler for every opcode, indexed by opcode byte
+static const DecodedOp_t *(* const decoded_jumptable[256])(sf_t *sf, const DecodedOp_t *op) = {
+    [0 ... 255] = decoded_jump,
+    OPCODE_TABLE(DECODED_ENTRY)
+    BRANCH_TABLE(DECODED_BRANCH_ENTRY)
+    FLAG_TABLE(DECODED_FLAG_ENTRY)
+    REGISTER_TABLE(DECODED_REGISTER_ENTRY)
+    [OP_JMP] = decoded_JMP_ABS,
+    [OP_PHA] = decoded_stack,
+    [OP_PHP] = decoded_stack,
+    [OP_PLA] = decoded_stack,
+    [OP_PLP] = decoded_stack,
+    [OP_TXS] = decoded_stack,
+    [OP_NOP] = decoded_stack,
+};
+
+/* get_block_cache
+ *      DESCRIPTION: returns block cache of calling thread, allocating it on first use
+ *      INPUTS: none
+ *      OUTPUTS: block cache of calling thread
+ *      SIDE EFFECTS: may allocate memory
+ */
+static BlockCache_t *get_block_cache(void) {
+    if (thread_blocks == NULL) {
+        thread_blocks = (BlockCache_t *)calloc(1, sizeof(BlockCache_t));
+        if (thread_blocks == NULL) {
+            fprintf(stderr, "Failed to allocate memory for block cache\n");
+            exit(ERR_NO_MEM);
+        }
+    }
+    return thread_blocks;
+}
+
+/* flush_blocks
+ *      DESCRIPTION: empties the pool, unlinking every block
+ *      INPUTS: cache -- block cache to flush
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies cache
+ */
+static void flush_blocks(BlockCache_t *cache) {
+    for (uint32_t i = 0; i < cache->num_blocks; i++) {
+        const Block_t *block = &cache->blocks[i];
+        cache->block_at[block->start] = NULL;
+        for (int j = 0; j < block->bytes; j++) {
+            cache->code_byte[(uint16_t)(block->start + j)] = 0;
+        }
+    }
+    cache->num_blocks = 0;
+}
+
+/* decode_block
+ *      DESCRIPTION: decodes the block starting at passed address into the pool, up to and including the first
+ *                   instruction that ends a block or BLOCK_MAX_INSTRUCTIONS instructions
+ *      INPUTS: cache -- block cache to decode into
+ *              memory -- memory holding the code
+ *              start -- address of first instruction
+ *      OUTPUTS: decoded block
+ *      SIDE EFFECTS: modifies cache, flushing it first if the pool is full
+ */
+static Block_t *decode_block(BlockCache_t *cache, const uint8_t *memory, uint16_t start) {
+    if (cache->num_blocks == BLOCK_CACHE_BLOCKS) {
+        flush_blocks(cache);
+    }
+    Block_t *block = &cache->blocks[cache->num_blocks++];
+    uint16_t address = start;
+    uint32_t cycles = 0;
+    uint8_t opcode;
+    int i = 0;
+    do {
+        DecodedOp_t *op = &block->ops[i];
+        opcode = memory[address];
+        op->handler = decoded_jumptable[opcode];
+        op->opcode = opcode;
+        op->operand = memory[(uint16_t)(address + 1)];
+        op->next_pc = address + opcode_length[opcode];
+        if (opcode_mode[opcode] == OPCODE_MODE_ZPG) {
+            op->address = op->operand;
+        } else if (opcode_mode[opcode] == OPCODE_MODE_REL) {
+            op->address = op->next_pc + (int8_t)op->operand;
+        } else {
+            op->address = (memory[(uint16_t)(address + 2)] << 8) | op->operand;
+        }
+        cycles += opcode_cycles[opcode];
+        op->cycles_through = cycles;
+        op->index = i++;
+        for (int j = 0; j < opcode_length[opcode]; j++) {
+            cache->code_byte[(uint16_t)(address + j)] = 1;
+        }
+        address = op->next_pc;
+    } while (!ends_block(opcode) && i < BLOCK_MAX_INSTRUCTIONS);
+
+    if (!ends_block(opcode)) {
+        block->ops[i].handler = decoded_end;
+        block->ops[i].next_pc = address;
+    }
+    block->start = start;
+    block->bytes = (uint16_t)(address - start);
+    block->num_instr = i;
+    block->cycles = cycles;
+    block->ends_in_brk = opcode == OP_BRK;
+    cache->block_at[start] = block;
+    return block;
+}
+
+/* block_run_instructions
+ *      DESCRIPTION: runs up to num_instr instructions from pre-decoded basic blocks, returning early if BRK is
+ *                   executed; behaves exactly like run_instructions, but blocks stay cached from one call to the
+ *                   next, so memory written other than by the CPU on this thread needs invalidate_code
+ *      INPUTS: sf -- 6502 struct
+ *              num_instr -- maximum number of instructions to run
+ *      OUTPUTS: RUN_BRK if BRK was executed, RUN_BREAKPOINT if an armed breakpoint was hit, RUN_BUDGET otherwise
+ *      SIDE EFFECTS: same as running process_line up to num_instr times, decodes code into the block cache of the
+ *                    calling thread
+ */
+RunExit_t block_run_instructions(sf_t *sf, uint64_t num_instr) {
+    if (armed_breakpoints() != NULL) {
+        return run_instructions(sf, num_instr);
+    }
+    BlockCache_t *cache = get_block_cache();
+    if (claim_code(&cache->owner, sf)) {
+        flush_blocks(cache);
+    }
+    blocks_dropped = 0; // stores made outside block runs have nothing to stop
+    RunExit_t exit_reason = RUN_BUDGET;
+
+    uint64_t remaining = num_instr;
+    for (;;) {
+        Block_t *block = cache->block_at[sf->pc];
+        if (block == NULL) {
+            block = decode_block(cache, sf->memory, sf->pc);
+        }
+        if (block->num_instr > remaining) {
+            break;
+        }
+        sf->cycles += block->cycles;
+        remaining -= block->num_instr;
+        const DecodedOp_t *op = block->ops;
+        do {
+            op = (*op->handler)(sf, op);
+        } while (op != NULL);
+        if (cache->stopped != NULL) {
+            // give back what the instructions after the one that stopped the block were charged
+            sf->cycles -= block->cycles - cache->stopped->cycles_through;
+            remaining += block->num_instr - (cache->stopped->index + 1);
+            cache->stopped = NULL;
+            blocks_dropped = 0;
+            continue;
+        }
+        if (block->ends_in_brk) {
+            exit_reason = RUN_BRK;
+            break;
+        }
+    }
+
+    if (exit_reason == RUN_BUDGET && remaining) {
+        return run_instructions(sf, remaining); // rest of the budget, too short for the next block
+    }
+    sync_negative_and_zero(sf);
+    return exit_reason;
+}
+
+/* compare_pair_counts
+ *      DESCRIPTION: qsort comparator ordering pair indices by descending count in pair_counts
+ */
+static const uint64_t *pair_counts;
+static int compare_pair_counts(const void *a, const void *b) {
+    uint64_t count_a = pair_counts[*(const uint32_t *)a];
+    uint64_t count_b = pair_counts[*(const uint32_t *)b];
+    return (count_a < count_b) - (count_a > count_b);
+}
+
+/* profile_pairs
+ *      DESCRIPTION: runs up to num_instr instructions (stopping at BRK) while counting how often each opcode is
+ *                   directly followed by each other opcode, then prints the most frequent pairs and whether they
+ *                   are fused, could be fused, or can't be fused
+ *      INPUTS: sf -- 6502 struct with program loaded
+ *              num_instr -- maximum number of instructions to run
+ *              top_n -- number of pairs to print
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: same as running process_line up to num_instr times, prints to stdout
+ */
+void profile_pairs(sf_t *sf, uint64_t num_instr, int top_n) {
+    uint64_t *counts = (uint64_t *)calloc(PAIR_INDEX(0xFF, 0xFF) + 1, sizeof(uint64_t));
+    uint32_t *order = (uint32_t *)malloc((PAIR_INDEX(0xFF, 0xFF) + 1) * sizeof(uint32_t));
+    if (counts == NULL || order == NULL) {
+        fprintf(stderr, "Failed to allocate memory for pair profile\n");
+        exit(ERR_NO_MEM);
+    }
+
+    uint64_t total = 0;
+    uint64_t executed = 0;
+    int previous = -1; // opcode of previous instruction if it fell through to this one
+    while (executed < num_instr) {
+        uint8_t opcode = sf->memory[sf->pc];
+        if (previous >= 0) {
+            counts[PAIR_INDEX(previous, opcode)]++;
+            total++;
+        }
+        process_line(sf);
+        executed++;
+        if (opcode == OP_BRK) {
+            break;
+        }
+        previous = ends_block(opcode) ? -1 : opcode;
+    }
+
+    for (uint32_t i = 0; i <= PAIR_INDEX(0xFF, 0xFF); i++) {
+        order[i] = i;
+    }
+    pair_counts = counts;
+    qsort(order, PAIR_INDEX(0xFF, 0xFF) + 1, sizeof(uint32_t), compare_pair_counts);
+
+    printf("%llu instructions, %llu fall-through pairs\n", (unsigned long long)executed, (unsigned long long)total);
+    for (int i = 0; i < top_n && counts[order[i]] != 0; i++) {
+        uint8_t first = order[i] >> 8;
+        uint8_t second = order[i] & 0xFF;
+        const char *state = !can_fuse(first, second) ? "can't fuse" :
+                            find_superinstruction(first, second) != NULL ? "fused" : "fusable";
+        printf("$%02X $%02X  %10llu  %5.1f%%  %s\n", first, second, (unsigned long long)counts[order[i]],
+               100.0 * counts[order[i]] / total, state);
+    }
+
+    free(order);
+    free(counts);
+}
+
+/* profile_run_cycles
+ *      DESCRIPTION: same as run_cycles, but adds one execution and the cycles it took to the instruction's address
+ *                   in profile; a loop of its own, so the other run loops don't pay for profiling
+ *      INPUTS: sf -- 6502 struct
+ *              max_cycles -- number of clock cycles to run for
+ *              profile -- counts to add to
+ *      OUTPUTS: RUN_BRK if BRK was executed, RUN_BUDGET otherwise
+ *      SIDE EFFECTS: same as run_cycles, modifies profile
+ */
+RunExit_t profile_run_cycles(sf_t *sf, uint64_t max_cycles, Profile_t *profile) {
+    if (max_cycles == 0) {
+        return RUN_BUDGET;
+    }
+    sf->next_event = sf->cycles + max_cycles;
+    void (* const *jumptable)(sf_t *sf) = opcode_jumptable;
+    const uint8_t *memory = sf->memory;
+    RunExit_t exit_reason = RUN_BUDGET;
+    for (;;) {
+        uint16_t pc = sf->pc;
+        uint8_t opcode = memory[pc];
+        uint64_t cycles = sf->cycles;
+        sf->cycles += opcode_cycles[opcode];
+        (*jumptable[opcode])(sf);
+        profile->executions[pc]++;
+        profile->cycles[pc] += sf->cycles - cycles;
+        if (opcode == OP_BRK) {
+            exit_reason = RUN_BRK;
+            break;
+        }
+        if (sf->cycles >= sf->next_event) {
+            break;
+        }
+    }
+    sync_negative_and_zero(sf);
+    return exit_reason;
+}
+
+#ifdef JIT
+/* JIT
+ * translated code keeps sf in rbx, the instruction budget in r12 and the JitState_t in r13; every block starts
+ * by checking the budget covers all of its instructions, charges their base cycles up front, then runs each
+ * instruction natively or by calling its handler; sf->pc is only written where a handler or exit needs it
+ * blocks end by jumping straight to the translation of the next block (patched in once it exists), looking up
+ * code_at for targets only known at run time (RTS, RTI, JMP indirect), or returning to jit_run_instructions
+ */
+#define JIT_EXIT_COLD       0 // next block has no translation, or budget too small for it (pc at its first instruction)
+#define JIT_EXIT_BRK        1 // BRK was executed
+#define JIT_EXIT_FLUSH      2 // a store hit translated code (pc at instruction after the store)
+#define JIT_EXIT_BUDGET     3 // budget can't cover the next block (pc at its first instruction)
+#define JIT_BLOCK_SPACE     (JIT_MAX_INSTRUCTIONS * 96 + 128) // bound on bytes emitted for one block
+
+// LDA/LDX/LDY #imm set nz_result and nz_pending with one 16-bit store
+_Static_assert(offsetof(sf_t, nz_pending) == offsetof(sf_t, nz_result) + 1, "nz_pending must follow nz_result");
+
+static uint32_t jit_hot_threshold = JIT_HOT_THRESHOLD;
+static uint32_t jit_max_instructions = JIT_MAX_INSTRUCTIONS;
+static _Thread_local int thread_jit_failed = 0; // set if executable memory couldn't be mapped
+
+/* emit
+ *      DESCRIPTION: appends bytes of little-endian value to translated code
+ *      INPUTS: jit -- translator state
+ *              value -- value to append
+ *              num_bytes -- number of bytes of value to append
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: advances code_free
+ */
+static void emit(JitState_t *jit, uint64_t value, int num_bytes) {
+    for (int i = 0; i < num_bytes; i++) {
+        *jit->code_free++ = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+/* emit_rel32
+ *      DESCRIPTION: appends rel32 field of a jump to target
+ *      INPUTS: jit -- translator state
+ *              target -- host address to jump to
+ *      OUTPUTS: address of the rel32 field, so it can be patched later
+ *      SIDE EFFECTS: advances code_free
+ */
+static uint8_t *emit_rel32(JitState_t *jit, uint8_t *target) {
+    uint8_t *site = jit->code_free;
+    emit(jit, (uint32_t)(target - (site + 4)), 4);
+    return site;
+}
+
+/* patch_rel32
+ *      DESCRIPTION: points rel32 field of an emitted jump at target
+ *      INPUTS: site -- rel32 field to patch
+ *              target -- host address to jump to
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies translated code
+ */
+static void patch_rel32(uint8_t *site, uint8_t *target) {
+    uint32_t rel = (uint32_t)(target - (site + 4));
+    memcpy(site, &rel, 4);
+}
+
+/* emit_exit
+ *      DESCRIPTION: appends code returning exit_code to jit_run_instructions
+ *      INPUTS: jit -- translator state
+ *              exit_code -- one of JIT_EXIT_*
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: advances code_free
+ */
+static void emit_exit(JitState_t *jit, uint32_t exit_code) {
+    emit(jit, 0xB8, 1); // mov eax, exit_code
+    emit(jit, exit_code, 4);
+    emit(jit, 0xE9, 1); // jmp exit_common
+    emit_rel32(jit, jit->exit_common);
+}
+
+/* emit_sf_op
+ *      DESCRIPTION: appends instruction whose memory operand is a field of sf ([rbx + disp32])
+ *      INPUTS: jit -- translator state
+ *              opcode -- prefix and opcode bytes, first byte in the low byte
+ *              opcode_bytes -- number of bytes in opcode
+ *              reg -- ModRM reg field (register or opcode extension)
+ *              offset -- offset of field in sf_t
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: advances code_free
+ */
+static void emit_sf_op(JitState_t *jit, uint32_t opcode, int opcode_bytes, uint8_t reg, uint32_t offset) {
+    emit(jit, opcode, opcode_bytes);
+    emit(jit, 0x83 | (reg << 3), 1); // mod 10 (disp32), rm rbx
+    emit(jit, offset, 4);
+}
+
+/* emit_set_pc
+ *      DESCRIPTION: appends code storing address in sf->pc
+ *      INPUTS: jit -- translator state
+ *              address -- value to store
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: advances code_free
+ */
+static void emit_set_pc(JitState_t *jit, uint16_t address) {
+    emit_sf_op(jit, 0xC766, 2, 0, offsetof(sf_t, pc)); // mov word [rbx + pc], address
+    emit(jit, address, 2);
+}
+
+/* emit_chain
+ *      DESCRIPTION: appends rel32 field of a jump to the translation of target, recording it to be patched once
+ *                   target is translated if it isn't already
+ *      INPUTS: jit -- translator state
+ *              target -- 6502 address execution continues at
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: advances code_free, may add to chains
+ */
+static void emit_chain(JitState_t *jit, uint16_t target) {
+    if (jit->code_at[target] != NULL) {
+        emit_rel32(jit, jit->code_at[target]);
+        return;
+    }
+    uint8_t *site = emit_rel32(jit, jit->exit_cold);
+    if (jit->num_chains < JIT_MAX_CHAINS) { // otherwise the jump just keeps exiting to the dispatcher
+        jit->chains[jit->num_chains].site = site;
+        jit->chains[jit->num_chains].target = target;
+        jit->num_chains++;
+    }
+}
+
+/* emit_register_transfer
+ *      DESCRIPTION: appends code for TAX-style instructions: dst = src + delta, then records dst for N and Z
+ *      INPUTS: jit -- translator state
+ *              src -- offset of source register in sf_t
+ *              dst -- offset of destination register in sf_t
+ *              delta -- 1 to increment, -1 to decrement, 0 to copy
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: advances code_free
+ */
+static void emit_register_transfer(JitState_t *jit, uint32_t src, uint32_t dst, int delta) {
+    emit_sf_op(jit, 0xB60F, 2, 0, src); // movzx eax, byte [rbx + src]
+    if (delta > 0) {
+        emit(jit, 0xC0FE, 2); // inc al
+    } else if (delta < 0) {
+        emit(jit, 0xC8FE, 2); // dec al
+    }
+    emit_sf_op(jit, 0x88, 1, 0, dst); // mov [rbx + dst], al
+    emit_sf_op(jit, 0x88, 1, 0, offsetof(sf_t, nz_result)); // mov [rbx + nz_result], al
+    emit_sf_op(jit, 0xC6, 1, 0, offsetof(sf_t, nz_pending)); // mov byte [rbx + nz_pending], 1
+    emit(jit, 1, 1);
+}
+
+/* emit_native
+ *      DESCRIPTION: appends native code for instructions simple enough not to need their handler
+ *      INPUTS: jit -- translator state
+ *              memory -- memory holding the instruction
+ *              address -- address of the instruction
+ *      OUTPUTS: 1 if native code was emitted, 0 if the handler must be called
+ *      SIDE EFFECTS: may advance code_free
+ */
+static int emit_native(JitState_t *jit, const uint8_t *memory, uint16_t address) {
+    uint8_t opcode = memory[address];
+    uint32_t status = offsetof(sf_t, status);
+    switch (opcode) {
+        case OP_NOP:
+            return 1;
+        case OP_CLC: case OP_CLI: case OP_CLV: case OP_CLD: {
+            uint8_t mask = opcode == OP_CLC ? (1 << CARRY_INDEX) : opcode == OP_CLI ? (1 << INTERRUPT_INDEX) :
+                            opcode == OP_CLV ? (1 << OVERFLOW_INDEX) : (1 << DECIMAL_INDEX);
+            emit_sf_op(jit, 0x80, 1, 4, status); // and byte [rbx + status], ~mask
+            emit(jit, (uint8_t)~mask, 1);
+            return 1;
+        }
+        case OP_SEC: case OP_SEI: case OP_SED: {
+            uint8_t mask = opcode == OP_SEC ? (1 << CARRY_INDEX) : opcode == OP_SEI ? (1 << INTERRUPT_INDEX) :
+                            (1 << DECIMAL_INDEX);
+            emit_sf_op(jit, 0x80, 1, 1, status); // or byte [rbx + status], mask
+            emit(jit, mask, 1);
+            return 1;
+        }
+        case OP_TXS:
+            emit_sf_op(jit, 0xB60F, 2, 0, offsetof(sf_t, x_index)); // movzx eax, byte [rbx + x_index]
+            emit_sf_op(jit, 0x8966, 2, 0, offsetof(sf_t, esp)); // mov word [rbx + esp], ax
+            return 1;
+    }
+
+#ifdef LAZY_FLAGS
+    uint32_t a = offsetof(sf_t, accumulator), x = offsetof(sf_t, x_index), y = offsetof(sf_t, y_index);
+    switch (opcode) {
+        case OP_LDA | (ADDR_MODE_IMM << 2): case OP_LDX: case OP_LDY: {
+            uint32_t reg = opcode == OP_LDX ? x : opcode == OP_LDY ? y : a;
+            emit_sf_op(jit, 0xC6, 1, 0, reg); // mov byte [rbx + reg], operand
+            emit(jit, memory[(uint16_t)(address + 1)], 1);
+            emit_sf_op(jit, 0xC766, 2, 0, offsetof(sf_t, nz_result)); // mov word [rbx + nz_result], 0x100 | operand
+            emit(jit, 0x100 | memory[(uint16_t)(address + 1)], 2); // nz_pending is the byte after nz_result
+            return 1;
+        }
+        case OP_TAX: emit_register_transfer(jit, a, x, 0); return 1;
+        case OP_TAY: emit_register_transfer(jit, a, y, 0); return 1;
+        case OP_TXA: emit_register_transfer(jit, x, a, 0); return 1;
+        case OP_TYA: emit_register_transfer(jit, y, a, 0); return 1;
+        case OP_TSX: emit_register_transfer(jit, offsetof(sf_t, esp), x, 0); return 1;
+        case OP_INX: emit_register_transfer(jit, x, x, 1); return 1;
+        case OP_INY: emit_register_transfer(jit, y, y, 1); return 1;
+        case OP_DEX: emit_register_transfer(jit, x, x, -1); return 1;
+        case OP_DEY: emit_register_transfer(jit, y, y, -1); return 1;
+    }
+#endif
+    return 0;
+}
+
+/* jit_protect
+ *      DESCRIPTION: maps the code buffer read/write to emit or patch code, or read/execute to run it
+ *      INPUTS: jit -- translator state
+ *              writable -- nonzero for read/write, 0 for read/execute
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: changes protection of the code buffer
+ */
+static void jit_protect(JitState_t *jit, int writable) {
+    if (jit->writable == writable) {
+        return;
+    }
+    if (mprotect(jit->code, JIT_CODE_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) != 0) {
+        fprintf(stderr, "Failed to change protection of JIT code\n");
+        exit(ERR_NO_MEM);
+    }
+    jit->writable = writable;
+}
+
+/* jit_flush
+ *      DESCRIPTION: throws away all translated code
+ *      INPUTS: jit -- translator state
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: clears code_at, chains and code_page, rewinds code buffer, clears flush_pending
+ */
+static void jit_flush(JitState_t *jit) {
+    for (uint32_t i = 0; i < jit->num_blocks; i++) {
+        jit->code_at[jit->block_start[i]] = NULL;
+    }
+    jit->num_blocks = 0;
+    jit->num_chains = 0;
+    jit->code_free = jit->code_blocks;
+    memset(jit->code_page, 0, NUM_PAGES);
+    jit->flush_pending = 0;
+}
+
+/* jit_translate
+ *      DESCRIPTION: translates the basic block starting at start and links it with existing translations
+ *      INPUTS: jit -- translator state
+ *              memory -- memory holding the code
+ *              start -- address of first instruction
+ *      OUTPUTS: entry point of translated block, NULL if start can't be translated
+ *      SIDE EFFECTS: emits code, may flush all translations if the code buffer is full
+ */
+static uint8_t *jit_translate(JitState_t *jit, const uint8_t *memory, uint16_t start) {
+    // find the instructions in the block, stopping short of invalid opcodes and pages left to the interpreter
+    uint16_t address = start;
+    uint32_t num_instr = 0;
+    uint32_t base_cycles = 0;
+    uint8_t last_opcode = 0;
+    while (num_instr < jit_max_instructions) {
+        uint8_t opcode = memory[address];
+        uint16_t last_byte = address + opcode_length[opcode] - 1;
+        if (opcode_jumptable[opcode] == invalid_opcode ||
+            jit->no_jit_page[address >> 8] || jit->no_jit_page[last_byte >> 8]) {
+            break;
+        }
+        num_instr++;
+        base_cycles += opcode_cycles[opcode];
+        last_opcode = opcode;
+        address += opcode_length[opcode];
+        if (ends_block(opcode)) {
+            break;
+        }
+    }
+    if (num_instr == 0) {
+        return NULL;
+    }
+    uint16_t end = address; // address after last instruction
+
+    if (jit->code_free + JIT_BLOCK_SPACE > jit->code + JIT_CODE_SIZE) {
+        jit_flush(jit);
+    }
+    uint8_t *entry = jit->code_free;
+    jit->code_at[start] = entry;
+    jit->block_start[jit->num_blocks++] = start;
+    for (uint32_t page = start >> 8; ; page = (page + 1) % NUM_PAGES) {
+        jit->code_page[page] = 1;
+        if (page == (uint16_t)(end - 1) >> 8) {
+            break;
+        }
+    }
+
+    // prologue: leave if budget can't cover the block, else charge it and its base cycles
+    emit(jit, 0xFC8149, 3); // cmp r12, num_instr
+    emit(jit, num_instr, 4);
+    emit(jit, 0x820F, 2); // jb exit_budget
+    emit_rel32(jit, jit->exit_budget);
+    emit(jit, 0xEC8149, 3); // sub r12, num_instr
+    emit(jit, num_instr, 4);
+    emit_sf_op(jit, 0x8148, 2, 0, offsetof(sf_t, cycles)); // add qword [rbx + cycles], base_cycles
+    emit(jit, base_cycles, 4);
+
+    // body, remembering where to leave early after each store
+    uint8_t *flush_site[JIT_MAX_INSTRUCTIONS];
+    uint32_t cycles_after[JIT_MAX_INSTRUCTIONS];
+    uint32_t pc_in_sf = start; // value sf->pc holds at this point of the block
+    address = start;
+    for (uint32_t i = 0; i < num_instr; i++) {
+        uint8_t opcode = memory[address];
+        flush_site[i] = NULL;
+        base_cycles -= opcode_cycles[opcode];
+        cycles_after[i] = base_cycles;
+        if (!emit_native(jit, memory, address)) {
+            if (pc_in_sf != address) {
+                emit_set_pc(jit, address);
+            }
+            emit(jit, 0xDF8948, 3); // mov rdi, rbx
+            emit(jit, 0xB848, 2); // mov rax, handler
+            emit(jit, (uint64_t)(uintptr_t)opcode_jumptable[opcode], 8);
+            emit(jit, 0xD0FF, 2); // call rax
+            pc_in_sf = (uint16_t)(address + opcode_length[opcode]);
+            if (stores_memory(opcode) && opcode != OP_BRK) { // BRK leaves translated code anyway
+                emit(jit, 0x7D8041, 3); // cmp byte [r13 + flush_pending], 0
+                emit(jit, offsetof(JitState_t, flush_pending), 1);
+                emit(jit, 0, 1);
+                emit(jit, 0x850F, 2); // jne flush stub
+                flush_site[i] = emit_rel32(jit, jit->code_free);
+            }
+        }
+        address += opcode_length[opcode];
+    }
+
+    // epilogue: continue at next block
+    if (last_opcode == OP_BRK) {
+        emit_exit(jit, JIT_EXIT_BRK);
+    } else if ((last_opcode & 0x1F) == OP_BPL) {
+        uint16_t taken = end + (int8_t)memory[(uint16_t)(end - 1)];
+        emit_sf_op(jit, 0xB70F, 2, 0, offsetof(sf_t, pc)); // movzx eax, word [rbx + pc]
+        emit(jit, 0x3D, 1); // cmp eax, taken
+        emit(jit, taken, 4);
+        emit(jit, 0x840F, 2); // je taken
+        emit_chain(jit, taken);
+        emit(jit, 0xE9, 1); // jmp end
+        emit_chain(jit, end);
+    } else if (last_opcode == OP_JMP || last_opcode == OP_JSR) {
+        emit(jit, 0xE9, 1); // jmp target
+        emit_chain(jit, (memory[(uint16_t)(end - 1)] << 8) | memory[(uint16_t)(end - 2)]);
+    } else if (last_opcode == OP_RTS || last_opcode == OP_RTI || last_opcode == OP_JI) {
+        emit_sf_op(jit, 0xB70F, 2, 0, offsetof(sf_t, pc)); // movzx eax, word [rbx + pc]
+        emit(jit, 0xB948, 2); // mov rcx, code_at
+        emit(jit, (uint64_t)(uintptr_t)jit->code_at, 8);
+        emit(jit, 0xC10C8B48, 4); // mov rcx, [rcx + rax * 8]
+        emit(jit, 0xC98548, 3); // test rcx, rcx
+        emit(jit, 0x840F, 2); // je exit_cold
+        emit_rel32(jit, jit->exit_cold);
+        emit(jit, 0xE1FF, 2); // jmp rcx
+    } else { // block was cut short
+        if (pc_in_sf != end) {
+            emit_set_pc(jit, end);
+        }
+        emit(jit, 0xE9, 1); // jmp end
+        emit_chain(jit, end);
+    }
+
+    // flush stubs: give back budget and base cycles of the instructions after the store, then leave
+    for (uint32_t i = 0; i < num_instr; i++) {
+        if (flush_site[i] != NULL) {
+            patch_rel32(flush_site[i], jit->code_free);
+            emit(jit, 0xC48149, 3); // add r12, instructions after store
+            emit(jit, num_instr - i - 1, 4);
+            emit_sf_op(jit, 0x8148, 2, 5, offsetof(sf_t, cycles)); // sub qword [rbx + cycles], cycles_after
+            emit(jit, cycles_after[i], 4);
+            emit_exit(jit, JIT_EXIT_FLUSH);
+        }
+    }
+
+    // link jumps that were waiting for this block
+    for (uint32_t i = 0; i < jit->num_chains; ) {
+        if (jit->chains[i].target == start) {
+            patch_rel32(jit->chains[i].site, entry);
+            jit->chains[i] = jit->chains[--jit->num_chains];
+        } else {
+            i++;
+        }
+    }
+    return entry;
+}
+
+/* get_jit
+ *      DESCRIPTION: returns translator of calling thread, creating it and its fixed entry/exit code on first use
+ *      INPUTS: none
+ *      OUTPUTS: translator of calling thread, NULL if executable memory isn't available
+ *      SIDE EFFECTS: may allocate and map memory
+ */
+static JitState_t *get_jit(void) {
+    if (thread_jit != NULL || thread_jit_failed) {
+        return thread_jit;
+    }
+    uint8_t *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        thread_jit_failed = 1;
+        return NULL;
+    }
+    JitState_t *jit = (JitState_t *)calloc(1, sizeof(JitState_t));
+    if (jit == NULL) {
+        fprintf(stderr, "Failed to allocate memory for JIT\n");
+        exit(ERR_NO_MEM);
+    }
+    jit->code = code;
+    jit->code_free = code;
+    jit->writable = 1;
+
+    // int enter(sf_t *sf, uint64_t remaining, void *jit, uint8_t *block)
+    jit->enter = (int (*)(sf_t *, uint64_t, void *, uint8_t *))jit->code_free;
+    emit(jit, 0x53, 1); // push rbx
+    emit(jit, 0x5441, 2); // push r12
+    emit(jit, 0x5541, 2); // push r13 (also realigns the stack for handler calls)
+    emit(jit, 0xFB8948, 3); // mov rbx, rdi
+    emit(jit, 0xF48949, 3); // mov r12, rsi
+    emit(jit, 0xD58949, 3); // mov r13, rdx
+    emit(jit, 0xE1FF, 2); // jmp rcx
+
+    jit->exit_common = jit->code_free;
+    emit(jit, 0x0065894D, 4); // mov [r13 + remaining], r12
+    emit(jit, 0x5D41, 2); // pop r13
+    emit(jit, 0x5C41, 2); // pop r12
+    emit(jit, 0x5B, 1); // pop rbx
+    emit(jit, 0xC3, 1); // ret
+
+    jit->exit_cold = jit->code_free;
+    emit_exit(jit, JIT_EXIT_COLD);
+    jit->exit_budget = jit->code_free;
+    emit_exit(jit, JIT_EXIT_BUDGET);
+
+    jit->code_blocks = jit->code_free;
+    thread_jit = jit;
+    return jit;
+}
+
+/* jit_configure
+ *      DESCRIPTION: sets how many times a block is interpreted before it is translated and how long blocks may get
+ *                   (JIT_HOT_THRESHOLD and JIT_MAX_INSTRUCTIONS by default; the tests translate every instruction alone)
+ *      INPUTS: hot_threshold -- number of interpreted runs before translation, 0 to translate on first run
+ *              max_block_instructions -- maximum instructions per translated block, 1 to JIT_MAX_INSTRUCTIONS
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: changes translation of all threads for subsequent runs
+ */
+void jit_configure(uint32_t hot_threshold, uint32_t max_block_instructions) {
+    jit_hot_threshold = hot_threshold;
+    if (max_block_instructions < 1) {
+        max_block_instructions = 1;
+    } else if (max_block_instructions > JIT_MAX_INSTRUCTIONS) {
+        max_block_instructions = JIT_MAX_INSTRUCTIONS;
+    }
+    jit_max_instructions = max_block_instructions;
+}
+
+/* jit_run_instructions
+ *      DESCRIPTION: same as run_instructions, but hot blocks run as translated x86-64 code; translations stay from
+ *                   one call to the next, so memory written other than by the CPU on this thread needs
+ *                   invalidate_code
+ *      INPUTS: sf -- 6502 struct
+ *              num_instr -- maximum number of instructions to run
+ *      OUTPUTS: RUN_BRK if BRK was executed, RUN_BUDGET otherwise
+ *      SIDE EFFECTS: same as running process_line up to num_instr times, translates code of calling thread
+ */
+RunExit_t jit_run_instructions(sf_t *sf, uint64_t num_instr) {
+    JitState_t *jit = get_jit();
+    if (jit == NULL) {
+        return run_instructions(sf, num_instr);
+    }
+    if (claim_code(&jit->owner, sf)) {
+        jit_flush(jit);
+        memset(jit->no_jit_page, 0, NUM_PAGES);
+    }
+
+    RunExit_t exit_reason = RUN_BUDGET;
+    uint64_t remaining = num_instr;
+    while (remaining) {
+        if (jit->flush_pending) {
+            jit_flush(jit);
+        }
+
+        uint16_t pc = sf->pc;
+        uint8_t *block = jit->code_at[pc];
+        if (block == NULL && !jit->no_jit_page[pc >> 8]) {
+            if (jit->hits[pc] >= jit_hot_threshold) {
+                jit->hits[pc] = 0;
+                jit_protect(jit, 1);
+                block = jit_translate(jit, sf->memory, pc);
+            } else {
+                jit->hits[pc]++;
+            }
+        }
+
+        if (block != NULL) {
+            jit_protect(jit, 0);
+            int exit_code = (*jit->enter)(sf, remaining, jit, block);
+            remaining = jit->remaining;
+            if (exit_code == JIT_EXIT_BRK) {
+                exit_reason = RUN_BRK;
+                break;
+            }
+            if (exit_code == JIT_EXIT_BUDGET) { // fewer instructions left than in the next block
+                return run_instructions(sf, remaining);
+            }
+            continue;
+        }
+
+        // interpret one block
+        uint8_t opcode;
+        do {
+            opcode = sf->memory[sf->pc];
+            sf->cycles += opcode_cycles[opcode];
+            (*opcode_jumptable[opcode])(sf);
+            remaining--;
+        } while (remaining && !ends_block(opcode));
+        if (opcode == OP_BRK) {
+            exit_reason = RUN_BRK;
+            break;
+        }
+    }
+
+    sync_negative_and_zero(sf);
+    return exit_reason;
+}
+#else
+/* jit_configure
+ *      DESCRIPTION: no JIT on this host; does nothing
+ */
+void jit_configure(uint32_t hot_threshold, uint32_t max_block_instructions) {
+}
+
+/* jit_run_instructions
+ *      DESCRIPTION: no JIT on this host; same as run_instructions
+ */
+RunExit_t jit_run_instructions(sf_t *sf, uint64_t num_instr) {
+    return run_instructions(sf, num_instr);
 }
+#endif
@@ -4,9 +4,43 @@
 #include <stdint.h>
 
 #include "assembler/bytecode.h"
+#include "opcodes.h"
 
 #define MEMORY_SIZE     (65536)
-#define IRQ_ADDRESS     (0xFFFE)
+#define NUM_PAGES       (MEMORY_SIZE >> 8)
+#define NMI_ADDRESS     (0xFFFA) // vector taken by non-maskable interrupts
+#define RESET_ADDRESS   (0xFFFC) // vector taken on reset
+#define IRQ_ADDRESS     (0xFFFE) // vector taken by maskable interrupts; BRK jumps to this address itself
+
+// sets the bit of the page holding address in sf->dirty
+#define MARK_DIRTY(sf, address) ((sf)->dirty[(uint16_t)(address) >> 14] |= 1ull << (((uint16_t)(address) >> 8) & 63))
+
+/*
+ * when defined, instructions only record the byte that determines N and Z; the flags are built from it when
+ * an instruction reads them (BPL/BMI/BNE/BEQ, PHP, BRK, BIT) and before process_line/run_* return, so
+ * status is always up to date outside the CPU core
+ */
+#define LAZY_FLAGS
+
+/*
+ * when defined, jit_run_instructions translates basic blocks that have run JIT_HOT_THRESHOLD times into x86-64
+ * code that calls the opcode handlers (simple register and flag instructions are inlined) and jumps straight
+ * from block to block; everything else is interpreted; only available on x86-64 hosts with the System V ABI
+ */
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT
+#endif
+#define JIT_HOT_THRESHOLD       16
+#define JIT_MAX_INSTRUCTIONS    32
+
+/*
+ * when defined, operand reads and writes go through the page table in sf->bus: a page mapped to memory
+ * (bus_map_memory, as RAM, ROM or a mirror of other pages) is accessed directly with no call, any other page calls
+ * its device's read/write callbacks (bus_map_device); opcode and immediate operand fetches, zero page pointers,
+ * the stack and JMP indirect pointers always use sf->memory
+ * when not defined, every access goes straight to sf->memory (the raw-array build)
+ */
+#define MEMORY_BUS
 
 /*
  * opcodes are 8 bits long and have the general form AAABBBCC
@@ -116,16 +150,63 @@
 #define ADDR_MODE_IND               (0x0E) // only for indirect jump instruction
 
 
+/* EFFECTIVE ADDRESSES (of the operand selected by each addressing mode) */
+#define IND_X_ADDRESS       ((sf->memory[((sf->x_index + sf->memory[sf->pc + 1]) + 1) % 0xFF] << 8) | (sf->memory[(sf->x_index + sf->memory[sf->pc + 1]) % 0xFF])) // add x_index without carry
+#define ZPG_ADDRESS         (sf->memory[sf->pc + 1])
+#define IMM_ADDRESS         (sf->pc + 1)
+#define ABS_ADDRESS         ((sf->memory[sf->pc + 2] << 8)|sf->memory[sf->pc + 1])
+#define IND_Y_ADDRESS       (((sf->memory[sf->memory[sf->pc + 1] + 1] << 8)|sf->memory[sf->memory[sf->pc + 1]]) + sf->y_index)
+#define ZPG_X_ADDRESS       ((sf->memory[sf->pc + 1] + sf->x_index) % 0xFF) // add x_index without carry
+#define ZPG_Y_ADDRESS       ((sf->memory[sf->pc + 1] + sf->y_index) % 0xFF) // add x_index without carry
+#define ABS_Y_ADDRESS       ((((sf->memory[sf->pc + 2] << 8)|sf->memory[sf->pc + 1]) + sf->y_index) % 0xFFFF) // has carry, but can't have result outside address space
+#define ABS_X_ADDRESS       ((((sf->memory[sf->pc + 2] << 8)|sf->memory[sf->pc + 1]) + sf->x_index) % 0xFFFF)
+
 /* MEMORY ACCESS MACROS */
-#define IND_X_MEM_ACCESS    (sf->memory[((sf->memory[((sf->x_index + sf->memory[sf->pc + 1]) + 1) % 0xFF] << 8) | (sf->memory[(sf->x_index + sf->memory[sf->pc + 1]) % 0xFF]))]) // add x_index without carry
-#define ZPG_MEM_ACCESS      (sf->memory[sf->memory[sf->pc + 1]])
-#define IMM_MEM_ACCESS      (sf->memory[sf->pc + 1])
-#define ABS_MEM_ACCESS      (sf->memory[(sf->memory[sf->pc + 2] << 8)|sf->memory[sf->pc + 1]])
-#define IND_Y_MEM_ACCESS    (sf->memory[((sf->memory[sf->memory[sf->pc + 1] + 1] << 8)|sf->memory[sf->memory[sf->pc + 1]]) + sf->y_index])
-#define ZPG_X_MEM_ACCESS    (sf->memory[(sf->memory[sf->pc + 1] + sf->x_index) % 0xFF]) // add x_index without carry
-#define ZPG_Y_MEM_ACCESS    (sf->memory[(sf->memory[sf->pc + 1] + sf->y_index) % 0xFF]) // add x_index without carry
-#define ABS_Y_MEM_ACCESS    (sf->memory[(((sf->memory[sf->pc + 2] << 8)|sf->memory[sf->pc + 1]) + sf->y_index) % 0xFFFF]) // has carry, but can't have result outside address space
-#define ABS_X_MEM_ACCESS    (sf->memory[(((sf->memory[sf->pc + 2] << 8)|sf->memory[sf->pc + 1]) + sf->x_index) % 0xFFFF])
+#define IND_X_MEM_ACCESS    (sf->memory[IND_X_ADDRESS])
+#define ZPG_MEM_ACCESS      (sf->memory[ZPG_ADDRESS])
+#define IMM_MEM_ACCESS      (sf->memory[IMM_ADDRESS])
+#define ABS_MEM_ACCESS      (sf->memory[ABS_ADDRESS])
+#define IND_Y_MEM_ACCESS    (sf->memory[IND_Y_ADDRESS])
+#define ZPG_X_MEM_ACCESS    (sf->memory[ZPG_X_ADDRESS])
+#define ZPG_Y_MEM_ACCESS    (sf->memory[ZPG_Y_ADDRESS])
+#define ABS_Y_MEM_ACCESS    (sf->memory[ABS_Y_ADDRESS])
+#define ABS_X_MEM_ACCESS    (sf->memory[ABS_X_ADDRESS])
+
+/* reasons a batch run returns to its caller */
+typedef enum {
+    RUN_BUDGET = 0, // instruction or cycle budget exhausted
+    RUN_BRK,        // BRK was executed; pc is at the interrupt handler
+    RUN_STOP_PC,    // pc reached the requested stop address
+    RUN_BREAKPOINT  // a breakpoint or watchpoint armed with use_breakpoints was hit, see its hit_ fields
+} RunExit_t;
+
+/* PAGE CROSSING PENALTIES (1 if indexing carries into the high byte of the address, 0 otherwise) */
+#define IND_X_PAGE_PENALTY  (0)
+#define ZPG_PAGE_PENALTY    (0)
+#define IMM_PAGE_PENALTY    (0)
+#define ABS_PAGE_PENALTY    (0)
+#define IND_Y_PAGE_PENALTY  ((sf->memory[sf->memory[sf->pc + 1]] + sf->y_index) >> 8)
+#define ZPG_X_PAGE_PENALTY  (0)
+#define ZPG_Y_PAGE_PENALTY  (0)
+#define ABS_Y_PAGE_PENALTY  ((sf->memory[sf->pc + 1] + sf->y_index) >> 8)
+#define ABS_X_PAGE_PENALTY  ((sf->memory[sf->pc + 1] + sf->x_index) >> 8)
+
+#ifdef MEMORY_BUS
+typedef uint8_t (*BusRead_t)(void *context, uint16_t address); // returns byte read by the CPU at address
+typedef void (*BusWrite_t)(void *context, uint16_t address, uint8_t value); // takes byte written by the CPU
+
+#define BUS_CALLBACK (-1) // base of pages whose accesses call the device's callbacks
+
+/* one page (256 bytes) of the address space as the CPU sees it; pages backed by memory refer to it by offset
+ * into sf->memory, so a copy of sf_t accesses its own memory */
+typedef struct {
+    int32_t read_base; // offset in sf->memory of the bytes reads come from, or BUS_CALLBACK
+    int32_t write_base; // offset in sf->memory of the bytes writes go to, or BUS_CALLBACK
+    BusRead_t read_callback;
+    BusWrite_t write_callback;
+    void *context; // passed to both callbacks
+} BusPage_t;
+#endif
 
 /* struct for 6502 processor */
 typedef struct sf {
@@ -135,11 +216,112 @@ typedef struct sf {
     uint8_t status;
     uint16_t esp;
     uint16_t pc;
+    uint64_t cycles; // clock cycles elapsed since registers were initialized
+    uint64_t next_event; // run_cycles stops once cycles reaches this; lowered by schedule_event during a run
+    uint8_t nz_result; // last result affecting N and Z, only meaningful while nz_pending is set (LAZY_FLAGS)
+    uint8_t nz_pending; // set when N and Z in status are stale and must be built from nz_result (LAZY_FLAGS)
+    uint64_t dirty[NUM_PAGES / 64]; // bit per page of memory the CPU has written since the last sf_snapshot/sf_restore
+    uint64_t code_version; // set by invalidate_code, engines keeping decoded code from one run to the next check it
     uint8_t memory[MEMORY_SIZE];
+#ifdef MEMORY_BUS
+    BusPage_t bus[NUM_PAGES]; // mapping of every page, indexed by high byte of address
+    uint16_t mapped_pages; // pages of bus not mapped as RAM to the same page of memory (devices, ROM, mirrors)
+#endif
 } sf_t;
 
+#define IDLE_MAX_INSTRUCTIONS   64 // longest loop skip_idle_loop recognizes
+#define IDLE_MAX_CYCLES         (IDLE_MAX_INSTRUCTIONS * 7) // bound on cycles skip_idle_loop runs for (7 per instruction)
+#define MAX_INSTRUCTION_STORES  3 // most bytes one instruction writes (BRK pushes pc and status)
+#define SPAN_MAX_INSTRUCTIONS   16 // most instructions in one span recorded by record_run_instructions
+#define MAX_LOGGED_STORES       1024 // most stores one log holds, later ones aren't logged
+
+// bytes overwritten by the stores of one instruction (or of a run recorded by record_run_instructions), filled in
+// while passed to log_stores
+typedef struct StoreLog {
+    uint16_t count;
+    uint8_t old_values[MAX_LOGGED_STORES];
+    uint16_t addresses[MAX_LOGGED_STORES]; // offsets in sf->memory, in the order they were written
+} StoreLog_t;
+
+// registers before a span of instructions run by record_run_instructions, which goes up to and including the first
+// one that ends a block (branches, jumps, BRK...) or SPAN_MAX_INSTRUCTIONS of them
+typedef struct RunSpan {
+    uint16_t pc;
+    uint16_t esp;
+    uint8_t accumulator;
+    uint8_t x_index;
+    uint8_t y_index;
+    uint8_t status;
+    uint8_t num_instr;
+    uint8_t num_stores; // stores the span made, logged right after those of the span before
+    uint64_t cycles; // sf->cycles before the span
+} RunSpan_t;
+
+/* BREAKPOINT KINDS */
+#define BREAK_EXECUTE       (0x01) // stop before the instruction at the address runs
+#define BREAK_READ          (0x02) // stop after an instruction reads its operand from the address
+#define BREAK_WRITE         (0x04) // stop after an instruction writes its operand to the address
+
+#define BREAKPOINT_SET(bitmap, address) (((bitmap)[(address) >> 6] >> ((address) & 63)) & 1)
+
+// execution breakpoints and read/write watchpoints, a bit per address for each kind; set through debug/breakpoints.h
+// so the counts stay right, runs only pay for checking them while one is set
+typedef struct Breakpoints {
+    uint64_t execute[MEMORY_SIZE / 64];
+    uint64_t read[MEMORY_SIZE / 64];
+    uint64_t write[MEMORY_SIZE / 64];
+    uint32_t num_execute; // bits set in execute
+    uint32_t num_watch; // bits set in read and write
+    uint8_t hit_kind; // BREAK_ kinds that ended the last run with RUN_BREAKPOINT
+    uint16_t hit_address; // address they are set on
+    uint16_t hit_pc; // address of the instruction that hit them, for BREAK_EXECUTE the same as hit_address
+} Breakpoints_t;
+
+// executions and clock cycles of the instructions at every address, filled in by profile_run_cycles
+typedef struct Profile {
+    uint64_t executions[MEMORY_SIZE];
+    uint64_t cycles[MEMORY_SIZE]; // including page crossing and branch penalties
+} Profile_t;
+
+extern const uint8_t opcode_cycles[256]; // base clock cycles of every opcode
+extern const uint8_t opcode_length[256]; // length in bytes of every opcode
+extern const char * const opcode_mnemonic[256]; // mnemonic of every opcode, NULL if it has no instruction
+extern const uint8_t opcode_mode[256]; // OpcodeMode_t of every opcode
+
 void load_bytecode(sf_t *sf, Bytecode_t *bc, uint16_t load_address, uint32_t num_bytes);
 void initialize_regs(sf_t *sf, uint16_t pc_init);
 void process_line(sf_t *sf);
+RunExit_t run_instructions(sf_t *sf, uint64_t num_instr);
+RunExit_t local_pc_run_instructions(sf_t *sf, uint64_t num_instr);
+RunExit_t run_until(sf_t *sf, uint16_t stop_pc, uint64_t max_instr);
+RunExit_t run_cycles(sf_t *sf, uint64_t max_cycles);
+uint64_t skip_idle_loop(sf_t *sf, uint64_t cycle_limit);
+RunExit_t threaded_run_instructions(sf_t *sf, uint64_t num_instr);
+RunExit_t block_run_instructions(sf_t *sf, uint64_t num_instr);
+void invalidate_code(sf_t *sf);
+void profile_pairs(sf_t *sf, uint64_t num_instr, int top_n);
+RunExit_t profile_run_cycles(sf_t *sf, uint64_t max_cycles, Profile_t *profile);
+RunExit_t jit_run_instructions(sf_t *sf, uint64_t num_instr);
+void jit_configure(uint32_t hot_threshold, uint32_t max_block_instructions);
+void log_stores(StoreLog_t *log);
+RunExit_t record_run_instructions(sf_t *sf, uint64_t num_instr, RunSpan_t *spans, uint32_t max_spans,
+                                  uint32_t *num_spans, StoreLog_t *stores);
+void record_stores(sf_t *const *sfs, const uint16_t *addresses, uint32_t num_stores);
+void use_breakpoints(Breakpoints_t *breakpoints);
+RunExit_t step_instruction(sf_t *sf);
+void raise_interrupt(sf_t *sf, uint16_t vector);
+void reset_cpu(sf_t *sf);
+#ifdef MEMORY_BUS
+void initialize_bus(sf_t *sf);
+void bus_map_memory(sf_t *sf, uint8_t first_page, uint8_t last_page, uint8_t target_page, int writable);
+void bus_map_device(sf_t *sf, uint8_t first_page, uint8_t last_page, BusRead_t read, BusWrite_t write, void *context);
+uint8_t bus_read(sf_t *sf, uint16_t address);
+void bus_write(sf_t *sf, uint16_t address, uint8_t value);
+#endif
+void build_arithmetic_tables(void);
+void ADC_arithmetic(sf_t *sf, uint8_t *operand);
+void SBC_arithmetic(sf_t *sf, uint8_t *operand);
+void ADC_lookup(sf_t *sf, uint8_t *operand);
+void SBC_lookup(sf_t *sf, uint8_t *operand);
 
 #endif
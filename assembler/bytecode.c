@@ -49,7 +49,7 @@ static int expand_bytecode(Bytecode_t *bc) {
  *      SIDE EFFECTS: adds bytes to bytecode, increases index field of bytecode
  */
 void add_to_bytecode(Bytecode_t *bc, uint8_t *write_buf, uint32_t num_bytes, uint32_t line_number) {
-    if ((num_bytes + bc->index) >= bc->size - 1) {
+    while ((num_bytes + bc->index) >= bc->size - 1) {
         if (expand_bytecode(bc) == -1) {
             fprintf(stderr, "Error at line %d: bytecode memory allocation failed", line_number);
             exit(ERR_NO_MEM);
@@ -63,11 +63,12 @@ void add_to_bytecode(Bytecode_t *bc, uint8_t *write_buf, uint32_t num_bytes, uin
  *      DESCRIPTION: creates new program of passed size
  *      INPUTS: initial number of pieces of bytecode for new program
  *      OUTPUTS: p -- new program
- *      SIDE EFFECTS: allocates memory for new program, initializes fields of new program
+ *      SIDE EFFECTS: allocates memory for new program, initializes fields of new program, clears its line map
  */
 Program_t* new_program(uint32_t size) {
     Program_t *p = (Program_t *)malloc(sizeof(Program_t));
     p->start = (Bytecode_t *)malloc(size * sizeof(Bytecode_t));
+    p->lines = (uint32_t *)calloc(PROGRAM_ADDRESSES, sizeof(uint32_t));
     p->index = 0;
     p->size = size;
     return p;
@@ -84,6 +85,7 @@ void free_program(Program_t *p) {
         free(p->start[i].start);
     }
     free(p->start);
+    free(p->lines);
     free(p);
 }
 
@@ -94,7 +96,7 @@ void free_program(Program_t *p) {
  *      SIDE EFFECTS: increases size of passed program
  */
 static int expand_program(Program_t *p) {
-    p->start = (Bytecode_t *)realloc(p->start, p->size * PROGRAM_GROWTH_FACTOR);
+    p->start = (Bytecode_t *)realloc(p->start, p->size * PROGRAM_GROWTH_FACTOR * sizeof(Bytecode_t));
     if (p->start == NULL) {
         return -1;
     }
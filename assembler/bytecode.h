@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#define PROGRAM_ADDRESSES       65536 // entries in a program's line map, one per address
+
 // an expandable container of bytecode with a specific load address
 typedef struct {
     uint8_t *start;
@@ -16,6 +18,7 @@ typedef struct {
     Bytecode_t *start;
     uint32_t size;
     uint32_t index;
+    uint32_t *lines; // source line of the instruction starting at each address, 0 where none does
 } Program_t;
 
 void add_to_bytecode(Bytecode_t *bc, uint8_t *write_buf, uint32_t num_bytes, uint32_t line_number);
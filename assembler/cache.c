@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+#define FNV_OFFSET_BASIS    0xCBF29CE484222325ull
+#define FNV_PRIME           0x00000100000001B3ull
+
+/* ASSEMBLY CACHE
+ * the output of assembling a source (its segments, the memory it leaves behind, which includes what directives
+ * write, its line map and its labels) is written beside it, keyed by a hash of the source text; when the hash
+ * matches, the program is rebuilt from one mapping of that file instead of being assembled again, so loading
+ * costs the same however long the source is
+ * a cache that is missing, stale or malformed is just a miss, and a cache that can't be written is skipped
+ */
+
+/* hash_source
+ *      DESCRIPTION: hashes source text (64-bit FNV-1a)
+ *      INPUTS: sf_asm -- source text
+ *              length -- number of characters in source text
+ *      OUTPUTS: hash of source text
+ *      SIDE EFFECTS: none
+ */
+uint64_t hash_source(const uint8_t *sf_asm, uint32_t length) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (uint32_t i = 0; i < length; i++) {
+        hash = (hash ^ sf_asm[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/* cache_path
+ *      DESCRIPTION: returns the path of the cache of passed source, which the caller frees
+ */
+static char *cache_path(const char *source_path) {
+    char *path = (char *)malloc(strlen(source_path) + sizeof(ASM_CACHE_SUFFIX));
+    strcpy(path, source_path);
+    strcat(path, ASM_CACHE_SUFFIX);
+    return path;
+}
+
+/* cache_size
+ *      DESCRIPTION: returns the size in bytes of a cache file with passed header
+ */
+static uint64_t cache_size(const AsmCacheHeader_t *header) {
+    return sizeof(AsmCacheHeader_t) + (uint64_t)header->num_segments * sizeof(AsmCacheSegment_t) +
+           PROGRAM_ADDRESSES * sizeof(uint32_t) + (uint64_t)header->num_labels * sizeof(AsmCacheLabel_t) +
+           header->segment_bytes + MEMORY_SIZE + header->name_bytes;
+}
+
+/* load_cached_program
+ *      DESCRIPTION: loads the program assembled from passed source out of its cache, if the cache was written for
+ *                   this exact source text
+ *      INPUTS: sf -- pointer to 6502 struct to load program into
+ *              source_path -- path of source file
+ *              sf_asm -- source text read from source_path
+ *              label_table_dbl_ptr -- double pointer to empty label table, filled with the labels of the program
+ *      OUTPUTS: the program, NULL if there is no cache for this source text (sf and the label table are untouched)
+ *      SIDE EFFECTS: on a hit, sets memory of sf to what assembling the program left behind, allocates memory for
+ *                    returned program and adds to label table
+ */
+Program_t *load_cached_program(sf_t *sf, const char *source_path, const uint8_t *sf_asm,
+                               Table_t **label_table_dbl_ptr) {
+    char *path = cache_path(source_path);
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(AsmCacheHeader_t)) {
+        close(fd);
+        return NULL;
+    }
+    uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    const AsmCacheHeader_t *header = (const AsmCacheHeader_t *)map;
+    uint32_t length = strlen((const char *)sf_asm);
+    if (header->magic != ASM_CACHE_MAGIC || header->version != ASM_CACHE_VERSION ||
+        header->source_length != length || header->num_segments == 0 || cache_size(header) != st.st_size ||
+        header->source_hash != hash_source(sf_asm, length)) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    const AsmCacheSegment_t *segments = (const AsmCacheSegment_t *)(header + 1);
+    const uint32_t *lines = (const uint32_t *)(segments + header->num_segments);
+    const AsmCacheLabel_t *labels = (const AsmCacheLabel_t *)(lines + PROGRAM_ADDRESSES);
+    const uint8_t *segment_bytes = (const uint8_t *)(labels + header->num_labels);
+    const uint8_t *image = segment_bytes + header->segment_bytes;
+    const char *names = (const char *)(image + MEMORY_SIZE);
+
+    // a file of the right size can still be garbage, so check everything that is used to index it
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < header->num_segments; i++) {
+        total += segments[i].length;
+    }
+    int valid = total == header->segment_bytes && (header->num_labels == 0 || names[header->name_bytes - 1] == '\0');
+    for (uint32_t i = 0; valid && i < header->num_labels; i++) {
+        valid = labels[i].name_offset < header->name_bytes;
+    }
+    if (!valid) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    Program_t *p = new_program(header->num_segments + 1);
+    for (uint32_t i = 0; i < header->num_segments; i++) {
+        open_bytecode(p, segments[i].load_address, 0);
+        add_to_bytecode(p->start + p->index - 1, (uint8_t *)segment_bytes, segments[i].length, 0);
+        segment_bytes += segments[i].length;
+    }
+    memcpy(p->lines, lines, PROGRAM_ADDRESSES * sizeof(uint32_t));
+    memcpy(sf->memory, image, MEMORY_SIZE);
+    for (uint32_t i = 0; i < header->num_labels; i++) {
+        add_to_table(label_table_dbl_ptr, (char *)names + labels[i].name_offset, labels[i].value);
+    }
+
+    munmap(map, st.st_size);
+    return p;
+}
+
+/* save_cached_program
+ *      DESCRIPTION: writes the cache of passed source, replacing any it had
+ *      INPUTS: sf -- pointer to 6502 struct the program was just assembled into
+ *              source_path -- path of source file
+ *              sf_asm -- source text read from source_path
+ *              p -- program assembled from sf_asm
+ *              label_table -- label table of program
+ *      OUTPUTS: 0 on success, -1 if the cache couldn't be written
+ *      SIDE EFFECTS: writes cache file beside source file
+ */
+int save_cached_program(const sf_t *sf, const char *source_path, const uint8_t *sf_asm, const Program_t *p,
+                        const Table_t *label_table) {
+    AsmCacheHeader_t header = {0};
+    header.magic = ASM_CACHE_MAGIC;
+    header.version = ASM_CACHE_VERSION;
+    header.source_length = strlen((const char *)sf_asm);
+    header.source_hash = hash_source(sf_asm, header.source_length);
+    header.num_segments = p->index;
+    for (uint32_t i = 0; i < p->index; i++) {
+        header.segment_bytes += p->start[i].index;
+    }
+    for (uint32_t i = 0; i < label_table->size; i++) {
+        if (label_table->data[i].key != NULL) {
+            header.num_labels++;
+            header.name_bytes += strlen(label_table->data[i].key) + 1;
+        }
+    }
+
+    // written under a temporary name of its own in the same directory and renamed, so a cache is never seen half
+    // written and processes saving the same cache at once don't write into each other's file
+    char *path = cache_path(source_path);
+    char *temp_path = (char *)malloc(strlen(path) + 8);
+    sprintf(temp_path, "%s.XXXXXX", path);
+    int fd = mkstemp(temp_path);
+    FILE *fp = fd == -1 ? NULL : fdopen(fd, "wb");
+    if (fp == NULL) {
+        if (fd != -1) {
+            close(fd);
+            remove(temp_path);
+        }
+        free(path);
+        free(temp_path);
+        return -1;
+    }
+    fwrite(&header, sizeof(header), 1, fp);
+    for (uint32_t i = 0; i < p->index; i++) {
+        AsmCacheSegment_t segment = {p->start[i].load_address, 0, p->start[i].index};
+        fwrite(&segment, sizeof(segment), 1, fp);
+    }
+    fwrite(p->lines, sizeof(uint32_t), PROGRAM_ADDRESSES, fp);
+    uint32_t name_offset = 0;
+    for (uint32_t i = 0; i < label_table->size; i++) {
+        if (label_table->data[i].key != NULL) {
+            AsmCacheLabel_t label = {name_offset, label_table->data[i].value, 0};
+            fwrite(&label, sizeof(label), 1, fp);
+            name_offset += strlen(label_table->data[i].key) + 1;
+        }
+    }
+    for (uint32_t i = 0; i < p->index; i++) {
+        fwrite(p->start[i].start, 1, p->start[i].index, fp);
+    }
+    fwrite(sf->memory, 1, MEMORY_SIZE, fp);
+    for (uint32_t i = 0; i < label_table->size; i++) {
+        if (label_table->data[i].key != NULL) {
+            fwrite(label_table->data[i].key, 1, strlen(label_table->data[i].key) + 1, fp);
+        }
+    }
+    int failed = ferror(fp);
+    failed |= fclose(fp) != 0;
+    if (failed || rename(temp_path, path) != 0) {
+        remove(temp_path);
+        failed = 1;
+    }
+    free(path);
+    free(temp_path);
+    return failed ? -1 : 0;
+}
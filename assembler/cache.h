@@ -0,0 +1,48 @@
+#ifndef __CACHE_H
+#define __CACHE_H
+
+#include <stdint.h>
+
+#include "../6502.h"
+#include "bytecode.h"
+#include "table.h"
+
+#define ASM_CACHE_SUFFIX        ".cache" // the cache of a source is kept beside it, at its path with this appended
+#define ASM_CACHE_MAGIC         0x43413536 // "65AC"
+#define ASM_CACHE_VERSION       2 // bump whenever the assembler would emit something different for the same source
+
+// start of a cache file, followed by the segments (AsmCacheSegment_t), the line map, the labels (AsmCacheLabel_t),
+// then the bytes of the segments, the memory image and the NUL-terminated label names; the fixed-size records come
+// first so every one of them is aligned in the mapped file
+typedef struct AsmCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_hash;
+    uint32_t source_length;
+    uint32_t num_segments;
+    uint32_t segment_bytes; // bytes in all segments together
+    uint32_t num_labels;
+    uint32_t name_bytes; // bytes in all label names together, NULs included
+    uint32_t reserved;
+} AsmCacheHeader_t;
+
+// one piece of bytecode of the program
+typedef struct AsmCacheSegment {
+    uint16_t load_address;
+    uint16_t reserved;
+    uint32_t length;
+} AsmCacheSegment_t;
+
+typedef struct AsmCacheLabel {
+    uint32_t name_offset; // from the first name
+    uint16_t value;
+    uint16_t reserved;
+} AsmCacheLabel_t;
+
+uint64_t hash_source(const uint8_t *sf_asm, uint32_t length);
+Program_t *load_cached_program(sf_t *sf, const char *source_path, const uint8_t *sf_asm,
+                               Table_t **label_table_dbl_ptr);
+int save_cached_program(const sf_t *sf, const char *source_path, const uint8_t *sf_asm, const Program_t *p,
+                        const Table_t *label_table);
+
+#endif
@@ -0,0 +1,70 @@
+#include <stddef.h>
+
+#include "encoder.h"
+#include "../6502.h"
+
+/* ENCODER
+ * generated from OPCODE_TABLE, one entry per mnemonic holding its opcode in every addressing mode; a mnemonic's three
+ * characters, case-folded, are packed into a 24-bit key, and multiplying that by MNEMONIC_MULTIPLIER and keeping the
+ * top MNEMONIC_SLOT_BITS bits gives every mnemonic a slot of its own, so a lookup is one multiply and one compare
+ * C can't index an initializer by a hash of a string, so the slots are filled from OPCODE_TABLE on first lookup
+ * the parser gives the modes that share ADDR_MODE_ values (accumulator and immediate, zero page x and y-indexed)
+ * values of their own, which are the ones mnemonics are keyed by
+ */
+
+#define MNEMONIC_SLOT_BITS      7
+#define MNEMONIC_SLOTS          (1 << MNEMONIC_SLOT_BITS)
+#define MNEMONIC_MULTIPLIER     0x01F75FC5u // found by search, gives each of the 56 mnemonics a slot of its own
+#define CASE_FOLD               0xDF // clears the bit that makes a letter lower case
+
+#define MNEMONIC_KEY(name)      ((((uint32_t)(name)[0] & CASE_FOLD) << 16) | (((uint32_t)(name)[1] & CASE_FOLD) << 8) | \
+                                 ((uint32_t)(name)[2] & CASE_FOLD))
+#define MNEMONIC_SLOT(key)      (((uint32_t)(key) * MNEMONIC_MULTIPLIER) >> (32 - MNEMONIC_SLOT_BITS))
+
+#define PARSED_IND_X    ADDR_MODE_IND_X
+#define PARSED_ZPG      ADDR_MODE_ZPG
+#define PARSED_IMM      ADDR_MODE_IMM
+#define PARSED_ABS      ADDR_MODE_ABS
+#define PARSED_IND_Y    ADDR_MODE_IND_Y
+#define PARSED_ZPG_X    ADDR_MODE_ZPG_X
+#define PARSED_ABS_Y    ADDR_MODE_ABS_Y
+#define PARSED_ABS_X    ADDR_MODE_ABS_X
+#define PARSED_IMP      ADDR_MODE_IMP
+#define PARSED_ACCUM    ADDR_MODE_ACCUM_GEN
+#define PARSED_ZPG_Y    ADDR_MODE_ZPG_Y_GEN
+#define PARSED_REL      ADDR_MODE_REL
+#define PARSED_IND      ADDR_MODE_IND
+
+#define ENCODING_ENTRY(mnemonic, mode, opcode, length, cycles, penalty, handler) \
+    add_encoding(#mnemonic, PARSED_##mode, opcode);
+
+static Mnemonic_t mnemonics[MNEMONIC_SLOTS];
+static int mnemonics_filled = 0;
+
+/* add_encoding
+ *      DESCRIPTION: adds opcode of mnemonic in passed addressing mode to the slot of mnemonic
+ */
+static void add_encoding(const char *name, uint8_t addressing_mode, uint8_t opcode) {
+    uint32_t key = MNEMONIC_KEY(name);
+    Mnemonic_t *mnemonic = &mnemonics[MNEMONIC_SLOT(key)];
+    mnemonic->key = key;
+    mnemonic->modes |= 1 << addressing_mode;
+    mnemonic->opcodes[addressing_mode] = opcode;
+    mnemonic->branch |= addressing_mode == ADDR_MODE_REL;
+}
+
+/* find_mnemonic
+ *      DESCRIPTION: looks up the three character mnemonic at passed pointer
+ *      INPUTS: name -- pointer to first character of mnemonic (either case)
+ *      OUTPUTS: pointer to mnemonic, NULL if there is no such instruction
+ *      SIDE EFFECTS: fills mnemonic slots on first call
+ */
+const Mnemonic_t *find_mnemonic(const uint8_t *name) {
+    if (!mnemonics_filled) {
+        OPCODE_TABLE(ENCODING_ENTRY)
+        mnemonics_filled = 1;
+    }
+    uint32_t key = MNEMONIC_KEY(name);
+    const Mnemonic_t *mnemonic = &mnemonics[MNEMONIC_SLOT(key)];
+    return mnemonic->modes != 0 && mnemonic->key == key ? mnemonic : NULL;
+}
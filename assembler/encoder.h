@@ -0,0 +1,20 @@
+#ifndef __ENCODER_H
+#define __ENCODER_H
+
+#include <stdint.h>
+
+#define ADDR_MODES          16 // ADDR_MODE_ values an operand can parse to are all below this
+
+// instruction the assembler can emit, in every addressing mode it has
+typedef struct Mnemonic {
+    uint32_t key; // case-folded characters of mnemonic, 0 for an empty slot
+    uint16_t modes; // bit per ADDR_MODE_ value mnemonic has an opcode for
+    uint8_t branch; // whether OPC LABEL is relative
+    uint8_t opcodes[ADDR_MODES]; // opcode of mnemonic in each addressing mode in modes
+} Mnemonic_t;
+
+#define HAS_MODE(mnemonic, addressing_mode)     ((mnemonic)->modes & (1 << (addressing_mode)))
+
+const Mnemonic_t *find_mnemonic(const uint8_t *name);
+
+#endif
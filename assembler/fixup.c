@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../lib/lib.h"
+#include "fixup.h"
+
+#define FIXUP_LIST_GROWTH_FACTOR    2
+
+/* new_fixup_list
+ *      DESCRIPTION: creates new fixup list of passed size
+ *      INPUTS: size -- initial number of fixups for new fixup list
+ *      OUTPUTS: f -- new fixup list
+ *      SIDE EFFECTS: allocates memory for new fixup list, initializes fields of new fixup list
+ */
+FixupList_t *new_fixup_list(uint32_t size) {
+    FixupList_t *f = (FixupList_t *)malloc(sizeof(FixupList_t));
+    f->start = (Fixup_t *)malloc(size * sizeof(Fixup_t));
+    f->index = 0;
+    f->size = size;
+    return f;
+}
+
+/* free_fixup_list
+ *      DESCRIPTION: frees memory allocated for passed fixup list, including the labels of its fixups
+ *      INPUTS: f -- fixup list to free
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: frees memory allocated for passed fixup list
+ */
+void free_fixup_list(FixupList_t *f) {
+    for (uint32_t i = 0; i < f->index; i++) {
+        free(f->start[i].label);
+    }
+    free(f->start);
+    free(f);
+}
+
+/* expand_fixup_list
+ *      DESCRIPTION: increases size of passed fixup list by a factor of FIXUP_LIST_GROWTH_FACTOR, keeping preexisting
+ *                   fixups intact
+ *      INPUTS: f -- fixup list to expand
+ *      OUTPUTS: -1 if size increase fails, 0 if success
+ *      SIDE EFFECTS: increases size of passed fixup list
+ */
+static int expand_fixup_list(FixupList_t *f) {
+    f->start = (Fixup_t *)realloc(f->start, f->size * FIXUP_LIST_GROWTH_FACTOR * sizeof(Fixup_t));
+    if (f->start == NULL) {
+        return -1;
+    }
+    f->size *= FIXUP_LIST_GROWTH_FACTOR;
+    return 0;
+}
+
+/* add_to_fixup_list
+ *      DESCRIPTION: copies fixup into fixup list, expanding if necessary
+ *      INPUTS: f -- fixup list to add fixup to
+ *              fixup -- fixup to add, whose label is then owned by fixup list
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: adds fixup to fixup list, increases index field of fixup list
+ */
+void add_to_fixup_list(FixupList_t *f, Fixup_t *fixup) {
+    if (f->index >= f->size) {
+        if (expand_fixup_list(f) == -1) {
+            fprintf(stderr, "Error at line %d: fixup memory allocation failed", fixup->line_num);
+            exit(ERR_NO_MEM);
+        }
+    }
+    memcpy(f->start + f->index, fixup, sizeof(Fixup_t));
+    f->index++;
+}
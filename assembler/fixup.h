@@ -0,0 +1,33 @@
+#ifndef __FIXUP_H
+#define __FIXUP_H
+
+#include <stdint.h>
+
+// how the address of a label is written into the operand of an instruction
+typedef enum {
+    FIXUP_ABSOLUTE = 0, // low byte then high byte
+    FIXUP_ZERO_PAGE,    // low byte, label must be in zero page
+    FIXUP_RELATIVE      // offset from the instruction following the branch
+} FixupKind_t;
+
+// operand of an instruction naming a label that wasn't defined when the instruction was generated
+typedef struct Fixup {
+    char *label;
+    FixupKind_t kind;
+    uint32_t bytecode_index; // index of bytecode in program holding instruction
+    uint32_t opcode_index; // index of opcode of instruction in that bytecode
+    uint32_t line_num;
+} Fixup_t;
+
+// an expandable container of fixups
+typedef struct FixupList {
+    Fixup_t *start;
+    uint32_t index;
+    uint32_t size;
+} FixupList_t;
+
+FixupList_t *new_fixup_list(uint32_t size);
+void free_fixup_list(FixupList_t *f);
+void add_to_fixup_list(FixupList_t *f, Fixup_t *fixup);
+
+#endif
@@ -5,351 +5,21 @@
 #include "../lib/lib.h"
 #include "generator.h"
 #include "../6502.h"
-#include "addressing_jumptable.h"
+#include "encoder.h"
 #include "table.h"
+#include "scanner.h"
+#include "fixup.h"
 
 #define PROGRAM_INIT_SIZE       256
+#define FIXUP_LIST_INIT_SIZE    256
 
-/* determine_opcode
- *      DESCRIPTION: determines opcode of token corresponding to passed pointer
- *      INPUTS: curr_char_ptr -- pointer to starting character of instruction token
- *      OUTPUTS: opcode of line on success, 0xFF on failure
- *      SIDE EFFECTS: none
+/* SINGLE PASS
+ * each line is generated as soon as it is scanned; an operand naming a label that isn't defined yet is generated
+ * as 0 and recorded in a fixup list, which is patched once every label is known, so the source is only walked once
+ * and no tokens outlive their line
+ * instruction lengths only depend on how operands are written, never on label values, so nothing generated after
+ * a fixup moves when it is patched
  */
-static uint8_t determine_opcode(uint8_t *curr_char_ptr) {
-    switch (*curr_char_ptr) {
-        case 'A':
-            switch (*(++curr_char_ptr)) {
-                case 'D':
-                    if (*(++curr_char_ptr) == 'C') {
-                        return OP_ADC;
-                    }
-                    break;
-                case 'N':
-                    if (*(++curr_char_ptr) == 'D') {
-                        return OP_AND;
-                    }
-                    break;
-                case 'S':
-                    if (*(++curr_char_ptr) == 'L') {
-                        return OP_ASL;
-                    }
-                    break;
-                default:
-                    break;
-            }
-            break;
-
-        case 'B':
-            switch (*(++curr_char_ptr)) {
-                case 'C':
-                    curr_char_ptr++;
-                    if (*curr_char_ptr == 'C') {
-                        return OP_BCC;
-                    } else if (*curr_char_ptr == 'S') {
-                        return OP_BCS;
-                    }
-                    break;
-                case 'E':
-                    if (*(++curr_char_ptr) == 'Q') {
-                        return OP_BEQ;
-                    }
-                    break;
-                case 'I':
-                    if (*(++curr_char_ptr) == 'T') {
-                        return OP_BIT;
-                    }
-                    break;
-                case 'M':
-                    if (*(++curr_char_ptr) == 'I') {
-                        return OP_BMI;
-                    }
-                    break;
-                case 'N':
-                    if (*(++curr_char_ptr) == 'E') {
-                        return OP_BNE;
-                    }
-                    break;
-                case 'P':
-                    if (*(++curr_char_ptr) == 'L') {
-                        return OP_BPL;
-                    }
-                    break;
-                case 'R':
-                    if (*(++curr_char_ptr) == 'K') {
-                        return OP_BRK;
-                    }
-                    break;
-                case 'V':
-                    curr_char_ptr++;
-                    if (*curr_char_ptr == 'C') {
-                        return OP_BVC;
-                    } else if (*curr_char_ptr == 'S') {
-                        return OP_BVS;
-                    }
-                    break;
-                default:
-                    break;
-            }
-            break;
-        
-        case 'C':
-            switch (*(++curr_char_ptr)) {
-                case 'L':
-                    switch (*(++curr_char_ptr)) {
-                        case 'C':
-                            return OP_CLC;
-                        case 'D':
-                            return OP_CLD;
-                        case 'I':
-                            return OP_CLI;
-                        case 'V':
-                            return OP_CLV;
-                        default:
-                            break;
-                    }
-                    break;
-                case 'M':
-                    if (*(++curr_char_ptr) == 'P') {
-                        return OP_CMP;
-                    }
-                    break;
-                case 'P':
-                    curr_char_ptr++;
-                    if (*curr_char_ptr == 'X') {
-                        return OP_CPX;
-                    } else if (*curr_char_ptr == 'Y') {
-                        return OP_CPY;
-                    }
-                    break;
-                default:
-                    break;
-            }
-            break;
-        
-        case 'D':
-            if (*(++curr_char_ptr) == 'E') {
-                switch (*(++curr_char_ptr)) {
-                    case 'C':
-                        return OP_DEC;
-                    case 'X':
-                        return OP_DEX;
-                    case 'Y':
-                        return OP_DEY;
-                    default:
-                        break;
-                }
-            }
-            break;
-        
-        case 'E':
-            if (*(++curr_char_ptr) == 'O') {
-                if (*(++curr_char_ptr) == 'R') {
-                    return OP_EOR;
-                }
-            }
-            break;
-        
-        case 'I':
-            if (*(++curr_char_ptr) == 'N') {
-                switch (*(++curr_char_ptr)) {
-                    case 'C':
-                        return OP_INC;
-                    case 'X':
-                        return OP_INX;
-                    case 'Y':
-                        return OP_INY;
-                    default:
-                        break;
-                }
-            }
-            break;
-        
-        case 'J':
-            curr_char_ptr++;
-            if (*curr_char_ptr == 'M') {
-                if (*(++curr_char_ptr) == 'P') {
-                    return OP_JMP;
-                }
-            } else if (*curr_char_ptr == 'S') {
-                if (*(++curr_char_ptr) == 'R') {
-                    return OP_JSR_GEN;
-                }
-            }
-            break;
-        
-        case 'L':
-            curr_char_ptr++;
-            if (*curr_char_ptr == 'D') {
-                switch(*(++curr_char_ptr)) {
-                    case 'A':
-                        return OP_LDA;
-                        break;
-                    case 'X':
-                        return OP_LDX;
-                        break;
-                    case 'Y':
-                        return OP_LDY;
-                        break;
-                    default:
-                        break;
-                }
-            } else if (*curr_char_ptr == 'S') {
-                if (*(++curr_char_ptr) == 'R') {
-                    return OP_LSR;
-                }
-            }
-            break;
-
-        case 'N':
-            if (*(++curr_char_ptr) == 'O') {
-                if (*(++curr_char_ptr) == 'P') {
-                    return OP_NOP;
-                }
-            }
-            break;
-        
-        case 'O':
-            if (*(++curr_char_ptr) == 'R') {
-                if (*(++curr_char_ptr) == 'A') {
-                    return OP_ORA;
-                }
-            }
-            break;
-        
-        case 'P':
-            curr_char_ptr++;
-            if (*curr_char_ptr == 'H') {
-                curr_char_ptr++;
-                if (*curr_char_ptr == 'A') {
-                    return OP_PHA;
-                } else if (*curr_char_ptr == 'P') {
-                    return OP_PHP;
-                }
-            } else if (*curr_char_ptr == 'L') {
-                curr_char_ptr++;
-                if (*curr_char_ptr == 'A') {
-                    return OP_PLA;
-                } else if (*curr_char_ptr == 'P') {
-                    return OP_PLP;
-                }
-            }
-            break;
-        
-        case 'R':
-            curr_char_ptr++;
-            if (*curr_char_ptr == 'O') {
-                curr_char_ptr++;
-                if (*curr_char_ptr == 'L') {
-                    return OP_ROL;
-                } else if (*curr_char_ptr == 'R') {
-                    return OP_ROR;
-                }
-            } else if (*curr_char_ptr == 'T') {
-                curr_char_ptr++;
-                if (*curr_char_ptr == 'I') {
-                    return OP_RTI;
-                } else if (*curr_char_ptr == 'S') {
-                    return OP_RTS;
-                }
-            }
-            break;
-        
-        case 'S':
-            switch (*(++curr_char_ptr)) {
-                case 'B':
-                    if (*(++curr_char_ptr) == 'C') {
-                        return OP_SBC;
-                    }
-                    break;
-                case 'E':
-                    switch (*(++curr_char_ptr)) {
-                        case 'C':
-                            return OP_SEC;
-                        case 'D':
-                            return OP_SED;
-                        case 'I':
-                            return OP_SEI;
-                        default:
-                            break;
-                    }
-                    break;
-                case 'T':
-                    switch (*(++curr_char_ptr)) {
-                        case 'A':
-                            return OP_STA;
-                        case 'X':
-                            return OP_STX;
-                        case 'Y':
-                            return OP_STY;
-                        default:
-                            break;
-                    }
-                    break;
-                default:
-                    break;
-            }
-            break;
-        
-        case 'T':
-            switch (*(++curr_char_ptr)) {
-                case 'A':
-                    curr_char_ptr++;
-                    if (*curr_char_ptr == 'X') {
-                        return OP_TAX;
-                    } else if (*curr_char_ptr == 'Y') {
-                        return OP_TAY;
-                    }
-                    break;
-                case 'S':
-                    if (*(++curr_char_ptr) == 'X') {
-                        return OP_TSX;
-                    }
-                    break;
-                case 'X':
-                    curr_char_ptr++;
-                    if (*curr_char_ptr == 'A') {
-                        return OP_TXA;
-                    } else if (*curr_char_ptr == 'S') {
-                        return OP_TXS;
-                    }
-                    break;
-                case 'Y':
-                    if (*(++curr_char_ptr) == 'A') {
-                        return OP_TYA;
-                    }
-                    break;
-                default:
-                    break;
-            }
-            break;
-    
-        default:
-            break;
-    }
-
-    return INVALID_OPCODE; // placeholder invalid opcode
-}
-
-/* is_branch_instruction
- *      DESCRIPTION: determines if passed instruction is a branch instruction
- *      INPUTS: opcode -- opcode of instruction we want to check
- *      OUTPUTS: 1 if instruction is branch instruction, 0 otherwise
- *      SIDE EFFECTS: none
- */
-static uint8_t is_branch_instruction(uint8_t opcode) {
-    if (opcode == OP_BPL ||
-        opcode == OP_BMI ||
-        opcode == OP_BVC ||
-        opcode == OP_BVS ||
-        opcode == OP_BCC ||
-        opcode == OP_BCS ||
-        opcode == OP_BNE ||
-        opcode == OP_BEQ) {
-        return 1;
-    }
-    return 0;
-}
 
 /* chars_until_delimiter
  *      DESCRIPTION: used to determine how many characters are in operand until delimiter (allows us to determine boundaries of label)
@@ -368,16 +38,36 @@ static uint8_t chars_until_delimiter(char *operand_string) {
     return i;
 }
 
+/* find_label
+ *      DESCRIPTION: looks up value of passed label, which is 0 until fixed up if the label isn't defined yet
+ *      INPUTS: label_table -- table of labels defined so far
+ *              label_str -- label to look up
+ *              unresolved_label_dbl_ptr -- set to a copy of label_str if label isn't defined yet
+ *      OUTPUTS: value of label, 0 if label isn't defined yet
+ *      SIDE EFFECTS: allocates memory for copy of label if label isn't defined yet
+ */
+static uint32_t find_label(Table_t *label_table, char *label_str, char **unresolved_label_dbl_ptr) {
+    uint32_t operand = get_value(label_table, label_str);
+    if (operand == -1) {
+        *unresolved_label_dbl_ptr = (char *)malloc(strlen(label_str) + 1);
+        strcpy(*unresolved_label_dbl_ptr, label_str);
+        return 0;
+    }
+    return operand;
+}
+
 /* determine_operand_and_addressing
  *      DESCRIPTION: determines operand and addressing mode based on operand
  *      INPUTS: sf_asm -- pointer to assembly being converted to bytecode
  *              operand_token -- token for operand which we are processing
  *              return_buf -- buffer with at least 4 bytes of allocated memory
  *              label_table_dbl_ptr -- double pointer to label table
+ *              unresolved_label_dbl_ptr -- set to label operand names if that isn't defined yet
  *      OUTPUTS: none
  *      SIDE EFFECTS: fills return_buf with return_buf[3] = addressing mode, return_buf[1] = low byte of operand, return_buf[2] = high byte of operand
  */
-static uint8_t determine_operand_and_addressing(uint8_t *sf_asm, Token_t operand_token, uint8_t *return_buf, Table_t **label_table_dbl_ptr) {
+static void determine_operand_and_addressing(uint8_t *sf_asm, Token_t operand_token, uint8_t *return_buf,
+                                             Table_t **label_table_dbl_ptr, char **unresolved_label_dbl_ptr) {
     char *operand_string = calloc(operand_token.end_index - operand_token.start_index + 2, 1);
     memcpy(operand_string, sf_asm + operand_token.start_index, operand_token.end_index - operand_token.start_index + 1);
     switch (operand_string[0]) {
@@ -417,11 +107,11 @@ static uint8_t determine_operand_and_addressing(uint8_t *sf_asm, Token_t operand
                     if ((operand_string[4] == 'X' || operand_string[4] == 'x')) {
                         // OPC $LL,X -- Zero Page X-Indexed Addressing Mode
                         return_buf[3] = ADDR_MODE_ZPG_X;
-                        return_buf[1] = (char_to_hex(operand_string[2]) << 4) | char_to_hex(operand_string[3]);
+                        return_buf[1] = (char_to_hex(operand_string[1]) << 4) | char_to_hex(operand_string[2]);
                     } else if ((operand_string[4] == 'Y' || operand_string[4] == 'y')) {
                         // OPC $LL,Y -- Zero-Page Y-Indexed Addressing Mode
-                        return_buf[3] = ADDR_MODE_ZPG_Y;
-                        return_buf[1] = (char_to_hex(operand_string[2]) << 4) | char_to_hex(operand_string[3]);
+                        return_buf[3] = ADDR_MODE_ZPG_Y_GEN;
+                        return_buf[1] = (char_to_hex(operand_string[1]) << 4) | char_to_hex(operand_string[2]);
                     }
                 }
             } else if (strlen(operand_string) == 7 &&
@@ -473,12 +163,8 @@ static uint8_t determine_operand_and_addressing(uint8_t *sf_asm, Token_t operand
                     char label_str[label_end_index];
                     memset(label_str, 0, label_end_index);
                     memcpy(label_str, operand_string + 1, label_end_index - 1);
-                    uint32_t operand = get_value(*label_table_dbl_ptr, label_str);
-                    if (operand == -1) {
-                        fprintf(stderr, "Error at line %d: invalid label\n", operand_token.line_num);
-                        exit(ERR_INVALID_LABEL);
-                    }
-                    
+                    uint32_t operand = find_label(*label_table_dbl_ptr, label_str, unresolved_label_dbl_ptr);
+
                     if (strlen(operand_string) == label_end_index + 1 && operand_string[label_end_index] == ')') {
                         // OPC (LABEL) -- Indirect Addressing Mode
                         return_buf[3] = ADDR_MODE_IND;
@@ -513,12 +199,8 @@ static uint8_t determine_operand_and_addressing(uint8_t *sf_asm, Token_t operand
                 char label_str[label_end_index + 1];
                 memset(label_str, 0, label_end_index + 1);
                 memcpy(label_str, operand_string, label_end_index);
-                uint32_t operand = get_value(*label_table_dbl_ptr, label_str);
-                if (operand == -1) {
-                    fprintf(stderr, "Error at line %d: invalid label\n", operand_token.line_num);
-                    exit(ERR_INVALID_LABEL);
-                }
-                
+                uint32_t operand = find_label(*label_table_dbl_ptr, label_str, unresolved_label_dbl_ptr);
+
                 if (strlen(operand_string) == label_end_index) {
                     // OPC LABEL -- Relative/Absolute Addressing Mode
                     return_buf[3] = ADDR_MODE_REL;
@@ -540,132 +222,172 @@ static uint8_t determine_operand_and_addressing(uint8_t *sf_asm, Token_t operand
             }
             break;
     }
+    free(operand_string);
+}
+
+/* branch_offset
+ *      DESCRIPTION: returns offset a branch at passed address takes to reach passed target, erroring out if it can't
+ */
+static uint8_t branch_offset(uint16_t target, uint16_t branch_address, uint32_t line_num) {
+    int32_t offset = (int32_t)target - (branch_address + 2); // relative to instruction following branch
+    if (offset < -128 || offset > 127) {
+        fprintf(stderr, "Error at line %d: branch offsets may be at most -128 or 127 bytes away\n", line_num);
+        exit(ERR_OVERFLOW);
+    }
+    return (uint8_t)offset;
 }
 
 /* generate_line
- *      DESCRIPTION: determines opcode and operand for current line and adds to passed return buffer 
- *      INPUTS: bc -- pointer to bytecode that line is to be added to
- *              sf_asm -- pointer to assembly which bytecode is being generated from
- *              curr_token_dbl_ptr -- double pointer to token which code is being generated from
- *              return_buf -- buffer to write opcode and operand to
- *              label_table_dbl_ptr -- double pointer to table which contains all labels for the current program
- *      OUTPUTS: none
- *      SIDE EFFECTS: increments passed token pointer beyond line,
- *                    fills return_buf with return_buf[0] = opcode, return_buf[1] = low byte of operand, return_buf[2] = high byte of operand, return_buf[3] = bytes in opcode + operand
+ *      DESCRIPTION: generates the instruction on a scanned line into the last bytecode of passed program, recording a
+ *                   fixup if its operand names a label that isn't defined yet
+ *      INPUTS: p -- program whose last bytecode the instruction is added to
+ *              sf_asm -- pointer to assembly which tokens index into
+ *              tokens -- instruction and operand tokens of line
+ *              num_tokens -- number of tokens in tokens
+ *              label_table_dbl_ptr -- double pointer to table of labels defined so far
+ *              fixups -- fixup list to add to
+ *      OUTPUTS: number of bytes in generated instruction
+ *      SIDE EFFECTS: adds instruction to program and its line to line map of program, may add fixup to fixups
  */
-static void generate_line(Bytecode_t *bc, uint8_t *sf_asm, Token_t **curr_token_dbl_ptr, uint8_t *return_buf, Table_t **label_table_dbl_ptr) {
-    uint32_t curr_line = (*curr_token_dbl_ptr)->line_num;
-    uint8_t opcode = INVALID_OPCODE;
-    memset(return_buf, ADDR_MODE_IMP, 4);
+static uint8_t generate_line(Program_t *p, uint8_t *sf_asm, Token_t *tokens, uint32_t num_tokens,
+                             Table_t **label_table_dbl_ptr, FixupList_t *fixups) {
+    Bytecode_t *bc = p->start + p->index - 1;
+    uint32_t curr_line = tokens[0].line_num;
+    uint16_t address = bc->load_address + bc->index;
+    const Mnemonic_t *mnemonic = NULL;
+    char *unresolved_label = NULL;
+    uint8_t opcode_operand_buf[4];
+    memset(opcode_operand_buf, ADDR_MODE_IMP, 4);
 
-    while ((*curr_token_dbl_ptr)->type != TOKEN_END && (*curr_token_dbl_ptr)->line_num == curr_line) {
-        switch ((*curr_token_dbl_ptr)->type) {
+    for (uint32_t i = 0; i < num_tokens; i++) {
+        switch (tokens[i].type) {
             case TOKEN_INSTRUCTION:
-                if (opcode != INVALID_OPCODE) {
-                    fprintf(stderr, "Syntax error at line %d: can't have two instructions in one line\n", (*curr_token_dbl_ptr)->line_num);
+                if (mnemonic != NULL) {
+                    fprintf(stderr, "Syntax error at line %d: can't have two instructions in one line\n", curr_line);
                     exit(ERR_SYNTAX);
                 }
-                opcode = determine_opcode(sf_asm + (*curr_token_dbl_ptr)->start_index);
-                if (opcode == INVALID_OPCODE) {
-                    fprintf(stderr, "Invalid opcode at line %d\n", (*curr_token_dbl_ptr)->line_num);
+                mnemonic = find_mnemonic(sf_asm + tokens[i].start_index);
+                if (mnemonic == NULL) {
+                    fprintf(stderr, "Invalid opcode at line %d\n", curr_line);
                     exit(ERR_INVALID_OPERAND_OPCODE);
                 }
                 break;
             case TOKEN_OPERAND:
-                if (return_buf[3] != ADDR_MODE_IMP) {
-                    fprintf(stderr, "Syntax error at line %d: can't have two operands in one line\n", (*curr_token_dbl_ptr)->line_num);
+                if (opcode_operand_buf[3] != ADDR_MODE_IMP) {
+                    fprintf(stderr, "Syntax error at line %d: can't have two operands in one line\n", curr_line);
                     exit(ERR_SYNTAX);
                 }
-                determine_operand_and_addressing(sf_asm, **curr_token_dbl_ptr, return_buf, label_table_dbl_ptr);
-                if (return_buf[3] == ADDR_MODE_IMP) {
-                    fprintf(stderr, "Invalid operand at line %d\n", (*curr_token_dbl_ptr)->line_num);
+                determine_operand_and_addressing(sf_asm, tokens[i], opcode_operand_buf, label_table_dbl_ptr,
+                                                 &unresolved_label);
+                if (opcode_operand_buf[3] == ADDR_MODE_IMP) {
+                    fprintf(stderr, "Invalid operand at line %d\n", curr_line);
                     exit(ERR_INVALID_OPERAND_OPCODE);
                 }
                 break;
             default:
                 break;
         }
-        (*curr_token_dbl_ptr)++;
     }
 
     // if OPC LABEL but instruction is not branch, change to absolute addressing
-    if (!is_branch_instruction(opcode) && return_buf[3] == ADDR_MODE_REL) {
-        return_buf[3] = ADDR_MODE_ABS;
+    if (mnemonic != NULL && !mnemonic->branch && opcode_operand_buf[3] == ADDR_MODE_REL) {
+        opcode_operand_buf[3] = ADDR_MODE_ABS;
     }
 
-    return_buf[0] = (*ptr_arr[opcode])(opcode, return_buf[3]);
-    
-    if (return_buf[0] == 0xFF) {
+    if (mnemonic == NULL || !HAS_MODE(mnemonic, opcode_operand_buf[3])) {
         fprintf(stderr, "Invalid addressing mode at line %d\n", curr_line);
         exit(ERR_INVALID_ADDRESSING_MODE);
     }
+    opcode_operand_buf[0] = mnemonic->opcodes[opcode_operand_buf[3]];
+    uint8_t length = opcode_length[opcode_operand_buf[0]];
 
-    if (return_buf[3] == ADDR_MODE_REL) {
-    // if offset will overflow beyond -128 or 127, error out
-        if (((((return_buf[2] << 8)|return_buf[1]) > (bc->load_address + bc->index + 1)) &&
-            (((return_buf[2] << 8)|return_buf[1]) - (bc->load_address + bc->index + 1) > 0x7F)) || 
-            ((((return_buf[2] << 8)|return_buf[1]) < (bc->load_address + bc->index + 1)) &&
-            ((bc->load_address + bc->index + 1) - ((return_buf[2] << 8)|return_buf[1])) > 0x80)) {
-            fprintf(stderr, "Error at line %d: branch offsets may be at most -128 or 127 bytes away\n", (*curr_token_dbl_ptr)->line_num);
-            exit(ERR_OVERFLOW);
+    if (unresolved_label != NULL) {
+        Fixup_t fixup = {unresolved_label, FIXUP_ABSOLUTE, p->index - 1, bc->index, curr_line};
+        if (opcode_operand_buf[3] == ADDR_MODE_REL) {
+            fixup.kind = FIXUP_RELATIVE;
+        } else if (opcode_operand_buf[3] == ADDR_MODE_IND_X || opcode_operand_buf[3] == ADDR_MODE_IND_Y) {
+            fixup.kind = FIXUP_ZERO_PAGE;
         }
-
-        return_buf[1] = ((return_buf[2] << 8)|return_buf[1]) - (bc->load_address + bc->index + 2); // bc->start + bc->index + 2 = previously filled entries plus where pc will be after running INST LABEL line
-    }
-
-    if (return_buf[3] == ADDR_MODE_IMP ||
-        return_buf[3] == ADDR_MODE_ACCUM_GEN) {
-        return_buf[3] = 1;
-    } else if (return_buf[3] == ADDR_MODE_ABS ||
-                return_buf[3] == ADDR_MODE_ABS_Y ||
-                return_buf[3] == ADDR_MODE_ABS_X ||
-                return_buf[3] == ADDR_MODE_IND) {
-        return_buf[3] = 3;
-    } else {
-        return_buf[3] = 2;
+        add_to_fixup_list(fixups, &fixup);
+    } else if (opcode_operand_buf[3] == ADDR_MODE_REL) {
+        opcode_operand_buf[1] = branch_offset((opcode_operand_buf[2] << 8) | opcode_operand_buf[1], address, curr_line);
     }
 
+    p->lines[address] = curr_line;
+    add_to_bytecode(bc, opcode_operand_buf, length, curr_line);
+    return length;
 }
 
-/* roll_to_bytecode
- *      DESCRIPTION: converts all of passed roll into bytecode
- *      INPUTS: bc -- pointer to bytecode that is to be populated
- *              r -- pointer to roll from which bytecode is to be generated
- *              sf_asm -- pointer to assembly which tokens index into
- *              label_table_dbl_ptr -- double pointer to table which labels in program use
+/* resolve_fixups
+ *      DESCRIPTION: patches the operand of every instruction in passed fixup list with the label it names
+ *      INPUTS: p -- program generated with fixups
+ *              fixups -- fixups recorded while generating program
+ *              label_table -- table of every label in program
  *      OUTPUTS: none
- *      SIDE EFFECTS: populates passed bytecode with generated code corresponding to tokens in roll
+ *      SIDE EFFECTS: writes operands into bytecode of program, errors out for labels that were never defined
  */
-static void roll_to_bytecode(Bytecode_t *bc, Roll_t *r, uint8_t *sf_asm, Table_t **label_table_dbl_ptr) {
-    Token_t *curr_token = r->start;
-    uint8_t opcode_operand_buf[4];
-    while (curr_token->type != TOKEN_END) {
-        generate_line(bc, sf_asm, &curr_token, opcode_operand_buf, label_table_dbl_ptr);
-        add_to_bytecode(bc, opcode_operand_buf, opcode_operand_buf[3], curr_token->line_num - 1);
+static void resolve_fixups(Program_t *p, FixupList_t *fixups, Table_t *label_table) {
+    for (uint32_t i = 0; i < fixups->index; i++) {
+        Fixup_t *fixup = fixups->start + i;
+        uint32_t operand = get_value(label_table, fixup->label);
+        if (operand == -1) {
+            fprintf(stderr, "Error at line %d: invalid label\n", fixup->line_num);
+            exit(ERR_INVALID_LABEL);
+        }
+
+        Bytecode_t *bc = p->start + fixup->bytecode_index;
+        uint8_t *operand_bytes = bc->start + fixup->opcode_index + 1;
+        switch (fixup->kind) {
+            case FIXUP_ABSOLUTE:
+                operand_bytes[0] = operand & (0x000000FF);
+                operand_bytes[1] = (operand & (0x0000FF00)) >> 8;
+                break;
+            case FIXUP_ZERO_PAGE:
+                if (operand > 0x000000FF) {
+                    fprintf(stderr, "Error at line %d: label corresponds to non zero-page address\n", fixup->line_num);
+                    exit(ERR_LABEL_ADDRESSING);
+                }
+                operand_bytes[0] = operand;
+                break;
+            case FIXUP_RELATIVE:
+                operand_bytes[0] = branch_offset(operand, bc->load_address + fixup->opcode_index, fixup->line_num);
+                break;
+        }
     }
 }
 
-/* clip_to_program
- *      DESCRIPTION: converts passed clip to program
- *      INPUTS: sf_asm -- array of assembly code which clip tokens index into
- *              c -- clip to convert into program
- *              label_table_dbl_ptr -- double pointer to label table populated during scanning
+/* assembly_to_program
+ *      DESCRIPTION: assembles passed assembly into program in a single pass, filling out label table as well
+ *      INPUTS: sf -- 6502 on which directives are run
+ *              sf_asm -- pointer to assembly being assembled
+ *              label_table_dbl_ptr -- double pointer to label table to be populated
  *      OUTPUTS: pointer to program to run
- *      SIDE EFFECTS: none
+ *      SIDE EFFECTS: populates passed label table, runs assembler directives on sf
  */
-Program_t *clip_to_program(uint8_t *sf_asm, Clip_t *c, Table_t **label_table_dbl_ptr) {
+Program_t *assembly_to_program(sf_t *sf, uint8_t *sf_asm, Table_t **label_table_dbl_ptr) {
     Program_t *p = new_program(PROGRAM_INIT_SIZE);
+    FixupList_t *fixups = new_fixup_list(FIXUP_LIST_INIT_SIZE);
+    Token_t line_tokens[MAX_LINE_TOKENS];
+    uint8_t *curr_char_ptr = sf_asm;
+    uint32_t line_number = 1;
+    sf->pc = ROM_START;
+    open_bytecode(p, ROM_START, line_number);
 
-    uint8_t *opcode_operand_buf = (uint8_t *)malloc(4);
-
-    for (int i = 0; i < c->index; i++) {
-        // skip empty rolls
-        if (c->start[i].start[0].type == TOKEN_END) {
-            continue;
+    while (*curr_char_ptr != '\0') {
+        uint32_t num_tokens = scan_line(sf, p, sf_asm, &curr_char_ptr, line_number, label_table_dbl_ptr, line_tokens);
+        if (num_tokens > 0) {
+            sf->pc += generate_line(p, sf_asm, line_tokens, num_tokens, label_table_dbl_ptr, fixups);
         }
-        open_bytecode(p, c->start[i].start_address, c->start[i].start->line_num);
-        roll_to_bytecode(p->start + p->index - 1, c->start + i, sf_asm, label_table_dbl_ptr);
+        line_number++;
+    }
+
+    // drop final bytecode if nothing was generated into it
+    if (p->index > 1 && p->start[p->index - 1].index == 0) {
+        p->index--;
+        free(p->start[p->index].start);
     }
 
+    resolve_fixups(p, fixups, *label_table_dbl_ptr);
+    free_fixup_list(fixups);
     return p;
 }
@@ -2,12 +2,10 @@
 #define     __GENERATOR_H
 
 #include <stdint.h>
-#include "token.h"
+#include "../6502.h"
 #include "bytecode.h"
 #include "table.h"
 
-#define INVALID_OPCODE      0xFF
+Program_t *assembly_to_program(sf_t *sf, uint8_t *sf_asm, Table_t **label_table_dbl_ptr);
 
-Program_t * clip_to_program(uint8_t *sf_asm, Clip_t *c, Table_t **label_table_dbl_ptr);
-
-#endif
\ No newline at end of file
+#endif
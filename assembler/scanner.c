@@ -4,8 +4,7 @@
 
 #include "../lib/lib.h"
 #include "scanner.h"
-
-#define CLIP_INIT_SIZE      256
+#include "encoder.h"
 
 /* skip_whitespace
  *      DESCRIPTION: helper function used to advance passed pointer beyond spaces and tabs
@@ -69,7 +68,7 @@ static uint32_t compare_characters(char *cmpstr, char *refstr, uint32_t num_char
 /* run_directive
  *      DESCRIPTION: determines and runs assembly directive, erroring out for invalid directive
  *      INPUTS: sf -- 6502 on which directives are to be run
- *              c -- current clip being populated (passed in since .ORG will close clip)
+ *              p -- program being generated (passed in since .ORG will start new bytecode)
  *              sf_asm -- pointer to assembly being processed into tokens
  *              curr_char_dbl_ptr -- double pointer to current character in assembly being processed (needed for .END directive)
  *              directive_token -- token corresponding to directive being run
@@ -77,7 +76,7 @@ static uint32_t compare_characters(char *cmpstr, char *refstr, uint32_t num_char
  *      OUTPUTS: none
  *      SIDE EFFECTS: various, depends on specific directive being run
  */
-static void run_directive(sf_t *sf, Clip_t *c, uint8_t *sf_asm, uint8_t **curr_char_dbl_ptr, Token_t directive_token, Token_t operand_token) {
+static void run_directive(sf_t *sf, Program_t *p, uint8_t *sf_asm, uint8_t **curr_char_dbl_ptr, Token_t directive_token, Token_t operand_token) {
     if (directive_token.end_index - directive_token.start_index + 1 == 4) {
         if (operand_token.type != TOKEN_EMPTY) {
             // directives that take absolute addressing
@@ -94,8 +93,12 @@ static void run_directive(sf_t *sf, Clip_t *c, uint8_t *sf_asm, uint8_t **curr_c
                         load_address |= (char_to_hex(*(sf_asm + operand_token.start_index + i + 1))) << ((3 - i) * 4);
                     }
                     
-                    close_roll(c->start + c->index - 1);
-                    open_roll(c, load_address, directive_token.line_num);
+                    // bytecode nothing was generated into yet is just moved
+                    if (p->start[p->index - 1].index == 0) {
+                        p->start[p->index - 1].load_address = load_address;
+                    } else {
+                        open_bytecode(p, load_address, directive_token.line_num);
+                    }
                     sf->pc = load_address;
                     return;
                 }
@@ -139,373 +142,23 @@ static void run_directive(sf_t *sf, Clip_t *c, uint8_t *sf_asm, uint8_t **curr_c
     exit(ERR_INVALID_DIRECTIVE);
 }
 
-/* operand_num_bytes
- *      DESCRIPTION: determines number of bytes passed operand will take depending on addressing mode
- *      INPUTS: sf_asm --  pointer to assembly
- *              operand_token -- token corresponding to operand whose bytes we which to determine
- *      OUTPUTS: number of bytes operand will take up, or 3 if number of bytes will depend on preceding operand
- *      SIDE EFFECTS: none
- */
-static uint8_t operand_num_bytes(uint8_t *sf_asm, Token_t operand_token) {
-    char *operand_string = calloc(operand_token.end_index - operand_token.start_index + 2, 1);
-    memcpy(operand_string, sf_asm + operand_token.start_index, operand_token.end_index - operand_token.start_index + 1);
-    if (strlen(operand_string) == 1 && (operand_string[0] == 'A' || operand_string[0] == 'a')) {
-        // OPC A -- Accumulator Addressing Mode
-        return 0;
-    } else if (operand_string[0] == '#') {
-        // OPC #$BB -- Immediate Addressing Mode
-        return 1;
-    } else if (operand_string[0] == '$') {
-        uint32_t chars_until_comma = (uint32_t)(strchr(operand_string, ',') - operand_string);
-        if (chars_until_comma == 5) {
-            // OPC $LLHH,X/Y -- Absolute X/Y indexed
-            return 2;
-        } else if (chars_until_comma == 3) {
-            // OPC $LL,X/Y -- ZPG X/Y indexed
-            return 1;
-        } else {
-            // OPC $LLHH -- Absolute
-            return 2;
-        }
-    } else if (operand_string[0] == '(') {
-        if (strchr(operand_string, ',')) {
-            // OPC ($LL,X)/($LL),Y -- indirect X/Y indexed
-            return 1;
-        } else {
-            // OPC ($LLHH) -- indirect
-            return 2;
-        }
-    } else {
-        // OPC LABEL -- may be absolute, absolute x-indexed, or absolute y-indexed
-        // if instruction preceding this is branch, it must be relative
-        return 3;
-    }
-}
-
-/* check_instruction
- *      DESCRIPTION: determines if instruction at passed pointer is valid or not
- *      INPUTS: curr_char_ptr -- pointer to beginning character of instruction
- *      OUTPUTS: 1 if instruction is valid, 0 otherwise
- *      SIDE EFFECTS: none
- */
-static uint8_t check_instruction(uint8_t *curr_char_ptr) {
-    switch (*curr_char_ptr) {
-        case 'A':
-            switch (*(++curr_char_ptr)) {
-                case 'D':
-                    if (*(++curr_char_ptr) == 'C') {
-                        return 1;
-                    }
-                    break;
-                case 'N':
-                    if (*(++curr_char_ptr) == 'D') {
-                        return 1;
-                    }
-                    break;
-                case 'S':
-                    if (*(++curr_char_ptr) == 'L') {
-                        return 1;
-                    }
-                    break;
-                default:
-                    break;
-            }
-            break;
-
-        case 'B':
-            switch (*(++curr_char_ptr)) {
-                case 'C':
-                    curr_char_ptr++;
-                    if (*curr_char_ptr == 'C' || *curr_char_ptr == 'S') {
-                        return 1;
-                    }
-                    break;
-                case 'E':
-                    if (*(++curr_char_ptr) == 'Q') {
-                        return 1;
-                    }
-                    break;
-                case 'I':
-                    if (*(++curr_char_ptr) == 'T') {
-                        return 1;
-                    }
-                    break;
-                case 'M':
-                    if (*(++curr_char_ptr) == 'I') {
-                        return 1;
-                    }
-                    break;
-                case 'N':
-                    if (*(++curr_char_ptr) == 'E') {
-                        return 1;
-                    }
-                    break;
-                case 'P':
-                    if (*(++curr_char_ptr) == 'L') {
-                        return 1;
-                    }
-                    break;
-                case 'R':
-                    if (*(++curr_char_ptr) == 'K') {
-                        return 1;
-                    }
-                    break;
-                case 'V':
-                    curr_char_ptr++;
-                    if (*curr_char_ptr == 'C' || *curr_char_ptr == 'S') {
-                        return 1;
-                    }
-                    break;
-                default:
-                    break;
-            }
-            break;
-        
-        case 'C':
-            switch (*(++curr_char_ptr)) {
-                case 'L':
-                    curr_char_ptr++;
-                    if (*curr_char_ptr == 'C' || *curr_char_ptr == 'D' || *curr_char_ptr == 'I' || *curr_char_ptr == 'V') {
-                        return 1;
-                    }
-                    break;
-                case 'M':
-                    if (*(++curr_char_ptr) == 'P') {
-                        return 1;
-                    }
-                    break;
-                case 'P':
-                    curr_char_ptr++;
-                    if (*curr_char_ptr == 'X' || *curr_char_ptr == 'Y') {
-                        return 1;
-                    }
-                    break;
-                default:
-                    break;
-            }
-            break;
-        
-        case 'D':
-            if (*(++curr_char_ptr) == 'E') {
-                curr_char_ptr++;
-                if (*curr_char_ptr == 'C' || *curr_char_ptr == 'X' || *curr_char_ptr == 'Y') {
-                    return 1;
-                }
-            }
-            break;
-        
-        case 'E':
-            if (*(++curr_char_ptr) == 'O') {
-                if (*(++curr_char_ptr) == 'R') {
-                    return 1;
-                }
-            }
-            break;
-        
-        case 'I':
-            if (*(++curr_char_ptr) == 'N') {
-                curr_char_ptr++;
-                if (*curr_char_ptr == 'C' || *curr_char_ptr == 'X' || *curr_char_ptr == 'Y') {
-                    return 1;
-                }
-            }
-            break;
-        
-        case 'J':
-            curr_char_ptr++;
-            if (*curr_char_ptr == 'M') {
-                if (*(++curr_char_ptr) == 'P') {
-                    return 1;
-                }
-            } else if (*curr_char_ptr == 'S') {
-                if (*(++curr_char_ptr) == 'R') {
-                    return 1;
-                }
-            }
-            break;
-        
-        case 'L':
-            curr_char_ptr++;
-            if (*curr_char_ptr == 'D') {
-                curr_char_ptr++;
-                if (*curr_char_ptr == 'A' || *curr_char_ptr == 'X' || *curr_char_ptr == 'Y') {
-                    return 1;
-                }
-            } else if (*curr_char_ptr == 'S') {
-                if (*(++curr_char_ptr) == 'R') {
-                    return 1;
-                }
-            }
-            break;
-
-        case 'N':
-            if (*(++curr_char_ptr) == 'O') {
-                if (*(++curr_char_ptr) == 'P') {
-                    return 1;
-                }
-            }
-            break;
-        
-        case 'O':
-            if (*(++curr_char_ptr) == 'R') {
-                if (*(++curr_char_ptr) == 'A') {
-                    return 1;
-                }
-            }
-            break;
-        
-        case 'P':
-            curr_char_ptr++;
-            if (*curr_char_ptr == 'H') {
-                curr_char_ptr++;
-                if (*curr_char_ptr == 'A' || *curr_char_ptr == 'P') {
-                    return 1;
-                }
-            } else if (*curr_char_ptr == 'L') {
-                curr_char_ptr++;
-                if (*curr_char_ptr == 'A' || *curr_char_ptr == 'P') {
-                    return 1;
-                }
-            }
-            break;
-        
-        case 'R':
-            curr_char_ptr++;
-            if (*curr_char_ptr == 'O') {
-                curr_char_ptr++;
-                if (*curr_char_ptr == 'L' || *curr_char_ptr == 'R') {
-                    return 1;
-                }
-            } else if (*curr_char_ptr == 'T') {
-                curr_char_ptr++;
-                if (*curr_char_ptr == 'I' || *curr_char_ptr == 'S') {
-                    return 1;
-                }
-            }
-            break;
-        
-        case 'S':
-            switch (*(++curr_char_ptr)) {
-                case 'B':
-                    if (*(++curr_char_ptr) == 'C') {
-                        return OP_SBC;
-                    }
-                    break;
-                case 'E':
-                    curr_char_ptr++;
-                    if (*curr_char_ptr == 'C' || *curr_char_ptr == 'D' || *curr_char_ptr == 'I') {
-                        return 1;
-                    }
-                    break;
-                case 'T':
-                    curr_char_ptr++;
-                    if (*curr_char_ptr == 'A' || *curr_char_ptr == 'X' || *curr_char_ptr == 'Y') {
-                        return 1;
-                    }
-                    break;
-                default:
-                    break;
-            }
-            break;
-        
-        case 'T':
-            switch (*(++curr_char_ptr)) {
-                case 'A':
-                    curr_char_ptr++;
-                    if (*curr_char_ptr == 'X' || *curr_char_ptr == 'Y') {
-                        return 1;
-                    }
-                    break;
-                case 'S':
-                    if (*(++curr_char_ptr) == 'X') {
-                        return 1;
-                    }
-                    break;
-                case 'X':
-                    curr_char_ptr++;
-                    if (*curr_char_ptr == 'A' || *curr_char_ptr == 'S') {
-                        return OP_TXA;
-                    }
-                    break;
-                case 'Y':
-                    if (*(++curr_char_ptr) == 'A') {
-                        return 1;
-                    }
-                    break;
-                default:
-                    break;
-            }
-            break;
-    
-        default:
-            break;
-    }
-
-    return 0;
-}
-
-/* check_branch_instruction
- *      DESCRIPTION: determines if instruction at passed pointer is branch instruction or not
- *      INPUTS: curr_char_ptr -- pointer to beginning character of instruction
- *      OUTPUTS: 1 if instruction is branch instruction, 0 otherwise
- *      SIDE EFFECTS: none
- */
-static uint8_t check_branch_instruction(uint8_t *curr_char_ptr) {
-    if (*curr_char_ptr == 'B') {
-        switch (*(++curr_char_ptr)) {
-            case 'C':
-                curr_char_ptr++;
-                if (*curr_char_ptr == 'C' || *curr_char_ptr == 'S') {
-                    return 1;
-                }
-                break;
-            case 'E':
-                if (*(++curr_char_ptr) == 'Q') {
-                    return 1;
-                }
-                break;
-            case 'M':
-                if (*(++curr_char_ptr) == 'I') {
-                    return 1;
-                }
-                break;
-            case 'N':
-                if (*(++curr_char_ptr) == 'E') {
-                    return 1;
-                }
-                break;
-            case 'P':
-                if (*(++curr_char_ptr) == 'L') {
-                    return 1;
-                }
-                break;
-            case 'V':
-                curr_char_ptr++;
-                if (*curr_char_ptr == 'C' || *curr_char_ptr == 'S') {
-                    return 1;
-                }
-                break;
-            default:
-                break;
-        }
-    }
-    return 0;
-}
-
 /* scan_line
- *      DESCRIPTION: scans line into tokens and adds tokens to clip, running assembler directives and adding labels to label table on the way
+ *      DESCRIPTION: scans line into tokens, running assembler directives and adding labels to label table on the way
  *      INPUTS: sf -- pointer to 6502 which contains current PC
- *              c -- pointer to clip containing rolls where tokens are to be added
+ *              p -- pointer to program being generated, which directives may start new bytecode in
  *              sf_asm -- pointer to assembly being tokenized
  *              curr_char_dbl_ptr -- double pointer to current character in sf_asm being processed
  *              line_number -- number of line being scanned
  *              label_table_dbl_ptr -- double pointer to label table
- *      OUTPUTS: none
- *      SIDE EFFECTS: adds tokens to clip, advances curr_char_dbl_ptr to next line, advances scan_pc, runs assembler directives, adds labels to lable table
+ *              line_tokens -- buffer of at least MAX_LINE_TOKENS tokens, filled with instruction and operand of line
+ *      OUTPUTS: number of tokens in line_tokens, 0 if line has no instruction to generate
+ *      SIDE EFFECTS: advances curr_char_dbl_ptr to next line, runs assembler directives, adds labels to label table
  */
-static void scan_line(sf_t *sf, Clip_t *c, uint8_t* sf_asm, uint8_t **curr_char_dbl_ptr, uint32_t line_number, Table_t **label_table_dbl_ptr) {
+uint32_t scan_line(sf_t *sf, Program_t *p, uint8_t* sf_asm, uint8_t **curr_char_dbl_ptr, uint32_t line_number,
+                   Table_t **label_table_dbl_ptr, Token_t *line_tokens) {
 
     uint8_t directive_run = 0;
+    uint32_t num_line_tokens = 0;
 
     skip_whitespace(curr_char_dbl_ptr);
     if (**curr_char_dbl_ptr == ';') {
@@ -514,9 +167,13 @@ static void scan_line(sf_t *sf, Clip_t *c, uint8_t* sf_asm, uint8_t **curr_char_
     } else if (**curr_char_dbl_ptr != '\n' && **curr_char_dbl_ptr != '\0') {
         // determine number of, start/end index of tokens
         uint8_t num_tokens = 0;
-        Token_t token_buf[3];
-        memset(token_buf, '\0', 3 * sizeof(Token_t));
+        Token_t token_buf[MAX_LINE_TOKENS + 1]; // room for an empty token after the last, read as a directive's operand
+        memset(token_buf, '\0', (MAX_LINE_TOKENS + 1) * sizeof(Token_t));
         while ((**curr_char_dbl_ptr != '\n' && **curr_char_dbl_ptr != '\0' && **curr_char_dbl_ptr != ';')) {
+            if (num_tokens == MAX_LINE_TOKENS) {
+                fprintf(stderr, "Invalid syntax at line %d\n", line_number);
+                exit(ERR_SYNTAX);
+            }
             uint32_t token_start_index = *curr_char_dbl_ptr - sf_asm;
             uint32_t token_end_index = *curr_char_dbl_ptr - sf_asm + skip_until_whitespace(curr_char_dbl_ptr) - 1;
             token_buf[num_tokens].start_index = token_start_index;
@@ -530,12 +187,11 @@ static void scan_line(sf_t *sf, Clip_t *c, uint8_t* sf_asm, uint8_t **curr_char_
         for (int i = 0; i < num_tokens; i++) {
             if (sf_asm[token_buf[i].start_index] == '.') {
                 // next token in buffer must either be operand or empty, so pass in token_buf[i + 1] as operand token
-                run_directive(sf, c, sf_asm, curr_char_dbl_ptr, token_buf[i], token_buf[i + 1]);
+                run_directive(sf, p, sf_asm, curr_char_dbl_ptr, token_buf[i], token_buf[i + 1]);
                 directive_run = 1;
-            } else if ((token_buf[i].end_index - token_buf[i].start_index + 1 == 3) && check_instruction(sf_asm + token_buf[i].start_index)) {
+            } else if ((token_buf[i].end_index - token_buf[i].start_index + 1 == 3) && find_mnemonic(sf_asm + token_buf[i].start_index) != NULL) {
                 // instruction
                 token_buf[i].type = TOKEN_INSTRUCTION;
-                sf->pc++;
             } else if ((i == 0) && // check for label declaration
                         // valid if length 1 and NOT A/a (accumulator addressing) OR if length > 1 and starts with letter/underscore (we checked for instruction in above branch)
                         (((token_buf[i].end_index == token_buf[i].start_index) && 
@@ -562,21 +218,8 @@ static void scan_line(sf_t *sf, Clip_t *c, uint8_t* sf_asm, uint8_t **curr_char_
                     exit(ERR_SYNTAX);
                 }
 
-                // if directive has been run we've already consumed operand and incremented PC accordingly
+                // if directive has been run it has already consumed operand
                 if (!directive_run) {
-                    uint8_t operand_bytes = operand_num_bytes(sf_asm, token_buf[i]);
-                    if (operand_bytes == 3) {
-                        if (check_branch_instruction(sf_asm + token_buf[i - 1].start_index)) {
-                            sf->pc++;
-                        } else {
-                            sf->pc += 2;
-                        }
-                    } else if (operand_bytes == 0xFF) {
-                        fprintf(stderr, "Error at line %d: invalid operand\n", token_buf[i].line_num);
-                        exit(ERR_SYNTAX);
-                    } else {
-                        sf->pc = sf->pc + operand_bytes;
-                    }
                     token_buf[i].type = TOKEN_OPERAND;
                 }
             }
@@ -589,7 +232,7 @@ static void scan_line(sf_t *sf, Clip_t *c, uint8_t* sf_asm, uint8_t **curr_char_
                 i++;
             }
             for (i; i < num_tokens; i++) {
-                add_to_roll(c->start + c->index - 1 , token_buf + i);
+                line_tokens[num_line_tokens++] = token_buf[i];
             }
         }
 
@@ -609,27 +252,6 @@ static void scan_line(sf_t *sf, Clip_t *c, uint8_t* sf_asm, uint8_t **curr_char_
     if (**curr_char_dbl_ptr == '\n') {
         (*curr_char_dbl_ptr)++;
     }
-} 
-
-/* assembly_to_clip
- *      DESCRIPTION: scans assembly into clip, filling out label table as well
- *      INPUTS: sf_asm -- pointer to assembly being processed
- *              label_table_dbl_ptr -- double pointer to label table to be populated
- *      OUTPUTS: pointer to clip containing tokens scanned from assembly
- *      SIDE EFFECTS: populates passed label table
- */
-Clip_t *assembly_to_clip(sf_t *sf, uint8_t* sf_asm, Table_t **label_table_dbl_ptr) {
-    uint8_t *curr_char_ptr = sf_asm;
-    uint32_t line_number = 1;
-    sf->pc = 0x8000;
-    Clip_t *c = new_clip(CLIP_INIT_SIZE);
-
-    while (*curr_char_ptr != '\0') {
-        scan_line(sf, c, sf_asm, &curr_char_ptr, line_number, label_table_dbl_ptr);
-        line_number++;
-    }
-
-    close_roll(c->start + c->index - 1); // close off final roll
 
-    return c;
+    return num_line_tokens;
 }
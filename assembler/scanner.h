@@ -4,10 +4,14 @@
 #define DIRECTIVE_ORG   0x01
 #define DIRECTIVE_ERROR 0xFF
 
+#define MAX_LINE_TOKENS 3 // label, instruction and operand
+
 #include "../6502.h"
 #include "token.h"
 #include "table.h"
+#include "bytecode.h"
 
-Clip_t *assembly_to_clip(sf_t *sf, uint8_t *sf_asm, Table_t **label_table_dbl_ptr);
+uint32_t scan_line(sf_t *sf, Program_t *p, uint8_t *sf_asm, uint8_t **curr_char_dbl_ptr, uint32_t line_number,
+                   Table_t **label_table_dbl_ptr, Token_t *line_tokens);
 
 #endif
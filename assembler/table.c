@@ -46,6 +46,14 @@ static uint32_t JSHash(const char* str, uint32_t length) {
     return hash;
 }
 
+/* probe_step
+ *      DESCRIPTION: returns how far to step between probes for passed key; the step is odd so that, with the
+ *                   power of two table sizes used here, probing visits every slot instead of cycling through a few
+ */
+static uint32_t probe_step(const char *key) {
+    return JSHash(key, strlen(key)) | 1;
+}
+
 /* initialize_table
  *      DESCRIPTION: sets all key-value pairs in table to known initial values
  *      INPUTS: t -- table we wish to initialize
@@ -123,11 +131,12 @@ int add_to_table(Table_t **t_dbl_ptr, char *key, uint16_t value) {
     }
 
     uint32_t index = RSHash(key, strlen(key)) % (*t_dbl_ptr)->size;
+    uint32_t step = probe_step(key);
     while ((*t_dbl_ptr)->data[index].key != NULL) {
         if (!(strcmp((*t_dbl_ptr)->data[index].key, key))) {
             return -1;
         }
-        index = (index + JSHash(key, strlen(key))) % (*t_dbl_ptr)->size;
+        index = (index + step) % (*t_dbl_ptr)->size;
     }
 
     (*t_dbl_ptr)->data[index].key = (char *)malloc((strlen(key) + 1) * sizeof(char));
@@ -147,13 +156,14 @@ int add_to_table(Table_t **t_dbl_ptr, char *key, uint16_t value) {
  */
 uint32_t get_value(Table_t *t, char *key) {
     uint32_t index = RSHash(key, strlen(key)) % t->size;
+    uint32_t step = probe_step(key);
     while (1) {
         if (t->data[index].key == NULL) {
             break;
         } else if (!strcmp(t->data[index].key, key)) {
             return t->data[index].value;
         }
-        index = (index + JSHash(key, strlen(key))) % t->size;
+        index = (index + step) % t->size;
     }
     return -1; // since this is uint32_t -1, this won't correspond to an actual address
 }
@@ -0,0 +1,492 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "lockstep.h"
+#include "../lib/lib.h"
+
+#define DEQUE_EMPTY (-1) // returned by deque_take/deque_steal when no group could be taken
+
+/* WORK-STEALING DEQUES
+ * every worker owns a Chase-Lev deque of group indices, a group being a single instance or, with batch->lockstep,
+ * LOCKSTEP_LANES neighbouring ones: the owner pushes and takes at the bottom, other workers steal from the top once
+ * their own deque runs dry; a group that used up its slice without finishing goes back on the bottom of its
+ * worker's deque
+ * groups are never duplicated, so a deque never holds more than num_groups entries and never grows
+ */
+typedef struct Deque {
+    _Atomic int64_t top; // next entry thieves steal
+    _Atomic int64_t bottom; // next free slot of owner
+    _Atomic int32_t *entries; // group indices, circular
+    int64_t mask; // capacity - 1, capacity is a power of 2
+} Deque_t;
+
+// state shared by the workers of one run_batch call
+typedef struct BatchRun {
+    Batch_t *batch;
+    uint64_t *cycle_limits; // value of sf->cycles at which each instance's budget runs out
+    uint8_t *finished; // set for every instance that has hit BRK or its budget (lockstep groups only)
+    uint32_t group_size; // instances per group, 1 unless batch->lockstep is set
+    uint32_t num_groups;
+    struct BatchWorker *workers;
+    uint32_t num_workers;
+    _Atomic uint32_t unfinished; // groups with an instance that hasn't hit BRK or its budget yet
+} BatchRun_t;
+
+// one worker thread, its deque and the flat 6502s it runs instances in
+typedef struct BatchWorker {
+    BatchRun_t *run;
+    Deque_t deque;
+    sf_t *slots; // group_size 6502s, each holding the instance it last ran (or the prototype) between slices
+    SfSnapshot_t **held; // state each slot was left in, sharing pages with the snapshot of that instance
+    uint32_t id;
+    uint32_t seed; // state for picking victims to steal from
+    pthread_t thread;
+} BatchWorker_t;
+
+/* deque_init
+ *      DESCRIPTION: allocates empty deque large enough for passed number of entries
+ *      INPUTS: deque -- deque to initialize
+ *              capacity -- most entries the deque will ever hold
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: allocates memory for entries
+ */
+static void deque_init(Deque_t *deque, uint32_t capacity) {
+    int64_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    deque->entries = (_Atomic int32_t *)malloc(size * sizeof(_Atomic int32_t));
+    if (deque->entries == NULL) {
+        fprintf(stderr, "Failed to allocate memory for batch deque\n");
+        exit(ERR_NO_MEM);
+    }
+    deque->mask = size - 1;
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+}
+
+/* deque_push
+ *      DESCRIPTION: pushes group onto bottom of deque; only called by the owner
+ *      INPUTS: deque -- deque of calling worker
+ *              index -- group to push
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies deque
+ */
+static void deque_push(Deque_t *deque, int32_t index) {
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    atomic_store_explicit(&deque->entries[bottom & deque->mask], index, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+}
+
+/* deque_take
+ *      DESCRIPTION: takes group from bottom of deque; only called by the owner
+ *      INPUTS: deque -- deque of calling worker
+ *      OUTPUTS: group taken, or DEQUE_EMPTY
+ *      SIDE EFFECTS: modifies deque
+ */
+static int32_t deque_take(Deque_t *deque) {
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom) { // already empty
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return DEQUE_EMPTY;
+    }
+    int32_t index = atomic_load_explicit(&deque->entries[bottom & deque->mask], memory_order_relaxed);
+    if (top == bottom) { // last entry, race thieves for it
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst,
+                                                     memory_order_relaxed)) {
+            index = DEQUE_EMPTY;
+        }
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return index;
+}
+
+/* deque_steal
+ *      DESCRIPTION: steals group from top of another worker's deque
+ *      INPUTS: deque -- deque to steal from
+ *      OUTPUTS: group stolen, or DEQUE_EMPTY if deque was empty or another worker got there first
+ *      SIDE EFFECTS: modifies deque
+ */
+static int32_t deque_steal(Deque_t *deque) {
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (top >= bottom) {
+        return DEQUE_EMPTY;
+    }
+    int32_t index = atomic_load_explicit(&deque->entries[top & deque->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+        return DEQUE_EMPTY;
+    }
+    return index;
+}
+
+/* steal_group
+ *      DESCRIPTION: tries every other worker's deque once, starting from a random one
+ *      INPUTS: worker -- calling worker
+ *      OUTPUTS: group stolen, or DEQUE_EMPTY if nothing could be stolen
+ *      SIDE EFFECTS: modifies deques, advances seed of worker
+ */
+static int32_t steal_group(BatchWorker_t *worker) {
+    BatchRun_t *run = worker->run;
+    worker->seed ^= worker->seed << 13;
+    worker->seed ^= worker->seed >> 17;
+    worker->seed ^= worker->seed << 5;
+
+    uint32_t start = worker->seed % run->num_workers;
+    for (uint32_t i = 0; i < run->num_workers; i++) {
+        uint32_t victim = (start + i) % run->num_workers;
+        if (victim == worker->id) {
+            continue;
+        }
+        int32_t index = deque_steal(&run->workers[victim].deque);
+        if (index != DEQUE_EMPTY) {
+            return index;
+        }
+    }
+    return DEQUE_EMPTY;
+}
+
+/* INSTANCE SLOTS
+ * instances live in the batch as snapshots; to run one for a slice, a worker restores it into one of its slots and
+ * takes a new snapshot after the slice, so only the pages the instance wrote get their own copy
+ * a slot keeps its own copy of the snapshot it was left in (held): restoring the next instance over it then copies
+ * just the pages where the two instances differ, and the snapshot in the batch may be replaced by whichever worker
+ * runs that instance next
+ */
+
+/* bring_in
+ *      DESCRIPTION: restores instance into a slot of worker
+ *      INPUTS: worker -- calling worker
+ *              slot -- slot to restore into
+ *              index -- instance to restore
+ *      OUTPUTS: 6502 of slot, in the state of the instance
+ *      SIDE EFFECTS: overwrites slot
+ */
+static sf_t *bring_in(BatchWorker_t *worker, uint32_t slot, uint32_t index) {
+    sf_t *sf = &worker->slots[slot];
+    sf_restore(sf, worker->run->batch->states[index], worker->held[slot]);
+    return sf;
+}
+
+/* put_back
+ *      DESCRIPTION: replaces the snapshot of instance with the state it was left in by a slice in a slot of worker
+ *      INPUTS: worker -- calling worker
+ *              slot -- slot the instance ran in
+ *              index -- instance that ran
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies batch->states[index] and held snapshot of slot, frees their old snapshots
+ */
+static void put_back(BatchWorker_t *worker, uint32_t slot, uint32_t index) {
+    Batch_t *batch = worker->run->batch;
+    SfSnapshot_t *state = sf_snapshot(&worker->slots[slot], batch->states[index]);
+    free_snapshot(batch->states[index]);
+    batch->states[index] = state;
+    free_snapshot(worker->held[slot]);
+    worker->held[slot] = copy_snapshot(state);
+}
+
+/* run_slice
+ *      DESCRIPTION: runs every unfinished instance of group for up to BATCH_SLICE_CYCLES cycles
+ *      INPUTS: worker -- calling worker
+ *              index -- group to run
+ *      OUTPUTS: nonzero if every instance of group is finished (hit BRK or its cycle budget)
+ *      SIDE EFFECTS: runs instances, records why each one stopped once finished
+ */
+static int run_slice(BatchWorker_t *worker, int32_t index) {
+    BatchRun_t *run = worker->run;
+    Batch_t *batch = run->batch;
+    if (run->group_size == 1) {
+        sf_t *sf = bring_in(worker, 0, index);
+        uint64_t limit = run->cycle_limits[index];
+        if (limit - sf->cycles > IDLE_MAX_CYCLES) {
+            skip_idle_loop(sf, limit); // an instance spinning until its budget runs out has only its last pass left
+        }
+        uint64_t left = limit - sf->cycles;
+        RunExit_t exit_reason = run_cycles(sf, left < BATCH_SLICE_CYCLES ? left : BATCH_SLICE_CYCLES);
+        put_back(worker, 0, index);
+        if (exit_reason == RUN_BRK || sf->cycles >= limit) {
+            batch->exits[index] = exit_reason;
+            return 1;
+        }
+        return 0;
+    }
+
+    sf_t *lanes[LOCKSTEP_LANES];
+    uint64_t slice_limits[LOCKSTEP_LANES];
+    RunExit_t lane_exits[LOCKSTEP_LANES];
+    uint32_t members[LOCKSTEP_LANES];
+    uint32_t num_lanes = 0;
+    uint32_t first = index * run->group_size;
+    uint32_t last = first + run->group_size < batch->num_instances ? first + run->group_size : batch->num_instances;
+    for (uint32_t i = first; i < last; i++) {
+        if (!run->finished[i]) {
+            sf_t *sf = bring_in(worker, num_lanes, i);
+            uint64_t left = run->cycle_limits[i] - sf->cycles;
+            lanes[num_lanes] = sf;
+            slice_limits[num_lanes] = sf->cycles + (left < BATCH_SLICE_CYCLES ? left : BATCH_SLICE_CYCLES);
+            members[num_lanes++] = i;
+        }
+    }
+    run_lockstep(lanes, num_lanes, slice_limits, lane_exits);
+
+    int finished = 1;
+    for (uint32_t lane = 0; lane < num_lanes; lane++) {
+        uint32_t i = members[lane];
+        put_back(worker, lane, i);
+        if (lane_exits[lane] == RUN_BRK || lanes[lane]->cycles >= run->cycle_limits[i]) {
+            batch->exits[i] = lane_exits[lane];
+            run->finished[i] = 1;
+        } else {
+            finished = 0;
+        }
+    }
+    return finished;
+}
+
+/* batch_worker
+ *      DESCRIPTION: thread body; runs groups from own deque, stealing once it is empty, until every instance
+ *                   of the batch is finished
+ *      INPUTS: arg -- BatchWorker_t of thread
+ *      OUTPUTS: NULL
+ *      SIDE EFFECTS: runs instances
+ */
+static void *batch_worker(void *arg) {
+    BatchWorker_t *worker = (BatchWorker_t *)arg;
+    BatchRun_t *run = worker->run;
+
+    while (atomic_load_explicit(&run->unfinished, memory_order_acquire) > 0) {
+        int32_t index = deque_take(&worker->deque);
+        if (index == DEQUE_EMPTY) {
+            index = steal_group(worker);
+        }
+        if (index == DEQUE_EMPTY) {
+            sched_yield(); // the remaining groups are running on other workers
+            continue;
+        }
+        if (run_slice(worker, index)) {
+            atomic_fetch_sub_explicit(&run->unfinished, 1, memory_order_release);
+        } else {
+            deque_push(&worker->deque, index);
+        }
+    }
+    return NULL;
+}
+
+/* new_batch
+ *      DESCRIPTION: creates a batch whose instances all start as copies of prototype, sharing its memory
+ *      INPUTS: prototype -- 6502 with program loaded and registers initialized
+ *              num_instances -- number of instances in batch
+ *      OUTPUTS: new batch; instances may be modified (e.g. given their own input memory) with batch_set_instance
+ *               and lockstep set before run_batch
+ *      SIDE EFFECTS: allocates memory for batch
+ */
+Batch_t *new_batch(const sf_t *prototype, uint32_t num_instances) {
+    Batch_t *batch = (Batch_t *)malloc(sizeof(Batch_t));
+    if (batch == NULL) {
+        fprintf(stderr, "Failed to allocate memory for batch\n");
+        exit(ERR_NO_MEM);
+    }
+    batch->prototype = (sf_t *)malloc(sizeof(sf_t));
+    batch->states = (SfSnapshot_t **)malloc((size_t)num_instances * sizeof(SfSnapshot_t *));
+    batch->exits = (RunExit_t *)calloc(num_instances, sizeof(RunExit_t));
+    if (batch->prototype == NULL || (batch->states == NULL && num_instances != 0) ||
+        (batch->exits == NULL && num_instances != 0)) {
+        fprintf(stderr, "Failed to allocate memory for %u batch instances\n", num_instances);
+        exit(ERR_NO_MEM);
+    }
+    *batch->prototype = *prototype;
+    batch->base = sf_snapshot(batch->prototype, NULL);
+    for (uint32_t i = 0; i < num_instances; i++) {
+        batch->states[i] = copy_snapshot(batch->base);
+    }
+    batch->num_instances = num_instances;
+    batch->lockstep = 0;
+    return batch;
+}
+
+/* free_batch
+ *      DESCRIPTION: frees batch and all of its instances
+ *      INPUTS: batch -- batch to free
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: frees memory
+ */
+void free_batch(Batch_t *batch) {
+    for (uint32_t i = 0; i < batch->num_instances; i++) {
+        free_snapshot(batch->states[i]);
+    }
+    free_snapshot(batch->base);
+    free(batch->states);
+    free(batch->prototype);
+    free(batch->exits);
+    free(batch);
+}
+
+/* batch_get_instance
+ *      DESCRIPTION: copies the current state of an instance into a flat 6502
+ *      INPUTS: batch -- batch holding instance
+ *              index -- instance to copy
+ *              sf -- 6502 struct to copy it into
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: overwrites sf
+ */
+void batch_get_instance(const Batch_t *batch, uint32_t index, sf_t *sf) {
+    *sf = *batch->prototype;
+    sf_restore(sf, batch->states[index], batch->base);
+}
+
+/* batch_set_instance
+ *      DESCRIPTION: replaces the state of an instance with that of a flat 6502, e.g. one from batch_get_instance
+ *                   with its input memory written; pages equal to the prototype's stay shared with it
+ *      INPUTS: batch -- batch holding instance
+ *              index -- instance to replace
+ *              sf -- 6502 struct holding its new state
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies batch->states[index], overwrites sf->dirty
+ */
+void batch_set_instance(Batch_t *batch, uint32_t index, sf_t *sf) {
+    memset(sf->dirty, 0, sizeof(sf->dirty));
+    for (uint32_t page = 0; page < NUM_PAGES; page++) {
+        // host writes don't mark their pages, so find the ones that differ
+        if (memcmp(sf->memory + page * PAGE_BYTES, paged_page(batch->base->memory, page), PAGE_BYTES) != 0) {
+            MARK_DIRTY(sf, page * PAGE_BYTES);
+        }
+    }
+    free_snapshot(batch->states[index]);
+    batch->states[index] = sf_snapshot(sf, batch->base);
+}
+
+/* run_batch
+ *      DESCRIPTION: runs every instance of batch until it executes BRK or runs for max_cycles cycles, spreading
+ *                   the instances (or lockstep groups of them) over num_threads worker threads
+ *      INPUTS: batch -- batch to run
+ *              num_threads -- number of worker threads, 0 for one per online CPU
+ *              max_cycles -- cycle budget of each instance
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: runs instances, fills in batch->exits
+ */
+void run_batch(Batch_t *batch, uint32_t num_threads, uint64_t max_cycles) {
+    if (num_threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = online > 0 ? (uint32_t)online : 1;
+    }
+    if (batch->num_instances == 0 || max_cycles == 0) {
+        for (uint32_t i = 0; i < batch->num_instances; i++) {
+            batch->exits[i] = RUN_BUDGET;
+        }
+        return;
+    }
+    build_arithmetic_tables(); // shared by every worker, so build them before any start
+
+    BatchRun_t run;
+    run.batch = batch;
+    run.num_workers = num_threads;
+    run.group_size = batch->lockstep ? LOCKSTEP_LANES : 1;
+    run.num_groups = (batch->num_instances + run.group_size - 1) / run.group_size;
+    atomic_init(&run.unfinished, run.num_groups);
+    run.cycle_limits = (uint64_t *)malloc(batch->num_instances * sizeof(uint64_t));
+    run.finished = (uint8_t *)calloc(batch->num_instances, sizeof(uint8_t));
+    run.workers = (BatchWorker_t *)malloc(num_threads * sizeof(BatchWorker_t));
+    if (run.cycle_limits == NULL || run.finished == NULL || run.workers == NULL) {
+        fprintf(stderr, "Failed to allocate memory for batch run\n");
+        exit(ERR_NO_MEM);
+    }
+    for (uint32_t i = 0; i < batch->num_instances; i++) {
+        run.cycle_limits[i] = batch->states[i]->cycles + max_cycles;
+    }
+
+    // deal groups out in contiguous runs, so neighbouring groups share a worker until stealing starts
+    for (uint32_t w = 0; w < num_threads; w++) {
+        BatchWorker_t *worker = &run.workers[w];
+        worker->run = &run;
+        worker->id = w;
+        worker->seed = 2463534242u + w * 2654435761u;
+        deque_init(&worker->deque, run.num_groups);
+        worker->slots = (sf_t *)malloc(run.group_size * sizeof(sf_t));
+        worker->held = (SfSnapshot_t **)malloc(run.group_size * sizeof(SfSnapshot_t *));
+        if (worker->slots == NULL || worker->held == NULL) {
+            fprintf(stderr, "Failed to allocate memory for batch worker\n");
+            exit(ERR_NO_MEM);
+        }
+        for (uint32_t slot = 0; slot < run.group_size; slot++) {
+            worker->slots[slot] = *batch->prototype;
+            worker->held[slot] = copy_snapshot(batch->base);
+        }
+        uint32_t first = (uint64_t)run.num_groups * w / num_threads;
+        uint32_t last = (uint64_t)run.num_groups * (w + 1) / num_threads;
+        for (uint32_t i = last; i > first; i--) {
+            deque_push(&worker->deque, i - 1); // taken from the bottom, so push in reverse
+        }
+    }
+
+    // calling thread is worker 0
+    for (uint32_t w = 1; w < num_threads; w++) {
+        if (pthread_create(&run.workers[w].thread, NULL, batch_worker, &run.workers[w]) != 0) {
+            fprintf(stderr, "Failed to create batch worker thread\n");
+            exit(ERR_THREAD);
+        }
+    }
+    batch_worker(&run.workers[0]);
+    for (uint32_t w = 1; w < num_threads; w++) {
+        pthread_join(run.workers[w].thread, NULL);
+    }
+
+    for (uint32_t w = 0; w < num_threads; w++) {
+        for (uint32_t slot = 0; slot < run.group_size; slot++) {
+            free_snapshot(run.workers[w].held[slot]);
+        }
+        free(run.workers[w].held);
+        free(run.workers[w].slots);
+        free(run.workers[w].deque.entries);
+    }
+    free(run.workers);
+    free(run.finished);
+    free(run.cycle_limits);
+}
+
+/* write_batch_results
+ *      DESCRIPTION: writes one line per instance holding its index, why it stopped, its registers and cycle count,
+ *                   then the bytes of every passed range in hex
+ *      INPUTS: batch -- batch that has been run
+ *              file_path -- path of results file, overwritten if it exists
+ *              ranges -- memory ranges to dump from every instance
+ *              num_ranges -- number of ranges
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: writes results file
+ */
+void write_batch_results(Batch_t *batch, const char *file_path, const BatchRange_t *ranges, uint32_t num_ranges) {
+    FILE *fp = fopen(file_path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open file %s\n", file_path);
+        exit(ERR_FILE_NOOPEN);
+    }
+
+    for (uint32_t i = 0; i < batch->num_instances; i++) {
+        const SfSnapshot_t *state = batch->states[i];
+        fprintf(fp, "%u %s A=%02X X=%02X Y=%02X P=%02X SP=%04X PC=%04X CYC=%llu", i,
+                batch->exits[i] == RUN_BRK ? "BRK" : "BUDGET", state->accumulator, state->x_index, state->y_index,
+                state->status, state->esp, state->pc, (unsigned long long)state->cycles);
+        for (uint32_t r = 0; r < num_ranges; r++) {
+            fprintf(fp, " $%04X:", ranges[r].start);
+            for (uint32_t address = ranges[r].start; address <= ranges[r].end; address++) {
+                fprintf(fp, "%02X", paged_read(state->memory, address));
+            }
+        }
+        fprintf(fp, "\n");
+    }
+
+    fclose(fp);
+}
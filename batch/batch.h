@@ -0,0 +1,35 @@
+#ifndef __BATCH_H
+#define __BATCH_H
+
+#include <stdint.h>
+
+#include "../6502.h"
+#include "../memory/snapshot.h"
+
+#define BATCH_SLICE_CYCLES  (1 << 20) // cycles an instance runs before its worker checks the deques again
+
+// inclusive range of addresses written to the results file for every instance
+typedef struct BatchRange {
+    uint16_t start;
+    uint16_t end;
+} BatchRange_t;
+
+// pool of independent 6502 instances run together by run_batch; each instance is kept as a snapshot sharing
+// every page it hasn't written with the prototype, and only comes out into a flat sf_t while a worker runs it
+typedef struct Batch {
+    sf_t *prototype; // what fields snapshots don't hold (next_event, ...) are set to in the sf_t instances run in
+    SfSnapshot_t *base; // snapshot of prototype, which every instance starts as a copy of
+    SfSnapshot_t **states; // current state of every instance
+    RunExit_t *exits; // why each instance stopped (RUN_BRK, or RUN_BUDGET once its cycle budget ran out)
+    uint32_t num_instances;
+    uint8_t lockstep; // nonzero to run groups of LOCKSTEP_LANES neighbouring instances on the lockstep engine
+} Batch_t;
+
+Batch_t *new_batch(const sf_t *prototype, uint32_t num_instances);
+void free_batch(Batch_t *batch);
+void batch_get_instance(const Batch_t *batch, uint32_t index, sf_t *sf);
+void batch_set_instance(Batch_t *batch, uint32_t index, sf_t *sf);
+void run_batch(Batch_t *batch, uint32_t num_threads, uint64_t max_cycles);
+void write_batch_results(Batch_t *batch, const char *file_path, const BatchRange_t *ranges, uint32_t num_ranges);
+
+#endif
@@ -0,0 +1,866 @@
+#include <string.h>
+
+#include "lockstep.h"
+
+/* LOCKSTEP ENGINE
+ * a lockstep group keeps the registers and cycle counts of up to LOCKSTEP_LANES instances side by side in vectors
+ * (structure of arrays), decodes every instruction once and runs it on all lanes of the group together; loads and
+ * stores go to each lane's own memory, except that a load every lane makes from the same address of a page all
+ * lanes hold alike is done once; stores are recorded through record_stores like any CPU store
+ * lanes only share an instruction while they share a pc: once a branch or a return splits the group, the lanes at
+ * the lowest pc run on while the others are parked, and rejoin them when the group reaches their pc (taking the
+ * lowest pc first lets skipped if-bodies and finished loops reconverge); a lane left alone at the lowest pc for
+ * more than a few instructions is peeled off to process_line until it catches up with the rest
+ * opcodes without a vector implementation (stack, JSR/RTS, decimal arithmetic...) run through process_line on every
+ * lane of the group
+ */
+
+typedef uint32_t Lanes_t __attribute__((vector_size(LOCKSTEP_LANES * sizeof(uint32_t)))); // one value per lane
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define LOCKSTEP_TARGETS __attribute__((target_clones("avx2", "default"))) // AVX2 if the CPU has it, SSE2 otherwise
+#else
+#define LOCKSTEP_TARGETS
+#endif
+// everything run_group calls per instruction is inlined into it, so each target gets its own copy
+#define LANE_INLINE static inline __attribute__((always_inline))
+
+#define LOCKSTEP_NO_PC      (0x10000) // parked_min while no lane is parked, above every pc
+#define LOCKSTEP_MAX_BUDGET (1u << 30) // most cycles a lane runs per group, so cycles spent fit in a 32 bit lane
+#define LOCKSTEP_SOLO_STEPS 32 // steps a lone active lane runs in the vectors before it is peeled off to process_line
+
+#define PAGE_UNKNOWN    0 // page not compared since it last changed
+#define PAGE_SAME       1 // page holds the same bytes in every running lane
+#define PAGE_VARIES     2 // page may differ, so instructions on it are compared lane by lane
+
+#define FLAG(index)     (1u << (index))
+
+// registers and cycle counts of a lockstep group; parked lanes keep their values, only their pc moves to lane_pc
+typedef struct Lockstep {
+    Lanes_t a;
+    Lanes_t x;
+    Lanes_t y;
+    Lanes_t p; // status, with negative and zero flags always up to date
+    Lanes_t spent; // cycles run by each lane since it joined the group
+    Lanes_t budget; // cycles each lane may run before it stops with RUN_BUDGET
+    Lanes_t active_mask; // all ones in lanes of the next instruction
+    uint32_t active; // bit per lane of the next instruction, all at pc
+    uint32_t running; // bit per lane that hasn't stopped yet, active or parked
+    uint32_t pc; // pc of active lanes
+    uint32_t parked_min; // lowest pc of parked lanes, LOCKSTEP_NO_PC if there are none
+    uint32_t solo_steps; // steps run in a row with a single active lane
+    uint32_t slack; // cycles every active lane can run before the first of them may use up its budget
+    Lanes_t lane_pc; // pc of every lane that isn't active
+    uint16_t esp[LOCKSTEP_LANES];
+    uint64_t start_cycles[LOCKSTEP_LANES]; // sf->cycles of every lane when it joined the group
+    uint8_t *memory[LOCKSTEP_LANES]; // memory of every lane, lanes with no instance use another lane's
+    sf_t *sf[LOCKSTEP_LANES];
+    RunExit_t *exits[LOCKSTEP_LANES];
+    uint8_t page_state[NUM_PAGES]; // PAGE_UNKNOWN, PAGE_SAME or PAGE_VARIES for every page
+    uint8_t same_pages[NUM_PAGES]; // pages verify_page found PAGE_SAME, some may have changed state since
+    uint32_t num_same;
+} Lockstep_t;
+
+// operations run on all lanes of a group, ordered so ranges can be tested: reads (which pay page crossing penalties)
+// up to LS_LDY, then stores, then read-modify-writes up to LS_DEC
+typedef enum {
+    LS_SCALAR = 0, // run through process_line on every lane
+    LS_ORA, LS_AND, LS_EOR, LS_ADC, LS_SBC, LS_CMP, LS_CPX, LS_CPY, LS_BIT, LS_LDA, LS_LDX, LS_LDY,
+    LS_STA, LS_STX, LS_STY,
+    LS_ASL, LS_LSR, LS_ROL, LS_ROR, LS_INC, LS_DEC,
+    LS_INX, LS_INY, LS_DEX, LS_DEY, LS_TAX, LS_TAY, LS_TXA, LS_TYA,
+    LS_CLC, LS_SEC, LS_CLI, LS_SEI, LS_CLD, LS_SED, LS_CLV, LS_NOP,
+    LS_BRANCH, LS_JMP
+} LaneOperation_t;
+
+// operand of a lane operation; effective addresses are computed per lane, with the same wrapping as the core
+typedef enum {
+    LANE_IMP = 0, LANE_REL, LANE_ACCUM, LANE_IMM, LANE_ZPG, LANE_ZPG_X, LANE_ZPG_Y, LANE_ABS, LANE_ABS_X, LANE_ABS_Y,
+    LANE_IND_X, LANE_IND_Y
+} LaneMode_t;
+
+typedef struct LaneOp {
+    uint8_t operation; // LaneOperation_t
+    uint8_t mode; // LaneMode_t
+} LaneOp_t;
+
+#define LANE_OP(operation, mode) { LS_##operation, LANE_##mode }
+
+// vector implementation of every opcode, indexed by opcode byte; missing opcodes are LS_SCALAR
+static const LaneOp_t lane_ops[256] = {
+    [0x09] = LANE_OP(ORA, IMM), [0x05] = LANE_OP(ORA, ZPG), [0x15] = LANE_OP(ORA, ZPG_X), [0x0D] = LANE_OP(ORA, ABS),
+    [0x1D] = LANE_OP(ORA, ABS_X), [0x19] = LANE_OP(ORA, ABS_Y), [0x01] = LANE_OP(ORA, IND_X), [0x11] = LANE_OP(ORA, IND_Y),
+    [0x29] = LANE_OP(AND, IMM), [0x25] = LANE_OP(AND, ZPG), [0x35] = LANE_OP(AND, ZPG_X), [0x2D] = LANE_OP(AND, ABS),
+    [0x3D] = LANE_OP(AND, ABS_X), [0x39] = LANE_OP(AND, ABS_Y), [0x21] = LANE_OP(AND, IND_X), [0x31] = LANE_OP(AND, IND_Y),
+    [0x49] = LANE_OP(EOR, IMM), [0x45] = LANE_OP(EOR, ZPG), [0x55] = LANE_OP(EOR, ZPG_X), [0x4D] = LANE_OP(EOR, ABS),
+    [0x5D] = LANE_OP(EOR, ABS_X), [0x59] = LANE_OP(EOR, ABS_Y), [0x41] = LANE_OP(EOR, IND_X), [0x51] = LANE_OP(EOR, IND_Y),
+    [0x69] = LANE_OP(ADC, IMM), [0x65] = LANE_OP(ADC, ZPG), [0x75] = LANE_OP(ADC, ZPG_X), [0x6D] = LANE_OP(ADC, ABS),
+    [0x7D] = LANE_OP(ADC, ABS_X), [0x79] = LANE_OP(ADC, ABS_Y), [0x61] = LANE_OP(ADC, IND_X), [0x71] = LANE_OP(ADC, IND_Y),
+    [0xE9] = LANE_OP(SBC, IMM), [0xE5] = LANE_OP(SBC, ZPG), [0xF5] = LANE_OP(SBC, ZPG_X), [0xED] = LANE_OP(SBC, ABS),
+    [0xFD] = LANE_OP(SBC, ABS_X), [0xF9] = LANE_OP(SBC, ABS_Y), [0xE1] = LANE_OP(SBC, IND_X), [0xF1] = LANE_OP(SBC, IND_Y),
+    [0xC9] = LANE_OP(CMP, IMM), [0xC5] = LANE_OP(CMP, ZPG), [0xD5] = LANE_OP(CMP, ZPG_X), [0xCD] = LANE_OP(CMP, ABS),
+    [0xDD] = LANE_OP(CMP, ABS_X), [0xD9] = LANE_OP(CMP, ABS_Y), [0xC1] = LANE_OP(CMP, IND_X), [0xD1] = LANE_OP(CMP, IND_Y),
+    [0xA9] = LANE_OP(LDA, IMM), [0xA5] = LANE_OP(LDA, ZPG), [0xB5] = LANE_OP(LDA, ZPG_X), [0xAD] = LANE_OP(LDA, ABS),
+    [0xBD] = LANE_OP(LDA, ABS_X), [0xB9] = LANE_OP(LDA, ABS_Y), [0xA1] = LANE_OP(LDA, IND_X), [0xB1] = LANE_OP(LDA, IND_Y),
+    [0x85] = LANE_OP(STA, ZPG), [0x95] = LANE_OP(STA, ZPG_X), [0x8D] = LANE_OP(STA, ABS), [0x9D] = LANE_OP(STA, ABS_X),
+    [0x99] = LANE_OP(STA, ABS_Y), [0x81] = LANE_OP(STA, IND_X), [0x91] = LANE_OP(STA, IND_Y),
+    [0xA2] = LANE_OP(LDX, IMM), [0xA6] = LANE_OP(LDX, ZPG), [0xB6] = LANE_OP(LDX, ZPG_Y), [0xAE] = LANE_OP(LDX, ABS),
+    [0xBE] = LANE_OP(LDX, ABS_Y),
+    [0xA0] = LANE_OP(LDY, IMM), [0xA4] = LANE_OP(LDY, ZPG), [0xB4] = LANE_OP(LDY, ZPG_X), [0xAC] = LANE_OP(LDY, ABS),
+    [0xBC] = LANE_OP(LDY, ABS_X),
+    [0x86] = LANE_OP(STX, ZPG), [0x96] = LANE_OP(STX, ZPG_Y), [0x8E] = LANE_OP(STX, ABS),
+    [0x84] = LANE_OP(STY, ZPG), [0x94] = LANE_OP(STY, ZPG_X), [0x8C] = LANE_OP(STY, ABS),
+    [0xE0] = LANE_OP(CPX, IMM), [0xE4] = LANE_OP(CPX, ZPG), [0xEC] = LANE_OP(CPX, ABS),
+    [0xC0] = LANE_OP(CPY, IMM), [0xC4] = LANE_OP(CPY, ZPG), [0xCC] = LANE_OP(CPY, ABS),
+    [0x24] = LANE_OP(BIT, ZPG), [0x2C] = LANE_OP(BIT, ABS),
+    [0x0A] = LANE_OP(ASL, ACCUM), [0x06] = LANE_OP(ASL, ZPG), [0x16] = LANE_OP(ASL, ZPG_X), [0x0E] = LANE_OP(ASL, ABS),
+    [0x1E] = LANE_OP(ASL, ABS_X),
+    [0x4A] = LANE_OP(LSR, ACCUM), [0x46] = LANE_OP(LSR, ZPG), [0x56] = LANE_OP(LSR, ZPG_X), [0x4E] = LANE_OP(LSR, ABS),
+    [0x5E] = LANE_OP(LSR, ABS_X),
+    [0x2A] = LANE_OP(ROL, ACCUM), [0x26] = LANE_OP(ROL, ZPG), [0x36] = LANE_OP(ROL, ZPG_X), [0x2E] = LANE_OP(ROL, ABS),
+    [0x3E] = LANE_OP(ROL, ABS_X),
+    [0x6A] = LANE_OP(ROR, ACCUM), [0x66] = LANE_OP(ROR, ZPG), [0x76] = LANE_OP(ROR, ZPG_X), [0x6E] = LANE_OP(ROR, ABS),
+    [0x7E] = LANE_OP(ROR, ABS_X),
+    [0xE6] = LANE_OP(INC, ZPG), [0xF6] = LANE_OP(INC, ZPG_X), [0xEE] = LANE_OP(INC, ABS), [0xFE] = LANE_OP(INC, ABS_X),
+    [0xC6] = LANE_OP(DEC, ZPG), [0xD6] = LANE_OP(DEC, ZPG_X), [0xCE] = LANE_OP(DEC, ABS), [0xDE] = LANE_OP(DEC, ABS_X),
+    [OP_INX] = LANE_OP(INX, IMP), [OP_INY] = LANE_OP(INY, IMP), [OP_DEX] = LANE_OP(DEX, IMP), [OP_DEY] = LANE_OP(DEY, IMP),
+    [OP_TAX] = LANE_OP(TAX, IMP), [OP_TAY] = LANE_OP(TAY, IMP), [OP_TXA] = LANE_OP(TXA, IMP), [OP_TYA] = LANE_OP(TYA, IMP),
+    [OP_CLC] = LANE_OP(CLC, IMP), [OP_SEC] = LANE_OP(SEC, IMP), [OP_CLI] = LANE_OP(CLI, IMP), [OP_SEI] = LANE_OP(SEI, IMP),
+    [OP_CLD] = LANE_OP(CLD, IMP), [OP_SED] = LANE_OP(SED, IMP), [OP_CLV] = LANE_OP(CLV, IMP), [OP_NOP] = LANE_OP(NOP, IMP),
+    [OP_BPL] = LANE_OP(BRANCH, REL), [OP_BMI] = LANE_OP(BRANCH, REL), [OP_BVC] = LANE_OP(BRANCH, REL),
+    [OP_BVS] = LANE_OP(BRANCH, REL), [OP_BCC] = LANE_OP(BRANCH, REL), [OP_BCS] = LANE_OP(BRANCH, REL),
+    [OP_BNE] = LANE_OP(BRANCH, REL), [OP_BEQ] = LANE_OP(BRANCH, REL),
+    [OP_JMP] = LANE_OP(JMP, ABS)
+};
+
+// flag tested by branches, indexed by top two bits of opcode; bit 5 of opcode gives the value that takes the branch
+static const uint32_t branch_flags[4] = {
+    FLAG(NEGATIVE_INDEX), FLAG(OVERFLOW_INDEX), FLAG(CARRY_INDEX), FLAG(ZERO_INDEX)
+};
+
+// bit of every lane, LOCKSTEP_LANES must match its length
+static const Lanes_t lane_select = { 1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, 1 << 6, 1 << 7 };
+
+/* lane_bits
+ *      DESCRIPTION: packs lanes that are all ones/all zeros into a bit per lane
+ */
+LANE_INLINE uint32_t lane_bits(const Lanes_t *mask) {
+    Lanes_t bits = *mask & lane_select;
+    bits |= __builtin_shuffle(bits, (Lanes_t){ 4, 5, 6, 7, 0, 1, 2, 3 });
+    bits |= __builtin_shuffle(bits, (Lanes_t){ 2, 3, 0, 1, 6, 7, 4, 5 });
+    bits |= __builtin_shuffle(bits, (Lanes_t){ 1, 0, 3, 2, 5, 4, 7, 6 });
+    return bits[0];
+}
+
+/* verify_page
+ *      DESCRIPTION: compares page across running lanes
+ *      INPUTS: ls -- lockstep group
+ *              page -- page to compare
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: sets page_state of page to PAGE_SAME or PAGE_VARIES
+ */
+static void verify_page(Lockstep_t *ls, uint32_t page) {
+    int lead = __builtin_ctz(ls->running);
+    ls->page_state[page] = PAGE_SAME;
+    ls->same_pages[ls->num_same++] = page;
+    for (uint32_t bits = ls->running & (ls->running - 1); bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        if (memcmp(ls->memory[lane] + (page << 8), ls->memory[lead] + (page << 8), 0x100) != 0) {
+            ls->page_state[page] = PAGE_VARIES;
+            return;
+        }
+    }
+}
+
+/* same_address
+ *      DESCRIPTION: returns nonzero if every active lane has the same address
+ */
+LANE_INLINE int same_address(const Lockstep_t *ls, const Lanes_t *address) {
+    Lanes_t same = (Lanes_t)(*address == (*address)[__builtin_ctz(ls->active)]);
+    return (lane_bits(&same) & ls->active) == ls->active;
+}
+
+/* load_lanes
+ *      DESCRIPTION: reads the byte at every lane's address from that lane's memory into value; lanes running the
+ *                   same code mostly read the same address, which is read once if its page holds the same bytes in
+ *                   every lane
+ */
+LANE_INLINE void load_lanes(Lockstep_t *ls, const Lanes_t *address, Lanes_t *value) {
+    if (same_address(ls, address)) {
+        uint32_t target = (*address)[__builtin_ctz(ls->active)];
+        if (ls->page_state[target >> 8] == PAGE_UNKNOWN) {
+            verify_page(ls, target >> 8);
+        }
+        if (ls->page_state[target >> 8] == PAGE_SAME) {
+            *value = (Lanes_t){ 0 } + ls->memory[__builtin_ctz(ls->active)][target];
+            return;
+        }
+        for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+            (*value)[lane] = ls->memory[lane][target];
+        }
+        return;
+    }
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        (*value)[lane] = ls->memory[lane][(*address)[lane]];
+    }
+}
+
+/* store_lanes
+ *      DESCRIPTION: writes the value of every active lane to its address in that lane's memory, after passing the
+ *                   stores to record_stores like any store of the CPU; a page written may now differ between lanes,
+ *                   so its instructions are compared from then on
+ */
+LANE_INLINE void store_lanes(Lockstep_t *ls, const Lanes_t *address, const Lanes_t *value) {
+    sf_t *sfs[LOCKSTEP_LANES];
+    uint16_t targets[LOCKSTEP_LANES];
+    uint8_t *bytes[LOCKSTEP_LANES];
+    uint8_t values[LOCKSTEP_LANES];
+    uint32_t num_stores = 0;
+    for (uint32_t bits = ls->active; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        uint32_t target = (*address)[lane];
+        sfs[num_stores] = ls->sf[lane];
+        targets[num_stores] = target;
+        bytes[num_stores] = &ls->memory[lane][target];
+        values[num_stores++] = (*value)[lane];
+        if (ls->page_state[target >> 8] == PAGE_SAME) {
+            ls->page_state[target >> 8] = PAGE_VARIES;
+        }
+    }
+    record_stores(sfs, targets, num_stores); // one call per step, so the vectors stay in registers around it
+    for (uint32_t i = 0; i < num_stores; i++) {
+        *bytes[i] = values[i];
+    }
+}
+
+// vectors are only ever passed by pointer (or inside macros), as the SSE2 and AVX2 targets pass them differently
+
+// all ones in the lanes whose bit is set in bits, all zeros elsewhere
+#define LANE_MASK(bits)             ((Lanes_t)((lane_select & (bits)) != 0))
+
+// value in the lanes selected by mask, old everywhere else
+#define MERGE(old, value, mask)     ((old) ^ (((old) ^ (value)) & (mask)))
+
+// status with negative and zero flags of every lane replaced by the ones of result
+#define WITH_NEGATIVE_AND_ZERO(status, result)                                                          \
+    (((status) & ~(FLAG(NEGATIVE_INDEX)|FLAG(ZERO_INDEX))) | ((result) & FLAG(NEGATIVE_INDEX)) |       \
+     ((Lanes_t)((result) == 0) & FLAG(ZERO_INDEX)))
+
+// status with carry flag of every lane replaced by carry (0 or 1)
+#define WITH_CARRY(status, carry)   (((status) & ~FLAG(CARRY_INDEX)) | ((carry) << CARRY_INDEX))
+
+// sum (at most $1FF) minus $FF once if it reaches $FF; applied twice it is sum modulo $FF, like ZPG_X_ADDRESS
+#define WRAP_ONCE(sum)              ((sum) - ((Lanes_t)((sum) >= 0xFF) & 0xFF))
+#define WRAP_ZERO_PAGE(sum)         WRAP_ONCE(WRAP_ONCE(sum))
+
+// absolute address plus index modulo $FFFF, like ABS_X_ADDRESS
+#define WRAP_ABSOLUTE(sum)          ((sum) - ((Lanes_t)((sum) >= 0xFFFF) & 0xFFFF))
+
+/* lanes_min
+ *      DESCRIPTION: returns the lowest value of all lanes
+ */
+LANE_INLINE uint32_t lanes_min(const Lanes_t *values) {
+    Lanes_t min = *values;
+    Lanes_t other = __builtin_shuffle(min, (Lanes_t){ 4, 5, 6, 7, 0, 1, 2, 3 });
+    min = MERGE(min, other, (Lanes_t)(other < min));
+    other = __builtin_shuffle(min, (Lanes_t){ 2, 3, 0, 1, 6, 7, 4, 5 });
+    min = MERGE(min, other, (Lanes_t)(other < min));
+    other = __builtin_shuffle(min, (Lanes_t){ 1, 0, 3, 2, 5, 4, 7, 6 });
+    min = MERGE(min, other, (Lanes_t)(other < min));
+    return min[0];
+}
+
+/* load_lane
+ *      DESCRIPTION: copies registers of instance into its lane
+ *      INPUTS: ls -- lockstep group
+ *              lane -- lane of instance
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies lane of group, pc goes to lane_pc
+ */
+static void load_lane(Lockstep_t *ls, int lane) {
+    const sf_t *sf = ls->sf[lane];
+    ls->a[lane] = sf->accumulator;
+    ls->x[lane] = sf->x_index;
+    ls->y[lane] = sf->y_index;
+    ls->p[lane] = sf->status;
+    ls->esp[lane] = sf->esp;
+    ls->lane_pc[lane] = sf->pc;
+    ls->spent[lane] = sf->cycles - ls->start_cycles[lane];
+}
+
+/* store_lane
+ *      DESCRIPTION: copies registers of lane back into its instance
+ *      INPUTS: ls -- lockstep group
+ *              lane -- lane to copy
+ *              pc -- current pc of lane
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies instance of lane
+ */
+static void store_lane(const Lockstep_t *ls, int lane, uint32_t pc) {
+    sf_t *sf = ls->sf[lane];
+    sf->accumulator = ls->a[lane];
+    sf->x_index = ls->x[lane];
+    sf->y_index = ls->y[lane];
+    sf->status = ls->p[lane];
+    sf->nz_pending = 0;
+    sf->esp = ls->esp[lane];
+    sf->pc = pc;
+    sf->cycles = ls->start_cycles[lane] + ls->spent[lane];
+}
+
+/* retire_lane
+ *      DESCRIPTION: stops running lane, handing its state back to its instance
+ *      INPUTS: ls -- lockstep group
+ *              lane -- lane to stop
+ *              pc -- current pc of lane
+ *              exit_reason -- why the lane stopped
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies instance of lane and its exit, removes lane from group (active_mask is left to caller)
+ */
+static void retire_lane(Lockstep_t *ls, int lane, uint32_t pc, RunExit_t exit_reason) {
+    store_lane(ls, lane, pc);
+    *ls->exits[lane] = exit_reason;
+    ls->running &= ~(1u << lane);
+    ls->active &= ~(1u << lane);
+}
+
+/* peel_lane
+ *      DESCRIPTION: takes lane out of the group for good and runs it on its own until it stops
+ *      INPUTS: ls -- lockstep group
+ *              lane -- lane to run alone
+ *              pc -- current pc of lane
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: runs instance of lane, removes lane from group (active_mask is left to caller)
+ */
+static void peel_lane(Lockstep_t *ls, int lane, uint32_t pc) {
+    store_lane(ls, lane, pc);
+    *ls->exits[lane] = run_cycles(ls->sf[lane], ls->budget[lane] - ls->spent[lane]);
+    ls->running &= ~(1u << lane);
+    ls->active &= ~(1u << lane);
+}
+
+/* regroup
+ *      DESCRIPTION: makes the running lanes at the lowest pc the active ones and parks the rest
+ *      INPUTS: ls -- lockstep group whose running lanes all have their pc in lane_pc and haven't used up their budget
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies active lanes, pc, parked_min and slack of group
+ */
+LANE_INLINE void regroup(Lockstep_t *ls) {
+    // lanes that stopped sit above every pc, as do the active ones once parked_min is looked for
+    Lanes_t pc = MERGE((Lanes_t){ 0 } + LOCKSTEP_NO_PC, ls->lane_pc, LANE_MASK(ls->running));
+    uint32_t min_pc = lanes_min(&pc);
+    Lanes_t at_min = (Lanes_t)(pc == min_pc);
+    Lanes_t parked = pc | (at_min & LOCKSTEP_NO_PC);
+    ls->active = lane_bits(&at_min) & ls->running;
+    ls->parked_min = lanes_min(&parked);
+    ls->pc = min_pc;
+    ls->active_mask = LANE_MASK(ls->active);
+    Lanes_t left = MERGE((Lanes_t){ 0 } + LOCKSTEP_MAX_BUDGET, ls->budget - ls->spent, ls->active_mask);
+    ls->slack = lanes_min(&left);
+}
+
+/* finish_step
+ *      DESCRIPTION: stops lanes that used up their budget, then regroups if the active lanes split up, stopped or
+ *                   caught up with parked ones; budgets are only compared once the step may have used up slack
+ *      INPUTS: ls -- lockstep group
+ *              split -- nonzero if active lanes have their own pc in lane_pc, 0 if they are all at pc
+ *              cost -- most cycles the step charged any active lane, LOCKSTEP_MAX_BUDGET to compare budgets anyway
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: may retire lanes, modifies active lanes
+ */
+LANE_INLINE void finish_step(Lockstep_t *ls, int split, uint32_t cost) {
+    if (!split && ls->pc < ls->parked_min && ls->slack > cost) {
+        ls->slack -= cost;
+        return;
+    }
+
+    if (!split) {
+        ls->lane_pc = MERGE(ls->lane_pc, (Lanes_t){ 0 } + ls->pc, ls->active_mask);
+    }
+    Lanes_t spent_all = (Lanes_t)(ls->spent >= ls->budget);
+    for (uint32_t over = lane_bits(&spent_all) & ls->active; over; over &= over - 1) {
+        int lane = __builtin_ctz(over);
+        retire_lane(ls, lane, ls->lane_pc[lane], RUN_BUDGET);
+    }
+    if (ls->running) {
+        regroup(ls);
+    }
+}
+
+/* check_code
+ *      DESCRIPTION: makes sure every active lane holds the same instruction at pc as the first active lane, peeling
+ *                   off lanes that don't (their code was patched, or modified itself)
+ *      INPUTS: ls -- lockstep group
+ *              length -- length of instruction at pc in first active lane
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: may peel lanes off group
+ */
+LANE_INLINE void check_code(Lockstep_t *ls, uint32_t length) {
+    uint32_t first_page = ls->pc >> 8;
+    uint32_t last_page = (ls->pc + length - 1) >> 8;
+    if (last_page < NUM_PAGES) {
+        if (ls->page_state[first_page] == PAGE_UNKNOWN) {
+            verify_page(ls, first_page);
+        }
+        if (ls->page_state[last_page] == PAGE_UNKNOWN) {
+            verify_page(ls, last_page);
+        }
+        if (ls->page_state[first_page] == PAGE_SAME && ls->page_state[last_page] == PAGE_SAME) {
+            return;
+        }
+    }
+
+    int lead = __builtin_ctz(ls->active);
+    uint32_t peeled = 0;
+    for (uint32_t bits = ls->active & (ls->active - 1); bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        if (memcmp(ls->memory[lane] + ls->pc, ls->memory[lead] + ls->pc, length) != 0) {
+            peel_lane(ls, lane, ls->pc);
+            peeled = 1;
+        }
+    }
+    if (peeled) {
+        ls->active_mask = LANE_MASK(ls->active);
+    }
+}
+
+/* scalar_step
+ *      DESCRIPTION: runs instruction at pc with process_line on every active lane
+ *      INPUTS: ls -- lockstep group
+ *              opcode -- opcode at pc
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: runs instruction on instances of active lanes, may retire lanes or regroup
+ */
+static void scalar_step(Lockstep_t *ls, uint8_t opcode) {
+    uint32_t pc = LOCKSTEP_NO_PC;
+    int split = 0;
+    for (uint32_t bits = ls->active; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        store_lane(ls, lane, ls->pc);
+        process_line(ls->sf[lane]);
+        load_lane(ls, lane);
+        if (opcode == OP_BRK) {
+            retire_lane(ls, lane, ls->lane_pc[lane], RUN_BRK);
+            continue;
+        }
+        split |= pc != LOCKSTEP_NO_PC && ls->lane_pc[lane] != pc;
+        pc = ls->lane_pc[lane];
+    }
+    // vector stores mark the pages they write, the only other writes are pushes
+    if (ls->page_state[0x01] == PAGE_SAME) {
+        ls->page_state[0x01] = PAGE_VARIES;
+    }
+
+    if (ls->active == 0) {
+        if (ls->running) {
+            regroup(ls);
+        }
+        return;
+    }
+    if (!split) {
+        ls->pc = pc;
+    }
+    finish_step(ls, split, LOCKSTEP_MAX_BUDGET);
+}
+
+/* run_alone
+ *      DESCRIPTION: runs the only active lane with process_line until it stops or reaches the pc of a parked lane
+ *      INPUTS: ls -- lockstep group with a single active lane
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: runs instance of lane, may retire it, regroups
+ */
+static void run_alone(Lockstep_t *ls) {
+    int lane = __builtin_ctz(ls->active);
+    sf_t *sf = ls->sf[lane];
+    uint64_t limit = ls->start_cycles[lane] + ls->budget[lane];
+    store_lane(ls, lane, ls->pc);
+    ls->running &= ~(1u << lane);
+    ls->active = 0;
+
+    if (ls->running == 0) {
+        *ls->exits[lane] = run_cycles(sf, limit - sf->cycles);
+        return;
+    }
+    do {
+        uint8_t opcode = sf->memory[sf->pc];
+        process_line(sf);
+        if (opcode == OP_BRK) {
+            *ls->exits[lane] = RUN_BRK;
+            regroup(ls);
+            return;
+        }
+        if (sf->cycles >= limit) {
+            *ls->exits[lane] = RUN_BUDGET;
+            regroup(ls);
+            return;
+        }
+    } while (sf->pc < ls->parked_min);
+
+    // lane may have written anything, so pages the group shares are compared again with its copy
+    load_lane(ls, lane);
+    uint8_t *other = ls->memory[__builtin_ctz(ls->running)];
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < ls->num_same; i++) {
+        uint32_t page = ls->same_pages[i];
+        if (ls->page_state[page] != PAGE_SAME) {
+            continue;
+        }
+        if (memcmp(ls->memory[lane] + (page << 8), other + (page << 8), 0x100) != 0) {
+            ls->page_state[page] = PAGE_VARIES;
+            continue;
+        }
+        ls->same_pages[kept++] = page;
+    }
+    ls->num_same = kept;
+    ls->running |= 1u << lane;
+    regroup(ls);
+}
+
+/* step
+ *      DESCRIPTION: runs instruction at pc on every active lane
+ *      INPUTS: ls -- lockstep group with at least one active lane
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: runs instruction on active lanes, may retire lanes or regroup
+ */
+LANE_INLINE void step(Lockstep_t *ls) {
+    const uint8_t *code = ls->memory[__builtin_ctz(ls->active)] + ls->pc;
+    uint8_t opcode = code[0];
+    check_code(ls, opcode_length[opcode]);
+
+    const LaneOp_t op = lane_ops[opcode];
+    Lanes_t act = ls->active_mask;
+    Lanes_t p = ls->p;
+    Lanes_t decimal = (Lanes_t)((p & act & FLAG(DECIMAL_INDEX)) != 0);
+    if (op.operation == LS_SCALAR ||
+        ((op.operation == LS_ADC || op.operation == LS_SBC) && lane_bits(&decimal))) { // decimal arithmetic stays in the core
+        scalar_step(ls, opcode);
+        return;
+    }
+
+    Lanes_t address = { 0 };
+    Lanes_t operand = { 0 };
+    Lanes_t penalty = { 0 };
+    uint32_t absolute = (code[2] << 8) | code[1];
+    switch (op.mode) {
+        case LANE_ACCUM:
+            operand = ls->a;
+            break;
+        case LANE_IMM:
+            operand += code[1];
+            break;
+        case LANE_ZPG:
+            address += code[1];
+            break;
+        case LANE_ZPG_X:
+            address = WRAP_ZERO_PAGE(ls->x + code[1]);
+            break;
+        case LANE_ZPG_Y:
+            address = WRAP_ZERO_PAGE(ls->y + code[1]);
+            break;
+        case LANE_ABS:
+            address += absolute;
+            break;
+        case LANE_ABS_X:
+            address = WRAP_ABSOLUTE(ls->x + absolute);
+            penalty = (ls->x + code[1]) >> 8;
+            break;
+        case LANE_ABS_Y:
+            address = WRAP_ABSOLUTE(ls->y + absolute);
+            penalty = (ls->y + code[1]) >> 8;
+            break;
+        case LANE_IND_X: {
+            Lanes_t low_address = WRAP_ZERO_PAGE(ls->x + code[1]);
+            Lanes_t high_address = WRAP_ZERO_PAGE(ls->x + code[1] + 1);
+            Lanes_t low;
+            Lanes_t high;
+            load_lanes(ls, &low_address, &low);
+            load_lanes(ls, &high_address, &high);
+            address = (high << 8) | low;
+            break;
+        }
+        case LANE_IND_Y: {
+            Lanes_t low_address = address + code[1];
+            Lanes_t high_address = low_address + 1;
+            Lanes_t low;
+            Lanes_t high;
+            load_lanes(ls, &low_address, &low);
+            load_lanes(ls, &high_address, &high);
+            address = (((high << 8) | low) + ls->y) & 0xFFFF; // wraps like the bus
+            penalty = (low + ls->y) >> 8;
+            break;
+        }
+        default:
+            break;
+    }
+    if (op.mode >= LANE_ZPG && (op.operation <= LS_LDY || (op.operation >= LS_ASL && op.operation <= LS_DEC))) {
+        load_lanes(ls, &address, &operand);
+    }
+    if (op.operation > LS_LDY) {
+        penalty = (Lanes_t){ 0 }; // only reads pay for crossing a page
+    }
+
+    Lanes_t result;
+    uint32_t next_pc = (ls->pc + opcode_length[opcode]) & 0xFFFF;
+    int split = 0;
+    switch (op.operation) {
+        case LS_ORA:
+            result = ls->a | operand;
+            ls->a = MERGE(ls->a, result, act);
+            p = WITH_NEGATIVE_AND_ZERO(p, result);
+            break;
+        case LS_AND:
+            result = ls->a & operand;
+            ls->a = MERGE(ls->a, result, act);
+            p = WITH_NEGATIVE_AND_ZERO(p, result);
+            break;
+        case LS_EOR:
+            result = ls->a ^ operand;
+            ls->a = MERGE(ls->a, result, act);
+            p = WITH_NEGATIVE_AND_ZERO(p, result);
+            break;
+        case LS_ADC: {
+            Lanes_t addend = operand + (p & FLAG(CARRY_INDEX));
+            Lanes_t sum = ls->a + addend;
+            Lanes_t overflow = ((sum ^ ls->a) & (sum ^ addend) & 0x80) >> (7 - OVERFLOW_INDEX);
+            result = sum & 0xFF;
+            ls->a = MERGE(ls->a, result, act);
+            p = WITH_CARRY((p & ~FLAG(OVERFLOW_INDEX)) | overflow, sum >> 8);
+            p = WITH_NEGATIVE_AND_ZERO(p, result);
+            break;
+        }
+        case LS_SBC: {
+            Lanes_t subtrahend = operand + ((p & FLAG(CARRY_INDEX)) ^ FLAG(CARRY_INDEX));
+            result = (ls->a - subtrahend) & 0xFF;
+            Lanes_t overflow = ((result ^ ls->a) & (ls->a ^ subtrahend) & 0x80) >> (7 - OVERFLOW_INDEX);
+            p = WITH_CARRY((p & ~FLAG(OVERFLOW_INDEX)) | overflow, (Lanes_t)(ls->a >= subtrahend) & 1);
+            ls->a = MERGE(ls->a, result, act);
+            p = WITH_NEGATIVE_AND_ZERO(p, result);
+            break;
+        }
+        case LS_CMP:
+            p = WITH_NEGATIVE_AND_ZERO(WITH_CARRY(p, (Lanes_t)(ls->a >= operand) & 1), (ls->a - operand) & 0xFF);
+            break;
+        case LS_CPX:
+            p = WITH_NEGATIVE_AND_ZERO(WITH_CARRY(p, (Lanes_t)(ls->x >= operand) & 1), (ls->x - operand) & 0xFF);
+            break;
+        case LS_CPY:
+            p = WITH_NEGATIVE_AND_ZERO(WITH_CARRY(p, (Lanes_t)(ls->y >= operand) & 1), (ls->y - operand) & 0xFF);
+            break;
+        case LS_BIT: // like BIT_operation, sets but never clears negative and overflow
+            result = ls->a & operand;
+            p = (p & ~FLAG(ZERO_INDEX)) | ((Lanes_t)(result == 0) & FLAG(ZERO_INDEX)) |
+                (result & (FLAG(NEGATIVE_INDEX)|FLAG(OVERFLOW_INDEX)));
+            break;
+        case LS_LDA:
+            ls->a = MERGE(ls->a, operand, act);
+            p = WITH_NEGATIVE_AND_ZERO(p, operand);
+            break;
+        case LS_LDX:
+            ls->x = MERGE(ls->x, operand, act);
+            p = WITH_NEGATIVE_AND_ZERO(p, operand);
+            break;
+        case LS_LDY:
+            ls->y = MERGE(ls->y, operand, act);
+            p = WITH_NEGATIVE_AND_ZERO(p, operand);
+            break;
+        case LS_STA:
+            store_lanes(ls, &address, &ls->a);
+            break;
+        case LS_STX:
+            store_lanes(ls, &address, &ls->x);
+            break;
+        case LS_STY:
+            store_lanes(ls, &address, &ls->y);
+            break;
+        case LS_ASL:
+        case LS_LSR:
+        case LS_ROL:
+        case LS_ROR:
+        case LS_INC:
+        case LS_DEC:
+            if (op.operation == LS_ASL) {
+                result = (operand << 1) & 0xFF;
+                p = WITH_CARRY(p, operand >> 7);
+            } else if (op.operation == LS_LSR) {
+                result = operand >> 1;
+                p = WITH_CARRY(p, operand & 1);
+            } else if (op.operation == LS_ROL) {
+                result = ((operand << 1) | (p & FLAG(CARRY_INDEX))) & 0xFF;
+                p = WITH_CARRY(p, operand >> 7);
+            } else if (op.operation == LS_ROR) {
+                result = (operand >> 1) | ((p & FLAG(CARRY_INDEX)) << 7);
+                p = WITH_CARRY(p, operand & 1);
+            } else {
+                result = (operand + (op.operation == LS_INC ? 1 : 0xFF)) & 0xFF;
+            }
+            p = WITH_NEGATIVE_AND_ZERO(p, result);
+            if (op.mode == LANE_ACCUM) {
+                ls->a = MERGE(ls->a, result, act);
+            } else {
+                store_lanes(ls, &address, &result);
+            }
+            break;
+        case LS_INX:
+        case LS_DEX:
+            result = (ls->x + (op.operation == LS_INX ? 1 : 0xFF)) & 0xFF;
+            ls->x = MERGE(ls->x, result, act);
+            p = WITH_NEGATIVE_AND_ZERO(p, result);
+            break;
+        case LS_INY:
+        case LS_DEY:
+            result = (ls->y + (op.operation == LS_INY ? 1 : 0xFF)) & 0xFF;
+            ls->y = MERGE(ls->y, result, act);
+            p = WITH_NEGATIVE_AND_ZERO(p, result);
+            break;
+        case LS_TAX:
+            ls->x = MERGE(ls->x, ls->a, act);
+            p = WITH_NEGATIVE_AND_ZERO(p, ls->a);
+            break;
+        case LS_TAY:
+            ls->y = MERGE(ls->y, ls->a, act);
+            p = WITH_NEGATIVE_AND_ZERO(p, ls->a);
+            break;
+        case LS_TXA:
+            ls->a = MERGE(ls->a, ls->x, act);
+            p = WITH_NEGATIVE_AND_ZERO(p, ls->x);
+            break;
+        case LS_TYA:
+            ls->a = MERGE(ls->a, ls->y, act);
+            p = WITH_NEGATIVE_AND_ZERO(p, ls->y);
+            break;
+        case LS_CLC:
+            p &= ~FLAG(CARRY_INDEX);
+            break;
+        case LS_SEC:
+            p |= FLAG(CARRY_INDEX);
+            break;
+        case LS_CLI:
+            p &= ~FLAG(INTERRUPT_INDEX);
+            break;
+        case LS_SEI:
+            p |= FLAG(INTERRUPT_INDEX);
+            break;
+        case LS_CLD:
+            p &= ~FLAG(DECIMAL_INDEX);
+            break;
+        case LS_SED:
+            p |= FLAG(DECIMAL_INDEX);
+            break;
+        case LS_CLV:
+            p &= ~FLAG(OVERFLOW_INDEX);
+            break;
+        case LS_BRANCH: {
+            Lanes_t taken_all = (Lanes_t)((p & branch_flags[opcode >> 6]) != 0) ^ ((opcode & 0x20) ? 0 : ~0u);
+            uint32_t taken = lane_bits(&taken_all) & ls->active;
+            uint32_t target = (next_pc + (int8_t)code[1]) & 0xFFFF;
+            penalty = LANE_MASK(taken) & (1 + (((target ^ next_pc) >> 8) != 0));
+            if (taken == ls->active) {
+                next_pc = target;
+            } else if (taken != 0) {
+                Lanes_t lane_pc = MERGE((Lanes_t){ 0 } + next_pc, (Lanes_t){ 0 } + target, LANE_MASK(taken));
+                ls->lane_pc = MERGE(ls->lane_pc, lane_pc, act);
+                split = 1;
+            }
+            break;
+        }
+        case LS_JMP:
+            next_pc = absolute;
+            break;
+        default:
+            break;
+    }
+
+    ls->p = MERGE(ls->p, p, act);
+    ls->spent += (opcode_cycles[opcode] + penalty) & act;
+    ls->pc = next_pc;
+    finish_step(ls, split, opcode_cycles[opcode] + 2); // page crossing and taken branch penalties add at most 2
+}
+
+/* run_group
+ *      DESCRIPTION: runs lanes of group until every one of them has stopped
+ *      INPUTS: ls -- lockstep group, regrouped
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: runs instances of group
+ */
+LOCKSTEP_TARGETS
+static void run_group(Lockstep_t *ls) {
+    while (ls->running) {
+        if ((ls->active & (ls->active - 1)) != 0) {
+            ls->solo_steps = 0;
+        } else if (ls->active == ls->running || ++ls->solo_steps > LOCKSTEP_SOLO_STEPS) {
+            // short if-bodies are cheaper in the vectors than storing and loading the lane around them
+            ls->solo_steps = 0;
+            run_alone(ls);
+            continue;
+        }
+        step(ls);
+    }
+}
+
+/* plain_memory
+ *      DESCRIPTION: checks whether every page of instance is mapped to its own page of memory, which is all the
+ *                   lanes can access
+ *      INPUTS: sf -- instance to check
+ *      OUTPUTS: nonzero if instance can run in a lockstep group
+ *      SIDE EFFECTS: none
+ */
+static int plain_memory(const sf_t *sf) {
+#ifdef MEMORY_BUS
+    return sf->mapped_pages == 0;
+#else
+    return 1;
+#endif
+}
+
+/* run_lockstep
+ *      DESCRIPTION: runs every instance until it executes BRK or its cycle count reaches its limit, running groups of
+ *                   LOCKSTEP_LANES instances side by side; each instance ends up exactly as run_cycles would leave it
+ *      INPUTS: instances -- instances to run, neighbours should run the same code for the groups to stay together
+ *              num_instances -- number of instances
+ *              cycle_limits -- value of sf->cycles at or beyond which each instance stops
+ *              exits -- filled in with why each instance stopped (RUN_BRK or RUN_BUDGET)
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: runs instances
+ */
+void run_lockstep(sf_t **instances, uint32_t num_instances, const uint64_t *cycle_limits, RunExit_t *exits) {
+    for (uint32_t first = 0; first < num_instances; first += LOCKSTEP_LANES) {
+        uint32_t count = num_instances - first < LOCKSTEP_LANES ? num_instances - first : LOCKSTEP_LANES;
+        uint32_t pending = (1u << count) - 1;
+
+        while (pending) { // lanes only run LOCKSTEP_MAX_BUDGET cycles per group
+            Lockstep_t ls;
+            memset(&ls, 0, sizeof(ls));
+            for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                ls.sf[lane] = instances[first + (lane < (int)count ? lane : 0)];
+                ls.memory[lane] = ls.sf[lane]->memory;
+            }
+            for (uint32_t bits = pending; bits; bits &= bits - 1) {
+                int lane = __builtin_ctz(bits);
+                sf_t *sf = ls.sf[lane];
+                uint64_t limit = cycle_limits[first + lane];
+                ls.exits[lane] = &exits[first + lane];
+                if (sf->cycles >= limit) {
+                    exits[first + lane] = RUN_BUDGET;
+                } else if (!plain_memory(sf)) {
+                    exits[first + lane] = run_cycles(sf, limit - sf->cycles);
+                } else {
+                    ls.start_cycles[lane] = sf->cycles;
+                    ls.budget[lane] = limit - sf->cycles < LOCKSTEP_MAX_BUDGET ? limit - sf->cycles : LOCKSTEP_MAX_BUDGET;
+                    ls.running |= 1u << lane;
+                    load_lane(&ls, lane);
+                }
+            }
+            if (ls.running) {
+                regroup(&ls);
+                run_group(&ls);
+            }
+
+            pending = 0;
+            for (int lane = 0; lane < (int)count; lane++) {
+                if (exits[first + lane] == RUN_BUDGET && instances[first + lane]->cycles < cycle_limits[first + lane]) {
+                    pending |= 1u << lane;
+                }
+            }
+        }
+    }
+}
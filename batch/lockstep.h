@@ -0,0 +1,12 @@
+#ifndef __LOCKSTEP_H
+#define __LOCKSTEP_H
+
+#include <stdint.h>
+
+#include "../6502.h"
+
+#define LOCKSTEP_LANES  8 // instances one lockstep group runs side by side, one per vector lane
+
+void run_lockstep(sf_t **instances, uint32_t num_instances, const uint64_t *cycle_limits, RunExit_t *exits);
+
+#endif
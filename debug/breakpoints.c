@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "breakpoints.h"
+#include "../lib/lib.h"
+
+/* BREAKPOINTS
+ * a set is three bitmaps over the address space, one per kind, checked by the run loops of the thread it is armed
+ * on (use_breakpoints); the functions here keep count of the bits set, which is what lets a run without any fall
+ * back to the loop that doesn't check
+ */
+
+/* bitmap_of
+ *      DESCRIPTION: returns the bitmap of passed kind, which must be a single BREAK_ kind
+ */
+static uint64_t *bitmap_of(Breakpoints_t *breakpoints, uint8_t kind) {
+    return kind == BREAK_EXECUTE ? breakpoints->execute : kind == BREAK_READ ? breakpoints->read : breakpoints->write;
+}
+
+/* count_of
+ *      DESCRIPTION: returns the count the bits of passed kind are part of
+ */
+static uint32_t *count_of(Breakpoints_t *breakpoints, uint8_t kind) {
+    return kind == BREAK_EXECUTE ? &breakpoints->num_execute : &breakpoints->num_watch;
+}
+
+/* new_breakpoints
+ *      DESCRIPTION: creates an empty set of breakpoints
+ *      INPUTS: none
+ *      OUTPUTS: new set
+ *      SIDE EFFECTS: allocates memory
+ */
+Breakpoints_t *new_breakpoints(void) {
+    Breakpoints_t *breakpoints = (Breakpoints_t *)calloc(1, sizeof(Breakpoints_t));
+    if (breakpoints == NULL) {
+        fprintf(stderr, "Failed to allocate memory for breakpoints\n");
+        exit(ERR_NO_MEM);
+    }
+    return breakpoints;
+}
+
+/* free_breakpoints
+ *      DESCRIPTION: frees set of breakpoints, which must not be armed on any thread
+ *      INPUTS: breakpoints -- set to free
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: frees memory
+ */
+void free_breakpoints(Breakpoints_t *breakpoints) {
+    free(breakpoints);
+}
+
+/* set_breakpoint
+ *      DESCRIPTION: sets breakpoints of passed kinds on address
+ *      INPUTS: breakpoints -- set to add to
+ *              kinds -- BREAK_EXECUTE, BREAK_READ and/or BREAK_WRITE
+ *              address -- address to set them on
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies breakpoints
+ */
+void set_breakpoint(Breakpoints_t *breakpoints, uint8_t kinds, uint16_t address) {
+    for (uint8_t kind = BREAK_EXECUTE; kind <= BREAK_WRITE; kind <<= 1) {
+        uint64_t *bitmap = bitmap_of(breakpoints, kind);
+        if ((kinds & kind) && !BREAKPOINT_SET(bitmap, address)) {
+            bitmap[address >> 6] |= (uint64_t)1 << (address & 63);
+            (*count_of(breakpoints, kind))++;
+        }
+    }
+}
+
+/* clear_breakpoint
+ *      DESCRIPTION: clears breakpoints of passed kinds from address
+ *      INPUTS: breakpoints -- set to remove from
+ *              kinds -- BREAK_EXECUTE, BREAK_READ and/or BREAK_WRITE
+ *              address -- address to clear them from
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies breakpoints
+ */
+void clear_breakpoint(Breakpoints_t *breakpoints, uint8_t kinds, uint16_t address) {
+    for (uint8_t kind = BREAK_EXECUTE; kind <= BREAK_WRITE; kind <<= 1) {
+        uint64_t *bitmap = bitmap_of(breakpoints, kind);
+        if ((kinds & kind) && BREAKPOINT_SET(bitmap, address)) {
+            bitmap[address >> 6] &= ~((uint64_t)1 << (address & 63));
+            (*count_of(breakpoints, kind))--;
+        }
+    }
+}
+
+/* toggle_breakpoint
+ *      DESCRIPTION: sets a breakpoint of passed kind on address if there is none, clears it otherwise
+ *      INPUTS: breakpoints -- set to modify
+ *              kind -- one of BREAK_EXECUTE, BREAK_READ or BREAK_WRITE
+ *              address -- address to toggle it on
+ *      OUTPUTS: 1 if the breakpoint is now set, 0 if it is now clear
+ *      SIDE EFFECTS: modifies breakpoints
+ */
+int toggle_breakpoint(Breakpoints_t *breakpoints, uint8_t kind, uint16_t address) {
+    if (BREAKPOINT_SET(bitmap_of(breakpoints, kind), address)) {
+        clear_breakpoint(breakpoints, kind, address);
+        return 0;
+    }
+    set_breakpoint(breakpoints, kind, address);
+    return 1;
+}
+
+/* clear_all_breakpoints
+ *      DESCRIPTION: clears every breakpoint and watchpoint in set
+ *      INPUTS: breakpoints -- set to empty
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies breakpoints
+ */
+void clear_all_breakpoints(Breakpoints_t *breakpoints) {
+    memset(breakpoints->execute, 0, sizeof(breakpoints->execute));
+    memset(breakpoints->read, 0, sizeof(breakpoints->read));
+    memset(breakpoints->write, 0, sizeof(breakpoints->write));
+    breakpoints->num_execute = 0;
+    breakpoints->num_watch = 0;
+}
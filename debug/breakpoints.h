@@ -0,0 +1,15 @@
+#ifndef __BREAKPOINTS_H
+#define __BREAKPOINTS_H
+
+#include <stdint.h>
+
+#include "../6502.h"
+
+Breakpoints_t *new_breakpoints(void);
+void free_breakpoints(Breakpoints_t *breakpoints);
+void set_breakpoint(Breakpoints_t *breakpoints, uint8_t kinds, uint16_t address);
+void clear_breakpoint(Breakpoints_t *breakpoints, uint8_t kinds, uint16_t address);
+int toggle_breakpoint(Breakpoints_t *breakpoints, uint8_t kind, uint16_t address);
+void clear_all_breakpoints(Breakpoints_t *breakpoints);
+
+#endif
@@ -0,0 +1,322 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "callgraph.h"
+#include "../lib/lib.h"
+
+#define CALLGRAPH_GROWTH_FACTOR 2
+
+/* CALL GRAPH
+ * recorded runs go through process_line one instruction at a time; a JSR or BRK pushes a frame for the routine it
+ * enters onto a shadow call stack, and an RTS or RTI pops the frame whose return address it pulls, found by the
+ * stack pointer (frames entered deeper than it were left without returning, by a JMP out or by dropping the
+ * return address, and go with it; an RTS used as a computed jump matches no frame and pops nothing)
+ * cycles are charged to the routine on top of the stack whenever the stack changes: the JSR or BRK to its caller,
+ * the RTS or RTI to the routine it leaves; every distinct path of calls has a node of its own, which is what the
+ * folded stacks a flame graph is drawn from list
+ */
+
+// a called routine and its inclusive cycles, for ordering the report
+typedef struct RoutineCost {
+    uint16_t entry;
+    uint64_t inclusive_cycles;
+} RoutineCost_t;
+
+/* compare_inclusive
+ *      DESCRIPTION: qsort comparator putting routines with more inclusive cycles first, then lower addresses first
+ */
+static int compare_inclusive(const void *a, const void *b) {
+    const RoutineCost_t *cost_a = (const RoutineCost_t *)a;
+    const RoutineCost_t *cost_b = (const RoutineCost_t *)b;
+    if (cost_a->inclusive_cycles != cost_b->inclusive_cycles) {
+        return cost_a->inclusive_cycles < cost_b->inclusive_cycles ? 1 : -1;
+    }
+    return cost_a->entry - cost_b->entry;
+}
+
+/* routine_name
+ *      DESCRIPTION: fills name with the label at entry, or its address if no label is
+ */
+static void routine_name(const Table_t *labels, uint16_t entry, char *name) {
+    for (uint32_t i = 0; i < labels->size; i++) {
+        if (labels->data[i].key != NULL && labels->data[i].value == entry) {
+            snprintf(name, CALLGRAPH_NAME_SIZE, "%s", labels->data[i].key);
+            return;
+        }
+    }
+    snprintf(name, CALLGRAPH_NAME_SIZE, "$%04X", entry);
+}
+
+/* find_child
+ *      DESCRIPTION: returns the node for calls to entry made from parent, adding it if there is none yet
+ */
+static uint32_t find_child(CallGraph_t *graph, uint32_t parent, uint16_t entry) {
+    uint32_t child = graph->nodes[parent].first_child;
+    while (child != 0) {
+        if (graph->nodes[child].entry == entry) {
+            return child;
+        }
+        child = graph->nodes[child].next_sibling;
+    }
+    if (graph->num_nodes == graph->size) {
+        graph->nodes = (CallNode_t *)realloc(graph->nodes,
+                                             graph->size * CALLGRAPH_GROWTH_FACTOR * sizeof(CallNode_t));
+        if (graph->nodes == NULL) {
+            fprintf(stderr, "Failed to allocate memory for call graph\n");
+            exit(ERR_NO_MEM);
+        }
+        graph->size *= CALLGRAPH_GROWTH_FACTOR;
+    }
+    child = graph->num_nodes++;
+    graph->nodes[child].entry = entry;
+    graph->nodes[child].parent = parent;
+    graph->nodes[child].first_child = 0;
+    graph->nodes[child].next_sibling = graph->nodes[parent].first_child;
+    graph->nodes[child].self_cycles = 0;
+    graph->nodes[parent].first_child = child;
+    return child;
+}
+
+/* charge
+ *      DESCRIPTION: charges the cycles since the last charge to the routine on top of the stack
+ */
+static inline void charge(CallGraph_t *graph, uint64_t cycles) {
+    CallNode_t *node = &graph->nodes[graph->stack[graph->depth - 1].node];
+    node->self_cycles += cycles - graph->mark;
+    graph->routines[node->entry].self_cycles += cycles - graph->mark;
+    graph->mark = cycles;
+}
+
+/* enter_routine
+ *      DESCRIPTION: pushes a frame for the routine sf has just entered; past CALLGRAPH_MAX_DEPTH the routine stays
+ *                   part of its caller
+ */
+static void enter_routine(CallGraph_t *graph, const sf_t *sf) {
+    if (graph->depth == CALLGRAPH_MAX_DEPTH) {
+        return;
+    }
+    uint32_t node = find_child(graph, graph->stack[graph->depth - 1].node, sf->pc);
+    CallFrame_t *frame = &graph->stack[graph->depth++];
+    frame->node = node;
+    frame->esp = sf->esp;
+    frame->start = sf->cycles;
+
+    Routine_t *routine = &graph->routines[sf->pc];
+    routine->calls++;
+    routine->active++;
+    if (graph->depth > routine->max_depth) {
+        routine->max_depth = graph->depth;
+    }
+    if ((uint16_t)(STACK_START - sf->esp) > routine->max_stack) {
+        routine->max_stack = STACK_START - sf->esp;
+    }
+}
+
+/* leave_routines
+ *      DESCRIPTION: pops the frame an RTS or RTI run with passed stack pointer returns from, along with every frame
+ *                   entered after it
+ */
+static void leave_routines(CallGraph_t *graph, uint16_t esp, uint64_t cycles) {
+    while (graph->depth > 1 && graph->stack[graph->depth - 1].esp <= esp) {
+        const CallFrame_t *frame = &graph->stack[--graph->depth];
+        Routine_t *routine = &graph->routines[graph->nodes[frame->node].entry];
+        if (--routine->active == 0) {
+            routine->inclusive_cycles += cycles - frame->start;
+        }
+    }
+}
+
+/* inclusive_cycles
+ *      DESCRIPTION: returns the inclusive cycles of the routine at entry, counting its frames still on the stack as
+ *                   returning now
+ */
+static uint64_t inclusive_cycles(const CallGraph_t *graph, uint16_t entry) {
+    uint64_t cycles = graph->routines[entry].inclusive_cycles;
+    for (uint32_t i = 0; i < graph->depth; i++) {
+        if (graph->nodes[graph->stack[i].node].entry == entry) {
+            return cycles + graph->mark - graph->stack[i].start; // outermost frame covers the ones above it
+        }
+    }
+    return cycles;
+}
+
+/* write_node_stacks
+ *      DESCRIPTION: writes the folded stack of node and of every node below it, path holding the names leading up
+ *                   to node (without it) in its first length characters
+ */
+static void write_node_stacks(FILE *fp, const CallGraph_t *graph, const Table_t *labels, uint32_t node, char *path,
+                              size_t length) {
+    char name[CALLGRAPH_NAME_SIZE];
+    routine_name(labels, graph->nodes[node].entry, name);
+    size_t name_length = strlen(name);
+    if (length) {
+        path[length++] = ';';
+    }
+    memcpy(path + length, name, name_length + 1);
+    length += name_length;
+
+    if (graph->nodes[node].self_cycles) {
+        fprintf(fp, "%s %llu\n", path, (unsigned long long)graph->nodes[node].self_cycles);
+    }
+    for (uint32_t child = graph->nodes[node].first_child; child != 0; child = graph->nodes[child].next_sibling) {
+        write_node_stacks(fp, graph, labels, child, path, length);
+    }
+}
+
+/* new_call_graph
+ *      DESCRIPTION: starts following the calls of sf, with the routine it is running as the first frame
+ *      INPUTS: sf -- 6502 struct to follow
+ *      OUTPUTS: call graph holding only the routine at sf->pc
+ *      SIDE EFFECTS: allocates memory
+ */
+CallGraph_t *new_call_graph(const sf_t *sf) {
+    CallGraph_t *graph = (CallGraph_t *)calloc(1, sizeof(CallGraph_t));
+    if (graph == NULL || (graph->nodes = (CallNode_t *)malloc(CALLGRAPH_INIT_NODES * sizeof(CallNode_t))) == NULL) {
+        fprintf(stderr, "Failed to allocate memory for call graph\n");
+        exit(ERR_NO_MEM);
+    }
+    graph->size = CALLGRAPH_INIT_NODES;
+    graph->num_nodes = 1;
+    graph->nodes[0].entry = sf->pc;
+    graph->nodes[0].parent = 0;
+    graph->nodes[0].first_child = 0;
+    graph->nodes[0].next_sibling = 0;
+    graph->nodes[0].self_cycles = 0;
+    graph->depth = 1;
+    graph->stack[0].node = 0;
+    graph->stack[0].esp = sf->esp;
+    graph->stack[0].start = sf->cycles;
+    graph->mark = sf->cycles;
+    graph->routines[sf->pc].calls = 1;
+    graph->routines[sf->pc].active = 1;
+    graph->routines[sf->pc].max_depth = 1;
+    graph->routines[sf->pc].max_stack = STACK_START - sf->esp;
+    return graph;
+}
+
+/* free_call_graph
+ *      DESCRIPTION: frees call graph
+ *      INPUTS: graph -- call graph to free
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: frees memory
+ */
+void free_call_graph(CallGraph_t *graph) {
+    free(graph->nodes);
+    free(graph);
+}
+
+/* callgraph_run_cycles
+ *      DESCRIPTION: same as run_cycles, but the calls made are followed in graph; cycles sf ran outside of it since
+ *                   are charged to the routine that was on top of the stack
+ *      INPUTS: graph -- call graph of sf
+ *              sf -- 6502 struct
+ *              max_cycles -- number of clock cycles to run for
+ *              profile -- per-address counts to add to as profile_run_cycles would, or NULL
+ *      OUTPUTS: RUN_BRK if BRK was executed, RUN_BUDGET otherwise
+ *      SIDE EFFECTS: same as run_cycles, modifies graph and profile
+ */
+RunExit_t callgraph_run_cycles(CallGraph_t *graph, sf_t *sf, uint64_t max_cycles, Profile_t *profile) {
+    if (max_cycles == 0) {
+        return RUN_BUDGET;
+    }
+    sf->next_event = sf->cycles + max_cycles;
+    RunExit_t exit_reason = RUN_BUDGET;
+    while (sf->cycles < sf->next_event) {
+        uint16_t pc = sf->pc;
+        uint16_t esp = sf->esp;
+        uint8_t opcode = sf->memory[pc];
+        uint64_t cycles = sf->cycles;
+        process_line(sf);
+        if (profile != NULL) {
+            profile->executions[pc]++;
+            profile->cycles[pc] += sf->cycles - cycles;
+        }
+        if (opcode == OP_JSR || opcode == OP_BRK) {
+            charge(graph, sf->cycles);
+            enter_routine(graph, sf);
+            if (opcode == OP_BRK) {
+                exit_reason = RUN_BRK;
+                break;
+            }
+        } else if (opcode == OP_RTS || opcode == OP_RTI) {
+            charge(graph, sf->cycles);
+            leave_routines(graph, esp, sf->cycles);
+        }
+    }
+    charge(graph, sf->cycles);
+    return exit_reason;
+}
+
+/* write_folded_stacks
+ *      DESCRIPTION: writes one line per path of calls the run spent cycles at the end of, holding the routine names
+ *                   from the first one down separated by semicolons then the cycles, the format flame graph tools
+ *                   (flamegraph.pl, speedscope, inferno) take
+ *      INPUTS: graph -- call graph of a run
+ *              file_path -- path of folded stacks file, overwritten if it exists
+ *              labels -- label table of the program, routines without a label are named by address
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: writes folded stacks file
+ */
+void write_folded_stacks(const CallGraph_t *graph, const char *file_path, const Table_t *labels) {
+    FILE *fp = fopen(file_path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open file %s\n", file_path);
+        exit(ERR_FILE_NOOPEN);
+    }
+    char path[CALLGRAPH_MAX_DEPTH * CALLGRAPH_NAME_SIZE + 1]; // a name and a separator per frame
+    write_node_stacks(fp, graph, labels, 0, path, 0);
+    fclose(fp);
+}
+
+/* write_call_report
+ *      DESCRIPTION: writes a line per routine called ordered by inclusive cycles, holding its calls, inclusive and
+ *                   self cycles with their share of the run, and the deepest frame and most stack bytes in use it
+ *                   was entered with
+ *      INPUTS: graph -- call graph of a run
+ *              file_path -- path of report file, overwritten if it exists
+ *              labels -- label table of the program, routines without a label are named by address
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: writes report file
+ */
+void write_call_report(const CallGraph_t *graph, const char *file_path, const Table_t *labels) {
+    RoutineCost_t *costs = (RoutineCost_t *)malloc(MEMORY_SIZE * sizeof(RoutineCost_t));
+    if (costs == NULL) {
+        fprintf(stderr, "Failed to allocate memory for call report\n");
+        exit(ERR_NO_MEM);
+    }
+    FILE *fp = fopen(file_path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open file %s\n", file_path);
+        exit(ERR_FILE_NOOPEN);
+    }
+
+    uint32_t num_routines = 0;
+    uint64_t total_cycles = 0;
+    for (uint32_t entry = 0; entry < MEMORY_SIZE; entry++) {
+        if (graph->routines[entry].calls) {
+            costs[num_routines].entry = entry;
+            costs[num_routines].inclusive_cycles = inclusive_cycles(graph, entry);
+            num_routines++;
+            total_cycles += graph->routines[entry].self_cycles;
+        }
+    }
+    double percent = total_cycles ? 100.0 / total_cycles : 0.0;
+    qsort(costs, num_routines, sizeof(RoutineCost_t), compare_inclusive);
+
+    fprintf(fp, "CALLS: %u routines, %llu cycles\n\n", num_routines, (unsigned long long)total_cycles);
+    fprintf(fp, "%-*s       calls     inclusive       %%          self       %%  depth  stack\n",
+            CALLGRAPH_NAME_SIZE - 1, "routine");
+    for (uint32_t i = 0; i < num_routines; i++) {
+        const Routine_t *routine = &graph->routines[costs[i].entry];
+        char name[CALLGRAPH_NAME_SIZE];
+        routine_name(labels, costs[i].entry, name);
+        fprintf(fp, "%-*s  %10llu  %12llu  %5.1f%%  %12llu  %5.1f%%  %5u  %5u\n", CALLGRAPH_NAME_SIZE - 1, name,
+                (unsigned long long)routine->calls, (unsigned long long)costs[i].inclusive_cycles,
+                costs[i].inclusive_cycles * percent, (unsigned long long)routine->self_cycles,
+                routine->self_cycles * percent, routine->max_depth, routine->max_stack);
+    }
+
+    fclose(fp);
+    free(costs);
+}
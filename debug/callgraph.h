@@ -0,0 +1,56 @@
+#ifndef __CALLGRAPH_H
+#define __CALLGRAPH_H
+
+#include <stdint.h>
+
+#include "../6502.h"
+#include "../assembler/table.h"
+
+#define CALLGRAPH_MAX_DEPTH     128 // frames in the shadow call stack, as many JSRs as the 6502 stack holds
+#define CALLGRAPH_INIT_NODES    64
+#define CALLGRAPH_NAME_SIZE     32 // longest routine name written, including the null terminator
+
+// one path through the calls (the routine at the end of the chain of parents leading to the root)
+typedef struct CallNode {
+    uint16_t entry; // address the routine was entered at
+    uint32_t parent;
+    uint32_t first_child; // 0 if none, the root is node 0 and nobody's child
+    uint32_t next_sibling; // 0 if none
+    uint64_t self_cycles; // cycles spent in the routine on this path, not in its callees
+} CallNode_t;
+
+// routine on the shadow call stack
+typedef struct CallFrame {
+    uint32_t node;
+    uint16_t esp; // stack pointer after the return address was pushed, the RTS or RTI leaving the routine sees it
+    uint64_t start; // cycles when the routine was entered
+} CallFrame_t;
+
+// totals of every routine, keyed by entry address
+typedef struct Routine {
+    uint64_t calls;
+    uint64_t self_cycles;
+    uint64_t inclusive_cycles; // cycles between entry and return, callees included, recursive calls counted once
+    uint32_t active; // frames of the routine on the shadow call stack
+    uint32_t max_depth; // deepest frame the routine was entered at, the first routine being at 1
+    uint16_t max_stack; // most bytes of the 6502 stack in use as the routine was entered
+} Routine_t;
+
+// calls made by a run of one 6502, followed through JSR/RTS and BRK/RTI
+typedef struct CallGraph {
+    CallNode_t *nodes;
+    uint32_t num_nodes;
+    uint32_t size;
+    CallFrame_t stack[CALLGRAPH_MAX_DEPTH];
+    uint32_t depth;
+    uint64_t mark; // cycles up to which the routine on top of the stack has been charged
+    Routine_t routines[MEMORY_SIZE];
+} CallGraph_t;
+
+CallGraph_t *new_call_graph(const sf_t *sf);
+void free_call_graph(CallGraph_t *graph);
+RunExit_t callgraph_run_cycles(CallGraph_t *graph, sf_t *sf, uint64_t max_cycles, Profile_t *profile);
+void write_folded_stacks(const CallGraph_t *graph, const char *file_path, const Table_t *labels);
+void write_call_report(const CallGraph_t *graph, const char *file_path, const Table_t *labels);
+
+#endif
@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "profiler.h"
+#include "../lib/lib.h"
+
+/* PROFILER
+ * profile_run_cycles counts the executions and cycles of every address; the report maps addresses back to the
+ * program through the line map the assembler leaves in Program_t and the label table: first every executed
+ * address ordered by the cycles spent there, then the whole source with the cost of each line beside it
+ */
+
+static const Profile_t *sort_profile; // profile compare_cycles orders addresses by (qsort takes no context)
+
+/* compare_cycles
+ *      DESCRIPTION: qsort comparator putting addresses with more cycles first, then lower addresses first
+ */
+static int compare_cycles(const void *a, const void *b) {
+    uint16_t address_a = *(const uint16_t *)a;
+    uint16_t address_b = *(const uint16_t *)b;
+    if (sort_profile->cycles[address_a] != sort_profile->cycles[address_b]) {
+        return sort_profile->cycles[address_a] < sort_profile->cycles[address_b] ? 1 : -1;
+    }
+    return address_a - address_b;
+}
+
+/* name_addresses
+ *      DESCRIPTION: sets names and bases to the nearest label at or below every address and the address it marks,
+ *                   names is NULL below the first label
+ */
+static void name_addresses(const Table_t *labels, const char **names, uint16_t *bases) {
+    memset(names, 0, MEMORY_SIZE * sizeof(const char *));
+    for (uint32_t i = 0; i < labels->size; i++) {
+        if (labels->data[i].key != NULL && names[labels->data[i].value] == NULL) {
+            names[labels->data[i].value] = labels->data[i].key;
+        }
+    }
+    const char *name = NULL;
+    uint16_t base = 0;
+    for (uint32_t address = 0; address < MEMORY_SIZE; address++) {
+        if (names[address] != NULL) {
+            name = names[address];
+            base = address;
+        }
+        names[address] = name;
+        bases[address] = base;
+    }
+}
+
+/* print_source_line
+ *      DESCRIPTION: prints source line starting at line without its leading whitespace or line break
+ */
+static void print_source_line(FILE *fp, const uint8_t *line) {
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    int length = 0;
+    while (line[length] != '\0' && line[length] != '\n' && line[length] != '\r') {
+        length++;
+    }
+    fprintf(fp, "%.*s", length, (const char *)line);
+}
+
+/* new_profile
+ *      DESCRIPTION: creates a profile with nothing counted
+ *      INPUTS: none
+ *      OUTPUTS: new profile
+ *      SIDE EFFECTS: allocates memory
+ */
+Profile_t *new_profile(void) {
+    Profile_t *profile = (Profile_t *)calloc(1, sizeof(Profile_t));
+    if (profile == NULL) {
+        fprintf(stderr, "Failed to allocate memory for profile\n");
+        exit(ERR_NO_MEM);
+    }
+    return profile;
+}
+
+/* free_profile
+ *      DESCRIPTION: frees profile
+ *      INPUTS: profile -- profile to free
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: frees memory
+ */
+void free_profile(Profile_t *profile) {
+    free(profile);
+}
+
+/* write_profile_report
+ *      DESCRIPTION: writes the totals of profile, then a line per executed address ordered by cycles holding its
+ *                   label and offset, source line, executions, cycles, share of all cycles and source text, then
+ *                   the source annotated with the executions and cycles of every line
+ *      INPUTS: profile -- counts of a run of the program
+ *              file_path -- path of report file, overwritten if it exists
+ *              source -- null-terminated assembly the program was assembled from
+ *              lines -- line map of the assembled program (Program_t lines)
+ *              labels -- label table of the assembled program
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: writes report file
+ */
+void write_profile_report(const Profile_t *profile, const char *file_path, const uint8_t *source,
+                          const uint32_t *lines, const Table_t *labels) {
+    uint32_t num_lines = 0;
+    const uint8_t *c = source;
+    for (; *c != '\0'; c++) {
+        num_lines += *c == '\n';
+    }
+    if (c != source && c[-1] != '\n') {
+        num_lines++; // last line has no line break
+    }
+    const uint8_t **line_starts = (const uint8_t **)malloc((num_lines + 2) * sizeof(const uint8_t *));
+    uint64_t *line_executions = (uint64_t *)calloc(num_lines + 1, sizeof(uint64_t));
+    uint64_t *line_cycles = (uint64_t *)calloc(num_lines + 1, sizeof(uint64_t));
+    uint16_t *order = (uint16_t *)malloc(MEMORY_SIZE * sizeof(uint16_t));
+    const char **names = (const char **)malloc(MEMORY_SIZE * sizeof(const char *));
+    uint16_t *bases = (uint16_t *)malloc(MEMORY_SIZE * sizeof(uint16_t));
+    if (line_starts == NULL || line_executions == NULL || line_cycles == NULL || order == NULL || names == NULL ||
+        bases == NULL) {
+        fprintf(stderr, "Failed to allocate memory for profile report\n");
+        exit(ERR_NO_MEM);
+    }
+    FILE *fp = fopen(file_path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open file %s\n", file_path);
+        exit(ERR_FILE_NOOPEN);
+    }
+
+    // lines are numbered from 1
+    line_starts[1] = source;
+    for (uint32_t line = 2; line <= num_lines; line++) {
+        line_starts[line] = (const uint8_t *)strchr((const char *)line_starts[line - 1], '\n') + 1;
+    }
+    name_addresses(labels, names, bases);
+
+    uint64_t total_executions = 0;
+    uint64_t total_cycles = 0;
+    uint32_t num_executed = 0;
+    for (uint32_t address = 0; address < MEMORY_SIZE; address++) {
+        if (profile->executions[address] == 0) {
+            continue;
+        }
+        total_executions += profile->executions[address];
+        total_cycles += profile->cycles[address];
+        order[num_executed++] = address;
+        if (lines[address] != 0 && lines[address] <= num_lines) {
+            line_executions[lines[address]] += profile->executions[address];
+            line_cycles[lines[address]] += profile->cycles[address];
+        }
+    }
+    double percent = total_cycles ? 100.0 / total_cycles : 0.0;
+    sort_profile = profile;
+    qsort(order, num_executed, sizeof(uint16_t), compare_cycles);
+
+    fprintf(fp, "PROFILE: %llu instructions, %llu cycles, %u addresses executed\n\n",
+            (unsigned long long)total_executions, (unsigned long long)total_cycles, num_executed);
+
+    fprintf(fp, "HOT SPOTS\n");
+    fprintf(fp, "address  %-*s   line  executions        cycles       %%  source\n", PROFILE_LABEL_WIDTH, "label");
+    for (uint32_t i = 0; i < num_executed; i++) {
+        uint16_t address = order[i];
+        char label[PROFILE_LABEL_WIDTH + 1] = "-";
+        if (names[address] != NULL && address == bases[address]) {
+            snprintf(label, sizeof(label), "%s", names[address]);
+        } else if (names[address] != NULL) {
+            snprintf(label, sizeof(label), "%s+%u", names[address], address - bases[address]);
+        }
+        fprintf(fp, "$%04X    %-*s %6u  %10llu  %12llu  %5.1f%%  ", address, PROFILE_LABEL_WIDTH, label,
+                lines[address], (unsigned long long)profile->executions[address],
+                (unsigned long long)profile->cycles[address], profile->cycles[address] * percent);
+        if (lines[address] != 0 && lines[address] <= num_lines) {
+            print_source_line(fp, line_starts[lines[address]]);
+        } else {
+            fprintf(fp, "(not assembled from source)");
+        }
+        fprintf(fp, "\n");
+    }
+
+    fprintf(fp, "\nSOURCE\n");
+    fprintf(fp, "executions        cycles       %%    line\n");
+    for (uint32_t line = 1; line <= num_lines; line++) {
+        if (line_executions[line] != 0) {
+            fprintf(fp, "%10llu  %12llu  %5.1f%%", (unsigned long long)line_executions[line],
+                    (unsigned long long)line_cycles[line], line_cycles[line] * percent);
+        } else {
+            fprintf(fp, "%32s", "");
+        }
+        const uint8_t *end = line_starts[line];
+        while (*end != '\0' && *end != '\n') {
+            end++;
+        }
+        int length = end - line_starts[line];
+        if (length && end[-1] == '\r') {
+            length--;
+        }
+        fprintf(fp, "  %6u  %.*s\n", line, length, (const char *)line_starts[line]);
+    }
+
+    fclose(fp);
+    free(bases);
+    free(names);
+    free(order);
+    free(line_cycles);
+    free(line_executions);
+    free(line_starts);
+}
@@ -0,0 +1,16 @@
+#ifndef __PROFILER_H
+#define __PROFILER_H
+
+#include <stdint.h>
+
+#include "../6502.h"
+#include "../assembler/table.h"
+
+#define PROFILE_LABEL_WIDTH     24 // widest label+offset printed in the hot spot list
+
+Profile_t *new_profile(void);
+void free_profile(Profile_t *profile);
+void write_profile_report(const Profile_t *profile, const char *file_path, const uint8_t *source,
+                          const uint32_t *lines, const Table_t *labels);
+
+#endif
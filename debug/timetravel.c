@@ -0,0 +1,388 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "timetravel.h"
+#include "../lib/lib.h"
+
+/* TIME TRAVEL
+ * recorded runs go through record_run_instructions, which fills in a span for every basic block it runs (the
+ * registers before the block) straight into a ring buffer, and logs the bytes their stores overwrite through
+ * log_stores; the log is then moved into a second ring buffer, the oldest spans dropping out of both to make room
+ * undoing the latest instruction writes the bytes of the latest span back, reloads the registers before it and runs
+ * the rest of its instructions again; a span stepped back into keeps all of its stores, as the instructions run again
+ * write the same bytes, so writing them all back still leaves memory as it was before the span
+ * every TRAVEL_CHECKPOINT_STEPS instructions a snapshot is taken as well, sharing unwritten pages with the one
+ * before; once the ring buffer has no more spans to undo, the state is rebuilt by restoring the latest checkpoint
+ * before the current position and recording forward to it again, which assumes devices answer the same way twice
+ */
+
+#define SEEK_ANY    0 // step back over the latest instruction
+#define SEEK_PC     1 // step back to the latest instruction at an address
+#define SEEK_WRITE  2 // step back to the latest instruction that wrote an address
+
+/* free_checkpoint
+ *      DESCRIPTION: frees checkpoint at passed index and closes the gap it leaves
+ */
+static void free_checkpoint(TimeTravel_t *travel, uint32_t index) {
+    if (travel->synced == travel->checkpoints[index].snapshot) {
+        travel->synced = NULL;
+    }
+    free_snapshot(travel->checkpoints[index].snapshot);
+    memmove(travel->checkpoints + index, travel->checkpoints + index + 1,
+            (travel->num_checkpoints - index - 1) * sizeof(TravelCheckpoint_t));
+    travel->num_checkpoints--;
+}
+
+/* take_checkpoint
+ *      DESCRIPTION: snapshots sf at the current position, dropping the oldest checkpoint but the first if all are
+ *                   in use
+ */
+static void take_checkpoint(TimeTravel_t *travel, sf_t *sf) {
+    if (travel->num_checkpoints == TRAVEL_MAX_CHECKPOINTS) {
+        free_checkpoint(travel, 1);
+    }
+    SfSnapshot_t *snapshot = sf_snapshot(sf, travel->synced);
+    travel->checkpoints[travel->num_checkpoints].position = travel->position;
+    travel->checkpoints[travel->num_checkpoints].snapshot = snapshot;
+    travel->num_checkpoints++;
+    travel->synced = snapshot;
+}
+
+/* drop_oldest_span
+ *      DESCRIPTION: drops the oldest span of the ring buffer and its stores
+ */
+static void drop_oldest_span(TimeTravel_t *travel) {
+    travel->num_stores -= travel->spans[(travel->span_head - travel->num_spans) & travel->span_mask].num_stores;
+    travel->num_spans--;
+}
+
+/* keep_spans
+ *      DESCRIPTION: takes the spans record_run_instructions just filled in at the head of the ring buffer, and the
+ *                   stores it logged, into the history, advancing the position past them
+ */
+static void keep_spans(TimeTravel_t *travel, uint32_t num_spans) {
+    for (uint32_t i = 0; i < num_spans; i++) {
+        travel->position += travel->spans[(travel->span_head + i) & travel->span_mask].num_instr;
+    }
+    while (travel->num_stores + travel->log->count > travel->store_mask + 1) {
+        drop_oldest_span(travel); // drops spans recorded before, the new ones' stores aren't counted yet
+    }
+    for (uint32_t i = 0; i < travel->log->count; i++) {
+        travel->store_addresses[travel->store_head] = travel->log->addresses[i];
+        travel->store_values[travel->store_head] = travel->log->old_values[i];
+        travel->store_head = (travel->store_head + 1) & travel->store_mask;
+    }
+    travel->num_stores += travel->log->count;
+    travel->span_head = (travel->span_head + num_spans) & travel->span_mask;
+    travel->num_spans += num_spans;
+}
+
+/* record
+ *      DESCRIPTION: runs up to num_instr instructions, recording them
+ *      INPUTS: travel -- history to record into
+ *              sf -- 6502 struct to run
+ *              num_instr -- maximum number of instructions to run
+ *              can_stop -- nonzero to stop after a BRK or at an armed breakpoint
+ *      OUTPUTS: RUN_BRK or RUN_BREAKPOINT if stopped early, RUN_BUDGET otherwise
+ *      SIDE EFFECTS: runs sf, may take checkpoints
+ */
+static RunExit_t record(TimeTravel_t *travel, sf_t *sf, uint64_t num_instr, int can_stop) {
+    uint64_t end = travel->position + num_instr;
+    while (travel->position < end) {
+        if (travel->position % TRAVEL_CHECKPOINT_STEPS == 0 &&
+            travel->checkpoints[travel->num_checkpoints - 1].position < travel->position) {
+            take_checkpoint(travel, sf);
+        }
+        // stop at the next multiple of TRAVEL_CHECKPOINT_STEPS, so the checkpoint lands on it
+        uint64_t next_checkpoint = (travel->position / TRAVEL_CHECKPOINT_STEPS + 1) * TRAVEL_CHECKPOINT_STEPS;
+        uint64_t chunk = (end < next_checkpoint ? end : next_checkpoint) - travel->position;
+        // record up to the end of the ring buffer, over the oldest spans
+        uint32_t room = travel->span_mask + 1 - travel->span_head;
+        room = room < TRAVEL_CHUNK_SPANS ? room : TRAVEL_CHUNK_SPANS;
+        while (travel->num_spans + room > travel->span_mask + 1) {
+            drop_oldest_span(travel);
+        }
+        uint32_t num_spans;
+        travel->log->count = 0;
+        RunExit_t exit_reason = record_run_instructions(sf, chunk, &travel->spans[travel->span_head], room,
+                                                        &num_spans, travel->log);
+        keep_spans(travel, num_spans);
+        if (exit_reason != RUN_BUDGET && can_stop) {
+            return exit_reason;
+        }
+    }
+    return RUN_BUDGET;
+}
+
+/* latest_span
+ *      DESCRIPTION: returns the latest span of the ring buffer, which must hold one
+ */
+static RunSpan_t *latest_span(TimeTravel_t *travel) {
+    return &travel->spans[(travel->span_head - 1) & travel->span_mask];
+}
+
+/* rewind_span
+ *      DESCRIPTION: takes sf back to the start of the latest span, writing back the bytes it overwrote latest first
+ */
+static void rewind_span(TimeTravel_t *travel, sf_t *sf) {
+    const RunSpan_t *span = latest_span(travel);
+    for (uint32_t i = 1; i <= span->num_stores; i++) {
+        uint32_t slot = (travel->store_head - i) & travel->store_mask;
+        MARK_DIRTY(sf, travel->store_addresses[slot]);
+        sf->memory[travel->store_addresses[slot]] = travel->store_values[slot];
+    }
+    if (span->num_stores) {
+        invalidate_code(sf); // the bytes put back may be code
+    }
+    sf->pc = span->pc;
+    sf->esp = span->esp;
+    sf->accumulator = span->accumulator;
+    sf->x_index = span->x_index;
+    sf->y_index = span->y_index;
+    sf->status = span->status;
+    sf->cycles = span->cycles;
+}
+
+/* drop_latest_span
+ *      DESCRIPTION: drops the latest span of the ring buffer and its stores
+ */
+static void drop_latest_span(TimeTravel_t *travel) {
+    const RunSpan_t *span = latest_span(travel);
+    travel->store_head = (travel->store_head - span->num_stores) & travel->store_mask;
+    travel->num_stores -= span->num_stores;
+    travel->span_head = (travel->span_head - 1) & travel->span_mask;
+    travel->num_spans--;
+}
+
+/* span_wrote
+ *      DESCRIPTION: checks whether any store of the latest span went to address
+ */
+static int span_wrote(TimeTravel_t *travel, uint16_t address) {
+    const RunSpan_t *span = latest_span(travel);
+    for (uint32_t i = 1; i <= span->num_stores; i++) {
+        if (travel->store_addresses[(travel->store_head - i) & travel->store_mask] == address) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* find_in_span
+ *      DESCRIPTION: runs the latest span again from its start, returning the index of the last of its instructions
+ *                   at address (SEEK_PC) or writing it (SEEK_WRITE), -1 if there is none; leaves sf at its end
+ */
+static int32_t find_in_span(TimeTravel_t *travel, sf_t *sf, int kind, uint16_t address) {
+    rewind_span(travel, sf);
+    int32_t found = -1;
+    StoreLog_t log;
+    for (int32_t i = 0; i < latest_span(travel)->num_instr; i++) {
+        int matches = sf->pc == address;
+        log.count = 0;
+        log_stores(&log);
+        process_line(sf);
+        log_stores(NULL);
+        if (kind == SEEK_WRITE) {
+            matches = 0;
+            for (int j = 0; j < log.count; j++) {
+                matches |= log.addresses[j] == address;
+            }
+        }
+        if (matches) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+/* refill
+ *      DESCRIPTION: rebuilds the spans leading to the current position from the latest checkpoint before it
+ *      INPUTS: travel -- history whose ring buffer ran out of spans
+ *              sf -- 6502 struct at the current position
+ *      OUTPUTS: 0 if there are spans to undo again, -1 at the first checkpoint
+ *      SIDE EFFECTS: restores and reruns sf
+ */
+static int refill(TimeTravel_t *travel, sf_t *sf) {
+    if (travel->position == 0) {
+        return -1;
+    }
+    uint32_t index = travel->num_checkpoints - 1;
+    while (travel->checkpoints[index].position >= travel->position) {
+        index--; // the first checkpoint is at 0, so this stops
+    }
+    uint64_t target = travel->position;
+    sf_restore(sf, travel->checkpoints[index].snapshot, travel->synced);
+    travel->synced = travel->checkpoints[index].snapshot;
+    travel->position = travel->checkpoints[index].position;
+    travel->num_spans = 0;
+    travel->num_stores = 0;
+    record(travel, sf, target - travel->position, 0);
+    return 0;
+}
+
+/* seek_back
+ *      DESCRIPTION: steps back to before the latest instruction (SEEK_ANY), the latest one at address (SEEK_PC) or
+ *                   the latest one that wrote address (SEEK_WRITE); whole spans that can't hold it are undone
+ *                   without running anything
+ *      INPUTS: travel -- history of sf
+ *              sf -- 6502 struct
+ *              kind -- SEEK_ANY, SEEK_PC or SEEK_WRITE
+ *              address -- pc or offset in sf->memory to look for, unused for SEEK_ANY
+ *      OUTPUTS: number of instructions stepped back, -1 if there was no such instruction (sf is then at the start
+ *               of its history)
+ *      SIDE EFFECTS: modifies sf, may restore checkpoints and rerun from them
+ */
+static int64_t seek_back(TimeTravel_t *travel, sf_t *sf, int kind, uint16_t address) {
+    int64_t steps = 0;
+    for (;;) {
+        if (travel->num_spans == 0 && refill(travel, sf) != 0) {
+            return -1;
+        }
+        RunSpan_t *span = latest_span(travel);
+        uint32_t ran = span->num_instr;
+        int32_t found = kind == SEEK_ANY ? (int32_t)ran - 1 : -1;
+        if (kind == SEEK_PC || (kind == SEEK_WRITE && span_wrote(travel, address))) {
+            found = find_in_span(travel, sf, kind, address);
+        }
+        rewind_span(travel, sf);
+        if (found < 0) {
+            drop_latest_span(travel);
+            travel->position -= ran;
+            steps += ran;
+            continue;
+        }
+        for (int32_t i = 0; i < found; i++) {
+            process_line(sf);
+        }
+        if (found == 0) {
+            drop_latest_span(travel);
+        } else {
+            span->num_instr = found;
+        }
+        travel->position -= ran - found;
+        return steps + ran - found;
+    }
+}
+
+/* new_time_travel
+ *      DESCRIPTION: starts recording the history of sf from its current state
+ *      INPUTS: sf -- 6502 struct to record
+ *              num_spans -- spans (basic blocks) to keep in the ring buffer (rounded up to a power of 2), each the
+ *                           registers before it and the bytes it overwrote
+ *      OUTPUTS: empty history whose first checkpoint is the current state of sf
+ *      SIDE EFFECTS: allocates memory, clears sf->dirty
+ */
+TimeTravel_t *new_time_travel(sf_t *sf, uint32_t num_spans) {
+    TimeTravel_t *travel = (TimeTravel_t *)malloc(sizeof(TimeTravel_t));
+    uint32_t capacity = 1;
+    while (capacity < num_spans) {
+        capacity <<= 1;
+    }
+    uint32_t store_capacity = capacity;
+    while (store_capacity < MAX_LOGGED_STORES) {
+        store_capacity <<= 1; // room for the stores of any one span
+    }
+    if (travel == NULL || (travel->spans = (RunSpan_t *)malloc(capacity * sizeof(RunSpan_t))) == NULL ||
+        (travel->store_addresses = (uint16_t *)malloc(store_capacity * sizeof(uint16_t))) == NULL ||
+        (travel->store_values = (uint8_t *)malloc(store_capacity)) == NULL ||
+        (travel->log = (StoreLog_t *)malloc(sizeof(StoreLog_t))) == NULL) {
+        fprintf(stderr, "Failed to allocate memory for time travel\n");
+        exit(ERR_NO_MEM);
+    }
+    travel->span_mask = capacity - 1;
+    travel->span_head = 0;
+    travel->num_spans = 0;
+    travel->store_mask = store_capacity - 1;
+    travel->store_head = 0;
+    travel->num_stores = 0;
+    travel->position = 0;
+    travel->num_checkpoints = 1;
+    travel->checkpoints[0].position = 0;
+    travel->checkpoints[0].snapshot = sf_snapshot(sf, NULL);
+    travel->synced = travel->checkpoints[0].snapshot;
+    return travel;
+}
+
+/* free_time_travel
+ *      DESCRIPTION: frees history and its checkpoints
+ *      INPUTS: travel -- history to free
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: frees memory
+ */
+void free_time_travel(TimeTravel_t *travel) {
+    for (uint32_t i = 0; i < travel->num_checkpoints; i++) {
+        free_snapshot(travel->checkpoints[i].snapshot);
+    }
+    free(travel->log);
+    free(travel->store_values);
+    free(travel->store_addresses);
+    free(travel->spans);
+    free(travel);
+}
+
+/* travel_run_instructions
+ *      DESCRIPTION: same as run_instructions, but every instruction is recorded; checkpoints past the current
+ *                   position (left by stepping back) are dropped first, as the run may take another path
+ *      INPUTS: travel -- history of sf
+ *              sf -- 6502 struct
+ *              num_instr -- maximum number of instructions to run
+ *      OUTPUTS: RUN_BRK if BRK was executed, RUN_BREAKPOINT if an armed breakpoint was hit, RUN_BUDGET otherwise
+ *      SIDE EFFECTS: runs sf, records its history
+ */
+RunExit_t travel_run_instructions(TimeTravel_t *travel, sf_t *sf, uint64_t num_instr) {
+    while (travel->checkpoints[travel->num_checkpoints - 1].position > travel->position) {
+        free_checkpoint(travel, travel->num_checkpoints - 1);
+    }
+    return record(travel, sf, num_instr, 1);
+}
+
+/* travel_step_back
+ *      DESCRIPTION: takes sf back to before the last instruction it ran
+ *      INPUTS: travel -- history of sf
+ *              sf -- 6502 struct
+ *      OUTPUTS: 0 on success, -1 if sf is at the start of its history
+ *      SIDE EFFECTS: modifies sf, may restore a checkpoint and rerun from it
+ */
+int travel_step_back(TimeTravel_t *travel, sf_t *sf) {
+    return seek_back(travel, sf, SEEK_ANY, 0) < 0 ? -1 : 0;
+}
+
+/* travel_back_to_pc
+ *      DESCRIPTION: steps back until sf is about to run the instruction at pc again
+ *      INPUTS: travel -- history of sf
+ *              sf -- 6502 struct
+ *              pc -- address of instruction to go back to
+ *      OUTPUTS: number of instructions stepped back, -1 if pc wasn't run (sf is then at the start of its history)
+ *      SIDE EFFECTS: modifies sf, may restore checkpoints and rerun from them
+ */
+int64_t travel_back_to_pc(TimeTravel_t *travel, sf_t *sf, uint16_t pc) {
+    return seek_back(travel, sf, SEEK_PC, pc);
+}
+
+/* travel_back_to_write
+ *      DESCRIPTION: steps back until sf is about to run the last instruction that wrote address
+ *      INPUTS: travel -- history of sf
+ *              sf -- 6502 struct
+ *              address -- offset in sf->memory
+ *      OUTPUTS: number of instructions stepped back, -1 if address wasn't written (sf is then at the start of its
+ *               history)
+ *      SIDE EFFECTS: modifies sf, may restore checkpoints and rerun from them
+ */
+int64_t travel_back_to_write(TimeTravel_t *travel, sf_t *sf, uint16_t address) {
+    return seek_back(travel, sf, SEEK_WRITE, address);
+}
+
+/* travel_rewind
+ *      DESCRIPTION: takes sf back to the start of its history
+ *      INPUTS: travel -- history of sf
+ *              sf -- 6502 struct
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: restores sf from the first checkpoint, empties the ring buffers
+ */
+void travel_rewind(TimeTravel_t *travel, sf_t *sf) {
+    sf_restore(sf, travel->checkpoints[0].snapshot, travel->synced);
+    travel->synced = travel->checkpoints[0].snapshot;
+    travel->position = 0;
+    travel->num_spans = 0;
+    travel->num_stores = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef __TIMETRAVEL_H
+#define __TIMETRAVEL_H
+
+#include <stdint.h>
+
+#include "../6502.h"
+#include "../memory/snapshot.h"
+
+#define TRAVEL_STEPS            (1 << 20) // spans (basic blocks) the GUI can step back through without replaying
+#define TRAVEL_CHECKPOINT_STEPS (1 << 16) // instructions between full checkpoints
+#define TRAVEL_MAX_CHECKPOINTS  64 // checkpoints kept, the oldest after the first is dropped to make room
+#define TRAVEL_CHUNK_SPANS      256 // most spans filled in by one record_run_instructions call
+
+// full state of the 6502 after a number of recorded instructions
+typedef struct TravelCheckpoint {
+    uint64_t position;
+    SfSnapshot_t *snapshot;
+} TravelCheckpoint_t;
+
+// recorded history of one 6502
+typedef struct TimeTravel {
+    RunSpan_t *spans; // ring buffer of the latest num_spans spans, the last one ending at position; a span stepped
+                      // back into keeps all its stores, but num_instr only counts those up to the position
+    uint32_t span_mask; // capacity of spans - 1, capacity is a power of 2
+    uint32_t span_head; // slot of the next span recorded
+    uint32_t num_spans;
+    uint16_t *store_addresses; // ring buffer of the bytes the spans overwrote, in the order they were written
+    uint8_t *store_values; // byte each store overwrote
+    uint32_t store_mask; // capacity of the store ring - 1, capacity is a power of 2
+    uint32_t store_head; // slot of the next store recorded
+    uint32_t num_stores; // stores of the spans in the ring buffer
+    StoreLog_t *log; // stores of the spans of the latest record_run_instructions call
+    uint64_t position; // instructions between the first checkpoint and the current state
+    TravelCheckpoint_t checkpoints[TRAVEL_MAX_CHECKPOINTS]; // ordered by position, the first one at position 0
+    uint32_t num_checkpoints;
+    const SfSnapshot_t *synced; // checkpoint sf was last captured into or restored from, NULL if none is
+} TimeTravel_t;
+
+TimeTravel_t *new_time_travel(sf_t *sf, uint32_t num_spans);
+void free_time_travel(TimeTravel_t *travel);
+RunExit_t travel_run_instructions(TimeTravel_t *travel, sf_t *sf, uint64_t num_instr);
+int travel_step_back(TimeTravel_t *travel, sf_t *sf);
+int64_t travel_back_to_pc(TimeTravel_t *travel, sf_t *sf, uint16_t pc);
+int64_t travel_back_to_write(TimeTravel_t *travel, sf_t *sf, uint16_t address);
+void travel_rewind(TimeTravel_t *travel, sf_t *sf);
+
+#endif
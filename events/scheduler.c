@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "scheduler.h"
+#include "../lib/lib.h"
+
+#define SCHEDULER_GROWTH_FACTOR 2
+#define IDLE_MAX_BACKOFF        6 // after failed checks, up to 2^6 - 1 runs go unchecked
+
+/* EVENT SCHEDULER
+ * devices and interrupt lines add events keyed on the cycle they come due; scheduler_run_cycles runs the CPU with
+ * run_cycles up to the earliest one, so the run loop compares against a single cycle value (sf->next_event) and
+ * nothing is polled per instruction; between runs every due event is delivered in cycle order
+ * an IRQ that comes due while the interrupt flag is set stays pending; until it is taken the CPU is stepped one
+ * instruction at a time so it is taken right after the instruction that clears the flag (CLI, PLP or RTI)
+ * a program waiting for an interrupt in a loop that can't change anything (skip_idle_loop) has its cycle counter
+ * moved straight up to the next event instead of spinning there; checking costs a pass through process_line, so
+ * a program that keeps failing the check is checked ever less often
+ */
+
+/* earlier
+ *      DESCRIPTION: returns nonzero if event a comes due before event b
+ */
+static inline int earlier(const Event_t *a, const Event_t *b) {
+    return a->cycle < b->cycle || (a->cycle == b->cycle && a->order < b->order);
+}
+
+/* push_event
+ *      DESCRIPTION: adds event to the heap, expanding it if necessary
+ */
+static void push_event(Scheduler_t *scheduler, Event_t event) {
+    if (scheduler->num_events == scheduler->size) {
+        scheduler->heap = (Event_t *)realloc(scheduler->heap,
+                                             scheduler->size * SCHEDULER_GROWTH_FACTOR * sizeof(Event_t));
+        if (scheduler->heap == NULL) {
+            fprintf(stderr, "Failed to allocate memory for scheduled events\n");
+            exit(ERR_NO_MEM);
+        }
+        scheduler->size *= SCHEDULER_GROWTH_FACTOR;
+    }
+    event.order = scheduler->next_order++;
+    uint32_t index = scheduler->num_events++;
+    while (index > 0 && earlier(&event, &scheduler->heap[(index - 1) / 2])) {
+        scheduler->heap[index] = scheduler->heap[(index - 1) / 2];
+        index = (index - 1) / 2;
+    }
+    scheduler->heap[index] = event;
+}
+
+/* pop_event
+ *      DESCRIPTION: removes and returns the earliest event, which must exist
+ */
+static Event_t pop_event(Scheduler_t *scheduler) {
+    Event_t first = scheduler->heap[0];
+    Event_t last = scheduler->heap[--scheduler->num_events];
+    uint32_t index = 0;
+    for (;;) {
+        uint32_t child = 2 * index + 1;
+        if (child >= scheduler->num_events) {
+            break;
+        }
+        if (child + 1 < scheduler->num_events && earlier(&scheduler->heap[child + 1], &scheduler->heap[child])) {
+            child++;
+        }
+        if (!earlier(&scheduler->heap[child], &last)) {
+            break;
+        }
+        scheduler->heap[index] = scheduler->heap[child];
+        index = child;
+    }
+    scheduler->heap[index] = last;
+    return first;
+}
+
+/* next_limit
+ *      DESCRIPTION: returns the cycle the CPU can run up to before the next event or end, whichever comes first
+ */
+static inline uint64_t next_limit(const Scheduler_t *scheduler, uint64_t end) {
+    if (scheduler->num_events && scheduler->heap[0].cycle < end) {
+        return scheduler->heap[0].cycle;
+    }
+    return end;
+}
+
+/* deliver_due
+ *      DESCRIPTION: delivers every event due by the current cycle, then takes a pending IRQ if it isn't masked
+ */
+static void deliver_due(Scheduler_t *scheduler) {
+    sf_t *sf = scheduler->sf;
+    while (scheduler->num_events && scheduler->heap[0].cycle <= sf->cycles) {
+        Event_t event = pop_event(scheduler);
+        switch (event.kind) {
+            case EVENT_CALLBACK:
+                (*event.callback)(scheduler, event.context);
+                break;
+            case EVENT_IRQ:
+                scheduler->irqs_pending++;
+                break;
+            case EVENT_NMI:
+                raise_interrupt(sf, NMI_ADDRESS);
+                break;
+            case EVENT_RESET:
+                reset_cpu(sf);
+                break;
+        }
+    }
+    if (scheduler->irqs_pending && !(sf->status & (1 << INTERRUPT_INDEX))) {
+        scheduler->irqs_pending--;
+        raise_interrupt(sf, IRQ_ADDRESS);
+    }
+}
+
+/* check_idle
+ *      DESCRIPTION: before the CPU runs up to limit, skips the passes of an idle loop it is in, returns the new limit
+ *                   (a device run during the check may have scheduled an earlier event)
+ */
+static uint64_t check_idle(Scheduler_t *scheduler, uint64_t limit) {
+    sf_t *sf = scheduler->sf;
+    if (scheduler->idle_backoff) {
+        scheduler->idle_backoff--;
+        return limit;
+    }
+    if (limit - sf->cycles <= IDLE_MAX_CYCLES) {
+        return limit;
+    }
+    uint64_t skipped = skip_idle_loop(sf, limit);
+    if (skipped) {
+        scheduler->idle_cycles += skipped;
+        scheduler->idle_misses = 0;
+        return limit; // no device was touched, so no event was scheduled
+    }
+    if (scheduler->idle_misses < IDLE_MAX_BACKOFF) {
+        scheduler->idle_misses++;
+    }
+    scheduler->idle_backoff = (1 << scheduler->idle_misses) - 1;
+    return next_limit(scheduler, limit);
+}
+
+/* new_scheduler
+ *      DESCRIPTION: creates a scheduler with no pending events
+ *      INPUTS: sf -- 6502 struct the events are delivered to
+ *      OUTPUTS: new scheduler
+ *      SIDE EFFECTS: allocates memory
+ */
+Scheduler_t *new_scheduler(sf_t *sf) {
+    Scheduler_t *scheduler = (Scheduler_t *)malloc(sizeof(Scheduler_t));
+    if (scheduler == NULL || (scheduler->heap = (Event_t *)malloc(SCHEDULER_INIT_SIZE * sizeof(Event_t))) == NULL) {
+        fprintf(stderr, "Failed to allocate memory for scheduler\n");
+        exit(ERR_NO_MEM);
+    }
+    scheduler->sf = sf;
+    scheduler->num_events = 0;
+    scheduler->size = SCHEDULER_INIT_SIZE;
+    scheduler->next_order = 0;
+    scheduler->irqs_pending = 0;
+    scheduler->idle_cycles = 0;
+    scheduler->idle_misses = 0;
+    scheduler->idle_backoff = 0;
+    return scheduler;
+}
+
+/* free_scheduler
+ *      DESCRIPTION: frees scheduler, dropping its pending events
+ *      INPUTS: scheduler -- scheduler to free
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: frees memory
+ */
+void free_scheduler(Scheduler_t *scheduler) {
+    free(scheduler->heap);
+    free(scheduler);
+}
+
+/* schedule_event
+ *      DESCRIPTION: has callback called once the 6502 reaches cycle; may be called from a callback or from a bus
+ *                   device in the middle of a run, which then stops in time for it
+ *      INPUTS: scheduler -- scheduler of the 6502
+ *              cycle -- value of sf->cycles at which the event comes due (it is delivered at the first instruction
+ *                       boundary at or after it)
+ *              callback -- function to call
+ *              context -- passed to callback
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: adds event, may lower sf->next_event
+ */
+void schedule_event(Scheduler_t *scheduler, uint64_t cycle, EventCallback_t callback, void *context) {
+    Event_t event = {.cycle = cycle, .kind = EVENT_CALLBACK, .callback = callback, .context = context};
+    push_event(scheduler, event);
+    if (cycle < scheduler->sf->next_event) {
+        scheduler->sf->next_event = cycle;
+    }
+}
+
+/* schedule_interrupt
+ *      DESCRIPTION: same as schedule_event, but the event is an interrupt or a reset
+ *      INPUTS: scheduler -- scheduler of the 6502
+ *              cycle -- value of sf->cycles at which the interrupt comes due
+ *              kind -- EVENT_IRQ, EVENT_NMI or EVENT_RESET
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: adds event, may lower sf->next_event
+ */
+void schedule_interrupt(Scheduler_t *scheduler, uint64_t cycle, EventKind_t kind) {
+    Event_t event = {.cycle = cycle, .kind = kind};
+    push_event(scheduler, event);
+    if (cycle < scheduler->sf->next_event) {
+        scheduler->sf->next_event = cycle;
+    }
+}
+
+/* scheduler_run_cycles
+ *      DESCRIPTION: same as run_cycles, but events are delivered as they come due
+ *      INPUTS: scheduler -- scheduler of the 6502 to run
+ *              max_cycles -- number of clock cycles to run for
+ *      OUTPUTS: RUN_BRK if BRK was executed, RUN_BREAKPOINT if an armed breakpoint was hit, RUN_BUDGET otherwise
+ *      SIDE EFFECTS: runs the 6502, delivers due events, adds cycles skipped in idle loops to idle_cycles
+ */
+RunExit_t scheduler_run_cycles(Scheduler_t *scheduler, uint64_t max_cycles) {
+    sf_t *sf = scheduler->sf;
+    uint64_t end = sf->cycles + max_cycles;
+    while (sf->cycles < end) {
+        deliver_due(scheduler);
+        uint64_t limit = next_limit(scheduler, end);
+        if (limit <= sf->cycles) {
+            continue; // delivering took the cycles up to the next event or the end
+        }
+        if (scheduler->irqs_pending) {
+            // interrupt flag is set, so look for the instruction that clears it
+            RunExit_t exit_reason = step_instruction(sf);
+            if (exit_reason != RUN_BUDGET) {
+                return exit_reason;
+            }
+        } else {
+            limit = check_idle(scheduler, limit);
+            if (limit > sf->cycles) {
+                RunExit_t exit_reason = run_cycles(sf, limit - sf->cycles);
+                if (exit_reason != RUN_BUDGET) {
+                    return exit_reason;
+                }
+            }
+        }
+    }
+    return RUN_BUDGET;
+}
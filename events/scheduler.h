@@ -0,0 +1,49 @@
+#ifndef __SCHEDULER_H
+#define __SCHEDULER_H
+
+#include <stdint.h>
+
+#include "../6502.h"
+
+#define SCHEDULER_INIT_SIZE     16
+
+// what happens when an event comes due
+typedef enum {
+    EVENT_CALLBACK = 0, // calls the device's callback
+    EVENT_IRQ,          // maskable interrupt through IRQ_ADDRESS, held until the interrupt flag is clear
+    EVENT_NMI,          // non-maskable interrupt through NMI_ADDRESS
+    EVENT_RESET         // reset through RESET_ADDRESS
+} EventKind_t;
+
+struct Scheduler;
+typedef void (*EventCallback_t)(struct Scheduler *scheduler, void *context); // may schedule further events
+
+// one pending event, due once sf->cycles reaches cycle
+typedef struct Event {
+    uint64_t cycle;
+    uint64_t order; // events due on the same cycle come due in the order they were scheduled
+    EventKind_t kind;
+    EventCallback_t callback; // EVENT_CALLBACK only
+    void *context; // EVENT_CALLBACK only
+} Event_t;
+
+// pending events of one 6502, in a binary min-heap ordered by cycle
+typedef struct Scheduler {
+    sf_t *sf;
+    Event_t *heap;
+    uint32_t num_events;
+    uint32_t size;
+    uint64_t next_order;
+    uint32_t irqs_pending; // IRQs that came due while the interrupt flag was set
+    uint64_t idle_cycles; // cycles skipped in idle loops, which a host pacing the 6502 to real time can sleep through
+    uint32_t idle_misses; // idle loop checks in a row that found none
+    uint32_t idle_backoff; // runs left before the next idle loop check
+} Scheduler_t;
+
+Scheduler_t *new_scheduler(sf_t *sf);
+void free_scheduler(Scheduler_t *scheduler);
+void schedule_event(Scheduler_t *scheduler, uint64_t cycle, EventCallback_t callback, void *context);
+void schedule_interrupt(Scheduler_t *scheduler, uint64_t cycle, EventKind_t kind);
+RunExit_t scheduler_run_cycles(Scheduler_t *scheduler, uint64_t max_cycles);
+
+#endif
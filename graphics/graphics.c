@@ -201,7 +201,7 @@ void initialize_characters(unsigned int shader) {
  *      OUTPUTS: none
  *      SIDE EFFECTS: renders text to window
  */
-void render_text(unsigned int shader, char *text, float x, float y, float scale, vec3 color, unsigned int VAO, unsigned int VBO) {
+void render_text(unsigned int shader, const char *text, float x, float y, float scale, vec3 color, unsigned int VAO, unsigned int VBO) {
     glUseProgram(shader);
     glUniform3f(glGetUniformLocation(shader, "textColor"), color[0], color[1], color[2]);
     glActiveTexture(GL_TEXTURE0);
@@ -240,7 +240,7 @@ void render_text(unsigned int shader, char *text, float x, float y, float scale,
  *      OUTPUTS: width (in pixels) of passed string
  *      SIDE EFFECTS: none
  */
-float text_width(char *text, float scale) {
+float text_width(const char *text, float scale) {
     float width = 0.0f;
     for (int i = 0; i < strlen(text); i++) {
         width += (Characters[text[i]].Advance >> 6) * scale;
@@ -16,6 +16,8 @@
 #define ERR_INVALID_LABEL               0x0A
 #define ERR_LABEL_ADDRESSING            0x0B
 #define ERR_GRAPHICS                    0x0C
+#define ERR_THREAD                      0x0D
+#define ERR_BENCH                       0x0E
 
 /*
  * 6502 memory map according to ChatGPT:
@@ -2,27 +2,56 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifndef HEADLESS
 #include "glad/glad.h"
 #include <GLFW/glfw3.h>
 #include <cglm/cglm.h>
+#endif
 
 #include "test_code/tests.h"
+#include "test_code/bench.h"
 #include "lib/lib.h"
 #include "assembler/generator.h"
-#include "assembler/scanner.h"
+#include "assembler/cache.h"
+#ifndef HEADLESS
 #include "graphics/graphics.h"
+#endif
+#include "batch/batch.h"
+#include "debug/timetravel.h"
+#include "debug/profiler.h"
+#include "debug/callgraph.h"
+#include "debug/breakpoints.h"
 
 #define TABLE_INIT_SIZE         256
 #define SCREEN_WIDTH            800
 #define SCREEN_HEIGHT           600
 #define NUM_MEM_LOCATIONS       16
+#define INSTRUCTIONS_PER_FRAME  1000000 // instructions run between rendered frames while Run is active
+#define NUM_ENTRY_KEYS          20 // keys accepted by the user entry field, the hex digits then x, p, r and w
 
 // #define RUN_TESTS
-
+// #define HEADLESS // build without the GUI, so without GLFW, OpenGL and FreeType (make headless)
+// #define RUN_BENCH // run the benchmarks instead of a program (make bench)
+// #define PROFILE_PAIRS // print the instruction pairs the program runs most often instead of opening the GUI
+#define ASM_CACHE // keep what a program assembles to beside it (ASM_CACHE_SUFFIX) and load that while it is current
+
+#define PROFILE_INSTRUCTIONS    10000000 // instructions run while profiling pairs
+#define PROFILE_TOP_PAIRS       20 // number of pairs printed by the profile
+#define BATCH_MAX_RANGES        16 // most --dump ranges accepted by --batch
+#define BATCH_DEFAULT_CYCLES    100000000 // cycle budget of every --batch instance unless --max-cycles is passed
+#define PROFILE_DEFAULT_CYCLES  100000000 // cycle budget of a --profile run unless --max-cycles is passed
+#define HEADLESS_MAX_RANGES     16 // most --dump ranges accepted by --headless
+#define HEADLESS_DEFAULT_CYCLES 100000000 // cycle budget of a --headless run unless --max-cycles is passed
+#define HEADLESS_FIRST_CHECK    1024 // cycles a --headless run goes before it first checks for a loop it can't leave
+#define HEADLESS_IDLE_CHECK     1000000 // most cycles it goes between later checks, each twice as far as the last
+#define HEADLESS_DUMP_WIDTH     16 // bytes per line of a --headless memory dump
+
+#ifndef HEADLESS
 // Flags
 volatile uint8_t mouse_down = 0; // flag for if mouse button has been pressed and not released
 volatile uint8_t click = 0; // flag for if mouse button has been pressed and released (full click)
 volatile uint8_t run = 0; // flag for if run button has been clicked
+uint8_t idle = 0; // flag for if the running program is spinning in a loop that can't end without user action
 volatile uint8_t user_entry = 0; // flag for if user entry field has been clicked
 volatile uint8_t backspace_pressed = 0; // flag for if backspace has been pressed and not released
 volatile uint8_t enter_pressed = 0; // flag for if enter has been pressed and not released
@@ -33,10 +62,13 @@ float curr_height = SCREEN_HEIGHT; // current height of screen in pixels
 char user_entry_buf[7] = "\0\0\0\0\0\0\0"; // buffer for user entry in search field
 char user_entry_index = 0; // index in user_entry_buf
 uint16_t starting_memory_location = 0x0000; // memory location to begin displayed memory locations from
-uint8_t hex_chars[17] = {GLFW_KEY_0, GLFW_KEY_1, GLFW_KEY_2, GLFW_KEY_3, GLFW_KEY_4, GLFW_KEY_5,
+uint8_t hex_chars[NUM_ENTRY_KEYS] = {GLFW_KEY_0, GLFW_KEY_1, GLFW_KEY_2, GLFW_KEY_3, GLFW_KEY_4, GLFW_KEY_5,
                         GLFW_KEY_6, GLFW_KEY_7, GLFW_KEY_8, GLFW_KEY_9, GLFW_KEY_A, GLFW_KEY_B,
-                        GLFW_KEY_C, GLFW_KEY_D, GLFW_KEY_E, GLFW_KEY_F, GLFW_KEY_X}; // buffer containing GLFW codes for hex keys    
-uint8_t hex_pressed[17] = "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0"; // buffer indicating if hex character corresponding to character in GLFW code buffer has been pressed and not released
+                        GLFW_KEY_C, GLFW_KEY_D, GLFW_KEY_E, GLFW_KEY_F, GLFW_KEY_X,
+                        GLFW_KEY_P, GLFW_KEY_R, GLFW_KEY_W}; // buffer containing GLFW codes for user entry keys
+uint8_t hex_pressed[NUM_ENTRY_KEYS] = {0}; // buffer indicating if key corresponding to character in GLFW code buffer has been pressed and not released
+Breakpoints_t *breakpoints = NULL; // breakpoints and watchpoints set through the user entry field
+uint8_t breakpoint_hit = 0; // flag for if the last run or step stopped on a breakpoint
 
 // Helper functions
 /* hex_to_char
@@ -75,16 +107,16 @@ static void fill_string(char *str, uint16_t reg_val, uint8_t num_chars) {
  *      DESCRIPTION: checks if any hex characters have been pressed by user, adjusts user entry buffer accordingly
  *      INPUTS: window -- pointer to window object for emulator
  *      OUTPUTS: none
- *      SIDE EFFECTS: adds pressed hex characters to user_entry_buf if user_entry_buf isn't full
+ *      SIDE EFFECTS: adds pressed hex characters, x, p, r and w to user_entry_buf if user_entry_buf isn't full
  */
 static void check_hex_characters(GLFWwindow *window) {
-    for (int i = 0; i < 17; i++) {
+    for (int i = 0; i < NUM_ENTRY_KEYS; i++) {
         if (glfwGetKey(window, hex_chars[i]) == GLFW_PRESS) {
             hex_pressed[i] = 1;
         } else if ((glfwGetKey(window, hex_chars[i]) == GLFW_RELEASE) && hex_pressed[i]) {
             hex_pressed[i] = 0;
             if (user_entry_index < 6) {
-                if (hex_chars[i] == GLFW_KEY_X) {
+                if (hex_chars[i] > GLFW_KEY_F) { // letters that aren't hex digits are entered lowercase
                     user_entry_buf[user_entry_index++] = hex_chars[i] + 0x20;
                 } else {
                     user_entry_buf[user_entry_index++] = hex_chars[i];
@@ -94,31 +126,124 @@ static void check_hex_characters(GLFWwindow *window) {
     }
 }
 
+/* take_user_address
+ *      DESCRIPTION: reads user_entry_buf as an absolute address and clears it
+ *      INPUTS: address -- set to address in user_entry_buf if it is valid
+ *      OUTPUTS: 0 if user_entry_buf contained a valid address, -1 otherwise
+ *      SIDE EFFECTS: clears user_entry_buf
+ */
+static int take_user_address(uint16_t *address) {
+    int valid = user_entry_index == 6 &&
+                user_entry_buf[0] == '0' &&
+                user_entry_buf[1] == 'x' &&
+                is_hex_number(user_entry_buf[2]) &&
+                is_hex_number(user_entry_buf[3]) &&
+                is_hex_number(user_entry_buf[4]) &&
+                is_hex_number(user_entry_buf[5]);
+    if (valid) {
+        *address = 0x0000;
+        *address |= (char_to_hex(user_entry_buf[2]) << 12);
+        *address |= (char_to_hex(user_entry_buf[3]) << 8);
+        *address |= (char_to_hex(user_entry_buf[4]) << 4);
+        *address |= char_to_hex(user_entry_buf[5]);
+    }
+    user_entry_index = 0;
+    user_entry = 0;
+    memset(user_entry_buf, '\0', 7);
+    return valid ? 0 : -1;
+}
+
+/* take_user_breakpoint
+ *      DESCRIPTION: reads user_entry_buf as a breakpoint, p (execute), r (read) or w (write) followed by four hex
+ *                   digits, and clears it
+ *      INPUTS: kind -- set to BREAK_ kind in user_entry_buf if it is valid
+ *              address -- set to address in user_entry_buf if it is valid
+ *      OUTPUTS: 0 if user_entry_buf contained a valid breakpoint, -1 otherwise
+ *      SIDE EFFECTS: clears user_entry_buf
+ */
+static int take_user_breakpoint(uint8_t *kind, uint16_t *address) {
+    *kind = user_entry_buf[0] == 'p' ? BREAK_EXECUTE :
+            user_entry_buf[0] == 'r' ? BREAK_READ :
+            user_entry_buf[0] == 'w' ? BREAK_WRITE : 0;
+    int valid = user_entry_index == 5 &&
+                *kind != 0 &&
+                is_hex_number(user_entry_buf[1]) &&
+                is_hex_number(user_entry_buf[2]) &&
+                is_hex_number(user_entry_buf[3]) &&
+                is_hex_number(user_entry_buf[4]);
+    if (valid) {
+        *address = 0x0000;
+        *address |= (char_to_hex(user_entry_buf[1]) << 12);
+        *address |= (char_to_hex(user_entry_buf[2]) << 8);
+        *address |= (char_to_hex(user_entry_buf[3]) << 4);
+        *address |= char_to_hex(user_entry_buf[4]);
+    }
+    user_entry_index = 0;
+    user_entry = 0;
+    memset(user_entry_buf, '\0', 7);
+    return valid ? 0 : -1;
+}
+
 /* check_user_input
  *      DESCRIPTION: checks to see if user_entry_buf is valid absolute address, if so adjusts starting_memory_location
-                     to nearest 16 memory location increment
+                     to nearest 16 memory location increment; if it is a breakpoint (pXXXX, rXXXX or wXXXX) toggles it
         INPUTS: none
         OUTPUTS: none
-        SIDE EFFECTS: adjusts starting_memory_location if user_entry_buf contains valid address, clears user_entry_buf
+        SIDE EFFECTS: adjusts starting_memory_location if user_entry_buf contains valid address, modifies breakpoints
+                      if it contains a valid breakpoint, clears user_entry_buf
  */
 static void check_user_input() {
-    if (user_entry_index == 6 &&
-        user_entry_buf[0] == '0' &&
-        user_entry_buf[1] == 'x' &&
-        is_hex_number(user_entry_buf[2]) &&
-        is_hex_number(user_entry_buf[3]) &&
-        is_hex_number(user_entry_buf[4]) &&
-        is_hex_number(user_entry_buf[5])) {
-        starting_memory_location = 0x0000;
-        starting_memory_location |= (char_to_hex(user_entry_buf[2]) << 12);
-        starting_memory_location |= (char_to_hex(user_entry_buf[3]) << 8);
-        starting_memory_location |= (char_to_hex(user_entry_buf[4]) << 4);
-        starting_memory_location |= char_to_hex(user_entry_buf[5]);
-        starting_memory_location = starting_memory_location/16 * 16;
+    uint16_t address;
+    uint8_t kind;
+    if (user_entry_buf[0] == 'p' || user_entry_buf[0] == 'r' || user_entry_buf[0] == 'w') {
+        if (take_user_breakpoint(&kind, &address) == 0) {
+            toggle_breakpoint(breakpoints, kind, address);
+        }
+    } else if (take_user_address(&address) == 0) {
+        starting_memory_location = address/16 * 16;
     }
-    user_entry_index = 0;
-    user_entry = 0;
-    memset(user_entry_buf, '\0', 7);
+}
+#endif
+
+/* assemble_program
+ *      DESCRIPTION: assembles user program specified via command line and loads it at locations specified by assembly
+ *      INPUTS: sf -- pointer to 6502 struct running program
+ *              file_path -- string for file path of assembly to run
+ *              sf_asm_dbl_ptr -- set to assembly read from file
+ *              label_table_dbl_ptr -- set to label table of program
+ *      OUTPUTS: assembled program
+ *      SIDE EFFECTS: resets memory and loads with bytecode, resets all registers to initial values, allocates
+ *                    memory for returned program, assembly and label table; with ASM_CACHE, loads the program from
+ *                    its cache if that is current and writes the cache otherwise
+ */
+static Program_t *assemble_program(sf_t *sf, char *file_path, uint8_t **sf_asm_dbl_ptr,
+                                   Table_t **label_table_dbl_ptr) {
+    memset(sf->memory, '\0', MEMORY_SIZE);
+    invalidate_code(sf);
+
+    uint8_t *sf_asm = read_file(file_path);
+    Table_t *label_table = new_table(TABLE_INIT_SIZE);
+
+    Program_t *p = NULL;
+#ifdef ASM_CACHE
+    p = load_cached_program(sf, file_path, sf_asm, &label_table);
+#endif
+    if (p == NULL) {
+        p = assembly_to_program(sf, sf_asm, &label_table);
+
+        for (int i = 0; i < p->index; i++) {
+            load_bytecode(sf, p->start + i, p->start[i].load_address, p->start[i].index);
+        }
+#ifdef ASM_CACHE
+        save_cached_program(sf, file_path, sf_asm, p, label_table);
+#endif
+    }
+
+    initialize_regs(sf, p->start[0].load_address);
+
+    *sf_asm_dbl_ptr = sf_asm;
+    *label_table_dbl_ptr = label_table;
+    return p;
 }
 
 /* load_program
@@ -129,27 +254,348 @@ static void check_user_input() {
  *      SIDE EFFECTS: resets memory and loads with bytecode, resets all registers to initial values
  */
 static void load_program(sf_t *sf, char *file_path) {
-    memset(sf->memory, '\0', MEMORY_SIZE);
+    uint8_t *sf_asm;
+    Table_t *label_table;
+    Program_t *p = assemble_program(sf, file_path, &sf_asm, &label_table);
+    free_program(p);
+    free_table(label_table);
+    free(sf_asm);
+}
 
-    uint8_t *sf_asm = read_file(file_path);
-    Table_t *label_table = new_table(TABLE_INIT_SIZE);
+/* parse_number
+ *      DESCRIPTION: parses command line number, in hex if it starts with $ or 0x, otherwise in decimal
+ *      INPUTS: str -- string to parse
+ *              max -- largest value accepted
+ *      OUTPUTS: parsed value
+ *      SIDE EFFECTS: exits with ERR_SYNTAX if str isn't a number no larger than max
+ */
+static uint64_t parse_number(const char *str, uint64_t max) {
+    char *end;
+    uint64_t value = (str[0] == '$') ? strtoull(str + 1, &end, 16) : strtoull(str, &end, 0);
+    if (str[0] == '\0' || *end != '\0' || value > max) {
+        fprintf(stderr, "Error: invalid number %s\n", str);
+        exit(ERR_SYNTAX);
+    }
+    return value;
+}
 
-    Clip_t *c = assembly_to_clip(sf, sf_asm, &label_table);
-    Program_t *p = clip_to_program(sf_asm, c, &label_table);
+/* parse_range
+ *      DESCRIPTION: parses command line memory range START:END
+ *      INPUTS: str -- string to parse, modified
+ *              range -- set to parsed range
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: exits with ERR_SYNTAX if str isn't a range
+ */
+static void parse_range(char *str, BatchRange_t *range) {
+    char *colon = strchr(str, ':');
+    if (colon == NULL) {
+        fprintf(stderr, "Error: --dump takes START:END, got %s\n", str);
+        exit(ERR_SYNTAX);
+    }
+    *colon = '\0';
+    range->start = parse_number(str, 0xFFFF);
+    range->end = parse_number(colon + 1, 0xFFFF);
+    if (range->end < range->start) {
+        fprintf(stderr, "Error: --dump range ends before it starts\n");
+        exit(ERR_SYNTAX);
+    }
+}
 
-    
-    for (int i = 0; i < p->index; i++) {
-        load_bytecode(sf, p->start + i, p->start[i].load_address, p->start[i].index);
+/* load_image
+ *      DESCRIPTION: copies binary file into memory of 6502, starting at passed address
+ *      INPUTS: sf -- pointer to 6502 struct
+ *              file_path -- path of binary file
+ *              address -- address first byte of file is loaded at
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: modifies memory and invalidates code engines decoded from it; bytes past the end of memory are
+ *                    dropped
+ */
+static void load_image(sf_t *sf, const char *file_path, uint16_t address) {
+    FILE *fp = fopen(file_path, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open file %s\n", file_path);
+        exit(ERR_FILE_NOOPEN);
     }
+    fread(sf->memory + address, 1, MEMORY_SIZE - address, fp);
+    fclose(fp);
+    invalidate_code(sf);
+}
 
-    initialize_regs(sf, p->start[0].load_address);
+/* batch_main
+ *      DESCRIPTION: runs an assembled program once per input memory image on worker threads, without opening
+ *                   the GUI; invoked as
+ *                   main --batch program.txt --out results.txt [--threads N] [--max-cycles N] [--load ADDR]
+ *                        [--dump START:END]... [--lockstep] image...
+ *                   every image is loaded at ADDR ($0200 by default) over a fresh copy of the program; --lockstep
+ *                   runs neighbouring images side by side on the lockstep engine
+ *      INPUTS: argc -- number of command line arguments
+ *              argv -- command line arguments
+ *      OUTPUTS: 0 on success
+ *      SIDE EFFECTS: writes results file, exits with an error code on bad arguments
+ */
+static int batch_main(int argc, char *argv[]) {
+    const char *program_path = NULL;
+    const char *out_path = NULL;
+    uint32_t num_threads = 0;
+    uint64_t max_cycles = BATCH_DEFAULT_CYCLES;
+    uint16_t load_address = SYSTEM_START;
+    BatchRange_t ranges[BATCH_MAX_RANGES];
+    uint32_t num_ranges = 0;
+    int lockstep = 0;
+    int first_image = argc;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            num_threads = parse_number(argv[++i], 4096);
+        } else if (strcmp(argv[i], "--max-cycles") == 0 && i + 1 < argc) {
+            max_cycles = parse_number(argv[++i], UINT64_MAX);
+        } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+            load_address = parse_number(argv[++i], 0xFFFF);
+        } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc && num_ranges < BATCH_MAX_RANGES) {
+            parse_range(argv[++i], &ranges[num_ranges++]);
+        } else if (strcmp(argv[i], "--lockstep") == 0) {
+            lockstep = 1;
+        } else if (program_path == NULL) {
+            program_path = argv[i];
+        } else {
+            first_image = i;
+            break;
+        }
+    }
+    if (program_path == NULL || out_path == NULL || first_image == argc) {
+        fprintf(stderr, "Error: usage: %s --batch program.txt --out results.txt [--threads N] [--max-cycles N] "
+                        "[--load ADDR] [--dump START:END]... [--lockstep] image...\n", argv[0]);
+        exit(ERR_NO_FILE);
+    }
+
+    sf_t *prototype = (sf_t *)malloc(sizeof(sf_t));
+    if (prototype == NULL) {
+        fprintf(stderr, "Failed to allocate memory for batch program\n");
+        exit(ERR_NO_MEM);
+    }
+    load_program(prototype, (char *)program_path);
+
+    Batch_t *batch = new_batch(prototype, argc - first_image);
+    for (int i = first_image; i < argc; i++) {
+        // the batch keeps its own copy of the program, so prototype is free to stage each image in
+        batch_get_instance(batch, i - first_image, prototype);
+        load_image(prototype, argv[i], load_address);
+        batch_set_instance(batch, i - first_image, prototype);
+    }
+    batch->lockstep = lockstep;
+    run_batch(batch, num_threads, max_cycles);
+    write_batch_results(batch, out_path, ranges, num_ranges);
+
+    free_batch(batch);
+    free(prototype);
+    return 0;
+}
+
+/* profile_main
+ *      DESCRIPTION: runs an assembled program with the profiler on, without opening the GUI, then writes reports of
+ *                   where its cycles went; invoked as
+ *                   main --profile program.txt [--out report.txt] [--calls calls.txt] [--folded stacks.folded]
+ *                        [--max-cycles N]
+ *                   --out writes the per-address report, --calls the per-routine report of the call graph and
+ *                   --folded its folded stacks for flame graph tools; the run stops at BRK or once the cycle budget
+ *                   (PROFILE_DEFAULT_CYCLES by default) is spent
+ *      INPUTS: argc -- number of command line arguments
+ *              argv -- command line arguments
+ *      OUTPUTS: 0 on success
+ *      SIDE EFFECTS: writes report files, exits with an error code on bad arguments
+ */
+static int profile_main(int argc, char *argv[]) {
+    char *program_path = NULL;
+    const char *out_path = NULL;
+    const char *calls_path = NULL;
+    const char *folded_path = NULL;
+    uint64_t max_cycles = PROFILE_DEFAULT_CYCLES;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc) {
+            calls_path = argv[++i];
+        } else if (strcmp(argv[i], "--folded") == 0 && i + 1 < argc) {
+            folded_path = argv[++i];
+        } else if (strcmp(argv[i], "--max-cycles") == 0 && i + 1 < argc) {
+            max_cycles = parse_number(argv[++i], UINT64_MAX);
+        } else if (program_path == NULL) {
+            program_path = argv[i];
+        } else {
+            program_path = NULL;
+            break;
+        }
+    }
+    if (program_path == NULL || (out_path == NULL && calls_path == NULL && folded_path == NULL)) {
+        fprintf(stderr, "Error: usage: %s --profile program.txt [--out report.txt] [--calls calls.txt] "
+                        "[--folded stacks.folded] [--max-cycles N]\n", argv[0]);
+        exit(ERR_NO_FILE);
+    }
+
+    sf_t *sf = (sf_t *)malloc(sizeof(sf_t));
+    if (sf == NULL) {
+        fprintf(stderr, "Failed to allocate memory for profiled program\n");
+        exit(ERR_NO_MEM);
+    }
+    uint8_t *sf_asm;
+    Table_t *label_table;
+    Program_t *p = assemble_program(sf, program_path, &sf_asm, &label_table);
+
+    Profile_t *profile = out_path != NULL ? new_profile() : NULL;
+    if (calls_path != NULL || folded_path != NULL) {
+        // following calls takes process_line, so the flat profile only gets its own loop when it runs alone
+        CallGraph_t *graph = new_call_graph(sf);
+        callgraph_run_cycles(graph, sf, max_cycles, profile);
+        if (calls_path != NULL) {
+            write_call_report(graph, calls_path, label_table);
+        }
+        if (folded_path != NULL) {
+            write_folded_stacks(graph, folded_path, label_table);
+        }
+        free_call_graph(graph);
+    } else {
+        profile_run_cycles(sf, max_cycles, profile);
+    }
+    if (profile != NULL) {
+        write_profile_report(profile, out_path, sf_asm, p->lines, label_table);
+        free_profile(profile);
+    }
 
-    free_clip(c);
     free_program(p);
     free_table(label_table);
     free(sf_asm);
+    free(sf);
+    return 0;
+}
+
+/* headless_main
+ *      DESCRIPTION: runs an assembled program at full speed without opening the GUI, then prints its registers and
+ *                   memory; invoked as
+ *                   main --headless program.txt [--max-cycles N] [--dump START:END]...
+ *                   the run stops at BRK, in a loop it can't leave (one skip_idle_loop recognizes, as nothing can interrupt
+ *                   it here; checks back off from HEADLESS_FIRST_CHECK to HEADLESS_IDLE_CHECK cycles apart, so a
+ *                   short program isn't left spinning for long) or once the cycle budget
+ *                   (HEADLESS_DEFAULT_CYCLES by default) is spent
+ *      INPUTS: argc -- number of command line arguments
+ *              argv -- command line arguments
+ *      OUTPUTS: 0 on success
+ *      SIDE EFFECTS: prints to stdout, exits with an error code on bad arguments
+ */
+static int headless_main(int argc, char *argv[]) {
+    char *program_path = NULL;
+    uint64_t max_cycles = HEADLESS_DEFAULT_CYCLES;
+    BatchRange_t ranges[HEADLESS_MAX_RANGES];
+    uint32_t num_ranges = 0;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--max-cycles") == 0 && i + 1 < argc) {
+            max_cycles = parse_number(argv[++i], UINT64_MAX);
+        } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc && num_ranges < HEADLESS_MAX_RANGES) {
+            parse_range(argv[++i], &ranges[num_ranges++]);
+        } else if (program_path == NULL) {
+            program_path = argv[i];
+        } else {
+            program_path = NULL;
+            break;
+        }
+    }
+    if (program_path == NULL) {
+        fprintf(stderr, "Error: usage: %s --headless program.txt [--max-cycles N] [--dump START:END]...\n",
+                argv[0]);
+        exit(ERR_NO_FILE);
+    }
+
+    sf_t *sf = (sf_t *)malloc(sizeof(sf_t));
+    sf_t *idle_check = (sf_t *)malloc(sizeof(sf_t)); // copy of sf run to find out whether it is idling
+    if (sf == NULL || idle_check == NULL) {
+        fprintf(stderr, "Failed to allocate memory for 6502\n");
+        exit(ERR_NO_MEM);
+    }
+    load_program(sf, program_path);
+
+    const char *stop = "BUDGET";
+    uint64_t check = HEADLESS_FIRST_CHECK;
+    while (sf->cycles < max_cycles) {
+        uint64_t budget = max_cycles - sf->cycles;
+        if (run_cycles(sf, budget < check ? budget : check) == RUN_BRK) {
+            stop = "BRK";
+            break;
+        }
+        // a copy is checked so sf stops where the loop was found, not where skipping it would have left it
+        *idle_check = *sf;
+        if (skip_idle_loop(idle_check, UINT64_MAX) != 0) {
+            stop = "IDLE";
+            break;
+        }
+        check = check < HEADLESS_IDLE_CHECK / 2 ? check * 2 : HEADLESS_IDLE_CHECK;
+    }
+
+    printf("%s A=%02X X=%02X Y=%02X P=%02X SP=%04X PC=%04X CYC=%llu\n", stop, sf->accumulator, sf->x_index,
+           sf->y_index, sf->status, sf->esp, sf->pc, (unsigned long long)sf->cycles);
+    for (uint32_t r = 0; r < num_ranges; r++) {
+        for (uint32_t line = ranges[r].start; line <= ranges[r].end; line += HEADLESS_DUMP_WIDTH) {
+            printf("$%04X:", line);
+            for (uint32_t address = line; address <= ranges[r].end && address < line + HEADLESS_DUMP_WIDTH;
+                 address++) {
+                printf(" %02X", sf->memory[address]);
+            }
+            printf("\n");
+        }
+    }
+
+    free(idle_check);
+    free(sf);
+    return 0;
+}
+
+#ifdef RUN_BENCH
+/* bench_main
+ *      DESCRIPTION: runs the benchmarks; invoked as
+ *                   bench [--out results.json] [--iterations N] [program.txt...]
+ *                   the macro benchmarks run the programs in test_code unless programs are passed
+ *      INPUTS: argc -- number of command line arguments
+ *              argv -- command line arguments
+ *      OUTPUTS: 0 on success
+ *      SIDE EFFECTS: prints results, writes them to a JSON file (BENCH_DEFAULT_OUTPUT by default), exits with an
+ *                    error code on bad arguments
+ */
+static int bench_main(sf_t *sf, int argc, char *argv[]) {
+    static char *default_programs[] = {
+        "test_code/multiplication.txt", "test_code/tolower.txt", "test_code/loadmemory.txt"
+    };
+    const char *out_path = BENCH_DEFAULT_OUTPUT;
+    uint64_t iterations = BENCH_DEFAULT_ITERATIONS;
+    char *programs[BENCH_MAX_PROGRAMS];
+    int num_programs = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = parse_number(argv[++i], UINT64_MAX);
+        } else if (num_programs < BENCH_MAX_PROGRAMS && argv[i][0] != '-') {
+            programs[num_programs++] = argv[i];
+        } else {
+            fprintf(stderr, "Error: usage: %s [--out results.json] [--iterations N] [program.txt...]\n", argv[0]);
+            exit(ERR_SYNTAX);
+        }
+    }
+    if (iterations == 0) {
+        fprintf(stderr, "Error: --iterations must be at least 1\n");
+        exit(ERR_SYNTAX);
+    }
+    if (num_programs == 0) {
+        num_programs = sizeof(default_programs) / sizeof(default_programs[0]);
+        memcpy(programs, default_programs, sizeof(default_programs));
+    }
+    return run_benchmarks(sf, out_path, iterations, programs, num_programs);
 }
+#endif
 
+#ifndef HEADLESS
 /* processInput
  *      DESCRIPTION: processes user key presses
  *      INPUTS: window -- pointer to window object for emulator
@@ -206,19 +652,64 @@ static void mouse_button_callback(GLFWwindow *window, int button, int action, in
         click = 1;
     }
 }
+#endif
 
 int main(int argc, char* argv[]) {
     sf_t *sf = (sf_t *)malloc(sizeof(sf_t));
 #ifdef RUN_TESTS
     run_opcode_tests(sf);
+    run_threaded_opcode_tests(sf);
+    run_jit_opcode_tests(sf);
     table_test();
+    batch_run_test(sf);
+    bus_test(sf);
+    batch_engine_test(sf);
+    lockstep_test(sf);
+    block_engine_test(sf);
+    jit_test(sf);
+    threaded_engine_test(sf);
+    paged_memory_test(sf);
+    snapshot_test(sf);
+    time_travel_test(sf);
+    scheduler_test(sf);
+    idle_loop_test(sf);
+    profiler_test(sf);
+    callgraph_test(sf);
+    breakpoint_test(sf);
+    opcode_table_test(sf);
+    asm_cache_test(sf);
+    fixup_test(sf);
+    mnemonic_test(sf);
+    arithmetic_benchmark(sf);
+    jit_benchmark(sf);
+#elif defined(RUN_BENCH)
+    int status = bench_main(sf, argc, argv);
+    free(sf);
+    return status;
 #else
     if (argc == 1) {
         fprintf(stderr, "Error: must enter an assembly file to run\n");
         exit(ERR_NO_FILE);
     }
+    if (strcmp(argv[1], "--batch") == 0) {
+        return batch_main(argc, argv);
+    }
+    if (strcmp(argv[1], "--profile") == 0) {
+        return profile_main(argc, argv);
+    }
+    if (strcmp(argv[1], "--headless") == 0) {
+        return headless_main(argc, argv);
+    }
+#ifdef HEADLESS
+    fprintf(stderr, "Error: built without the GUI, run with --headless, --batch or --profile\n");
+    exit(ERR_NO_FILE);
+#else
 
     load_program(sf, argv[1]);
+#ifdef PROFILE_PAIRS
+    profile_pairs(sf, PROFILE_INSTRUCTIONS, PROFILE_TOP_PAIRS);
+    return 0;
+#endif
 
     // strings for register values, memory values
     char accumulator_str[20] = "Accumulator: 0x00";
@@ -227,6 +718,8 @@ int main(int argc, char* argv[]) {
     char status_str[13] = "Status: 0x00";
     char esp_str[22] = "Stack Pointer: 0x0000";
     char pc_str[11] = "PC: 0x0000";
+    char cycles_str[32] = "Cycles: 0";
+    char breakpoint_str[40] = "Breakpoints: 0";
     char memory_string[16] = "0x0000: 0x00";
 
     // initialize and configure GLFW
@@ -319,6 +812,22 @@ int main(int argc, char* argv[]) {
     initialize_quad(&enter_quad, search_quad.x + search_quad.width + 4.0f, search_quad.y, SCREEN_WIDTH / 15, SCREEN_HEIGHT / 15);
     Quad_t reset_quad;
     initialize_quad(&reset_quad, continue_quad.x + continue_quad.width + 4.0f, continue_quad.y, SCREEN_WIDTH / 5, SCREEN_HEIGHT / 15);
+    Quad_t back_quad;
+    initialize_quad(&back_quad, next_quad.x + next_quad.width + 4.0f, next_quad.y, SCREEN_WIDTH / 5, SCREEN_HEIGHT / 15);
+    Quad_t back_pc_quad;
+    initialize_quad(&back_pc_quad, SCREEN_WIDTH / 2, button_region_top - (4 * ((SCREEN_HEIGHT / 15) + 4.0f)), SCREEN_WIDTH / 5, SCREEN_HEIGHT / 15);
+    Quad_t back_write_quad;
+    initialize_quad(&back_write_quad, back_pc_quad.x + back_pc_quad.width + 4.0f, back_pc_quad.y, SCREEN_WIDTH / 5, SCREEN_HEIGHT / 15);
+
+    // history of everything run from right after loading, which Reset goes back to without reassembling
+    TimeTravel_t *travel = new_time_travel(sf, TRAVEL_STEPS);
+    breakpoints = new_breakpoints();
+    use_breakpoints(breakpoints);
+    sf_t *idle_check = (sf_t *)malloc(sizeof(sf_t)); // copy of sf run to find out whether it is idling
+    if (idle_check == NULL) {
+        fprintf(stderr, "Failed to allocate memory for 6502\n");
+        exit(ERR_NO_MEM);
+    }
 
     while(!glfwWindowShouldClose(window)) {
         // process keyboard inputs
@@ -329,24 +838,49 @@ int main(int argc, char* argv[]) {
             double xpos, ypos;
             glfwGetCursorPos(window, &xpos, &ypos);
             user_entry = 0;
+            idle = 0;
             if (pixel_in_quad(&continue_quad, xpos, curr_height - ypos, SCREEN_WIDTH, SCREEN_HEIGHT, curr_width, curr_height)) {
                 run = 1;
             } else if (pixel_in_quad(&next_quad, xpos, curr_height - ypos, SCREEN_WIDTH, SCREEN_HEIGHT, curr_width, curr_height)) {
-                process_line(sf);
+                breakpoint_hit = travel_run_instructions(travel, sf, 1) == RUN_BREAKPOINT;
+            } else if (pixel_in_quad(&back_quad, xpos, curr_height - ypos, SCREEN_WIDTH, SCREEN_HEIGHT, curr_width, curr_height)) {
+                travel_step_back(travel, sf);
+                run = 0;
+            } else if (pixel_in_quad(&back_pc_quad, xpos, curr_height - ypos, SCREEN_WIDTH, SCREEN_HEIGHT, curr_width, curr_height)) {
+                uint16_t address;
+                if (take_user_address(&address) == 0) {
+                    travel_back_to_pc(travel, sf, address); // goes back to the start if address was never run
+                }
+                run = 0;
+            } else if (pixel_in_quad(&back_write_quad, xpos, curr_height - ypos, SCREEN_WIDTH, SCREEN_HEIGHT, curr_width, curr_height)) {
+                uint16_t address;
+                if (take_user_address(&address) == 0) {
+                    travel_back_to_write(travel, sf, address);
+                    starting_memory_location = address/16 * 16;
+                }
+                run = 0;
             } else if (pixel_in_quad(&search_quad, xpos, curr_height - ypos, SCREEN_WIDTH, SCREEN_HEIGHT, curr_width, curr_height)) {
                 user_entry = 1;
             } else if (pixel_in_quad(&enter_quad, xpos, curr_height - ypos, SCREEN_WIDTH, SCREEN_HEIGHT, curr_width, curr_height)) {
                 check_user_input();
             } else if (pixel_in_quad(&reset_quad, xpos, curr_height - ypos, SCREEN_WIDTH, SCREEN_HEIGHT, curr_width, curr_height)) {
-                load_program(sf, argv[1]);
+                travel_rewind(travel, sf); // rewinds only the pages the program has written
                 run = 0;
             }
             click = 0;
         }
 
-        if (run) {
-            process_line(sf);
-        } 
+        if (run && !idle) {
+            RunExit_t exit_reason = travel_run_instructions(travel, sf, INSTRUCTIONS_PER_FRAME);
+            breakpoint_hit = exit_reason == RUN_BREAKPOINT;
+            if (exit_reason == RUN_BRK || breakpoint_hit) {
+                run = 0; // stop on software interrupt or breakpoint so state can be inspected
+            } else {
+                // a copy is checked so the instructions it takes stay out of the recorded history
+                *idle_check = *sf;
+                idle = skip_idle_loop(idle_check, UINT64_MAX) != 0;
+            }
+        }
 
         // rendering commands
         glClearColor(0.66f, 0.66f, 0.66f, 0.1f);
@@ -359,6 +893,16 @@ int main(int argc, char* argv[]) {
         fill_string(status_str + 10, sf->status, 2);
         fill_string(esp_str + 17, sf->esp, 4);
         fill_string(pc_str + 6, sf->pc, 4);
+        snprintf(cycles_str + 8, sizeof(cycles_str) - 8, "%llu", (unsigned long long)sf->cycles);
+        if (breakpoint_hit) {
+            const char *kind = breakpoints->hit_kind == BREAK_EXECUTE ? "PC" :
+                               breakpoints->hit_kind == BREAK_READ ? "Read" : "Write";
+            snprintf(breakpoint_str, sizeof(breakpoint_str), "Break: %s 0x%04X at 0x%04X", kind,
+                     breakpoints->hit_address, breakpoints->hit_pc);
+        } else {
+            snprintf(breakpoint_str, sizeof(breakpoint_str), "Breakpoints: %u",
+                     breakpoints->num_execute + breakpoints->num_watch);
+        }
 
         glBindVertexArray(VAO_text);
         glUniformMatrix4fv(glGetUniformLocation(text_shader, "projection"), 1, GL_FALSE, (float *)projection);
@@ -369,6 +913,8 @@ int main(int argc, char* argv[]) {
         render_text(text_shader, status_str, 2.0f, (float)SCREEN_HEIGHT - 98.0f, 0.75f, (vec3){1.0f, 0.0f, 0.0f}, VAO_text, VBO_text);
         render_text(text_shader, esp_str, 2.0f, (float)SCREEN_HEIGHT - 116.0f, 0.75f, (vec3){1.0f, 0.0f, 0.0f}, VAO_text, VBO_text);
         render_text(text_shader, pc_str, 2.0f, (float)SCREEN_HEIGHT - 134.0f, 0.75f, (vec3){1.0f, 0.0f, 0.0f}, VAO_text, VBO_text);
+        render_text(text_shader, cycles_str, 2.0f, (float)SCREEN_HEIGHT - 152.0f, 0.75f, (vec3){1.0f, 0.0f, 0.0f}, VAO_text, VBO_text);
+        render_text(text_shader, breakpoint_str, 2.0f, (float)SCREEN_HEIGHT - 170.0f, 0.75f, (vec3){1.0f, 0.0f, 0.0f}, VAO_text, VBO_text);
 
         // render buttons/search bar
         glBindVertexArray(VAO_quad);
@@ -382,14 +928,21 @@ int main(int argc, char* argv[]) {
         }
         render_quad(quad_shader, &enter_quad, (vec3){0.33f, 0.33f, 0.33f}, VAO_quad, VBO_quad, EBO_quad);
         render_quad(quad_shader, &reset_quad, (vec3){0.33f, 0.33f, 0.33f}, VAO_quad, VBO_quad, EBO_quad);
+        render_quad(quad_shader, &back_quad, (vec3){0.33f, 0.33f, 0.33f}, VAO_quad, VBO_quad, EBO_quad);
+        render_quad(quad_shader, &back_pc_quad, (vec3){0.33f, 0.33f, 0.33f}, VAO_quad, VBO_quad, EBO_quad);
+        render_quad(quad_shader, &back_write_quad, (vec3){0.33f, 0.33f, 0.33f}, VAO_quad, VBO_quad, EBO_quad);
         glBindVertexArray(VAO_text);
         glUniformMatrix4fv(glGetUniformLocation(text_shader, "projection"), 1, GL_FALSE, (float *)projection);
-        render_text(text_shader, "Run", continue_quad.x + ((continue_quad.width - text_width("Run", 0.5f))/2), continue_quad.y + ((continue_quad.height - 12)/2), 0.5f, (vec3){0.66f, 0.66f, 0.66f}, VAO_text, VBO_text);
+        const char *run_label = run && idle ? "Idle" : "Run";
+        render_text(text_shader, run_label, continue_quad.x + ((continue_quad.width - text_width(run_label, 0.5f))/2), continue_quad.y + ((continue_quad.height - 12)/2), 0.5f, (vec3){0.66f, 0.66f, 0.66f}, VAO_text, VBO_text);
         render_text(text_shader, "Next", next_quad.x + ((next_quad.width - text_width("Next", 0.5f))/2), next_quad.y + ((next_quad.height - 12)/2), 0.5f, (vec3){0.66f, 0.66f, 0.66f}, VAO_text, VBO_text);
         render_text(text_shader, "Search:", SCREEN_WIDTH/2, search_quad.y + ((search_quad.height - 12)/2), 0.5f, (vec3){0.33f, 0.33f, 0.33f}, VAO_text, VBO_text);
         render_text(text_shader, user_entry_buf, search_quad.x, search_quad.y + ((search_quad.height - 24)/2), 1.0f, (vec3){0.66f, 0.66f, 0.66f}, VAO_text, VBO_text);
         render_text(text_shader, "->", enter_quad.x + ((enter_quad.width - text_width("->", 0.5f))/2), enter_quad.y + ((enter_quad.height - 12)/2), 0.5f, (vec3){0.66f, 0.66f, 0.66f}, VAO_text, VBO_text);
         render_text(text_shader, "Reset", reset_quad.x + ((reset_quad.width - text_width("Reset", 0.5f))/2), reset_quad.y + ((reset_quad.height - 12)/2), 0.5f, (vec3){0.66f, 0.66f, 0.66f}, VAO_text, VBO_text);
+        render_text(text_shader, "Back", back_quad.x + ((back_quad.width - text_width("Back", 0.5f))/2), back_quad.y + ((back_quad.height - 12)/2), 0.5f, (vec3){0.66f, 0.66f, 0.66f}, VAO_text, VBO_text);
+        render_text(text_shader, "<-PC", back_pc_quad.x + ((back_pc_quad.width - text_width("<-PC", 0.5f))/2), back_pc_quad.y + ((back_pc_quad.height - 12)/2), 0.5f, (vec3){0.66f, 0.66f, 0.66f}, VAO_text, VBO_text);
+        render_text(text_shader, "<-Write", back_write_quad.x + ((back_write_quad.width - text_width("<-Write", 0.5f))/2), back_write_quad.y + ((back_write_quad.height - 12)/2), 0.5f, (vec3){0.66f, 0.66f, 0.66f}, VAO_text, VBO_text);
 
         // render memory locations
         glBindVertexArray(VAO_text);
@@ -408,12 +961,22 @@ int main(int argc, char* argv[]) {
             render_text(text_shader, memory_string, 2.0f, memory_quads[i].y, 0.66f, (vec3){1.0f, 0.0f, 0.0f}, VAO_text, VBO_text);
         }
 
-        // check/call window events and swap buffers
+        // check/call window events and swap buffers; unless a program is making progress, nothing changes until
+        // the user does something, so block instead of spinning
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (run && !idle) {
+            glfwPollEvents();
+        } else {
+            glfwWaitEvents();
+        }
     }
 
     glfwTerminate();
+    use_breakpoints(NULL);
+    free_breakpoints(breakpoints);
+    free_time_travel(travel);
+    free(idle_check);
+#endif
 
 #endif
     
@@ -0,0 +1,295 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "paged.h"
+#include "../lib/lib.h"
+
+/* PAGED MEMORY
+ * a paged memory is a two level table: NUM_CHUNKS pointers to reference-counted chunks, each pointing to
+ * PAGES_PER_CHUNK reference-counted pages; forking one copies the top level and bumps the chunk counts, and a
+ * chunk or page is only copied when a table that shares it writes to it
+ * pages of the ROM area (ROM_START up to RAM_START) come from a pool shared by every paged memory in the process,
+ * which holds the latest contents seen for each of them; writes through paged_write never reach them
+ * a count of 1 can't change under its holder: only tables referring to a chunk can fork it, and only chunks
+ * referring to a page can share it, so a holder with the only reference may write in place
+ */
+
+#define FIRST_ROM_PAGE  (ROM_START >> 8)
+#define LAST_ROM_PAGE   ((RAM_START >> 8) - 1)
+
+static Page_t *rom_pool[NUM_PAGES]; // latest contents of every ROM page, the pool holds a reference to each
+static pthread_mutex_t rom_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* new_page
+ *      DESCRIPTION: allocates a private page holding passed bytes
+ *      INPUTS: bytes -- PAGE_BYTES bytes to copy into the page
+ *      OUTPUTS: page with a single reference
+ *      SIDE EFFECTS: allocates memory, exits if there is none
+ */
+static Page_t *new_page(const uint8_t *bytes) {
+    Page_t *page = (Page_t *)malloc(sizeof(Page_t));
+    if (page == NULL) {
+        fprintf(stderr, "Failed to allocate memory for page\n");
+        exit(ERR_NO_MEM);
+    }
+    atomic_init(&page->refs, 1);
+    page->rom = 0;
+    memcpy(page->bytes, bytes, PAGE_BYTES);
+    return page;
+}
+
+/* release_page
+ *      DESCRIPTION: drops a reference to page, freeing it once nothing refers to it
+ *      INPUTS: page -- page to release
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: may free page
+ */
+static void release_page(Page_t *page) {
+    if (atomic_fetch_sub_explicit(&page->refs, 1, memory_order_acq_rel) == 1) {
+        free(page);
+    }
+}
+
+/* share_rom_page
+ *      DESCRIPTION: finds the pool page holding passed bytes for a ROM page, replacing the pool's page if its
+ *                   contents differ
+ *      INPUTS: index -- page number, in the ROM area
+ *              bytes -- PAGE_BYTES bytes the page should hold
+ *      OUTPUTS: pool page with a reference for the caller
+ *      SIDE EFFECTS: may allocate a page and release the pool's previous one
+ */
+static Page_t *share_rom_page(uint32_t index, const uint8_t *bytes) {
+    pthread_mutex_lock(&rom_pool_lock);
+    Page_t *page = rom_pool[index];
+    if (page == NULL || memcmp(page->bytes, bytes, PAGE_BYTES) != 0) {
+        if (page != NULL) {
+            release_page(page);
+        }
+        page = new_page(bytes);
+        page->rom = 1;
+        rom_pool[index] = page;
+    }
+    atomic_fetch_add_explicit(&page->refs, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&rom_pool_lock);
+    return page;
+}
+
+
+/* new_chunk
+ *      DESCRIPTION: allocates a chunk with a single reference and no pages filled in
+ *      INPUTS: none
+ *      OUTPUTS: new chunk
+ *      SIDE EFFECTS: allocates memory, exits if there is none
+ */
+static PageChunk_t *new_chunk(void) {
+    PageChunk_t *chunk = (PageChunk_t *)malloc(sizeof(PageChunk_t));
+    if (chunk == NULL) {
+        fprintf(stderr, "Failed to allocate memory for page chunk\n");
+        exit(ERR_NO_MEM);
+    }
+    atomic_init(&chunk->refs, 1);
+    return chunk;
+}
+
+/* release_chunk
+ *      DESCRIPTION: drops a reference to chunk, freeing it and releasing its pages once nothing refers to it
+ *      INPUTS: chunk -- chunk to release
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: may free chunk and pages
+ */
+static void release_chunk(PageChunk_t *chunk) {
+    if (atomic_fetch_sub_explicit(&chunk->refs, 1, memory_order_acq_rel) == 1) {
+        for (int i = 0; i < PAGES_PER_CHUNK; i++) {
+            release_page(chunk->pages[i]);
+        }
+        free(chunk);
+    }
+}
+
+/* own_chunk
+ *      DESCRIPTION: makes sure no other page table shares a chunk, copying it if one does
+ *      INPUTS: paged -- paged memory about to modify the chunk
+ *              index -- chunk number
+ *      OUTPUTS: chunk only paged refers to
+ *      SIDE EFFECTS: may allocate a chunk, take references to its pages and release the shared one
+ */
+static PageChunk_t *own_chunk(PagedMemory_t *paged, uint32_t index) {
+    PageChunk_t *chunk = paged->chunks[index];
+    if (atomic_load_explicit(&chunk->refs, memory_order_acquire) != 1) {
+        PageChunk_t *copy = new_chunk();
+        for (int i = 0; i < PAGES_PER_CHUNK; i++) {
+            atomic_fetch_add_explicit(&chunk->pages[i]->refs, 1, memory_order_relaxed);
+            copy->pages[i] = chunk->pages[i];
+        }
+        release_chunk(chunk);
+        paged->chunks[index] = chunk = copy;
+    }
+    return chunk;
+}
+
+/* own_page
+ *      DESCRIPTION: makes sure no other page table shares a page, copying it (and its chunk) if one does
+ *      INPUTS: paged -- paged memory about to write the page
+ *              index -- page number, not in the ROM area
+ *      OUTPUTS: page only paged refers to
+ *      SIDE EFFECTS: may allocate a chunk and a page and release shared ones
+ */
+static Page_t *own_page(PagedMemory_t *paged, uint32_t index) {
+    PageChunk_t *chunk = own_chunk(paged, index / PAGES_PER_CHUNK);
+    Page_t **slot = &chunk->pages[index % PAGES_PER_CHUNK];
+    if (atomic_load_explicit(&(*slot)->refs, memory_order_acquire) != 1) {
+        Page_t *copy = new_page((*slot)->bytes);
+        release_page(*slot);
+        *slot = copy;
+    }
+    return *slot;
+}
+
+/* new_paged_memory
+ *      DESCRIPTION: builds a paged copy of a flat 64 KiB memory
+ *      INPUTS: memory -- MEMORY_SIZE bytes to copy (e.g. sf->memory)
+ *      OUTPUTS: paged memory with private RAM pages and shared ROM pages
+ *      SIDE EFFECTS: allocates memory, exits if there is none
+ */
+PagedMemory_t *new_paged_memory(const uint8_t *memory) {
+    PagedMemory_t *paged = (PagedMemory_t *)malloc(sizeof(PagedMemory_t));
+    if (paged == NULL) {
+        fprintf(stderr, "Failed to allocate memory for page table\n");
+        exit(ERR_NO_MEM);
+    }
+    for (uint32_t index = 0; index < NUM_CHUNKS; index++) {
+        paged->chunks[index] = new_chunk();
+    }
+    for (uint32_t index = 0; index < NUM_PAGES; index++) {
+        const uint8_t *bytes = memory + index * PAGE_BYTES;
+        Page_t **slot = &paged->chunks[index / PAGES_PER_CHUNK]->pages[index % PAGES_PER_CHUNK];
+        *slot = index >= FIRST_ROM_PAGE && index <= LAST_ROM_PAGE ? share_rom_page(index, bytes) : new_page(bytes);
+    }
+    return paged;
+}
+
+/* fork_paged_memory
+ *      DESCRIPTION: makes a copy of paged memory that shares every page with it until either side writes one
+ *      INPUTS: source -- paged memory to fork
+ *      OUTPUTS: new paged memory, independent of source as far as its users can tell
+ *      SIDE EFFECTS: allocates a page table, takes a reference to every chunk of source
+ */
+PagedMemory_t *fork_paged_memory(const PagedMemory_t *source) {
+    PagedMemory_t *paged = (PagedMemory_t *)malloc(sizeof(PagedMemory_t));
+    if (paged == NULL) {
+        fprintf(stderr, "Failed to allocate memory for page table\n");
+        exit(ERR_NO_MEM);
+    }
+    for (uint32_t index = 0; index < NUM_CHUNKS; index++) {
+        atomic_fetch_add_explicit(&source->chunks[index]->refs, 1, memory_order_relaxed);
+        paged->chunks[index] = source->chunks[index];
+    }
+    return paged;
+}
+
+/* free_paged_memory
+ *      DESCRIPTION: frees page table and every chunk and page no other paged memory shares
+ *      INPUTS: paged -- paged memory to free
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: frees memory
+ */
+void free_paged_memory(PagedMemory_t *paged) {
+    for (uint32_t index = 0; index < NUM_CHUNKS; index++) {
+        release_chunk(paged->chunks[index]);
+    }
+    free(paged);
+}
+
+/* paged_page
+ *      DESCRIPTION: returns the bytes of a page, which stay valid until paged writes the page or is freed
+ *      INPUTS: paged -- paged memory to look in
+ *              index -- page number
+ *      OUTPUTS: PAGE_BYTES bytes of the page; paged memories sharing the page return the same pointer
+ *      SIDE EFFECTS: none
+ */
+const uint8_t *paged_page(const PagedMemory_t *paged, uint8_t index) {
+    return paged->chunks[index / PAGES_PER_CHUNK]->pages[index % PAGES_PER_CHUNK]->bytes;
+}
+
+/* paged_read
+ *      DESCRIPTION: reads a byte of paged memory
+ *      INPUTS: paged -- paged memory to read
+ *              address -- address to read
+ *      OUTPUTS: byte at address
+ *      SIDE EFFECTS: none
+ */
+uint8_t paged_read(const PagedMemory_t *paged, uint16_t address) {
+    return paged_page(paged, address >> 8)[address & 0xFF];
+}
+
+/* paged_write
+ *      DESCRIPTION: writes a byte of paged memory, first copying its page if another paged memory shares it;
+ *                   writes to ROM pages are dropped
+ *      INPUTS: paged -- paged memory to write
+ *              address -- address to write
+ *              value -- byte to write
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: may allocate a chunk and a page and release shared ones
+ */
+void paged_write(PagedMemory_t *paged, uint16_t address, uint8_t value) {
+    uint32_t index = address >> 8;
+    if (paged->chunks[index / PAGES_PER_CHUNK]->pages[index % PAGES_PER_CHUNK]->rom) {
+        return;
+    }
+    own_page(paged, index)->bytes[address & 0xFF] = value;
+}
+
+/* paged_copy_out
+ *      DESCRIPTION: copies paged memory into a flat 64 KiB memory the CPU can run on
+ *      INPUTS: paged -- paged memory to copy
+ *              memory -- MEMORY_SIZE bytes to overwrite (e.g. sf->memory)
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: overwrites memory
+ */
+void paged_copy_out(const PagedMemory_t *paged, uint8_t *memory) {
+    for (uint32_t index = 0; index < NUM_PAGES; index++) {
+        memcpy(memory + index * PAGE_BYTES, paged_page(paged, index), PAGE_BYTES);
+    }
+}
+
+/* paged_write_page
+ *      DESCRIPTION: replaces the contents of a whole page, copying its chunk if another paged memory shares it; a
+ *                   ROM page is swapped for the pool's page with the new contents
+ *      INPUTS: paged -- paged memory to write
+ *              index -- page number
+ *              bytes -- PAGE_BYTES bytes the page should hold
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: may allocate a chunk and a page and release shared ones
+ */
+void paged_write_page(PagedMemory_t *paged, uint8_t index, const uint8_t *bytes) {
+    if (index >= FIRST_ROM_PAGE && index <= LAST_ROM_PAGE) {
+        PageChunk_t *chunk = own_chunk(paged, index / PAGES_PER_CHUNK);
+        Page_t *old = chunk->pages[index % PAGES_PER_CHUNK];
+        chunk->pages[index % PAGES_PER_CHUNK] = share_rom_page(index, bytes);
+        release_page(old);
+    } else {
+        memcpy(own_page(paged, index)->bytes, bytes, PAGE_BYTES);
+    }
+}
+
+/* paged_copy_in
+ *      DESCRIPTION: brings paged memory up to date with a flat 64 KiB memory, replacing only the pages that
+ *                   differ so the rest stay shared
+ *      INPUTS: paged -- paged memory to update
+ *              memory -- MEMORY_SIZE bytes it should hold (e.g. sf->memory after a run)
+ *      OUTPUTS: number of pages that changed
+ *      SIDE EFFECTS: may allocate chunks and pages and release shared ones
+ */
+uint32_t paged_copy_in(PagedMemory_t *paged, const uint8_t *memory) {
+    uint32_t changed = 0;
+    for (uint32_t index = 0; index < NUM_PAGES; index++) {
+        const uint8_t *bytes = memory + index * PAGE_BYTES;
+        if (memcmp(paged_page(paged, index), bytes, PAGE_BYTES) != 0) {
+            paged_write_page(paged, index, bytes);
+            changed++;
+        }
+    }
+    return changed;
+}
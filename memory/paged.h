@@ -0,0 +1,41 @@
+#ifndef __PAGED_H
+#define __PAGED_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "../6502.h"
+
+#define PAGE_BYTES          (MEMORY_SIZE / NUM_PAGES) // bytes in one page, the unit pages are shared and copied in
+#define PAGES_PER_CHUNK     16 // pages behind one entry of a page table
+#define NUM_CHUNKS          (NUM_PAGES / PAGES_PER_CHUNK)
+
+// one page of memory, shared by every chunk that refers to it until one of them writes it
+typedef struct Page {
+    _Atomic uint32_t refs; // chunks (and the ROM pool) referring to the page
+    uint8_t rom; // set for pages of the ROM pool, which are never written
+    uint8_t bytes[PAGE_BYTES];
+} Page_t;
+
+// PAGES_PER_CHUNK consecutive pages, shared by every page table that refers to it until one of them writes it
+typedef struct PageChunk {
+    _Atomic uint32_t refs; // page tables referring to the chunk
+    Page_t *pages[PAGES_PER_CHUNK];
+} PageChunk_t;
+
+// 64 KiB address space as a two level table of reference-counted pages, copied on write
+typedef struct PagedMemory {
+    PageChunk_t *chunks[NUM_CHUNKS];
+} PagedMemory_t;
+
+PagedMemory_t *new_paged_memory(const uint8_t *memory);
+PagedMemory_t *fork_paged_memory(const PagedMemory_t *source);
+void free_paged_memory(PagedMemory_t *paged);
+const uint8_t *paged_page(const PagedMemory_t *paged, uint8_t index);
+uint8_t paged_read(const PagedMemory_t *paged, uint16_t address);
+void paged_write(PagedMemory_t *paged, uint16_t address, uint8_t value);
+void paged_write_page(PagedMemory_t *paged, uint8_t index, const uint8_t *bytes);
+void paged_copy_out(const PagedMemory_t *paged, uint8_t *memory);
+uint32_t paged_copy_in(PagedMemory_t *paged, const uint8_t *memory);
+
+#endif
@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "snapshot.h"
+#include "../lib/lib.h"
+
+/* SNAPSHOTS
+ * every store the CPU makes sets the bit of its page in sf->dirty (note_store), and sf_snapshot/sf_restore clear
+ * it: while sf runs on from the snapshot it last took or restored (last), the dirty pages are the only ones that
+ * can differ from it
+ * a new snapshot forks the paged memory of last and copies in just the dirty pages; restoring copies back the
+ * dirty pages plus the pages where the snapshot and last don't share a page, found by comparing page pointers
+ * host code that writes sf->memory directly (loading a program or an image) doesn't mark pages, so the next call
+ * must pass NULL for last, which takes or restores all of memory
+ */
+
+#define DIRTY_WORD_PAGES    64 // pages per word of sf->dirty
+
+/* save_registers
+ *      DESCRIPTION: copies everything but memory from sf into snapshot
+ */
+static void save_registers(SfSnapshot_t *snapshot, const sf_t *sf) {
+    snapshot->accumulator = sf->accumulator;
+    snapshot->x_index = sf->x_index;
+    snapshot->y_index = sf->y_index;
+    snapshot->status = sf->status;
+    snapshot->esp = sf->esp;
+    snapshot->pc = sf->pc;
+    snapshot->cycles = sf->cycles;
+#ifdef MEMORY_BUS
+    memcpy(snapshot->bus, sf->bus, sizeof(sf->bus));
+    snapshot->mapped_pages = sf->mapped_pages;
+#endif
+}
+
+/* load_registers
+ *      DESCRIPTION: copies everything but memory from snapshot into sf
+ */
+static void load_registers(sf_t *sf, const SfSnapshot_t *snapshot) {
+    sf->accumulator = snapshot->accumulator;
+    sf->x_index = snapshot->x_index;
+    sf->y_index = snapshot->y_index;
+    sf->status = snapshot->status;
+    sf->esp = snapshot->esp;
+    sf->pc = snapshot->pc;
+    sf->cycles = snapshot->cycles;
+    sf->nz_pending = 0; // status is always up to date outside the core
+#ifdef MEMORY_BUS
+    memcpy(sf->bus, snapshot->bus, sizeof(sf->bus));
+    sf->mapped_pages = snapshot->mapped_pages;
+#endif
+}
+
+/* sf_snapshot
+ *      DESCRIPTION: captures the full state of sf
+ *      INPUTS: sf -- 6502 struct to capture
+ *              last -- snapshot sf was last captured into or restored from, or NULL to copy all of memory
+ *      OUTPUTS: new snapshot, sharing every page sf hasn't written since last with it
+ *      SIDE EFFECTS: allocates memory, clears sf->dirty
+ */
+SfSnapshot_t *sf_snapshot(sf_t *sf, const SfSnapshot_t *last) {
+    SfSnapshot_t *snapshot = (SfSnapshot_t *)malloc(sizeof(SfSnapshot_t));
+    if (snapshot == NULL) {
+        fprintf(stderr, "Failed to allocate memory for snapshot\n");
+        exit(ERR_NO_MEM);
+    }
+    save_registers(snapshot, sf);
+    if (last == NULL) {
+        snapshot->memory = new_paged_memory(sf->memory);
+    } else {
+        snapshot->memory = fork_paged_memory(last->memory);
+        for (int word = 0; word < NUM_PAGES / DIRTY_WORD_PAGES; word++) {
+            for (uint64_t bits = sf->dirty[word]; bits; bits &= bits - 1) {
+                uint32_t page = word * DIRTY_WORD_PAGES + __builtin_ctzll(bits);
+                paged_write_page(snapshot->memory, page, sf->memory + page * PAGE_BYTES);
+            }
+        }
+    }
+    memset(sf->dirty, 0, sizeof(sf->dirty));
+    return snapshot;
+}
+
+/* sf_restore
+ *      DESCRIPTION: puts sf back in the state captured by snapshot
+ *      INPUTS: sf -- 6502 struct to restore
+ *              snapshot -- state to restore
+ *              last -- snapshot sf was last captured into or restored from (may be snapshot itself), or NULL to
+ *                      copy all of memory
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: overwrites registers, bus and the memory pages that differ, clears sf->dirty, invalidates code
+ *                    engines decoded from memory
+ */
+void sf_restore(sf_t *sf, const SfSnapshot_t *snapshot, const SfSnapshot_t *last) {
+    load_registers(sf, snapshot);
+    if (last == NULL) {
+        paged_copy_out(snapshot->memory, sf->memory);
+    } else {
+        for (int chunk = 0; chunk < NUM_CHUNKS; chunk++) {
+            int shared = snapshot->memory->chunks[chunk] == last->memory->chunks[chunk];
+            for (int index = chunk * PAGES_PER_CHUNK; index < (chunk + 1) * PAGES_PER_CHUNK; index++) {
+                const uint8_t *page = paged_page(snapshot->memory, index);
+                int dirty = (sf->dirty[index / DIRTY_WORD_PAGES] >> (index % DIRTY_WORD_PAGES)) & 1;
+                if (dirty || (!shared && page != paged_page(last->memory, index))) {
+                    memcpy(sf->memory + index * PAGE_BYTES, page, PAGE_BYTES);
+                }
+            }
+        }
+    }
+    memset(sf->dirty, 0, sizeof(sf->dirty));
+    invalidate_code(sf);
+}
+
+/* copy_snapshot
+ *      DESCRIPTION: makes a copy of snapshot that shares all of its memory, to be kept or freed independently of it
+ *      INPUTS: snapshot -- snapshot to copy
+ *      OUTPUTS: new snapshot
+ *      SIDE EFFECTS: allocates memory
+ */
+SfSnapshot_t *copy_snapshot(const SfSnapshot_t *snapshot) {
+    SfSnapshot_t *copy = (SfSnapshot_t *)malloc(sizeof(SfSnapshot_t));
+    if (copy == NULL) {
+        fprintf(stderr, "Failed to allocate memory for snapshot\n");
+        exit(ERR_NO_MEM);
+    }
+    *copy = *snapshot;
+    copy->memory = fork_paged_memory(snapshot->memory);
+    return copy;
+}
+
+/* free_snapshot
+ *      DESCRIPTION: frees snapshot and every page no other snapshot shares
+ *      INPUTS: snapshot -- snapshot to free
+ *      OUTPUTS: none
+ *      SIDE EFFECTS: frees memory
+ */
+void free_snapshot(SfSnapshot_t *snapshot) {
+    free_paged_memory(snapshot->memory);
+    free(snapshot);
+}
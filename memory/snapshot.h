@@ -0,0 +1,31 @@
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "../6502.h"
+#include "paged.h"
+
+// full machine state of a 6502 at one point: registers, bus mapping and memory (shared page by page with the
+// snapshots it was taken after)
+typedef struct SfSnapshot {
+    uint8_t accumulator;
+    uint8_t x_index;
+    uint8_t y_index;
+    uint8_t status;
+    uint16_t esp;
+    uint16_t pc;
+    uint64_t cycles;
+#ifdef MEMORY_BUS
+    BusPage_t bus[NUM_PAGES];
+    uint16_t mapped_pages;
+#endif
+    PagedMemory_t *memory;
+} SfSnapshot_t;
+
+SfSnapshot_t *sf_snapshot(sf_t *sf, const SfSnapshot_t *last);
+void sf_restore(sf_t *sf, const SfSnapshot_t *snapshot, const SfSnapshot_t *last);
+SfSnapshot_t *copy_snapshot(const SfSnapshot_t *snapshot);
+void free_snapshot(SfSnapshot_t *snapshot);
+
+#endif
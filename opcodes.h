@@ -0,0 +1,191 @@
+#ifndef _OPCODES_H
+#define _OPCODES_H
+
+/*
+ * every instruction the 6502 runs and the assembler emits is one row of OPCODE_TABLE, and everything that needs to
+ * know about opcodes is generated from it: the CPU's handlers, dispatch, cycle and length tables (6502.c), the
+ * assembler's encoder (assembler/encoder.c) and the mnemonic and mode tables disassembly reads
+ * each row is X(mnemonic, mode, opcode, length, cycles, penalty, handler):
+ *      mnemonic -- name of the instruction, as written in assembly
+ *      mode -- addressing mode, one of the OPCODE_MODE_ suffixes; mnemonic##_##mode names the handler
+ *      opcode -- opcode byte
+ *      length -- bytes in opcode + operand
+ *      cycles -- base clock cycles
+ *      penalty -- 1 if indexing across a page costs a cycle (mode##_PAGE_PENALTY), 0 otherwise
+ *      handler -- how the handler is generated: READ, STORE, MEMORY (read-modify-write) or ACCUM from the
+ *                 operation, CUSTOM if it is written out in 6502.c (branches, flags, registers, stack, jumps)
+ * opcodes with no row have no instruction
+ */
+
+// addressing mode of an opcode, for disassembly
+typedef enum {
+    OPCODE_MODE_IMP = 0,
+    OPCODE_MODE_ACCUM,
+    OPCODE_MODE_IMM,
+    OPCODE_MODE_ZPG,
+    OPCODE_MODE_ZPG_X,
+    OPCODE_MODE_ZPG_Y,
+    OPCODE_MODE_ABS,
+    OPCODE_MODE_ABS_X,
+    OPCODE_MODE_ABS_Y,
+    OPCODE_MODE_IND_X,
+    OPCODE_MODE_IND_Y,
+    OPCODE_MODE_IND,
+    OPCODE_MODE_REL,
+    OPCODE_MODE_NONE // no such opcode
+} OpcodeMode_t;
+
+#define OPCODE_TABLE(X)                      \
+    X(BRK, IMP,   0x00, 1, 7, 0, CUSTOM) \
+    X(ORA, IND_X, 0x01, 2, 6, 0, READ)   \
+    X(ORA, ZPG,   0x05, 2, 3, 0, READ)   \
+    X(ASL, ZPG,   0x06, 2, 5, 0, MEMORY) \
+    X(PHP, IMP,   0x08, 1, 3, 0, CUSTOM) \
+    X(ORA, IMM,   0x09, 2, 2, 0, READ)   \
+    X(ASL, ACCUM, 0x0A, 1, 2, 0, ACCUM)  \
+    X(ORA, ABS,   0x0D, 3, 4, 0, READ)   \
+    X(ASL, ABS,   0x0E, 3, 6, 0, MEMORY) \
+    X(BPL, REL,   0x10, 2, 2, 0, CUSTOM) \
+    X(ORA, IND_Y, 0x11, 2, 5, 1, READ)   \
+    X(ORA, ZPG_X, 0x15, 2, 4, 0, READ)   \
+    X(ASL, ZPG_X, 0x16, 2, 6, 0, MEMORY) \
+    X(CLC, IMP,   0x18, 1, 2, 0, CUSTOM) \
+    X(ORA, ABS_Y, 0x19, 3, 4, 1, READ)   \
+    X(ORA, ABS_X, 0x1D, 3, 4, 1, READ)   \
+    X(ASL, ABS_X, 0x1E, 3, 7, 0, MEMORY) \
+    X(JSR, ABS,   0x20, 3, 6, 0, CUSTOM) \
+    X(AND, IND_X, 0x21, 2, 6, 0, READ)   \
+    X(BIT, ZPG,   0x24, 2, 3, 0, READ)   \
+    X(AND, ZPG,   0x25, 2, 3, 0, READ)   \
+    X(ROL, ZPG,   0x26, 2, 5, 0, MEMORY) \
+    X(PLP, IMP,   0x28, 1, 4, 0, CUSTOM) \
+    X(AND, IMM,   0x29, 2, 2, 0, READ)   \
+    X(ROL, ACCUM, 0x2A, 1, 2, 0, ACCUM)  \
+    X(BIT, ABS,   0x2C, 3, 4, 0, READ)   \
+    X(AND, ABS,   0x2D, 3, 4, 0, READ)   \
+    X(ROL, ABS,   0x2E, 3, 6, 0, MEMORY) \
+    X(BMI, REL,   0x30, 2, 2, 0, CUSTOM) \
+    X(AND, IND_Y, 0x31, 2, 5, 1, READ)   \
+    X(AND, ZPG_X, 0x35, 2, 4, 0, READ)   \
+    X(ROL, ZPG_X, 0x36, 2, 6, 0, MEMORY) \
+    X(SEC, IMP,   0x38, 1, 2, 0, CUSTOM) \
+    X(AND, ABS_Y, 0x39, 3, 4, 1, READ)   \
+    X(AND, ABS_X, 0x3D, 3, 4, 1, READ)   \
+    X(ROL, ABS_X, 0x3E, 3, 7, 0, MEMORY) \
+    X(RTI, IMP,   0x40, 1, 6, 0, CUSTOM) \
+    X(EOR, IND_X, 0x41, 2, 6, 0, READ)   \
+    X(EOR, ZPG,   0x45, 2, 3, 0, READ)   \
+    X(LSR, ZPG,   0x46, 2, 5, 0, MEMORY) \
+    X(PHA, IMP,   0x48, 1, 3, 0, CUSTOM) \
+    X(EOR, IMM,   0x49, 2, 2, 0, READ)   \
+    X(LSR, ACCUM, 0x4A, 1, 2, 0, ACCUM)  \
+    X(JMP, ABS,   0x4C, 3, 3, 0, CUSTOM) \
+    X(EOR, ABS,   0x4D, 3, 4, 0, READ)   \
+    X(LSR, ABS,   0x4E, 3, 6, 0, MEMORY) \
+    X(BVC, REL,   0x50, 2, 2, 0, CUSTOM) \
+    X(EOR, IND_Y, 0x51, 2, 5, 1, READ)   \
+    X(EOR, ZPG_X, 0x55, 2, 4, 0, READ)   \
+    X(LSR, ZPG_X, 0x56, 2, 6, 0, MEMORY) \
+    X(CLI, IMP,   0x58, 1, 2, 0, CUSTOM) \
+    X(EOR, ABS_Y, 0x59, 3, 4, 1, READ)   \
+    X(EOR, ABS_X, 0x5D, 3, 4, 1, READ)   \
+    X(LSR, ABS_X, 0x5E, 3, 7, 0, MEMORY) \
+    X(RTS, IMP,   0x60, 1, 6, 0, CUSTOM) \
+    X(ADC, IND_X, 0x61, 2, 6, 0, READ)   \
+    X(ADC, ZPG,   0x65, 2, 3, 0, READ)   \
+    X(ROR, ZPG,   0x66, 2, 5, 0, MEMORY) \
+    X(PLA, IMP,   0x68, 1, 4, 0, CUSTOM) \
+    X(ADC, IMM,   0x69, 2, 2, 0, READ)   \
+    X(ROR, ACCUM, 0x6A, 1, 2, 0, ACCUM)  \
+    X(JMP, IND,   0x6C, 3, 5, 0, CUSTOM) \
+    X(ADC, ABS,   0x6D, 3, 4, 0, READ)   \
+    X(ROR, ABS,   0x6E, 3, 6, 0, MEMORY) \
+    X(BVS, REL,   0x70, 2, 2, 0, CUSTOM) \
+    X(ADC, IND_Y, 0x71, 2, 5, 1, READ)   \
+    X(ADC, ZPG_X, 0x75, 2, 4, 0, READ)   \
+    X(ROR, ZPG_X, 0x76, 2, 6, 0, MEMORY) \
+    X(SEI, IMP,   0x78, 1, 2, 0, CUSTOM) \
+    X(ADC, ABS_Y, 0x79, 3, 4, 1, READ)   \
+    X(ADC, ABS_X, 0x7D, 3, 4, 1, READ)   \
+    X(ROR, ABS_X, 0x7E, 3, 7, 0, MEMORY) \
+    X(STA, IND_X, 0x81, 2, 6, 0, STORE)  \
+    X(STY, ZPG,   0x84, 2, 3, 0, STORE)  \
+    X(STA, ZPG,   0x85, 2, 3, 0, STORE)  \
+    X(STX, ZPG,   0x86, 2, 3, 0, STORE)  \
+    X(DEY, IMP,   0x88, 1, 2, 0, CUSTOM) \
+    X(TXA, IMP,   0x8A, 1, 2, 0, CUSTOM) \
+    X(STY, ABS,   0x8C, 3, 4, 0, STORE)  \
+    X(STA, ABS,   0x8D, 3, 4, 0, STORE)  \
+    X(STX, ABS,   0x8E, 3, 4, 0, STORE)  \
+    X(BCC, REL,   0x90, 2, 2, 0, CUSTOM) \
+    X(STA, IND_Y, 0x91, 2, 6, 0, STORE)  \
+    X(STY, ZPG_X, 0x94, 2, 4, 0, STORE)  \
+    X(STA, ZPG_X, 0x95, 2, 4, 0, STORE)  \
+    X(STX, ZPG_Y, 0x96, 2, 4, 0, STORE)  \
+    X(TYA, IMP,   0x98, 1, 2, 0, CUSTOM) \
+    X(STA, ABS_Y, 0x99, 3, 5, 0, STORE)  \
+    X(TXS, IMP,   0x9A, 1, 2, 0, CUSTOM) \
+    X(STA, ABS_X, 0x9D, 3, 5, 0, STORE)  \
+    X(LDY, IMM,   0xA0, 2, 2, 0, READ)   \
+    X(LDA, IND_X, 0xA1, 2, 6, 0, READ)   \
+    X(LDX, IMM,   0xA2, 2, 2, 0, READ)   \
+    X(LDY, ZPG,   0xA4, 2, 3, 0, READ)   \
+    X(LDA, ZPG,   0xA5, 2, 3, 0, READ)   \
+    X(LDX, ZPG,   0xA6, 2, 3, 0, READ)   \
+    X(TAY, IMP,   0xA8, 1, 2, 0, CUSTOM) \
+    X(LDA, IMM,   0xA9, 2, 2, 0, READ)   \
+    X(TAX, IMP,   0xAA, 1, 2, 0, CUSTOM) \
+    X(LDY, ABS,   0xAC, 3, 4, 0, READ)   \
+    X(LDA, ABS,   0xAD, 3, 4, 0, READ)   \
+    X(LDX, ABS,   0xAE, 3, 4, 0, READ)   \
+    X(BCS, REL,   0xB0, 2, 2, 0, CUSTOM) \
+    X(LDA, IND_Y, 0xB1, 2, 5, 1, READ)   \
+    X(LDY, ZPG_X, 0xB4, 2, 4, 0, READ)   \
+    X(LDA, ZPG_X, 0xB5, 2, 4, 0, READ)   \
+    X(LDX, ZPG_Y, 0xB6, 2, 4, 0, READ)   \
+    X(CLV, IMP,   0xB8, 1, 2, 0, CUSTOM) \
+    X(LDA, ABS_Y, 0xB9, 3, 4, 1, READ)   \
+    X(TSX, IMP,   0xBA, 1, 2, 0, CUSTOM) \
+    X(LDY, ABS_X, 0xBC, 3, 4, 1, READ)   \
+    X(LDA, ABS_X, 0xBD, 3, 4, 1, READ)   \
+    X(LDX, ABS_Y, 0xBE, 3, 4, 1, READ)   \
+    X(CPY, IMM,   0xC0, 2, 2, 0, READ)   \
+    X(CMP, IND_X, 0xC1, 2, 6, 0, READ)   \
+    X(CPY, ZPG,   0xC4, 2, 3, 0, READ)   \
+    X(CMP, ZPG,   0xC5, 2, 3, 0, READ)   \
+    X(DEC, ZPG,   0xC6, 2, 5, 0, MEMORY) \
+    X(INY, IMP,   0xC8, 1, 2, 0, CUSTOM) \
+    X(CMP, IMM,   0xC9, 2, 2, 0, READ)   \
+    X(DEX, IMP,   0xCA, 1, 2, 0, CUSTOM) \
+    X(CPY, ABS,   0xCC, 3, 4, 0, READ)   \
+    X(CMP, ABS,   0xCD, 3, 4, 0, READ)   \
+    X(DEC, ABS,   0xCE, 3, 6, 0, MEMORY) \
+    X(BNE, REL,   0xD0, 2, 2, 0, CUSTOM) \
+    X(CMP, IND_Y, 0xD1, 2, 5, 1, READ)   \
+    X(CMP, ZPG_X, 0xD5, 2, 4, 0, READ)   \
+    X(DEC, ZPG_X, 0xD6, 2, 6, 0, MEMORY) \
+    X(CLD, IMP,   0xD8, 1, 2, 0, CUSTOM) \
+    X(CMP, ABS_Y, 0xD9, 3, 4, 1, READ)   \
+    X(CMP, ABS_X, 0xDD, 3, 4, 1, READ)   \
+    X(DEC, ABS_X, 0xDE, 3, 7, 0, MEMORY) \
+    X(CPX, IMM,   0xE0, 2, 2, 0, READ)   \
+    X(SBC, IND_X, 0xE1, 2, 6, 0, READ)   \
+    X(CPX, ZPG,   0xE4, 2, 3, 0, READ)   \
+    X(SBC, ZPG,   0xE5, 2, 3, 0, READ)   \
+    X(INC, ZPG,   0xE6, 2, 5, 0, MEMORY) \
+    X(INX, IMP,   0xE8, 1, 2, 0, CUSTOM) \
+    X(SBC, IMM,   0xE9, 2, 2, 0, READ)   \
+    X(NOP, IMP,   0xEA, 1, 2, 0, CUSTOM) \
+    X(CPX, ABS,   0xEC, 3, 4, 0, READ)   \
+    X(SBC, ABS,   0xED, 3, 4, 0, READ)   \
+    X(INC, ABS,   0xEE, 3, 6, 0, MEMORY) \
+    X(BEQ, REL,   0xF0, 2, 2, 0, CUSTOM) \
+    X(SBC, IND_Y, 0xF1, 2, 5, 1, READ)   \
+    X(SBC, ZPG_X, 0xF5, 2, 4, 0, READ)   \
+    X(INC, ZPG_X, 0xF6, 2, 6, 0, MEMORY) \
+    X(SED, IMP,   0xF8, 1, 2, 0, CUSTOM) \
+    X(SBC, ABS_Y, 0xF9, 3, 4, 1, READ)   \
+    X(SBC, ABS_X, 0xFD, 3, 4, 1, READ)   \
+    X(INC, ABS_X, 0xFE, 3, 7, 0, MEMORY)
+
+#endif
@@ -0,0 +1,467 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+#include "../lib/lib.h"
+#include "../assembler/table.h"
+#include "../assembler/generator.h"
+
+/* BENCHMARKS
+ * micro benchmarks run every opcode in every addressing mode it has through run_instructions, as BENCH_COPIES
+ * copies of the instruction followed by a JMP back to the first; macro benchmarks run the programs in test_code
+ * from their start to where they end (BRK or the loop they finish in) over and over on every engine; sliced
+ * benchmarks run them the same way, BENCH_SLICE instructions per call, on the engines that keep decoded code from one
+ * call to the next, kept and thrown away before every call; the assembler
+ * benchmark assembles a generated source holding every opcode in every addressing mode, block after block; results
+ * are printed and written as JSON so runs can be compared over time
+ */
+
+#define BENCH_BASE          0x0600 // address micro benchmark loops start at
+#define BENCH_SUBROUTINE    0x0700 // RTS the JSR copies call
+#define BENCH_POINTERS      0x0400 // targets of the JMP ($XXXX) copies, a word per copy
+#define BENCH_DATA          0x0300 // operand of absolute modes and target of the zero page pointer
+#define BENCH_ZERO_PAGE     0x20 // operand of zero page modes
+#define BENCH_POINTER       0x10 // zero page pointer of indirect modes
+#define BENCH_RTI_LOOP      0x0606 // PHA x3 + RTI runs here with the accumulator at $06, so RTI returns to it
+#define BENCH_COPIES        32 // copies of the instruction in a micro benchmark loop
+#define BENCH_NAME_SIZE     16
+#define BENCH_FIRST_CHECK   64 // instructions a program runs before it is first checked for having ended
+#define BENCH_MAX_RUN       (1 << 20) // most instructions of a program run from its start by a macro benchmark
+#define BENCH_SLICE         16 // instructions per call in sliced benchmarks
+#define BENCH_MAX_RESULTS   (256 + (BENCH_NUM_ENGINES + BENCH_NUM_SLICED_ENGINES) * BENCH_MAX_PROGRAMS)
+#define BENCH_ASM_BLOCKS    256 // copies of every opcode in the assembler benchmark source, each loaded at BENCH_BASE
+#define BENCH_ASM_LINE_SIZE 32 // most characters in a line of the assembler benchmark source
+#define BENCH_ASM_RUNS      8 // times the assembler benchmark source is assembled
+
+// one benchmark run on one engine
+typedef struct BenchResult {
+    char name[BENCH_NAME_SIZE]; // instruction(s) of a micro benchmark
+    const char *program; // program of a macro benchmark, NULL for micro benchmarks
+    const char *engine;
+    int opcode; // opcode of a micro benchmark, -1 for macro benchmarks
+    uint64_t run_length; // instructions in one pass of the loop or one run of the program
+    uint64_t instructions;
+    uint64_t cycles;
+    double seconds;
+} BenchResult_t;
+
+// engine a macro benchmark runs programs on
+typedef struct BenchEngine {
+    const char *name;
+    RunExit_t (*run)(sf_t *sf, uint64_t num_instr);
+} BenchEngine_t;
+
+// engines a macro benchmark runs programs on; local-pc is the interpreter fetching through a copy of pc in a local,
+// which shows what keeping pc in sf costs it
+static const BenchEngine_t engines[] = {
+    {"interpreter", run_instructions},
+    {"local-pc", local_pc_run_instructions},
+    {"threaded", threaded_run_instructions},
+    {"blocks", block_run_instructions},
+    {"jit", jit_run_instructions}
+};
+
+#define BENCH_NUM_ENGINES   (sizeof(engines) / sizeof(engines[0]))
+
+/* FLUSHED_ENGINE
+ *      DESCRIPTION: generates run function that invalidates the code of sf before running engine, so engine starts
+ *                   from scratch on every call
+ *      INPUTS: engine -- prefix of the run function of an engine keeping code from one call to the next (e.g. threaded)
+ */
+#define FLUSHED_ENGINE(engine)                                                           \
+    static RunExit_t flushed_##engine##_run_instructions(sf_t *sf, uint64_t num_instr) { \
+        invalidate_code(sf);                                                             \
+        return engine##_run_instructions(sf, num_instr);                                 \
+    }
+
+FLUSHED_ENGINE(threaded)
+FLUSHED_ENGINE(block)
+FLUSHED_ENGINE(jit)
+
+// engines a sliced benchmark runs programs on; the flushed ones throw their code away before every call, which
+// shows what keeping it saves when a caller runs few instructions at a time
+static const BenchEngine_t sliced_engines[] = {
+    {"interpreter", run_instructions},
+    {"threaded", threaded_run_instructions},
+    {"threaded-flush", flushed_threaded_run_instructions},
+    {"blocks", block_run_instructions},
+    {"blocks-flush", flushed_block_run_instructions},
+    {"jit", jit_run_instructions},
+    {"jit-flush", flushed_jit_run_instructions}
+};
+
+#define BENCH_NUM_SLICED_ENGINES    (sizeof(sliced_engines) / sizeof(sliced_engines[0]))
+
+// operand of every OpcodeMode_t in benchmark names
+static const char *mode_names[] = {
+    "", "A", "#imm", "zp", "zp,X", "zp,Y", "abs", "abs,X", "abs,Y", "(zp,X)", "(zp),Y", "(abs)", "rel"
+};
+
+// operand of every OpcodeMode_t in the assembler benchmark source, branches taking a label instead
+static const char *mode_operands[] = {
+    "", "A", "#$01", "$20", "$20,X", "$20,Y", "$0300", "$0300,X", "$0300,Y", "($10,X)", "($10),Y", "($0400)", ""
+};
+
+/* describe_opcode
+ *      DESCRIPTION: returns the addressing mode of opcode, OPCODE_MODE_NONE if it has no instruction, and sets name
+ *                   to its mnemonic followed by the mode
+ */
+static OpcodeMode_t describe_opcode(uint8_t opcode, char *name) {
+    OpcodeMode_t mode = opcode_mode[opcode];
+    if (mode != OPCODE_MODE_NONE) {
+        snprintf(name, BENCH_NAME_SIZE, "%s%s%s", opcode_mnemonic[opcode], mode != OPCODE_MODE_IMP ? " " : "",
+                 mode_names[mode]);
+    }
+    return mode;
+}
+
+/* build_micro_loop
+ *      DESCRIPTION: writes the loop benchmarking opcode into memory and resets registers to run it, returns the
+ *                   instructions in one pass of the loop, 0 if opcode isn't benchmarked on its own: BRK ends every
+ *                   run, and the stack would run away under copies of PLA, PLP, RTS or RTI, so they are paired
+ *                   with PHA, PHP and JSR, and RTI pulls back three PHAs
+ */
+static uint64_t build_micro_loop(sf_t *sf, uint8_t opcode, OpcodeMode_t mode, char *name) {
+    memset(sf->memory, 0, MEMORY_SIZE);
+    sf->memory[BENCH_POINTER] = BENCH_DATA & 0xFF;
+    sf->memory[BENCH_POINTER + 1] = BENCH_DATA >> 8;
+    sf->memory[BENCH_SUBROUTINE] = OP_RTS;
+    if (opcode == OP_BRK || opcode == OP_PLA || opcode == OP_PLP || opcode == OP_RTS) {
+        return 0;
+    }
+    if (opcode == OP_RTI) {
+        // RTI pulls status $06 and pc $0606
+        initialize_regs(sf, BENCH_RTI_LOOP);
+        sf->accumulator = BENCH_RTI_LOOP & 0xFF;
+        memset(sf->memory + BENCH_RTI_LOOP, OP_PHA, 3);
+        sf->memory[BENCH_RTI_LOOP + 3] = OP_RTI;
+        snprintf(name, BENCH_NAME_SIZE, "PHA x3+RTI");
+        return 4;
+    }
+    initialize_regs(sf, BENCH_BASE);
+
+    uint64_t per_copy = 1;
+    uint16_t address = BENCH_BASE;
+    for (int copy = 0; copy < BENCH_COPIES; copy++) {
+        uint8_t *code = sf->memory + address;
+        uint16_t operand = 0;
+        uint8_t length = opcode_length[opcode];
+        code[0] = opcode;
+        switch (mode) {
+            case OPCODE_MODE_IMM: operand = 0x01; break;
+            case OPCODE_MODE_REL: operand = 0x00; break; // taken or not, lands on the next copy
+            case OPCODE_MODE_ZPG: case OPCODE_MODE_ZPG_X: case OPCODE_MODE_ZPG_Y: operand = BENCH_ZERO_PAGE; break;
+            case OPCODE_MODE_IND_X: case OPCODE_MODE_IND_Y: operand = BENCH_POINTER; break;
+            case OPCODE_MODE_ABS: case OPCODE_MODE_ABS_X: case OPCODE_MODE_ABS_Y: operand = BENCH_DATA; break;
+            case OPCODE_MODE_IND: operand = BENCH_POINTERS + 2 * copy; break;
+            default: break;
+        }
+        if (opcode == OP_JMP) {
+            operand = address + 3; // the next copy
+        } else if (opcode == OP_JI) {
+            sf->memory[operand] = (address + 3) & 0xFF;
+            sf->memory[operand + 1] = (address + 3) >> 8;
+        } else if (opcode == OP_JSR) {
+            operand = BENCH_SUBROUTINE;
+            per_copy = 2;
+        }
+        if (opcode == OP_PHA || opcode == OP_PHP) {
+            code[1] = opcode + 0x20; // PLA or PLP
+            length = 2;
+            per_copy = 2;
+        } else if (length > 1) {
+            code[1] = operand & 0xFF;
+            if (length > 2) {
+                code[2] = operand >> 8;
+            }
+        }
+        address += length;
+    }
+    sf->memory[address] = OP_JMP;
+    sf->memory[address + 1] = BENCH_BASE & 0xFF;
+    sf->memory[address + 2] = BENCH_BASE >> 8;
+    if (opcode == OP_JSR) {
+        snprintf(name, BENCH_NAME_SIZE, "JSR+RTS");
+    } else if (opcode == OP_PHA || opcode == OP_PHP) {
+        snprintf(name, BENCH_NAME_SIZE, "%s+%s", opcode == OP_PHA ? "PHA" : "PHP", opcode == OP_PHA ? "PLA" : "PLP");
+    }
+    return BENCH_COPIES * per_copy + 1;
+}
+
+/* build_asm_source
+ *      DESCRIPTION: returns a source of BENCH_ASM_BLOCKS blocks of every opcode in every addressing mode, each line
+ *                   labelled and each branch taken to the line before it, and sets num_lines to its lines
+ */
+static uint8_t *build_asm_source(uint64_t *num_lines) {
+    uint32_t size = BENCH_ASM_BLOCKS * (256 + 1) * BENCH_ASM_LINE_SIZE;
+    uint8_t *source = (uint8_t *)malloc(size);
+    uint32_t used = 0;
+    *num_lines = 0;
+    for (int block = 0; block < BENCH_ASM_BLOCKS; block++) {
+        used += snprintf((char *)source + used, size - used, "\t.ORG\t$%04X\n", BENCH_BASE);
+        (*num_lines)++;
+        int previous = 0;
+        for (int opcode = 0; opcode < 256; opcode++) {
+            OpcodeMode_t mode = opcode_mode[opcode];
+            if (mode == OPCODE_MODE_NONE) {
+                continue;
+            }
+            used += snprintf((char *)source + used, size - used, "L%d_%02X\t%s%s", block, opcode,
+                             opcode_mnemonic[opcode], mode != OPCODE_MODE_IMP ? " " : "");
+            if (mode == OPCODE_MODE_REL) {
+                used += snprintf((char *)source + used, size - used, "L%d_%02X\n", block, previous);
+            } else {
+                used += snprintf((char *)source + used, size - used, "%s\n", mode_operands[mode]);
+            }
+            previous = opcode;
+            (*num_lines)++;
+        }
+    }
+    snprintf((char *)source + used, size - used, "\t.END\n");
+    (*num_lines)++;
+    return source;
+}
+
+/* seconds_since
+ *      DESCRIPTION: returns seconds elapsed since start (CLOCK_MONOTONIC)
+ */
+static double seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* print_result
+ *      DESCRIPTION: prints one line of results
+ */
+static void print_result(const BenchResult_t *result) {
+    printf("%-28s %-14s %9.1f MIPS %9.1f Mcycles/s %7.2f ns/instr\n",
+           result->program != NULL ? result->program : result->name, result->engine,
+           result->instructions / result->seconds / 1e6, result->cycles / result->seconds / 1e6,
+           result->seconds * 1e9 / result->instructions);
+}
+
+/* load_program
+ *      DESCRIPTION: assembles program at file_path into memory and resets registers to run it from its start
+ */
+static void load_program(sf_t *sf, const char *file_path) {
+    memset(sf->memory, 0, MEMORY_SIZE);
+    uint8_t *source = read_file((char *)file_path);
+    Table_t *labels = new_table(256);
+    Program_t *p = assembly_to_program(sf, source, &labels);
+    for (int i = 0; i < p->index; i++) {
+        load_bytecode(sf, p->start + i, p->start[i].load_address, p->start[i].index);
+    }
+    initialize_regs(sf, p->start[0].load_address);
+    free_program(p);
+    free_table(labels);
+    free(source);
+}
+
+/* program_length
+ *      DESCRIPTION: returns the instructions sf runs up to and including BRK, or until it is spinning in a loop
+ *                   skip_idle_loop recognizes (checked after BENCH_FIRST_CHECK instructions, then every time the
+ *                   count doubles), at most BENCH_MAX_RUN; runs sf
+ */
+static uint64_t program_length(sf_t *sf, sf_t *idle_check) {
+    uint64_t length = 0;
+    uint64_t check = BENCH_FIRST_CHECK;
+    while (length < BENCH_MAX_RUN) {
+        uint8_t opcode = sf->memory[sf->pc];
+        process_line(sf);
+        length++;
+        if (opcode == OP_BRK) {
+            break;
+        }
+        if (length == check) {
+            *idle_check = *sf;
+            if (skip_idle_loop(idle_check, UINT64_MAX) != 0) {
+                break;
+            }
+            check *= 2;
+        }
+    }
+    return length;
+}
+
+/* write_json_string
+ *      DESCRIPTION: writes str as a JSON string
+ */
+static void write_json_string(FILE *fp, const char *str) {
+    fputc('"', fp);
+    for (; *str != '\0'; str++) {
+        if (*str == '"' || *str == '\\') {
+            fputc('\\', fp);
+        }
+        fputc(*str, fp);
+    }
+    fputc('"', fp);
+}
+
+/* write_json_results
+ *      DESCRIPTION: writes an array of results, each an object holding what was run and how fast
+ */
+static void write_json_results(FILE *fp, const BenchResult_t *results, uint32_t num_results) {
+    fprintf(fp, "[");
+    for (uint32_t i = 0; i < num_results; i++) {
+        const BenchResult_t *result = &results[i];
+        fprintf(fp, "%s\n    {", i ? "," : "");
+        if (result->program != NULL) {
+            fprintf(fp, "\"program\": ");
+            write_json_string(fp, result->program);
+            fprintf(fp, ", \"instructions_per_run\": %llu", (unsigned long long)result->run_length);
+        } else {
+            fprintf(fp, "\"name\": ");
+            write_json_string(fp, result->name);
+            fprintf(fp, ", \"opcode\": %d, \"instructions_per_pass\": %llu", result->opcode,
+                    (unsigned long long)result->run_length);
+        }
+        fprintf(fp, ", \"engine\": \"%s\", \"instructions\": %llu, \"cycles\": %llu, \"seconds\": %.6f, "
+                    "\"instructions_per_second\": %.0f, \"cycles_per_second\": %.0f, \"ns_per_instruction\": %.3f}",
+                result->engine, (unsigned long long)result->instructions, (unsigned long long)result->cycles,
+                result->seconds, result->instructions / result->seconds, result->cycles / result->seconds,
+                result->seconds * 1e9 / result->instructions);
+    }
+    fprintf(fp, "\n  ]");
+}
+
+/* run_benchmarks
+ *      DESCRIPTION: runs a micro benchmark of every opcode and addressing mode on the interpreter, then a macro
+ *                   benchmark of every program on every engine, then a sliced benchmark of every program, then the
+ *                   assembler benchmark, printing results as they come and writing them all to a JSON file
+ *      INPUTS: sf -- 6502 struct to run benchmarks on
+ *              json_path -- path of JSON file, overwritten if it exists
+ *              iterations -- instructions run by every benchmark (rounded up to whole loop passes or runs)
+ *              programs -- paths of assembly programs for the macro benchmarks
+ *              num_programs -- number of programs, at most BENCH_MAX_PROGRAMS
+ *      OUTPUTS: 0 on success
+ *      SIDE EFFECTS: overwrites sf, prints to stdout, writes JSON file
+ */
+int run_benchmarks(sf_t *sf, const char *json_path, uint64_t iterations, char **programs, int num_programs) {
+    BenchResult_t *results = (BenchResult_t *)calloc(BENCH_MAX_RESULTS, sizeof(BenchResult_t));
+    sf_t *prototype = (sf_t *)malloc(sizeof(sf_t));
+    sf_t *idle_check = (sf_t *)malloc(sizeof(sf_t));
+    if (results == NULL || prototype == NULL || idle_check == NULL) {
+        fprintf(stderr, "Failed to allocate memory for benchmarks\n");
+        exit(ERR_NO_MEM);
+    }
+    struct timespec begin;
+
+    printf("MICRO BENCHMARKS (%d copies and a JMP back per pass)\n", BENCH_COPIES);
+    uint32_t num_micro = 0;
+    for (int opcode = 0; opcode < 256; opcode++) {
+        BenchResult_t *result = &results[num_micro];
+        OpcodeMode_t mode = describe_opcode(opcode, result->name);
+        uint64_t pass = mode != OPCODE_MODE_NONE ? build_micro_loop(sf, opcode, mode, result->name) : 0;
+        if (pass == 0) {
+            continue;
+        }
+        result->engine = engines[0].name;
+        result->opcode = opcode;
+        result->run_length = pass;
+        result->instructions = (iterations + pass - 1) / pass * pass;
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        RunExit_t exit_reason = run_instructions(sf, result->instructions);
+        result->seconds = seconds_since(&begin);
+        result->cycles = sf->cycles;
+        if (exit_reason != RUN_BUDGET) {
+            fprintf(stderr, "Benchmark of %s stopped early\n", result->name);
+            exit(ERR_BENCH);
+        }
+        print_result(result);
+        num_micro++;
+    }
+
+    printf("MACRO BENCHMARKS\n");
+    uint32_t num_macro = 0;
+    for (int i = 0; i < num_programs; i++) {
+        load_program(prototype, programs[i]);
+        *sf = *prototype;
+        uint64_t length = program_length(sf, idle_check);
+        uint64_t runs = (iterations + length - 1) / length;
+        for (uint32_t e = 0; e < BENCH_NUM_ENGINES; e++) {
+            BenchResult_t *result = &results[num_micro + num_macro++];
+            result->program = programs[i];
+            result->engine = engines[e].name;
+            result->opcode = -1;
+            result->run_length = length;
+            result->instructions = runs * length;
+            // only the runs are timed, not putting the program back between them
+            for (uint64_t run = 0; run < runs; run++) {
+                *sf = *prototype;
+                clock_gettime(CLOCK_MONOTONIC, &begin);
+                (*engines[e].run)(sf, length);
+                result->seconds += seconds_since(&begin);
+                result->cycles += sf->cycles - prototype->cycles;
+            }
+            print_result(result);
+        }
+    }
+
+    printf("SLICED BENCHMARKS (%d instructions per call)\n", BENCH_SLICE);
+    uint32_t num_sliced = 0;
+    BenchResult_t *sliced = results + num_micro + num_macro;
+    for (int i = 0; i < num_programs; i++) {
+        load_program(prototype, programs[i]);
+        *sf = *prototype;
+        uint64_t length = program_length(sf, idle_check);
+        uint64_t runs = (iterations + length - 1) / length;
+        for (uint32_t e = 0; e < BENCH_NUM_SLICED_ENGINES; e++) {
+            BenchResult_t *result = &sliced[num_sliced++];
+            result->program = programs[i];
+            result->engine = sliced_engines[e].name;
+            result->opcode = -1;
+            result->run_length = length;
+            result->instructions = runs * length;
+            for (uint64_t run = 0; run < runs; run++) {
+                *sf = *prototype;
+                clock_gettime(CLOCK_MONOTONIC, &begin);
+                for (uint64_t done = 0; done < length; done += BENCH_SLICE) {
+                    (*sliced_engines[e].run)(sf, length - done < BENCH_SLICE ? length - done : BENCH_SLICE);
+                }
+                result->seconds += seconds_since(&begin);
+                result->cycles += sf->cycles - prototype->cycles;
+            }
+            print_result(result);
+        }
+    }
+
+    printf("ASSEMBLER BENCHMARK\n");
+    uint64_t asm_lines;
+    uint8_t *asm_source = build_asm_source(&asm_lines);
+    double asm_seconds = 0;
+    for (int run = 0; run < BENCH_ASM_RUNS; run++) {
+        Table_t *labels = new_table(256);
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        Program_t *p = assembly_to_program(sf, asm_source, &labels);
+        asm_seconds += seconds_since(&begin);
+        free_program(p);
+        free_table(labels);
+    }
+    free(asm_source);
+    printf("%-28s %9.0f lines/s %7.2f ns/line\n", "assembler", asm_lines * BENCH_ASM_RUNS / asm_seconds,
+           asm_seconds * 1e9 / (asm_lines * BENCH_ASM_RUNS));
+
+    FILE *fp = fopen(json_path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open file %s\n", json_path);
+        exit(ERR_FILE_NOOPEN);
+    }
+    fprintf(fp, "{\n  \"iterations\": %llu,\n  \"micro\": ", (unsigned long long)iterations);
+    write_json_results(fp, results, num_micro);
+    fprintf(fp, ",\n  \"macro\": ");
+    write_json_results(fp, results + num_micro, num_macro);
+    fprintf(fp, ",\n  \"slice\": %d,\n  \"sliced\": ", BENCH_SLICE);
+    write_json_results(fp, sliced, num_sliced);
+    fprintf(fp, ",\n  \"assembler\": {\"lines\": %llu, \"seconds\": %.6f, \"lines_per_second\": %.0f}\n}\n",
+            (unsigned long long)asm_lines * BENCH_ASM_RUNS, asm_seconds, asm_lines * BENCH_ASM_RUNS / asm_seconds);
+    fclose(fp);
+    printf("results written to %s\n", json_path);
+
+    free(idle_check);
+    free(prototype);
+    free(results);
+    return 0;
+}
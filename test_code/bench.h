@@ -0,0 +1,12 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "../6502.h"
+
+#define BENCH_DEFAULT_OUTPUT        "bench.json"
+#define BENCH_DEFAULT_ITERATIONS    10000000 // instructions run by every micro benchmark and every macro one
+#define BENCH_MAX_PROGRAMS          16
+
+int run_benchmarks(sf_t *sf, const char *json_path, uint64_t iterations, char **programs, int num_programs);
+
+#endif
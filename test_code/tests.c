@@ -1,12 +1,30 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
+#include <time.h>
+#include <string.h>
 
 #include "tests.h"
 #include "../lib/lib.h"
 #include "../assembler/table.h"
+#include "../batch/batch.h"
+#include "../batch/lockstep.h"
+#include "../memory/paged.h"
+#include "../memory/snapshot.h"
+#include "../debug/timetravel.h"
+#include "../events/scheduler.h"
+#include "../debug/profiler.h"
+#include "../debug/callgraph.h"
+#include "../debug/breakpoints.h"
+#include "../assembler/generator.h"
+#include "../assembler/cache.h"
+#include "../assembler/encoder.h"
 
 /* OPCODE TESTS */
 
+// runs one instruction; run_threaded_opcode_tests and run_jit_opcode_tests point it at the other engines
+static void (*execute_line)(sf_t *sf) = process_line;
+
 static int check_flags(uint8_t status, uint8_t negative, uint8_t overflow, uint8_t brk,
                         uint8_t decimal_mode, uint8_t interrupt_disable, uint8_t zero, uint8_t carry) {
     
@@ -62,14 +80,14 @@ static int branch_not_set_test(sf_t *sf, uint8_t opcode, uint8_t flag_index) {
     sf->memory[ROM_START + 1] = offset;
     sf->status |= (1 << flag_index);
     // test when flag = 1
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->pc != ROM_START + 2) {
         return -1;
     }
     sf->pc = ROM_START;
     sf->status &= (~(1 << flag_index));
     // test when flag = 0
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->pc != ROM_START + offset + 2) {
         return -1;
     }
@@ -82,14 +100,14 @@ static int branch_set_test(sf_t *sf, uint8_t opcode, uint8_t flag_index) {
     sf->memory[ROM_START] = opcode;
     sf->memory[ROM_START + 1] = offset;
     // test when flag = 0
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->pc != ROM_START + 2) {
         return -1;
     }
     sf->pc = ROM_START;
     sf->status |= (1 << flag_index);
     // test when flag = 1
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->pc != ROM_START + offset + 2) {
         return -1;
     }
@@ -99,11 +117,11 @@ static int branch_set_test(sf_t *sf, uint8_t opcode, uint8_t flag_index) {
 static int BRK_RTI_TEST(sf_t *sf) {
     sf->memory[IRQ_ADDRESS] = OP_RTI;
     sf->memory[ROM_START] = OP_BRK;
-    process_line(sf);
+    (*execute_line)(sf);
     if ((sf->status != ((1 << INTERRUPT_INDEX)|(1 << BREAK_INDEX))) || sf->pc != IRQ_ADDRESS) {
         return -1;
     }
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->pc != (ROM_START + 1) || sf->status != 0) {
         return -1;
     }
@@ -114,9 +132,9 @@ static int PHP_PLP_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_PHP;
     sf->memory[ROM_START + 1] = OP_PLP;
     sf->status = TEST_MAGIC;
-    process_line(sf);
+    (*execute_line)(sf);
     sf->status = 0;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->status != TEST_MAGIC || sf->esp != STACK_START) {
         return -1;
     } 
@@ -134,10 +152,10 @@ static int CLC_CLD_CLI_CLV_TEST(sf_t *sf) {
     sf->memory[ROM_START + 2] = OP_CLI;
     sf->memory[ROM_START + 3] = OP_CLV;
     sf->status |= ((1 << CARRY_INDEX)|(1 << DECIMAL_INDEX)|(1 << INTERRUPT_INDEX)|(1 << OVERFLOW_INDEX));
-    process_line(sf);
-    process_line(sf);
-    process_line(sf);
-    process_line(sf);
+    (*execute_line)(sf);
+    (*execute_line)(sf);
+    (*execute_line)(sf);
+    (*execute_line)(sf);
     if (sf->status & ((1 << CARRY_INDEX)|(1 << DECIMAL_INDEX)|(1 << INTERRUPT_INDEX)|(1 << OVERFLOW_INDEX))) {
         return -1;
     }
@@ -150,11 +168,11 @@ static int JSR_RTS_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = sub_address & 0x00FF;
     sf->memory[ROM_START + 2] = sub_address >> 8;
     sf->memory[sub_address] = OP_RTS;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->pc != sub_address) {
         return -1;
     }
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->pc != ROM_START + 3) {
         return -1;
     }
@@ -169,9 +187,9 @@ static int SEC_SED_SEI_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_SEC;
     sf->memory[ROM_START + 1] = OP_SED;
     sf->memory[ROM_START + 2] = OP_SEI;
-    process_line(sf);
-    process_line(sf);
-    process_line(sf);
+    (*execute_line)(sf);
+    (*execute_line)(sf);
+    (*execute_line)(sf);
     if (sf->status != ((1 << CARRY_INDEX)|(1 << DECIMAL_INDEX)|(1 << INTERRUPT_INDEX))) {
         return -1;
     }
@@ -182,9 +200,9 @@ static int PHA_PLA_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_PHA;
     sf->memory[ROM_START + 1] = OP_PLA;
     sf->accumulator = TEST_MAGIC;
-    process_line(sf);
+    (*execute_line)(sf);
     sf->accumulator = 0;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != TEST_MAGIC || sf->esp != STACK_START) {
         return -1;
     }
@@ -196,7 +214,7 @@ static int JMP_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_JMP;
     sf->memory[ROM_START + 1] = jump_addr & 0x00FF;
     sf->memory[ROM_START + 2] = jump_addr >> 8;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->pc != jump_addr) {
         return -1;
     }
@@ -220,7 +238,7 @@ static int JI_TEST(sf_t *sf) {
     sf->memory[ROM_START + 2] = ind_location >> 8;
     sf->memory[ind_location] = jump_addr & 0x00FF; 
     sf->memory[ind_location + 1] = jump_addr >> 8;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->pc != jump_addr) {
         return -1;
     } 
@@ -232,11 +250,11 @@ static int TXA_TYA_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = OP_TYA;
     sf->x_index = 0x81;
     sf->y_index = 0x34;
-    process_line(sf);
+    (*execute_line)(sf);
     if ((sf->accumulator != sf->x_index) || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
-    process_line(sf);
+    (*execute_line)(sf);
     if ((sf->accumulator != sf->y_index) || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -250,7 +268,7 @@ static int BCC_TEST(sf_t *sf) {
 static int TXS_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_TXS;
     sf->x_index = 0x12;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->esp != sf->x_index) {
         return -1;
     }
@@ -261,11 +279,11 @@ static int TAX_TAY_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_TAX;
     sf->memory[ROM_START + 1] = OP_TAY;
     sf->accumulator = 0x76;
-    process_line(sf);
+    (*execute_line)(sf);
     if ((sf->x_index != sf->accumulator) || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
-    process_line(sf);
+    (*execute_line)(sf);
     if ((sf->y_index != sf->accumulator) || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -279,7 +297,7 @@ static int BCS_TEST(sf_t *sf) {
 static int TSX_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_TSX;
     sf->esp = 0x00;
-    process_line(sf);
+    (*execute_line)(sf);
     if ((sf->x_index != sf->esp) || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 2)) {
         return -1;
     }
@@ -291,11 +309,11 @@ static int INX_INY_TEST(sf_t *sf) {
     sf->y_index = 0x7F;
     sf->memory[ROM_START] = OP_INX;
     sf->memory[ROM_START + 1] = OP_INY;
-    process_line(sf);
+    (*execute_line)(sf);
     if ((sf->x_index != 0x00) || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 2)) {
         return -1;
     }
-    process_line(sf);
+    (*execute_line)(sf);
     if ((sf->y_index != 0x80) || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -306,11 +324,11 @@ static int DEX_DEY_TEST(sf_t *sf) {
     sf->y_index = 0x01;
     sf->memory[ROM_START] = OP_DEX;
     sf->memory[ROM_START + 1] = OP_DEY;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->x_index != 0xFF || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     } 
-    process_line(sf);
+    (*execute_line)(sf);
     if ((sf->y_index != 0x00) || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 2)) { // unsigned values will overflow
         return -1;
     }
@@ -323,7 +341,7 @@ static int BNE_TEST(sf_t *sf) {
 
 static int NOP_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_NOP;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->pc != ROM_START + 1) {
         return -1;
     }
@@ -417,7 +435,7 @@ static int ORA_TEST(sf_t *sf) {
     sf->memory[0xCE] = 0xEF;
     sf->memory[0xCF] = 0xBE;
     sf->memory[0xBEEF] = 0x6E;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != (0x22 | 0x6E) || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -427,7 +445,7 @@ static int ORA_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_ORA | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x01;
     sf->memory[0x01] = 0x14;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != (0x92 | 0x14) || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -436,7 +454,7 @@ static int ORA_TEST(sf_t *sf) {
     sf->accumulator = 0x12;
     sf->memory[ROM_START] = OP_ORA | (ADDR_MODE_IMM << 2);
     sf->memory[ROM_START + 1] = 0x41;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != (0x12 | 0x41) || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -447,7 +465,7 @@ static int ORA_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x2B;
     sf->memory[ROM_START + 2] = 0xEE;
     sf->memory[0xEE2B] = 0x00;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x00 || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 2)) {
         return -1;
     }
@@ -460,7 +478,7 @@ static int ORA_TEST(sf_t *sf) {
     sf->memory[0xFF] = 0x25;
     sf->memory[0x100] = 0x1D;
     sf->memory[0x1D2D] = 0x80;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x92 || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -471,7 +489,7 @@ static int ORA_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_ORA | (ADDR_MODE_ZPG_X << 2);
     sf->memory[ROM_START + 1] = 0x02;
     sf->memory[0xF6] = 0x67;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x67 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -483,7 +501,7 @@ static int ORA_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x3A;
     sf->memory[ROM_START + 2] = 0xFF;
     sf->memory[(0xFF3A + 0xE4) % 0xFFFF] = 0x00;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x72 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -495,7 +513,7 @@ static int ORA_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x3A;
     sf->memory[ROM_START + 2] = 0xFF;
     sf->memory[(0xFF3A + 0xE4) % 0xFFFF] = 0x00;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x72 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -506,7 +524,7 @@ static int ORA_TEST(sf_t *sf) {
 static int ASL_TEST(sf_t *sf) {
     sf->accumulator = 0x81;
     sf->memory[ROM_START] = OP_ASL | (ADDR_MODE_ACCUM << 2);
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x02 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -515,7 +533,7 @@ static int ASL_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_ASL | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x18;
     sf->memory[0x18] = 0x67;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x18] != 0xCE || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 0)) {
         return -1;
     } 
@@ -525,7 +543,7 @@ static int ASL_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x15;
     sf->memory[ROM_START + 2] = 0x24;
     sf->memory[0x2415] = 0x80;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x2415] != 0x00 || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 1)) {
         return -1;
     }
@@ -535,7 +553,7 @@ static int ASL_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_ASL | (ADDR_MODE_ZPG_X << 2);
     sf->memory[ROM_START + 1] = 0xFE;
     sf->memory[(0xFE + 0x76) % 0xFF] = 0x47;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[(0xFE + 0x76) % 0xFF] != 0x8E || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 0)) {
         return -1;
     } 
@@ -546,7 +564,7 @@ static int ASL_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x15;
     sf->memory[ROM_START + 2] = 0x24;
     sf->memory[0x242C] = 0x47;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x242C] != 0x8E || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 0)) {
         return -1;
     }
@@ -559,7 +577,7 @@ static int BIT_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x21;
     sf->memory[0x21] = 0b00111111;
     sf->accumulator = 0b11000000;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 0, 0, 2, 2, 2, 1, 2)) {
         return -1;
     }
@@ -568,7 +586,7 @@ static int BIT_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_BIT | (ADDR_MODE_ABS << 2);
     sf->memory[ROM_START + 2] = 0x12;
     sf->memory[0x1221] = 0b11000000;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 1, 1, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -584,7 +602,7 @@ static int AND_TEST(sf_t *sf) {
     sf->memory[0xCE] = 0xEF;
     sf->memory[0xCF] = 0xBE;
     sf->memory[0xBEEF] = 0x6E;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != (0x22 & 0x6E) || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -594,7 +612,7 @@ static int AND_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_AND | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x01;
     sf->memory[0x01] = 0x81;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != (0x92 & 0x81) || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -603,7 +621,7 @@ static int AND_TEST(sf_t *sf) {
     sf->accumulator = 0x12;
     sf->memory[ROM_START] = OP_AND | (ADDR_MODE_IMM << 2);
     sf->memory[ROM_START + 1] = 0x41;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x00 || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 2)) {
         return -1;
     }
@@ -614,7 +632,7 @@ static int AND_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x2B;
     sf->memory[ROM_START + 2] = 0xEE;
     sf->memory[0xEE2B] = 0x48;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x48 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -627,7 +645,7 @@ static int AND_TEST(sf_t *sf) {
     sf->memory[0xFF] = 0x25;
     sf->memory[0x100] = 0x1D;
     sf->memory[0x1D2D] = 0x73;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x73 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -638,7 +656,7 @@ static int AND_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_AND | (ADDR_MODE_ZPG_X << 2);
     sf->memory[ROM_START + 1] = 0x02;
     sf->memory[0xF6] = 0x67;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x00 || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 2)) {
         return -1;
     }
@@ -650,7 +668,7 @@ static int AND_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x3A;
     sf->memory[ROM_START + 2] = 0xFF;
     sf->memory[(0xFF3A + 0xE4) % 0xFFFF] = 0x8F;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x82 || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -662,7 +680,7 @@ static int AND_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x3A;
     sf->memory[ROM_START + 2] = 0xFF;
     sf->memory[(0xFF3A + 0xE4) % 0xFFFF] = 0x8F;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x82 || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -675,7 +693,7 @@ static int ROL_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_ROL | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x48;
     sf->memory[0x48] = 0xA1;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x48] != (((0xA1 << 1) & 0xFF) + 1) || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -684,7 +702,7 @@ static int ROL_TEST(sf_t *sf) {
     sf->status = 0x00;
     sf->memory[ROM_START] = OP_ROL | (ADDR_MODE_ACCUM << 2);
     sf->accumulator = 0x48;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != (0x48 << 1) || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 0)) {
         return -1;
     }
@@ -695,7 +713,7 @@ static int ROL_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x54;
     sf->memory[ROM_START + 2] = 0x76;
     sf->memory[0x7654] = 0x63;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x7654] != ((0x63 << 1) + 1) || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 0)) {
         return -1;
     }
@@ -705,7 +723,7 @@ static int ROL_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_ROL | (ADDR_MODE_ZPG_X << 2);
     sf->memory[ROM_START + 1] = 0x48;
     sf->memory[0x4F] = 0x80;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x4F] != 0x00 || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 1)) {
         return -1;
     }
@@ -717,7 +735,7 @@ static int ROL_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x54;
     sf->memory[ROM_START + 2] = 0x76;
     sf->memory[0x7654 + 0x89] = 0x00;
-    process_line(sf);
+    (*execute_line)(sf);
     if ((sf->memory[0x7654 + 0x89] != 0x00) || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 0)) {
         return -1;
     }
@@ -733,7 +751,7 @@ static int EOR_TEST(sf_t *sf) {
     sf->memory[0xCE] = 0xEF;
     sf->memory[0xCF] = 0xBE;
     sf->memory[0xBEEF] = 0x6E;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != (0x22 ^ 0x6E) || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -743,7 +761,7 @@ static int EOR_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_EOR | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x01;
     sf->memory[0x01] = 0x81;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0xF3 || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -752,7 +770,7 @@ static int EOR_TEST(sf_t *sf) {
     sf->accumulator = 0xA0;
     sf->memory[ROM_START] = OP_EOR | (ADDR_MODE_IMM << 2);
     sf->memory[ROM_START + 1] = 0xA0;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x00 || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 2)) {
         return -1;
     }
@@ -763,7 +781,7 @@ static int EOR_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x2B;
     sf->memory[ROM_START + 2] = 0xEE;
     sf->memory[0xEE2B] = 0x20;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x68 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -776,7 +794,7 @@ static int EOR_TEST(sf_t *sf) {
     sf->memory[0xFF] = 0x25;
     sf->memory[0x100] = 0x1D;
     sf->memory[0x1D2D] = 0x83;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x70 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -787,7 +805,7 @@ static int EOR_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_EOR | (ADDR_MODE_ZPG_X << 2);
     sf->memory[ROM_START + 1] = 0x02;
     sf->memory[0xF6] = 0x67;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x67 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -799,7 +817,7 @@ static int EOR_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x3A;
     sf->memory[ROM_START + 2] = 0xFF;
     sf->memory[(0xFF3A + 0xE4) % 0xFFFF] = 0x34;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0xC6 || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -811,7 +829,7 @@ static int EOR_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x3A;
     sf->memory[ROM_START + 2] = 0xFF;
     sf->memory[(0xFF3A + 0xE4) % 0xFFFF] = 0x34;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0xC6 || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -823,7 +841,7 @@ static int LSR_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_LSR | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x48;
     sf->memory[0x48] = 0xA1;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x48] != (0xA1 >> 1) || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -831,7 +849,7 @@ static int LSR_TEST(sf_t *sf) {
     sf->pc = ROM_START;
     sf->memory[ROM_START] = OP_LSR | (ADDR_MODE_ACCUM << 2);
     sf->accumulator = 0x48;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != (0x48 >> 1) || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 0)) {
         return -1;
     }
@@ -841,7 +859,7 @@ static int LSR_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x54;
     sf->memory[ROM_START + 2] = 0x76;
     sf->memory[0x7654] = 0x00;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x7654] != 0x00 || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 0)) {
         return -1;
     }
@@ -851,7 +869,7 @@ static int LSR_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x48;
     sf->x_index = 0x07;
     sf->memory[0x4F] = 0x01;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x4F] != 0x00 || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 1)) {
         return -1;
     }
@@ -863,7 +881,7 @@ static int LSR_TEST(sf_t *sf) {
     sf->memory[ROM_START + 2] = 0x76;
     sf->x_index = 0x89;
     sf->memory[0x7654 + 0x89] = 0x62;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x7654 + 0x89] != (0x62 >> 1) || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 0)) {
         return -1;
     }
@@ -879,7 +897,7 @@ static int ADC_TEST(sf_t *sf) {
     sf->memory[0xCE] = 0xEF;
     sf->memory[0xCF] = 0xBE;
     sf->memory[0xBEEF] = 0x6E;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x90 || check_flags(sf->status, 1, 1, 2, 2, 2, 0, 0)) {
         return -1;
     }
@@ -889,7 +907,7 @@ static int ADC_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_ADC | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x01;
     sf->memory[0x01] = 0x81;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x7F || check_flags(sf->status, 0, 1, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -898,7 +916,7 @@ static int ADC_TEST(sf_t *sf) {
     sf->accumulator = 0x21;
     sf->memory[ROM_START] = OP_ADC | (ADDR_MODE_IMM << 2);
     sf->memory[ROM_START + 1] = 0x42;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x64 || check_flags(sf->status, 0, 0, 2, 2, 2, 0, 0)) {
         return -1;
     }
@@ -909,7 +927,7 @@ static int ADC_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x2B;
     sf->memory[ROM_START + 2] = 0xEE;
     sf->memory[0xEE2B] = 0x01;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x00 || check_flags(sf->status, 0, 0, 2, 2, 2, 1, 1)) {
         return -1;
     }
@@ -923,7 +941,7 @@ static int ADC_TEST(sf_t *sf) {
     sf->memory[0xFF] = 0x25;
     sf->memory[0x100] = 0x1D;
     sf->memory[0x1D2D] = 0x40;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x90 || check_flags(sf->status, 1, 1, 2, 1, 2, 0, 0)) {
         return -1;
     }
@@ -934,7 +952,7 @@ static int ADC_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_ADC | (ADDR_MODE_ZPG_X << 2);
     sf->memory[ROM_START + 1] = 0x02;
     sf->memory[0xF6] = 0x20;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x00 || check_flags(sf->status, 0, 0, 2, 1, 2, 1, 1)) {
         return -1;
     }
@@ -946,7 +964,7 @@ static int ADC_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x3A;
     sf->memory[ROM_START + 2] = 0x33;
     sf->memory[0x333A + 0xE4] = 0x99;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x99 || check_flags(sf->status, 1, 0, 2, 1, 2, 0, 1)) {
         return -1;
     }
@@ -958,7 +976,7 @@ static int ADC_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x3A;
     sf->memory[ROM_START + 2] = 0x33;
     sf->memory[0x333A + 0xE4] = 0x83;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x71 || check_flags(sf->status, 0, 1, 2, 1, 2, 0, 1)) {
         return -1;
     }
@@ -971,7 +989,7 @@ static int ROR_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x48;
     sf->memory[0x48] = 0xA1;
     sf->status |= (1 << CARRY_INDEX);
-    process_line(sf);
+    (*execute_line)(sf);
     if ((sf->memory[0x48] != ((0xA1 >> 1) | 0x80)) || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -980,7 +998,7 @@ static int ROR_TEST(sf_t *sf) {
     sf->status = 0x00;
     sf->memory[ROM_START] = OP_ROR | (ADDR_MODE_ACCUM << 2);
     sf->accumulator = 0x48;
-    process_line(sf);
+    (*execute_line)(sf);
     if ((sf->accumulator != (0x48 >> 1)) || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 0)) {
         return -1;
     }
@@ -991,7 +1009,7 @@ static int ROR_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x54;
     sf->memory[ROM_START + 2] = 0x76;
     sf->memory[0x7654] = 0x01;
-    process_line(sf);
+    (*execute_line)(sf);
     if ((sf->memory[0x7654] != 0x00) || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 1)) {
         return -1;
     }
@@ -1002,7 +1020,7 @@ static int ROR_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x48;
     sf->x_index = 0x07;
     sf->memory[0x4F] = 0x03;
-    process_line(sf);
+    (*execute_line)(sf);
     if ((sf->memory[0x4F] != (0x03 >> 1)) || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -1015,7 +1033,7 @@ static int ROR_TEST(sf_t *sf) {
     sf->memory[ROM_START + 2] = 0x76;
     sf->x_index = 0x89;
     sf->memory[0x7654 + 0x89] = 0x34;
-    process_line(sf);
+    (*execute_line)(sf);
     if ((sf->memory[0x7654 + 0x89] != ((0x34 >> 1) | 0x80)) || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 0)) {
         return -1;
     }
@@ -1027,7 +1045,7 @@ static int STY_TEST(sf_t *sf) {
     sf->y_index = 0x71;
     sf->memory[ROM_START] = OP_STY | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x48;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x48] != sf->y_index) {
         return -1;
     }
@@ -1036,7 +1054,7 @@ static int STY_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_STY | (ADDR_MODE_ABS << 2);
     sf->memory[ROM_START + 1] = 0x34;
     sf->memory[ROM_START + 2] = 0x12;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x1234] != sf->y_index) {
         return -1;
     }
@@ -1045,7 +1063,7 @@ static int STY_TEST(sf_t *sf) {
     sf->x_index = 0x13;
     sf->memory[ROM_START] = OP_STY | (ADDR_MODE_ZPG_X << 2);
     sf->memory[ROM_START + 1] = 0x48;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x48 + 0x13] != sf->y_index) {
         return -1;
     }
@@ -1060,7 +1078,7 @@ static int STA_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x38;
     sf->memory[0x38 + 0x05] = 0x53;
     sf->memory[0x38 + 0x05 + 0x01] = 0x54;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x5453] != sf->accumulator) {
         return -1;
     }
@@ -1068,7 +1086,7 @@ static int STA_TEST(sf_t *sf) {
     sf->pc = ROM_START;
     sf->memory[ROM_START] = OP_STA | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x38;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x38] != sf->accumulator) {
         return -1;
     }
@@ -1077,7 +1095,7 @@ static int STA_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_STA | (ADDR_MODE_ABS << 2);
     sf->memory[ROM_START + 1] = 0x34;
     sf->memory[ROM_START + 2] = 0x12;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x1234] != sf->accumulator) {
         return -1;
     }
@@ -1088,7 +1106,7 @@ static int STA_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x49;
     sf->memory[0x49] = 0x53;
     sf->memory[0x4A] = 0x54;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x5459] != sf->accumulator) {
         return -1;
     }
@@ -1097,7 +1115,7 @@ static int STA_TEST(sf_t *sf) {
     sf->x_index = 0x13;
     sf->memory[ROM_START] = OP_STA | (ADDR_MODE_ZPG_X << 2);
     sf->memory[ROM_START + 1] = 0x48;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x48 + 0x13] != sf->accumulator) {
         return -1;
     }
@@ -1107,7 +1125,7 @@ static int STA_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_STA | (ADDR_MODE_ABS_Y << 2);
     sf->memory[ROM_START + 1] = 0x34;
     sf->memory[ROM_START + 2] = 0x12;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x1234 + 0x15] != sf->accumulator) {
         return -1;
     }
@@ -1117,7 +1135,7 @@ static int STA_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_STA | (ADDR_MODE_ABS_X << 2);
     sf->memory[ROM_START + 1] = 0x78;
     sf->memory[ROM_START + 2] = 0x56;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x5678 + 0x27] != sf->accumulator) {
         return -1;
     }
@@ -1129,7 +1147,7 @@ static int STX_TEST(sf_t *sf) {
     sf->x_index = 0x71;
     sf->memory[ROM_START] = OP_STX | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x48;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x48] != sf->x_index) {
         return -1;
     }
@@ -1138,7 +1156,7 @@ static int STX_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_STX | (ADDR_MODE_ABS << 2);
     sf->memory[ROM_START + 1] = 0x34;
     sf->memory[ROM_START + 2] = 0x12;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x1234] != sf->x_index) {
         return -1;
     }
@@ -1147,7 +1165,7 @@ static int STX_TEST(sf_t *sf) {
     sf->y_index = 0x13;
     sf->memory[ROM_START] = OP_STX | (ADDR_MODE_ZPG_Y << 2);
     sf->memory[ROM_START + 1] = 0x48;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x48 + 0x13] != sf->x_index) {
         return -1;
     }
@@ -1159,7 +1177,7 @@ static int LDY_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_LDY | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x21;
     sf->memory[0x21] = 0x19;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->y_index != 0x19 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1167,7 +1185,7 @@ static int LDY_TEST(sf_t *sf) {
     sf->pc = ROM_START;
     sf->memory[ROM_START] = OP_LDY; // special case, immediate is 0x00
     sf->memory[ROM_START + 1] = 0x80;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->y_index != 0x80 || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1177,7 +1195,7 @@ static int LDY_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x81;
     sf->memory[ROM_START + 2] = 0x72;
     sf->memory[0x7281] = 0x00;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->y_index != 0x00 || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 2)) {
         return -1;
     }
@@ -1187,7 +1205,7 @@ static int LDY_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_LDY | (ADDR_MODE_ZPG_X << 2);
     sf->memory[ROM_START + 1] = 0xF8;
     sf->memory[(0x12 + 0xF8) % 0xFF] = 0x46;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->y_index != 0x46 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1198,7 +1216,7 @@ static int LDY_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x09;
     sf->memory[ROM_START + 2] = 0x12;
     sf->memory[0x1209 + 0xC9] = 0x08;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->y_index != 0x08 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1213,7 +1231,7 @@ static int LDA_TEST(sf_t *sf) {
     sf->memory[(0x57 + 0xC8) % 0xFF] = 0x36;
     sf->memory[(0x57 + 0xC8 + 0x01) % 0xFF] = 0x63;
     sf->memory[0x6336] = 0x01;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x01 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1222,7 +1240,7 @@ static int LDA_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_LDA | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x21;
     sf->memory[0x21] = 0x19;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x19 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1230,7 +1248,7 @@ static int LDA_TEST(sf_t *sf) {
     sf->pc = ROM_START;
     sf->memory[ROM_START] = OP_LDA | (ADDR_MODE_IMM << 2);
     sf->memory[ROM_START + 1] = 0x80;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x80 || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1240,7 +1258,7 @@ static int LDA_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x81;
     sf->memory[ROM_START + 2] = 0x72;
     sf->memory[0x7281] = 0x00;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x00 || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 2)) {
         return -1;
     }
@@ -1252,7 +1270,7 @@ static int LDA_TEST(sf_t *sf) {
     sf->memory[0x83] = 0x61;
     sf->memory[0x84] = 0x41;
     sf->memory[0x4161 + 0x21] = 0x98;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x98 || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1262,7 +1280,7 @@ static int LDA_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_LDA | (ADDR_MODE_ZPG_X << 2);
     sf->memory[ROM_START + 1] = 0xF8;
     sf->memory[(0x12 + 0xF8) % 0xFF] = 0x46;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x46 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1273,7 +1291,7 @@ static int LDA_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x21;
     sf->memory[ROM_START + 2] = 0x34;
     sf->memory[0x3421 + 0x31] = 0x17;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x17 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1284,7 +1302,7 @@ static int LDA_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x09;
     sf->memory[ROM_START + 2] = 0x12;
     sf->memory[0x1209 + 0xC9] = 0x08;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x08 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1296,7 +1314,7 @@ static int LDX_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_LDX | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x21;
     sf->memory[0x21] = 0x19;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->x_index != 0x19 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1304,7 +1322,7 @@ static int LDX_TEST(sf_t *sf) {
     sf->pc = ROM_START;
     sf->memory[ROM_START] = OP_LDX; // special case, immediate is 0x00
     sf->memory[ROM_START + 1] = 0x80;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->x_index != 0x80 || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1314,7 +1332,7 @@ static int LDX_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x81;
     sf->memory[ROM_START + 2] = 0x72;
     sf->memory[0x7281] = 0x00;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->x_index != 0x00 || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 2)) {
         return -1;
     }
@@ -1324,7 +1342,7 @@ static int LDX_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_LDX | (ADDR_MODE_ZPG_Y << 2);
     sf->memory[ROM_START + 1] = 0xF8;
     sf->memory[(0x12 + 0xF8) % 0xFF] = 0x46;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->x_index != 0x46 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1335,7 +1353,7 @@ static int LDX_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x09;
     sf->memory[ROM_START + 2] = 0x12;
     sf->memory[0x1209 + 0xC9] = 0x08;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->x_index != 0x08 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1347,7 +1365,7 @@ static int CPY_TEST(sf_t *sf) {
     sf->y_index = 0x92;
     sf->memory[ROM_START] = OP_CPY;
     sf->memory[ROM_START + 1] = 0x92;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 0, 2, 2, 2, 2, 1, 1)) {
         return -1;
     }
@@ -1357,7 +1375,7 @@ static int CPY_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_CPY | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x41;
     sf->memory[0x41] = 0xFE;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 0, 2, 2, 2, 2, 0, 0)) {
         return -1;
     }
@@ -1368,7 +1386,7 @@ static int CPY_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x67;
     sf->memory[ROM_START + 2] = 0x13;
     sf->memory[0x1367] = 0x02;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 1, 2, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -1384,7 +1402,7 @@ static int CMP_TEST(sf_t *sf) {
     sf->memory[0x83] = 0x49;
     sf->memory[0x84] = 0x25;
     sf->memory[0x2549] = 0x02;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 1, 2, 2, 2, 2, 0, 0)) {
         return -1;
     }
@@ -1394,7 +1412,7 @@ static int CMP_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_CMP | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0xD2;
     sf->memory[0xD2] = 0x13;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 1, 2, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -1403,7 +1421,7 @@ static int CMP_TEST(sf_t *sf) {
     sf->accumulator = 0xB6;
     sf->memory[ROM_START] = OP_CMP | (ADDR_MODE_IMM << 2);
     sf->memory[ROM_START + 1] = 0xB6;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 0, 2, 2, 2, 2, 1, 1)) {
         return -1;
     }
@@ -1414,7 +1432,7 @@ static int CMP_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0xD9;
     sf->memory[ROM_START + 2] = 0x7D;
     sf->memory[0x7DD9] = 0x24;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 0, 2, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -1427,7 +1445,7 @@ static int CMP_TEST(sf_t *sf) {
     sf->memory[0xA9] = 0x7B;
     sf->memory[0xAA] = 0x06;
     sf->memory[0x067E] = 0xFF;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 0, 2, 2, 2, 2, 0, 0)) {
         return -1;
     }
@@ -1438,7 +1456,7 @@ static int CMP_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_CMP | (ADDR_MODE_ZPG_X << 2);
     sf->memory[ROM_START + 1] = 0x4B;
     sf->memory[0x5C + 0x4B] = 0x01;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 0, 2, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -1449,7 +1467,7 @@ static int CMP_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x01;
     sf->memory[ROM_START + 2] = 0x10;
     sf->memory[0x1001 + 0xF0] = 0x01;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 0, 2, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -1460,7 +1478,7 @@ static int CMP_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x02;
     sf->memory[ROM_START + 2] = 0x20;
     sf->memory[0x2002 + 0x12] = 0x01;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 0, 2, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -1472,7 +1490,7 @@ static int DEC_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_DEC | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x89;
     sf->memory[0x89] = 0x01;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x89] != 0x00 || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 2)) {
         return -1;
     }
@@ -1482,7 +1500,7 @@ static int DEC_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x7B;
     sf->memory[ROM_START + 2] = 0x7B;
     sf->memory[0x7B7B] = 0x00;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x7B7B] != 0xFF || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1492,7 +1510,7 @@ static int DEC_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_DEC | (ADDR_MODE_ZPG_X << 2);
     sf->memory[ROM_START + 1] = 0xC6;
     sf->memory[(0xC6 + 0x90) % 0xFF] = 0xFF;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[(0xC6 + 0x90) % 0xFF] != 0xFE || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1503,7 +1521,7 @@ static int DEC_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x08;
     sf->memory[ROM_START + 2] = 0xEE;
     sf->memory[0xEE08 + 0xE4] = 0x80;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0xEE08 + 0xE4] != 0x7F || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1515,7 +1533,7 @@ static int CPX_TEST(sf_t *sf) {
     sf->x_index = 0x92;
     sf->memory[ROM_START] = OP_CPX;
     sf->memory[ROM_START + 1] = 0x92;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 0, 2, 2, 2, 2, 1, 1)) {
         return -1;
     }
@@ -1525,7 +1543,7 @@ static int CPX_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_CPX | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x41;
     sf->memory[0x41] = 0xFE;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 0, 2, 2, 2, 2, 0, 0)) {
         return -1;
     }
@@ -1536,7 +1554,7 @@ static int CPX_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x67;
     sf->memory[ROM_START + 2] = 0x13;
     sf->memory[0x1367] = 0x02;
-    process_line(sf);
+    (*execute_line)(sf);
     if (check_flags(sf->status, 1, 2, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -1553,7 +1571,7 @@ static int SBC_TEST(sf_t *sf) {
     sf->memory[0x77] = 0x91;
     sf->memory[0x78] = 0x09;
     sf->memory[0x0991] = 0x05;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x7A || check_flags(sf->status, 0, 0, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -1564,7 +1582,7 @@ static int SBC_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_SBC | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0xC6;
     sf->memory[0xC6] = 0x05;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x79 || check_flags(sf->status, 0, 0, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -1574,7 +1592,7 @@ static int SBC_TEST(sf_t *sf) {
     sf->accumulator = 0x7F;
     sf->memory[ROM_START] = OP_SBC | (ADDR_MODE_IMM << 2);
     sf->memory[ROM_START + 1] = 0xFE;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x81 || check_flags(sf->status, 1, 1, 2, 2, 2, 0, 0)) {
         return -1;
     }
@@ -1586,7 +1604,7 @@ static int SBC_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0x89;
     sf->memory[ROM_START + 2] = 0x67;
     sf->memory[0x6789] = 0x10;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x70 || check_flags(sf->status, 0, 1, 2, 2, 2, 0, 1)) {
         return -1;
     }
@@ -1601,7 +1619,7 @@ static int SBC_TEST(sf_t *sf) {
     sf->memory[0x67] = 0x28;
     sf->memory[0x68] = 0x91;
     sf->memory[0x9128 + 0x54] = 0x19;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x00 || check_flags(sf->status, 0, 0, 2, 1, 2, 1, 1)) {
         return -1;
     }
@@ -1613,7 +1631,7 @@ static int SBC_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_SBC | (ADDR_MODE_ZPG_X << 2);
     sf->memory[ROM_START + 1] = 0x89;
     sf->memory[0x89 + 0x61] = 0x41;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x80 || check_flags(sf->status, 1, 0, 2, 1, 2, 0, 0)) {
         return -1;
     }
@@ -1626,7 +1644,7 @@ static int SBC_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0xB8;
     sf->memory[ROM_START + 2] = 0xAB;
     sf->memory[0xABBA] = 0x12;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x79 || check_flags(sf->status, 0, 1, 2, 1, 2, 0, 1)) {
         return -1;
     }
@@ -1639,7 +1657,7 @@ static int SBC_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0xB7;
     sf->memory[ROM_START + 2] = 0xBA;
     sf->memory[0xBABE] = 0x23;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->accumulator != 0x53 || check_flags(sf->status, 0, 0, 2, 1, 2, 0, 1)) {
         return -1;
     }
@@ -1651,7 +1669,7 @@ static int INC_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_INC | (ADDR_MODE_ZPG << 2);
     sf->memory[ROM_START + 1] = 0x65;
     sf->memory[0x65] = 0x80;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0x65] != 0x81 || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1661,7 +1679,7 @@ static int INC_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0xFF;
     sf->memory[ROM_START + 2] = 0xFF;
     sf->memory[0xFFFF] = 0x7F;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0xFFFF] != 0x80 || check_flags(sf->status, 1, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1671,7 +1689,7 @@ static int INC_TEST(sf_t *sf) {
     sf->memory[ROM_START] = OP_INC | (ADDR_MODE_ZPG_X << 2);
     sf->memory[ROM_START + 1] = 0x90;
     sf->memory[0xB0] = 0xFF;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0xB0] != 0x00 || check_flags(sf->status, 0, 2, 2, 2, 2, 1, 2)) {
         return -1;
     }
@@ -1682,7 +1700,7 @@ static int INC_TEST(sf_t *sf) {
     sf->memory[ROM_START + 1] = 0xD3;
     sf->memory[ROM_START + 2] = 0xCA;
     sf->memory[0xCAFE] = 0x22;
-    process_line(sf);
+    (*execute_line)(sf);
     if (sf->memory[0xCAFE] != 0x23 || check_flags(sf->status, 0, 2, 2, 2, 2, 0, 2)) {
         return -1;
     }
@@ -1748,6 +1766,34 @@ int run_opcode_tests(sf_t *sf) {
     return 0;
 }
 
+// the tests write each instruction over the last one, which entries and translations kept between runs would miss
+static void threaded_line(sf_t *sf) {
+    invalidate_code(sf);
+    threaded_run_instructions(sf, 1);
+}
+
+int run_threaded_opcode_tests(sf_t *sf) {
+    execute_line = threaded_line;
+    run_opcode_tests(sf);
+    execute_line = process_line;
+    return 0;
+}
+
+static void jit_line(sf_t *sf) {
+    invalidate_code(sf);
+    jit_run_instructions(sf, 1);
+}
+
+int run_jit_opcode_tests(sf_t *sf) {
+    // translate every instruction on its first run, each as a block of its own
+    jit_configure(0, 1);
+    execute_line = jit_line;
+    run_opcode_tests(sf);
+    execute_line = process_line;
+    jit_configure(JIT_HOT_THRESHOLD, JIT_MAX_INSTRUCTIONS);
+    return 0;
+}
+
 /* DATA STRUCTURE TESTS */
 
 int table_test() {
@@ -1780,3 +1826,1643 @@ int table_test() {
 
     return 0;
 }
+
+/* BATCH RUN TESTS */
+
+int batch_run_test(sf_t *sf) {
+    // LDX #$05; DEX; BNE -3; BRK
+    initialize_regs(sf, ROM_START);
+    sf->memory[ROM_START] = OP_LDX;
+    sf->memory[ROM_START + 1] = 0x05;
+    sf->memory[ROM_START + 2] = OP_DEX;
+    sf->memory[ROM_START + 3] = OP_BNE;
+    sf->memory[ROM_START + 4] = 0xFD;
+    sf->memory[ROM_START + 5] = OP_BRK;
+
+    assert(run_instructions(sf, 3) == RUN_BUDGET);
+    assert(sf->pc == ROM_START + 2 && sf->x_index == 0x04);
+
+    assert(run_until(sf, ROM_START + 5, 100) == RUN_STOP_PC);
+    assert(sf->x_index == 0x00);
+
+    assert(run_until(sf, ROM_START + 5, 100) == RUN_BRK);
+    assert(sf->pc == IRQ_ADDRESS);
+
+    // LDA $80F0,X crossing into page 0x81 costs 4 + 1 cycles
+    initialize_regs(sf, ROM_START);
+    sf->x_index = 0x20;
+    sf->memory[ROM_START] = OP_LDA | (ADDR_MODE_ABS_X << 2);
+    sf->memory[ROM_START + 1] = 0xF0;
+    sf->memory[ROM_START + 2] = 0x80;
+    process_line(sf);
+    assert(sf->cycles == 5);
+
+    // taken branch to another page costs 2 + 1 + 1 cycles, untaken branch costs 2
+    initialize_regs(sf, ROM_START);
+    sf->memory[ROM_START] = OP_BNE;
+    sf->memory[ROM_START + 1] = 0x80;
+    process_line(sf);
+    assert(sf->cycles == 4 && sf->pc == ROM_START + 2 - 0x80);
+    initialize_regs(sf, ROM_START);
+    sf->status |= (1 << ZERO_INDEX);
+    process_line(sf);
+    assert(sf->cycles == 2 && sf->pc == ROM_START + 2);
+
+    // cycle budget: NOP takes 2 cycles, so a 7 cycle budget runs 4 of them
+    initialize_regs(sf, ROM_START);
+    sf->memory[ROM_START] = OP_NOP;
+    sf->memory[ROM_START + 1] = OP_NOP;
+    sf->memory[ROM_START + 2] = OP_NOP;
+    sf->memory[ROM_START + 3] = OP_NOP;
+    sf->memory[ROM_START + 4] = OP_NOP;
+    assert(run_cycles(sf, 7) == RUN_BUDGET);
+    assert(sf->cycles == 8 && sf->pc == ROM_START + 4);
+
+    // self-modifying code: STA turns the NOP after it into INX while its block is running
+    // LDX #$00; LDA #OP_INX; STA ROM_START + 8; NOP; NOP; BRK
+    initialize_regs(sf, ROM_START);
+    sf->memory[ROM_START] = OP_LDX;
+    sf->memory[ROM_START + 1] = 0x00;
+    sf->memory[ROM_START + 2] = OP_LDA | (ADDR_MODE_IMM << 2);
+    sf->memory[ROM_START + 3] = OP_INX;
+    sf->memory[ROM_START + 4] = OP_STA | (ADDR_MODE_ABS << 2);
+    sf->memory[ROM_START + 5] = (ROM_START + 8) & 0xFF;
+    sf->memory[ROM_START + 6] = (ROM_START + 8) >> 8;
+    sf->memory[ROM_START + 7] = OP_NOP;
+    sf->memory[ROM_START + 8] = OP_NOP;
+    sf->memory[ROM_START + 9] = OP_BRK;
+    assert(run_instructions(sf, 100) == RUN_BRK);
+    assert(sf->x_index == 0x01);
+
+    // writes made between runs are seen by the next run
+    sf->memory[ROM_START + 3] = OP_DEX;
+    initialize_regs(sf, ROM_START);
+    assert(run_instructions(sf, 100) == RUN_BRK);
+    assert(sf->x_index == 0xFF);
+
+    // threaded code: a budget ending inside the DEX;BNE superinstruction stops after DEX
+    // LDX #$05; DEX; BNE -3; BRK
+    initialize_regs(sf, ROM_START);
+    sf->memory[ROM_START] = OP_LDX;
+    sf->memory[ROM_START + 1] = 0x05;
+    sf->memory[ROM_START + 2] = OP_DEX;
+    sf->memory[ROM_START + 3] = OP_BNE;
+    sf->memory[ROM_START + 4] = 0xFD;
+    sf->memory[ROM_START + 5] = OP_BRK;
+    assert(threaded_run_instructions(sf, 2) == RUN_BUDGET);
+    assert(sf->pc == ROM_START + 3 && sf->x_index == 0x04);
+    assert(threaded_run_instructions(sf, 100) == RUN_BRK);
+    assert(sf->x_index == 0x00 && sf->cycles == 2 + 5 * 2 + 5 * 2 + 4 * 1 + 7);
+
+    // self-modifying code: STA turns the BNE of a running DEX;BNE superinstruction into BEQ
+    // LDX #$03; LOOP: DEX; BNE PATCH; BRK; NOP; NOP; PATCH: LDA #OP_BEQ; STA LOOP + 1; JMP LOOP
+    initialize_regs(sf, ROM_START);
+    sf->memory[ROM_START] = OP_LDX;
+    sf->memory[ROM_START + 1] = 0x03;
+    sf->memory[ROM_START + 2] = OP_DEX;
+    sf->memory[ROM_START + 3] = OP_BNE;
+    sf->memory[ROM_START + 4] = 0x03;
+    sf->memory[ROM_START + 5] = OP_BRK;
+    sf->memory[ROM_START + 6] = OP_NOP;
+    sf->memory[ROM_START + 7] = OP_NOP;
+    sf->memory[ROM_START + 8] = OP_LDA | (ADDR_MODE_IMM << 2);
+    sf->memory[ROM_START + 9] = OP_BEQ;
+    sf->memory[ROM_START + 10] = OP_STA | (ADDR_MODE_ABS << 2);
+    sf->memory[ROM_START + 11] = (ROM_START + 3) & 0xFF;
+    sf->memory[ROM_START + 12] = (ROM_START + 3) >> 8;
+    sf->memory[ROM_START + 13] = OP_JMP;
+    sf->memory[ROM_START + 14] = (ROM_START + 2) & 0xFF;
+    sf->memory[ROM_START + 15] = (ROM_START + 2) >> 8;
+    assert(threaded_run_instructions(sf, 100) == RUN_BRK);
+    assert(sf->x_index == 0x01);
+
+    printf("BATCH RUN TESTS PASSED!\n");
+    return 0;
+}
+
+/* MEMORY BUS TESTS */
+
+#ifdef MEMORY_BUS
+// device used by bus_test: reads return the low byte of the address, writes are recorded
+typedef struct {
+    uint32_t reads;
+    uint32_t writes;
+    uint16_t last_address;
+    uint8_t last_value;
+} TestDevice_t;
+
+static uint8_t test_device_read(void *context, uint16_t address) {
+    TestDevice_t *device = (TestDevice_t *)context;
+    device->reads++;
+    return address & 0xFF;
+}
+
+static void test_device_write(void *context, uint16_t address, uint8_t value) {
+    TestDevice_t *device = (TestDevice_t *)context;
+    device->writes++;
+    device->last_address = address;
+    device->last_value = value;
+}
+#endif
+
+int bus_test(sf_t *sf) {
+#ifdef MEMORY_BUS
+    TestDevice_t device = {0};
+
+    // LDA $D012; STA $D020; INC $D030; LDA #$5A; STA $9000; LDA $9000; STA $C100; BRK
+    initialize_regs(sf, ROM_START);
+    bus_map_device(sf, 0xD0, 0xD0, test_device_read, test_device_write, &device);
+    bus_map_memory(sf, 0x90, 0x90, 0x90, 0); // ROM
+    bus_map_memory(sf, 0xC1, 0xC1, 0x10, 1); // mirror of page 0x10
+    sf->memory[0x9000] = 0x77;
+    static const uint8_t program[] = {
+        0xAD, 0x12, 0xD0, 0x8D, 0x20, 0xD0, 0xEE, 0x30, 0xD0, 0xA9, 0x5A, 0x8D, 0x00, 0x90,
+        0xAD, 0x00, 0x90, 0x8D, 0x00, 0xC1, 0x00
+    };
+    memcpy(sf->memory + ROM_START, program, sizeof(program));
+
+    assert(run_instructions(sf, 3) == RUN_BUDGET);
+    // LDA reads the device, STA only writes it, INC reads then writes back the incremented byte
+    assert(device.reads == 2 && device.writes == 2);
+    assert(device.last_address == 0xD030 && device.last_value == 0x31);
+    assert(sf->memory[0xD020] == 0x00);
+
+    assert(run_instructions(sf, 100) == RUN_BRK);
+    // the write to ROM is dropped, the write to the mirror lands in page 0x10
+    assert(sf->memory[0x9000] == 0x77 && sf->accumulator == 0x77);
+    assert(sf->memory[0x1000] == 0x77 && sf->memory[0xC100] == 0x00);
+    assert(bus_read(sf, 0xC100) == 0x77 && bus_read(sf, 0xD0AB) == 0xAB);
+
+    // copies of sf use their own memory
+    static sf_t copy;
+    copy = *sf;
+    bus_write(&copy, 0xC100, 0x11);
+    assert(copy.memory[0x1000] == 0x11 && sf->memory[0x1000] == 0x77);
+
+    initialize_regs(sf, ROM_START);
+    assert(bus_read(sf, 0xD0AB) == sf->memory[0xD0AB]);
+
+    printf("MEMORY BUS TESTS PASSED!\n");
+#endif
+    return 0;
+}
+
+/* BATCH ENGINE TESTS */
+
+#define BATCH_TEST_INSTANCES    256
+#define BATCH_TEST_THREADS      4
+#define BATCH_TEST_LOOPING      7 // instance that never reaches BRK
+
+/* seconds_since
+ *      DESCRIPTION: returns wall clock seconds elapsed since start
+ */
+static double seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* time_batch
+ *      DESCRIPTION: runs a fresh batch of the test program on passed number of threads, returns seconds taken
+ */
+static double time_batch(Batch_t *batch, const sf_t *prototype, uint32_t num_threads) {
+    static sf_t instance;
+    for (uint32_t i = 0; i < batch->num_instances; i++) {
+        instance = *prototype;
+        instance.memory[0x0300] = i; // outer loop count
+        if (i == BATCH_TEST_LOOPING) {
+            instance.memory[0x0610] = OP_JMP; // JMP OUTER instead of BRK
+            instance.memory[0x0611] = 0x05;
+            instance.memory[0x0612] = 0x06;
+        }
+        batch_set_instance(batch, i, &instance);
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    run_batch(batch, num_threads, 3 * BATCH_SLICE_CYCLES);
+    return seconds_since(&start);
+}
+
+int batch_engine_test(sf_t *sf) {
+    // LDX $0300; BEQ DONE; OUTER: LDY #$00; INNER: DEY; BNE INNER; INC $0301; DEX; BNE OUTER; DONE: BRK
+    static const uint8_t program[] = {
+        0xAE, 0x00, 0x03, 0xF0, 0x0B, 0xA0, 0x00, 0x88, 0xD0, 0xFD, 0xEE, 0x01, 0x03, 0xCA, 0xD0, 0xF5, 0x00
+    };
+    memset(sf->memory, 0, MEMORY_SIZE);
+    memcpy(sf->memory + 0x0600, program, sizeof(program));
+    initialize_regs(sf, 0x0600);
+
+    Batch_t *batch = new_batch(sf, BATCH_TEST_INSTANCES);
+    double serial = time_batch(batch, sf, 1);
+    double parallel = time_batch(batch, sf, BATCH_TEST_THREADS);
+
+    // every instance ends exactly where it does when run on its own, holding its own copy of only the pages it wrote
+    static sf_t reference;
+    static sf_t instance;
+    const sf_t *result = &instance;
+    for (uint32_t i = 0; i < BATCH_TEST_INSTANCES; i++) {
+        batch_get_instance(batch, i, &instance);
+        for (int index = 0; index < NUM_PAGES; index++) {
+            int written = (index == 0x01 && i != BATCH_TEST_LOOPING) || (index == 0x03 && i != 0) ||
+                          (index == 0x06 && i == BATCH_TEST_LOOPING); // BRK pushing, the counts, the JMP
+            assert((paged_page(batch->states[i]->memory, index) != paged_page(batch->base->memory, index)) == written);
+        }
+        reference = *sf;
+        reference.memory[0x0300] = i;
+        if (i == BATCH_TEST_LOOPING) {
+            memcpy(reference.memory + 0x0610, result->memory + 0x0610, 3);
+            assert(run_cycles(&reference, 3 * BATCH_SLICE_CYCLES) == RUN_BUDGET);
+            assert(batch->exits[i] == RUN_BUDGET && result->cycles >= 3 * BATCH_SLICE_CYCLES);
+        } else {
+            assert(run_cycles(&reference, 3 * BATCH_SLICE_CYCLES) == RUN_BRK);
+            assert(batch->exits[i] == RUN_BRK && result->memory[0x0301] == (uint8_t)i);
+        }
+        assert(result->accumulator == reference.accumulator && result->x_index == reference.x_index &&
+                result->y_index == reference.y_index && result->status == reference.status &&
+                result->esp == reference.esp && result->pc == reference.pc && result->cycles == reference.cycles &&
+                memcmp(result->memory, reference.memory, MEMORY_SIZE) == 0);
+    }
+    free_batch(batch);
+
+    printf("batch: 1 thread %.0f instances/s, %d threads %.0f instances/s (%.2fx)\n",
+           BATCH_TEST_INSTANCES / serial, BATCH_TEST_THREADS, BATCH_TEST_INSTANCES / parallel, serial / parallel);
+    printf("BATCH ENGINE TESTS PASSED!\n");
+    return 0;
+}
+
+/* LOCKSTEP TESTS */
+
+#define LOCKSTEP_TEST_ROUNDS    200
+#define LOCKSTEP_TEST_GROUP     (2 * LOCKSTEP_LANES)
+#define LOCKSTEP_TEST_STRINGS   4096
+
+/* same_state
+ *      DESCRIPTION: returns nonzero if both instances have the same registers, cycle count and memory
+ */
+static int same_state(const sf_t *a, const sf_t *b) {
+    return a->accumulator == b->accumulator && a->x_index == b->x_index && a->y_index == b->y_index &&
+           a->status == b->status && a->esp == b->esp && a->pc == b->pc && a->cycles == b->cycles &&
+           memcmp(a->memory, b->memory, MEMORY_SIZE) == 0 && memcmp(a->dirty, b->dirty, sizeof(a->dirty)) == 0;
+}
+
+/* random_program
+ *      DESCRIPTION: fills page $06 with random instructions, mostly ones the lanes run themselves, plus stack
+ *                   operations, subroutine calls and the odd BRK that go through process_line
+ */
+static void random_program(uint8_t *code) {
+    static const uint8_t opcodes[] = {
+        0x09, 0x05, 0x15, 0x0D, 0x1D, 0x19, 0x01, 0x11, 0x29, 0x35, 0x39, 0x31, 0x49, 0x55, 0x5D, 0x41,
+        0x69, 0x65, 0x75, 0x7D, 0x71, 0xE9, 0xE5, 0xFD, 0xF9, 0xE1, 0xC9, 0xC5, 0xDD, 0xD1, 0xA9, 0xA5,
+        0xB5, 0xAD, 0xBD, 0xB9, 0xA1, 0xB1, 0x85, 0x95, 0x9D, 0x99, 0x81, 0x91, 0xA2, 0xB6, 0xBE, 0xA0,
+        0xB4, 0xBC, 0x86, 0x96, 0x84, 0x94, 0xE0, 0xE4, 0xC0, 0xCC, 0x24, 0x2C, 0x0A, 0x06, 0x1E, 0x4A,
+        0x56, 0x2A, 0x36, 0x6A, 0x6E, 0xE6, 0xFE, 0xC6, 0xD6, OP_INX, OP_INY, OP_DEX, OP_DEY, OP_TAX,
+        OP_TAY, OP_TXA, OP_TYA, OP_CLC, OP_SEC, OP_CLD, OP_SED, OP_CLV, OP_NOP, OP_BPL, OP_BMI, OP_BVC,
+        OP_BVS, OP_BCC, OP_BCS, OP_BNE, OP_BEQ, OP_PHA, OP_PLA, OP_PHP, OP_TSX, OP_JSR, OP_RTS, OP_BRK
+    };
+    for (int i = 0; i < 0x100; i++) {
+        code[i] = rand();
+    }
+    for (int i = 0; i < 0xF0; i += opcode_length[code[i]]) {
+        code[i] = opcodes[rand() % sizeof(opcodes)];
+        if (code[i] == OP_JSR || code[i] == OP_JMP) {
+            code[i + 2] = 0x06; // stay on the page of random instructions
+        } else if (code[i] == OP_BRK && rand() % 4 != 0) {
+            code[i] = OP_NOP;
+        }
+    }
+}
+
+/* time_lockstep
+ *      DESCRIPTION: runs batch of strings on one thread, with or without the lockstep engine, returns seconds taken
+ */
+static double time_lockstep(Batch_t *batch, const sf_t *prototype, uint8_t lockstep) {
+    static sf_t instance;
+    srand(11);
+    for (uint32_t i = 0; i < batch->num_instances; i++) {
+        instance = *prototype;
+        int length = 192 + rand() % 64;
+        for (int c = 0; c < length; c++) {
+            static const char characters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ .,!?";
+            instance.memory[0x0400 + c] = characters[rand() % (sizeof(characters) - 1)];
+        }
+        instance.memory[0x0400 + length] = 0x00;
+        batch_set_instance(batch, i, &instance);
+    }
+    batch->lockstep = lockstep;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    run_batch(batch, 1, UINT64_MAX);
+    return seconds_since(&start);
+}
+
+/* compare_lockstep
+ *      DESCRIPTION: runs program over a batch of strings with and without the lockstep engine, asserting both leave
+ *                   every instance the same, and prints how many strings per second each got through
+ */
+static void compare_lockstep(sf_t *sf, const uint8_t *program, size_t size, const char *name) {
+    memset(sf->memory, 0, MEMORY_SIZE);
+    memcpy(sf->memory + 0x0600, program, size);
+    initialize_regs(sf, 0x0600);
+
+    Batch_t *scalar = new_batch(sf, LOCKSTEP_TEST_STRINGS);
+    Batch_t *lockstep = new_batch(sf, LOCKSTEP_TEST_STRINGS);
+    double scalar_time = time_lockstep(scalar, sf, 0);
+    double lockstep_time = time_lockstep(lockstep, sf, 1);
+    static sf_t lockstep_result;
+    static sf_t scalar_result;
+    for (uint32_t i = 0; i < LOCKSTEP_TEST_STRINGS; i++) {
+        assert(lockstep->exits[i] == RUN_BRK && scalar->exits[i] == RUN_BRK);
+        batch_get_instance(lockstep, i, &lockstep_result);
+        batch_get_instance(scalar, i, &scalar_result);
+        assert(same_state(&lockstep_result, &scalar_result));
+    }
+    free_batch(scalar);
+    free_batch(lockstep);
+
+    printf("%s: scalar %.0f strings/s, lockstep %.0f strings/s (%.2fx)\n", name, LOCKSTEP_TEST_STRINGS / scalar_time,
+           LOCKSTEP_TEST_STRINGS / lockstep_time, scalar_time / lockstep_time);
+}
+
+int lockstep_test(sf_t *sf) {
+    static sf_t initial[LOCKSTEP_TEST_GROUP];
+    static sf_t instances[LOCKSTEP_TEST_GROUP];
+    sf_t *lanes[LOCKSTEP_TEST_GROUP];
+    uint64_t limits[LOCKSTEP_TEST_GROUP];
+    RunExit_t exits[LOCKSTEP_TEST_GROUP];
+
+    // random programs over random memory: lanes split, rejoin, get peeled off and modify their own code, yet every
+    // instance must end exactly where run_cycles leaves it
+    srand(6502);
+    for (int round = 0; round < LOCKSTEP_TEST_ROUNDS; round++) {
+        uint8_t code[0x100];
+        random_program(code);
+        for (int i = 0; i < LOCKSTEP_TEST_GROUP; i++) {
+            for (int address = 0; address < MEMORY_SIZE; address++) {
+                sf->memory[address] = rand();
+            }
+#ifndef MEMORY_BUS
+            // without the bus (IND),Y past $FFFF runs off the end of memory, so keep pointers below it
+            for (int address = 0; address < 0x100; address++) {
+                sf->memory[address] &= 0x7F;
+            }
+#endif
+            memcpy(sf->memory + 0x0600, code, sizeof(code));
+            initialize_regs(sf, 0x0600);
+            sf->accumulator = rand();
+            sf->x_index = rand();
+            sf->y_index = rand();
+            sf->status = rand() & (rand() % 4 == 0 ? 0xFF : ~(1 << DECIMAL_INDEX));
+            initial[i] = *sf;
+            instances[i] = *sf;
+            lanes[i] = &instances[i];
+            limits[i] = sf->cycles + 200 + rand() % 4000;
+        }
+        run_lockstep(lanes, LOCKSTEP_TEST_GROUP, limits, exits);
+        for (int i = 0; i < LOCKSTEP_TEST_GROUP; i++) {
+            RunExit_t expected = run_cycles(&initial[i], limits[i] - initial[i].cycles);
+            assert(exits[i] == expected && same_state(&instances[i], &initial[i]));
+        }
+    }
+
+    // lanes store through note_store like the core does, so code this thread keeps for an instance sees its stores
+    // ROM_START: LDA #OP_DEX; STA ROM_START + $10; BRK; ROM_START + $10: INX; BRK
+    memset(sf->memory, 0, MEMORY_SIZE);
+    initialize_regs(sf, ROM_START + 0x10);
+    sf->memory[ROM_START] = OP_LDA | (ADDR_MODE_IMM << 2);
+    sf->memory[ROM_START + 1] = OP_DEX;
+    sf->memory[ROM_START + 2] = OP_STA | (ADDR_MODE_ABS << 2);
+    sf->memory[ROM_START + 3] = (ROM_START + 0x10) & 0xFF;
+    sf->memory[ROM_START + 4] = (ROM_START + 0x10) >> 8;
+    sf->memory[ROM_START + 5] = OP_BRK;
+    sf->memory[ROM_START + 0x10] = OP_INX;
+    sf->memory[ROM_START + 0x11] = OP_BRK;
+    instances[0] = *sf;
+    instances[1] = *sf;
+    assert(block_run_instructions(&instances[0], 100) == RUN_BRK && instances[0].x_index == 0x01);
+    for (int i = 0; i < 2; i++) {
+        instances[i].pc = ROM_START;
+        lanes[i] = &instances[i];
+        limits[i] = UINT64_MAX;
+    }
+    run_lockstep(lanes, 2, limits, exits);
+    assert(exits[0] == RUN_BRK && exits[1] == RUN_BRK && instances[0].memory[ROM_START + 0x10] == OP_DEX);
+    instances[0].pc = ROM_START + 0x10;
+    assert(block_run_instructions(&instances[0], 100) == RUN_BRK && instances[0].x_index == 0x00);
+
+    // tolower over strings of different lengths and case: lanes split at every character that needs converting
+    // TOLOWER: LDY #$00; LOOP: LDA $0400,Y; BEQ DONE; CMP #$41; BCC SKIP; CMP #$5B; BCS SKIP; ORA #$20;
+    // SKIP: STA $0500,Y; INY; BNE LOOP; DONE: BRK
+    static const uint8_t lowercase[] = {
+        0xA0, 0x00, 0xB9, 0x00, 0x04, 0xF0, 0x10, 0xC9, 0x41, 0x90, 0x06, 0xC9, 0x5B, 0xB0, 0x02, 0x09, 0x20,
+        0x99, 0x00, 0x05, 0xC8, 0xD0, 0xEB, 0x00
+    };
+    compare_lockstep(sf, lowercase, sizeof(lowercase), "tolower");
+
+    // running sums over the same strings: every lane takes the same path, the best case of the lockstep engine
+    // SUMS: LDY #$00; LDA #$00; LOOP: CLC; ADC $0400,Y; STA $0500,Y; INY; BNE LOOP; BRK
+    static const uint8_t sums[] = {
+        0xA0, 0x00, 0xA9, 0x00, 0x18, 0x79, 0x00, 0x04, 0x99, 0x00, 0x05, 0xC8, 0xD0, 0xF6, 0x00
+    };
+    compare_lockstep(sf, sums, sizeof(sums), "sums");
+
+    printf("LOCKSTEP TESTS PASSED!\n");
+    return 0;
+}
+
+/* BLOCK ENGINE TESTS */
+
+#define CODE_TEST_ROUNDS    64
+
+/* check_random_slices
+ *      DESCRIPTION: runs random programs over random memory on an engine in slices that end anywhere in a block,
+ *                   asserting every slice ends exactly where run_instructions leaves it; the programs store into
+ *                   their own code, which the engine must see
+ */
+static void check_random_slices(sf_t *sf, RunExit_t (*run)(sf_t *sf, uint64_t num_instr)) {
+    static sf_t reference;
+    srand(1977);
+    for (int round = 0; round < CODE_TEST_ROUNDS; round++) {
+        uint8_t code[0x100];
+        random_program(code);
+        // no byte is an opcode without an instruction or BRK, so programs that jump off their page keep running
+        for (int address = 0; address < MEMORY_SIZE; address++) {
+            do {
+                sf->memory[address] = rand();
+            } while (opcode_mnemonic[sf->memory[address]] == NULL || sf->memory[address] == OP_BRK);
+        }
+#ifndef MEMORY_BUS
+        // without the bus (IND),Y past $FFFF runs off the end of memory, so keep pointers below it
+        for (int address = 0; address < 0x100; address++) {
+            sf->memory[address] &= 0x7F;
+        }
+#endif
+        // aim a quarter of the zero page pointers at the code, so indirect stores rewrite it
+        for (int address = 1; address < 0x100; address += 2) {
+            if (rand() % 4 == 0) {
+                sf->memory[address] = 0x06;
+            }
+        }
+        memcpy(sf->memory + 0x0600, code, sizeof(code));
+        initialize_regs(sf, 0x0600);
+        sf->accumulator = rand();
+        sf->x_index = rand();
+        sf->y_index = rand();
+        sf->status = rand() & ~(1 << DECIMAL_INDEX);
+        reference = *sf;
+        for (int slice = 0; slice < 64; slice++) {
+            uint64_t length = 1 + rand() % 200;
+            RunExit_t exit_reason = (*run)(sf, length);
+            assert(exit_reason == run_instructions(&reference, length) && same_state(sf, &reference));
+            if (exit_reason == RUN_BRK) {
+                break;
+            }
+        }
+    }
+}
+
+/* check_kept_code
+ *      DESCRIPTION: asserts an engine that keeps code from one run to the next stops using it after a store the
+ *                   CPU makes in another run on this thread, and after a write from outside and invalidate_code
+ */
+static void check_kept_code(sf_t *sf, RunExit_t (*run)(sf_t *sf, uint64_t num_instr)) {
+    // the writer runs on run_instructions, so only note_store can tell the engine its INX became DEX
+    // ROM_START: LDA #OP_DEX; STA ROM_START + $10; BRK; ROM_START + $10: INX; BRK
+    initialize_regs(sf, ROM_START + 0x10);
+    sf->memory[ROM_START] = OP_LDA | (ADDR_MODE_IMM << 2);
+    sf->memory[ROM_START + 1] = OP_DEX;
+    sf->memory[ROM_START + 2] = OP_STA | (ADDR_MODE_ABS << 2);
+    sf->memory[ROM_START + 3] = (ROM_START + 0x10) & 0xFF;
+    sf->memory[ROM_START + 4] = (ROM_START + 0x10) >> 8;
+    sf->memory[ROM_START + 5] = OP_BRK;
+    sf->memory[ROM_START + 0x10] = OP_INX;
+    sf->memory[ROM_START + 0x11] = OP_BRK;
+    assert((*run)(sf, 100) == RUN_BRK && sf->x_index == 0x01);
+    sf->pc = ROM_START;
+    assert(run_instructions(sf, 100) == RUN_BRK);
+    sf->pc = ROM_START + 0x10;
+    assert((*run)(sf, 100) == RUN_BRK && sf->x_index == 0x00);
+    sf->memory[ROM_START + 0x10] = OP_INY;
+    invalidate_code(sf);
+    sf->pc = ROM_START + 0x10;
+    assert((*run)(sf, 100) == RUN_BRK && sf->x_index == 0x00 && sf->y_index == 0x01);
+}
+
+int block_engine_test(sf_t *sf) {
+    check_random_slices(sf, block_run_instructions);
+
+    // self-modifying code: STA turns the NOP after it into INX while its block is running
+    // LDX #$00; LDA #OP_INX; STA ROM_START + 8; NOP; NOP; BRK
+    initialize_regs(sf, ROM_START);
+    sf->memory[ROM_START] = OP_LDX;
+    sf->memory[ROM_START + 1] = 0x00;
+    sf->memory[ROM_START + 2] = OP_LDA | (ADDR_MODE_IMM << 2);
+    sf->memory[ROM_START + 3] = OP_INX;
+    sf->memory[ROM_START + 4] = OP_STA | (ADDR_MODE_ABS << 2);
+    sf->memory[ROM_START + 5] = (ROM_START + 8) & 0xFF;
+    sf->memory[ROM_START + 6] = (ROM_START + 8) >> 8;
+    sf->memory[ROM_START + 7] = OP_NOP;
+    sf->memory[ROM_START + 8] = OP_NOP;
+    sf->memory[ROM_START + 9] = OP_BRK;
+    assert(block_run_instructions(sf, 100) == RUN_BRK);
+    assert(sf->x_index == 0x01 && sf->cycles == 2 + 2 + 4 + 2 + 2 + 7);
+
+    // self-modifying code: a loop's own block rewrites its BNE into BEQ on the way round
+    // LDX #$03; LOOP: DEX; BNE PATCH; BRK; NOP; NOP; PATCH: LDA #OP_BEQ; STA LOOP + 1; JMP LOOP
+    initialize_regs(sf, ROM_START);
+    sf->memory[ROM_START] = OP_LDX;
+    sf->memory[ROM_START + 1] = 0x03;
+    sf->memory[ROM_START + 2] = OP_DEX;
+    sf->memory[ROM_START + 3] = OP_BNE;
+    sf->memory[ROM_START + 4] = 0x03;
+    sf->memory[ROM_START + 5] = OP_BRK;
+    sf->memory[ROM_START + 6] = OP_NOP;
+    sf->memory[ROM_START + 7] = OP_NOP;
+    sf->memory[ROM_START + 8] = OP_LDA | (ADDR_MODE_IMM << 2);
+    sf->memory[ROM_START + 9] = OP_BEQ;
+    sf->memory[ROM_START + 10] = OP_STA | (ADDR_MODE_ABS << 2);
+    sf->memory[ROM_START + 11] = (ROM_START + 3) & 0xFF;
+    sf->memory[ROM_START + 12] = (ROM_START + 3) >> 8;
+    sf->memory[ROM_START + 13] = OP_JMP;
+    sf->memory[ROM_START + 14] = (ROM_START + 2) & 0xFF;
+    sf->memory[ROM_START + 15] = (ROM_START + 2) >> 8;
+    assert(block_run_instructions(sf, 100) == RUN_BRK);
+    assert(sf->x_index == 0x01);
+
+    check_kept_code(sf, block_run_instructions);
+
+    printf("BLOCK ENGINE TESTS PASSED!\n");
+    return 0;
+}
+
+/* JIT TESTS */
+
+int jit_test(sf_t *sf) {
+    // translate every block on its first run, so the random programs run almost entirely as translated code
+    jit_configure(0, JIT_MAX_INSTRUCTIONS);
+    check_random_slices(sf, jit_run_instructions);
+    check_kept_code(sf, jit_run_instructions);
+    jit_configure(JIT_HOT_THRESHOLD, JIT_MAX_INSTRUCTIONS);
+
+#if defined(__linux__) && defined(JIT)
+    // W^X: no mapping of the process is writable and executable at once after translating and running code
+    FILE *maps = fopen("/proc/self/maps", "r");
+    assert(maps != NULL);
+    char line[512];
+    while (fgets(line, sizeof(line), maps) != NULL) {
+        char permissions[5];
+        assert(sscanf(line, "%*s %4s", permissions) == 1);
+        assert(!(permissions[1] == 'w' && permissions[2] == 'x'));
+    }
+    fclose(maps);
+#endif
+
+    printf("JIT TESTS PASSED!\n");
+    return 0;
+}
+
+/* THREADED ENGINE TESTS */
+
+int threaded_engine_test(sf_t *sf) {
+    check_random_slices(sf, threaded_run_instructions);
+    check_kept_code(sf, threaded_run_instructions);
+
+    printf("THREADED ENGINE TESTS PASSED!\n");
+    return 0;
+}
+
+/* PAGED MEMORY TESTS */
+
+#define PAGED_TEST_FORKS    4096
+
+int paged_memory_test(sf_t *sf) {
+    static uint8_t flat[MEMORY_SIZE];
+    srand(256);
+    for (int address = 0; address < MEMORY_SIZE; address++) {
+        sf->memory[address] = rand();
+    }
+    PagedMemory_t *paged = new_paged_memory(sf->memory);
+    paged_copy_out(paged, flat);
+    assert(memcmp(flat, sf->memory, MEMORY_SIZE) == 0);
+
+    // a fork shares every page until one side writes it
+    PagedMemory_t *fork = fork_paged_memory(paged);
+    for (int index = 0; index < NUM_PAGES; index++) {
+        assert(paged_page(fork, index) == paged_page(paged, index));
+    }
+    paged_write(fork, 0x0345, sf->memory[0x0345] ^ 0xFF);
+    assert(paged_page(fork, 0x03) != paged_page(paged, 0x03) && paged_page(fork, 0x04) == paged_page(paged, 0x04));
+    assert(paged_read(fork, 0x0345) == (sf->memory[0x0345] ^ 0xFF) && paged_read(paged, 0x0345) == sf->memory[0x0345]);
+    assert(paged_read(fork, 0x0346) == sf->memory[0x0346]);
+
+    // ROM pages are shared by paged memories built separately, and never written
+    PagedMemory_t *other = new_paged_memory(sf->memory);
+    assert(paged_page(other, ROM_START >> 8) == paged_page(paged, ROM_START >> 8));
+    assert(paged_page(other, SYSTEM_START >> 8) != paged_page(paged, SYSTEM_START >> 8));
+    paged_write(other, ROM_START, sf->memory[ROM_START] ^ 0xFF);
+    assert(paged_read(other, ROM_START) == sf->memory[ROM_START]);
+
+    // running a fork on the CPU and copying it back only replaces the pages the program wrote
+    // LDX #$00; LOOP: TXA; STA $0500,X; INX; BNE LOOP; BRK
+    static const uint8_t program[] = { 0xA2, 0x00, 0x8A, 0x9D, 0x00, 0x05, 0xE8, 0xD0, 0xF9, 0x00 };
+    for (int i = 0; i < (int)sizeof(program); i++) {
+        paged_write(fork, 0x0600 + i, program[i]);
+    }
+    paged_copy_out(fork, sf->memory);
+    initialize_regs(sf, 0x0600);
+    assert(run_cycles(sf, 100000) == RUN_BRK);
+    assert(paged_copy_in(fork, sf->memory) == 2); // page 5 and the stack page BRK pushed to
+    assert(paged_read(fork, 0x05AB) == 0xAB && paged_read(paged, 0x05AB) != 0xAB);
+    assert(paged_page(fork, 0x01) != paged_page(paged, 0x01) && paged_page(fork, 0x07) == paged_page(paged, 0x07));
+    assert(paged_copy_in(fork, sf->memory) == 0);
+
+    // forking costs a page table copy, against a copy of all of sf_t
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < PAGED_TEST_FORKS; i++) {
+        free_paged_memory(fork_paged_memory(paged));
+    }
+    double fork_time = seconds_since(&start);
+    static sf_t copy;
+    volatile uint8_t sink = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < PAGED_TEST_FORKS; i++) {
+        copy = *sf;
+        sink ^= copy.memory[i];
+    }
+    double copy_time = seconds_since(&start);
+
+    free_paged_memory(other);
+    free_paged_memory(fork);
+    free_paged_memory(paged);
+    printf("fork: paged %.0f ns, sf_t copy %.0f ns\n", fork_time / PAGED_TEST_FORKS * 1e9,
+           copy_time / PAGED_TEST_FORKS * 1e9);
+    printf("PAGED MEMORY TESTS PASSED!\n");
+    return 0;
+}
+
+/* SNAPSHOT TESTS */
+
+#define SNAPSHOT_TEST_RESTORES  4096
+
+int snapshot_test(sf_t *sf) {
+    static sf_t start;
+    static sf_t middle;
+    // FILL: LDX #$00; LOOP: TXA; STA $0500,X; INX; BNE LOOP; BRK
+    // POKE: LDA #$AA; STA $0300; INC $0500; BRK
+    static const uint8_t fill[] = { 0xA2, 0x00, 0x8A, 0x9D, 0x00, 0x05, 0xE8, 0xD0, 0xF9, 0x00 };
+    static const uint8_t poke[] = { 0xA9, 0xAA, 0x8D, 0x00, 0x03, 0xEE, 0x00, 0x05, 0x00 };
+    srand(1024);
+    for (int address = 0; address < MEMORY_SIZE; address++) {
+        sf->memory[address] = rand();
+    }
+    memcpy(sf->memory + 0x0600, fill, sizeof(fill));
+    memcpy(sf->memory + 0x0680, poke, sizeof(poke));
+    initialize_regs(sf, 0x0600);
+    SfSnapshot_t *first = sf_snapshot(sf, NULL);
+    start = *sf;
+    assert(sf->dirty[0] == 0 && sf->dirty[1] == 0 && sf->dirty[2] == 0 && sf->dirty[3] == 0);
+
+    // only the pages FILL wrote (page 5, and the stack page BRK pushed to) are copied into the second snapshot
+    assert(run_cycles(sf, 100000) == RUN_BRK);
+    assert(sf->dirty[0] == ((1ull << 0x01) | (1ull << 0x05)));
+    SfSnapshot_t *second = sf_snapshot(sf, first);
+    middle = *sf;
+    for (int index = 0; index < NUM_PAGES; index++) {
+        int written = index == 0x01 || index == 0x05;
+        assert((paged_page(second->memory, index) != paged_page(first->memory, index)) == written);
+    }
+
+    // rewinding copies back what was written since, and what differs between the snapshots
+    sf->pc = 0x0680;
+    assert(run_cycles(sf, 100000) == RUN_BRK);
+    assert(sf->memory[0x0300] == 0xAA);
+    sf_restore(sf, first, second);
+    assert(same_state(sf, &start));
+    sf_restore(sf, second, first);
+    assert(same_state(sf, &middle));
+    sf->pc = 0x0680;
+    assert(run_cycles(sf, 100000) == RUN_BRK);
+    sf_restore(sf, second, second);
+    assert(same_state(sf, &middle));
+
+    // rewinding after a short run, as a fuzzer would between inputs
+    struct timespec begin;
+    double restore_time = 0;
+    for (int i = 0; i < SNAPSHOT_TEST_RESTORES; i++) {
+        sf->pc = 0x0680;
+        run_cycles(sf, 100000);
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        sf_restore(sf, second, second);
+        restore_time += seconds_since(&begin);
+    }
+    assert(same_state(sf, &middle));
+
+    free_snapshot(second);
+    free_snapshot(first);
+    printf("restore: %.2f us\n", restore_time / SNAPSHOT_TEST_RESTORES * 1e6);
+    printf("SNAPSHOT TESTS PASSED!\n");
+    return 0;
+}
+
+/* TIME TRAVEL TESTS */
+
+#define TRAVEL_TEST_STEPS       4096 // ring buffer much shorter than the run, so stepping back replays checkpoints
+#define TRAVEL_TEST_RUN         (3 * TRAVEL_CHECKPOINT_STEPS + 1234)
+#define TRAVEL_TEST_BENCHMARK   10000000
+
+/* at_position
+ *      DESCRIPTION: checks sf against a fresh copy of start run for position instructions (sf->dirty aside, it
+ *                   depends on the snapshots taken)
+ */
+static int at_position(const sf_t *sf, const sf_t *start, uint64_t position) {
+    static sf_t reference;
+    reference = *start;
+    run_instructions(&reference, position);
+    memcpy(reference.dirty, sf->dirty, sizeof(reference.dirty));
+    return same_state(sf, &reference);
+}
+
+int time_travel_test(sf_t *sf) {
+    static sf_t start;
+    // LDX #$00; LOOP: INC $0300; TXA; STA $0500,X; JSR SUB; INX; JMP LOOP; SUB: PHA; PLA; RTS
+    static const uint8_t program[] = {
+        0xA2, 0x00, 0xEE, 0x00, 0x03, 0x8A, 0x9D, 0x00, 0x05, 0x20, 0x10, 0x06, 0xE8, 0x4C, 0x02, 0x06,
+        0x48, 0x68, 0x60
+    };
+    memset(sf->memory, 0, MEMORY_SIZE);
+    memcpy(sf->memory + 0x0600, program, sizeof(program));
+    initialize_regs(sf, 0x0600);
+    start = *sf;
+    TimeTravel_t *travel = new_time_travel(sf, TRAVEL_TEST_STEPS);
+
+    // stepping back within the ring buffer, then past it into the checkpoints
+    assert(travel_run_instructions(travel, sf, TRAVEL_TEST_RUN) == RUN_BUDGET);
+    assert(at_position(sf, &start, TRAVEL_TEST_RUN));
+    static const uint64_t positions[] = {
+        TRAVEL_TEST_RUN - 1, TRAVEL_TEST_RUN - TRAVEL_TEST_STEPS, TRAVEL_TEST_RUN - TRAVEL_TEST_STEPS - 1,
+        2 * TRAVEL_CHECKPOINT_STEPS, 2 * TRAVEL_CHECKPOINT_STEPS - 1, 12345, 1, 0
+    };
+    for (int i = 0; i < (int)(sizeof(positions) / sizeof(positions[0])); i++) {
+        while (travel->position > positions[i]) {
+            assert(travel_step_back(travel, sf) == 0);
+        }
+        assert(at_position(sf, &start, positions[i]));
+    }
+    assert(travel_step_back(travel, sf) == -1);
+
+    // running on from a point in the past, then searching back for a pc and for a write
+    assert(travel_run_instructions(travel, sf, TRAVEL_CHECKPOINT_STEPS + 10) == RUN_BUDGET);
+    assert(at_position(sf, &start, TRAVEL_CHECKPOINT_STEPS + 10));
+    uint8_t count = sf->memory[0x0300];
+    int64_t steps = travel_back_to_write(travel, sf, 0x0300);
+    assert(steps > 0 && sf->pc == 0x0602 && sf->memory[0x0300] == (uint8_t)(count - 1));
+    assert(at_position(sf, &start, TRAVEL_CHECKPOINT_STEPS + 10 - steps));
+    assert(travel_back_to_pc(travel, sf, 0x0610) > 0 && sf->pc == 0x0610);
+    int64_t position = travel->position;
+    assert(travel_back_to_pc(travel, sf, 0x0600) == position && travel->position == 0);
+    assert(travel_back_to_pc(travel, sf, 0x0610) == -1);
+
+    travel_run_instructions(travel, sf, 1000);
+    travel_rewind(travel, sf);
+    assert(at_position(sf, &start, 0));
+
+    // recording overhead against run_instructions
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    run_instructions(&start, TRAVEL_TEST_BENCHMARK);
+    double plain_time = seconds_since(&begin);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    travel_run_instructions(travel, sf, TRAVEL_TEST_BENCHMARK);
+    double travel_time = seconds_since(&begin);
+
+    free_time_travel(travel);
+    printf("run: %.1f MIPS, recorded: %.1f MIPS (%.2fx)\n", TRAVEL_TEST_BENCHMARK / plain_time / 1e6,
+           TRAVEL_TEST_BENCHMARK / travel_time / 1e6, plain_time / travel_time);
+    printf("TIME TRAVEL TESTS PASSED!\n");
+    return 0;
+}
+
+/* SCHEDULER TESTS */
+
+#define SCHEDULER_TEST_PERIOD       1000
+#define SCHEDULER_TEST_TICKS        100
+#define SCHEDULER_TEST_BENCHMARK    50000000
+
+// device raising an IRQ every period cycles
+typedef struct {
+    uint64_t due;
+    uint64_t period;
+    uint32_t ticks;
+    uint64_t max_late; // most cycles an event was delivered after coming due
+} TestTimer_t;
+
+/* timer_tick
+ *      DESCRIPTION: raises an IRQ now and schedules the next tick
+ */
+static void timer_tick(Scheduler_t *scheduler, void *context) {
+    TestTimer_t *timer = (TestTimer_t *)context;
+    if (scheduler->sf->cycles - timer->due > timer->max_late) {
+        timer->max_late = scheduler->sf->cycles - timer->due;
+    }
+    timer->ticks++;
+    schedule_interrupt(scheduler, scheduler->sf->cycles, EVENT_IRQ);
+    timer->due += timer->period;
+    schedule_event(scheduler, timer->due, timer_tick, timer);
+}
+
+/* record_order
+ *      DESCRIPTION: appends the digit context points at to the string at $0310
+ */
+static void record_order(Scheduler_t *scheduler, void *context) {
+    uint8_t *log = scheduler->sf->memory + 0x0310;
+    log[strlen((char *)log)] = *(const char *)context;
+}
+
+/* start_timer
+ *      DESCRIPTION: schedules the first tick of timer, half a period from now
+ */
+static void start_timer(Scheduler_t *scheduler, TestTimer_t *timer) {
+    timer->period = SCHEDULER_TEST_PERIOD;
+    timer->due = scheduler->sf->cycles + SCHEDULER_TEST_PERIOD / 2;
+    timer->ticks = 0;
+    timer->max_late = 0;
+    schedule_event(scheduler, timer->due, timer_tick, timer);
+}
+
+int scheduler_test(sf_t *sf) {
+    // SEI; LDX #$40; WAIT: DEX; BNE WAIT; CLI; LOOP: INC $0300; JMP LOOP
+    static const uint8_t program[] = {0x78, 0xA2, 0x40, 0xCA, 0xD0, 0xFD, 0x58, 0xEE, 0x00, 0x03, 0x4C, 0x07, 0x06};
+    static const uint8_t restore[] = {0x91, 0x80, 0xA2, 0x00, 0xF0, 0xFA}; // DONE: STA ($80),Y; LDX #$00; BEQ DONE
+    static const uint8_t irq_handler[] = {0xEE, 0x01, 0x03, 0x40}; // INC $0301; RTI
+    static const uint8_t nmi_handler[] = {0xEE, 0x02, 0x03, 0x40}; // INC $0302; RTI
+    static const uint8_t reset_handler[] = {0xEE, 0x03, 0x03, 0x4C, 0x07, 0x06}; // INC $0303; JMP LOOP
+    memset(sf->memory, 0, MEMORY_SIZE);
+    memcpy(sf->memory + 0x0600, program, sizeof(program));
+    memcpy(sf->memory + 0x0700, irq_handler, sizeof(irq_handler));
+    memcpy(sf->memory + 0x0710, nmi_handler, sizeof(nmi_handler));
+    memcpy(sf->memory + 0x0720, reset_handler, sizeof(reset_handler));
+    sf->memory[NMI_ADDRESS] = 0x10;
+    sf->memory[NMI_ADDRESS + 1] = 0x07;
+    sf->memory[RESET_ADDRESS] = 0x20;
+    sf->memory[RESET_ADDRESS + 1] = 0x07;
+    sf->memory[IRQ_ADDRESS] = 0x00;
+    sf->memory[IRQ_ADDRESS + 1] = 0x07;
+    initialize_regs(sf, 0x0600);
+    Scheduler_t *scheduler = new_scheduler(sf);
+
+    // an IRQ raised while masked is taken right after CLI, and returns to the instruction after it
+    schedule_interrupt(scheduler, 10, EVENT_IRQ);
+    assert(scheduler_run_cycles(scheduler, 100) == RUN_BUDGET);
+    assert(sf->memory[0x0301] == 0 && scheduler->irqs_pending == 1);
+    assert(scheduler_run_cycles(scheduler, 1000) == RUN_BUDGET);
+    assert(sf->memory[0x0301] == 1 && scheduler->irqs_pending == 0 && sf->esp == STACK_START);
+    assert(sf->memory[0x01FF] == 0x07 && sf->memory[0x01FE] == 0x06);
+    assert((sf->memory[0x01FD] & ((1 << INTERRUPT_INDEX)|(1 << BREAK_INDEX))) == 0);
+
+    // NMI ignores the interrupt flag, reset goes through its vector and moves the stack pointer
+    sf->status |= (1 << INTERRUPT_INDEX);
+    schedule_interrupt(scheduler, sf->cycles + 5, EVENT_NMI);
+    assert(scheduler_run_cycles(scheduler, 100) == RUN_BUDGET);
+    assert(sf->memory[0x0302] == 1 && sf->esp == STACK_START);
+    schedule_interrupt(scheduler, sf->cycles + 5, EVENT_RESET);
+    assert(scheduler_run_cycles(scheduler, 100) == RUN_BUDGET);
+    assert(sf->memory[0x0303] == 1 && sf->esp == STACK_START - 3 && (sf->status & (1 << INTERRUPT_INDEX)));
+    sf->status &= ~(1 << INTERRUPT_INDEX);
+
+    // events on the same cycle come due in the order they were scheduled, and adding one lowers the run's limit
+    sf->next_event = UINT64_MAX;
+    schedule_event(scheduler, sf->cycles + 50, record_order, (void *)"3");
+    schedule_event(scheduler, sf->cycles + 20, record_order, (void *)"1");
+    schedule_event(scheduler, sf->cycles + 20, record_order, (void *)"2");
+    assert(sf->next_event == sf->cycles + 20);
+    assert(scheduler_run_cycles(scheduler, 100) == RUN_BUDGET);
+    assert(strcmp((char *)sf->memory + 0x0310, "123") == 0);
+
+    // a timer device raising an IRQ every SCHEDULER_TEST_PERIOD cycles
+    static TestTimer_t timer;
+    start_timer(scheduler, &timer);
+    uint64_t start_cycles = sf->cycles;
+    assert(scheduler_run_cycles(scheduler, SCHEDULER_TEST_TICKS * SCHEDULER_TEST_PERIOD) == RUN_BUDGET);
+    assert(sf->cycles - start_cycles >= SCHEDULER_TEST_TICKS * SCHEDULER_TEST_PERIOD);
+    assert(timer.ticks == SCHEDULER_TEST_TICKS && sf->memory[0x0301] == 1 + SCHEDULER_TEST_TICKS);
+    assert(timer.max_late < 7 + 7); // longest instruction plus taking the IRQ before it
+    free_scheduler(scheduler);
+
+    // cost of delivering the timer against running with no events
+    sf_t *plain = (sf_t *)malloc(sizeof(sf_t));
+    *plain = *sf;
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    run_cycles(plain, SCHEDULER_TEST_BENCHMARK);
+    double plain_time = seconds_since(&begin);
+    free(plain);
+    scheduler = new_scheduler(sf);
+    start_timer(scheduler, &timer);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    scheduler_run_cycles(scheduler, SCHEDULER_TEST_BENCHMARK);
+    double scheduled_time = seconds_since(&begin);
+    assert(timer.ticks == SCHEDULER_TEST_BENCHMARK / SCHEDULER_TEST_PERIOD);
+    free_scheduler(scheduler);
+
+    printf("run_cycles: %.1f Mcycles/s, with a timer IRQ every %d cycles: %.1f Mcycles/s\n",
+           SCHEDULER_TEST_BENCHMARK / plain_time / 1e6, SCHEDULER_TEST_PERIOD,
+           SCHEDULER_TEST_BENCHMARK / scheduled_time / 1e6);
+    printf("SCHEDULER TESTS PASSED!\n");
+    return 0;
+}
+
+/* IDLE LOOP TESTS */
+
+#define IDLE_TEST_SPIN          100000000
+#define IDLE_TEST_BENCHMARK     1000000000
+
+/* load_idle_programs
+ *      DESCRIPTION: resets sf with every idle loop test program and interrupt handler loaded
+ */
+static void load_idle_programs(sf_t *sf) {
+    // LDA #$00; STA $10; LOOP: LDX #$00; LDA $10; BEQ LOOP
+    static const uint8_t idle[] = {0xA9, 0x00, 0x85, 0x10, 0xA2, 0x00, 0xA5, 0x10, 0xF0, 0xFA};
+    static const uint8_t busy[] = {0xEE, 0x00, 0x03, 0x4C, 0x20, 0x06}; // LOOP: INC $0300; JMP LOOP
+    static const uint8_t counter[] = {0xA2, 0x00, 0xCA, 0xD0, 0xFD, 0x00}; // LDX #$00; LOOP: DEX; BNE LOOP; BRK
+    static const uint8_t device[] = {0xAD, 0x00, 0xD0, 0xF0, 0xFB}; // LOOP: LDA $D000; BEQ LOOP
+    static const uint8_t restore[] = {0x91, 0x80, 0xA2, 0x00, 0xF0, 0xFA}; // DONE: STA ($80),Y; LDX #$00; BEQ DONE
+    static const uint8_t irq_handler[] = {0xEE, 0x01, 0x03, 0x40}; // INC $0301; RTI
+    memset(sf->memory, 0, MEMORY_SIZE);
+    memcpy(sf->memory + 0x0600, idle, sizeof(idle));
+    memcpy(sf->memory + 0x0620, busy, sizeof(busy));
+    memcpy(sf->memory + 0x0630, counter, sizeof(counter));
+    memcpy(sf->memory + 0x0640, device, sizeof(device));
+    memcpy(sf->memory + 0x0650, restore, sizeof(restore));
+    sf->memory[0x0081] = 0x05; // ($80) points at $0500
+    memcpy(sf->memory + 0x0700, irq_handler, sizeof(irq_handler));
+    sf->memory[IRQ_ADDRESS] = 0x00;
+    sf->memory[IRQ_ADDRESS + 1] = 0x07;
+    initialize_regs(sf, 0x0600);
+}
+
+int idle_loop_test(sf_t *sf) {
+    static sf_t reference;
+
+    // skipping passes of an idle loop leaves sf just as running through them would
+    static const uint64_t limits[] = {IDLE_MAX_CYCLES + 1, 1000, 1001, 12345, 1 << 30};
+    for (int i = 0; i < (int)(sizeof(limits) / sizeof(limits[0])); i++) {
+        load_idle_programs(sf);
+        reference = *sf;
+        assert(skip_idle_loop(sf, limits[i]) > 0 && sf->cycles <= limits[i]); // the pass starts after STA
+        run_cycles(sf, limits[i] - sf->cycles);
+        run_cycles(&reference, limits[i]);
+        assert(same_state(sf, &reference));
+    }
+
+    // so are loops whose stores write back the byte already there, as the one tolower.txt ends in
+    load_idle_programs(sf);
+    sf->pc = 0x0650;
+    run_instructions(sf, 3);
+    reference = *sf;
+    assert(skip_idle_loop(sf, 12345) > 0 && sf->cycles <= 12345);
+    run_cycles(sf, 12345 - sf->cycles);
+    run_cycles(&reference, 12345 - reference.cycles);
+    assert(same_state(sf, &reference));
+
+    // loops that store, count or read a device aren't idle
+    static const uint16_t busy_loops[] = {0x0620, 0x0632, 0x0640};
+    for (int i = 0; i < (int)(sizeof(busy_loops) / sizeof(busy_loops[0])); i++) {
+        load_idle_programs(sf);
+#ifdef MEMORY_BUS
+        TestDevice_t device = {0};
+        bus_map_device(sf, 0xD0, 0xD0, test_device_read, test_device_write, &device);
+#else
+        if (busy_loops[i] == 0x0640) {
+            continue; // without the bus $D000 is plain memory
+        }
+#endif
+        sf->pc = busy_loops[i];
+        run_instructions(sf, 10);
+        assert(skip_idle_loop(sf, 1 << 30) == 0);
+    }
+
+    // a program waiting for timer interrupts, against the same program left to spin
+    load_idle_programs(sf);
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    run_cycles(sf, IDLE_TEST_SPIN);
+    double spin_time = seconds_since(&begin);
+    load_idle_programs(sf);
+    Scheduler_t *scheduler = new_scheduler(sf);
+    static TestTimer_t timer;
+    start_timer(scheduler, &timer);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    assert(scheduler_run_cycles(scheduler, IDLE_TEST_BENCHMARK) == RUN_BUDGET);
+    double idle_time = seconds_since(&begin);
+    assert(timer.ticks == IDLE_TEST_BENCHMARK / SCHEDULER_TEST_PERIOD);
+    assert(sf->memory[0x0301] == (uint8_t)(IDLE_TEST_BENCHMARK / SCHEDULER_TEST_PERIOD));
+    assert(scheduler->idle_cycles > IDLE_TEST_BENCHMARK / 10 * 9);
+    printf("spinning: %.1f Mcycles/s, waiting for a timer IRQ every %d cycles: %.1f Mcycles/s (%.1f%% skipped)\n",
+           IDLE_TEST_SPIN / spin_time / 1e6, SCHEDULER_TEST_PERIOD, IDLE_TEST_BENCHMARK / idle_time / 1e6,
+           100.0 * scheduler->idle_cycles / IDLE_TEST_BENCHMARK);
+    free_scheduler(scheduler);
+    printf("IDLE LOOP TESTS PASSED!\n");
+    return 0;
+}
+
+/* PROFILER TESTS */
+
+#define PROFILER_TEST_REPORT    "profiler_test_report.txt"
+#define PROFILER_TEST_BENCHMARK 100000000
+
+int profiler_test(sf_t *sf) {
+    static sf_t reference;
+    uint8_t source[] = "; counts X down from 5\n"
+                       "\tLDX #$05\n"
+                       "LOOP\tDEX\n"
+                       "\tBNE LOOP\n"
+                       "\tBRK\n"
+                       "\t.END\n";
+    memset(sf->memory, 0, MEMORY_SIZE);
+    Table_t *labels = new_table(8);
+    Program_t *p = assembly_to_program(sf, source, &labels);
+    for (int i = 0; i < p->index; i++) {
+        load_bytecode(sf, p->start + i, p->start[i].load_address, p->start[i].index);
+    }
+    uint16_t start = p->start[0].load_address;
+    initialize_regs(sf, start);
+
+    // every instruction is mapped to its line, operand bytes to none
+    assert(p->lines[start] == 2 && p->lines[start + 1] == 0);
+    assert(p->lines[start + 2] == 3 && p->lines[start + 3] == 4 && p->lines[start + 5] == 5);
+
+    // counts add up to the run, which matches the one run_cycles makes
+    reference = *sf;
+    Profile_t *profile = new_profile();
+    assert(profile_run_cycles(sf, 1 << 20, profile) == RUN_BRK);
+    assert(run_cycles(&reference, 1 << 20) == RUN_BRK);
+    assert(same_state(sf, &reference));
+    assert(profile->executions[start] == 1 && profile->executions[start + 2] == 5);
+    assert(profile->executions[start + 3] == 5 && profile->executions[start + 5] == 1);
+    assert(profile->cycles[start + 2] == 5 * 2 && profile->cycles[start + 3] == 4 * 3 + 2); // branch taken 4 times
+    uint64_t total = 0;
+    for (uint32_t address = 0; address < MEMORY_SIZE; address++) {
+        total += profile->cycles[address];
+    }
+    assert(total == sf->cycles);
+
+    // report names addresses by label and line, costliest first
+    write_profile_report(profile, PROFILER_TEST_REPORT, source, p->lines, labels);
+    char *report = (char *)read_file(PROFILER_TEST_REPORT);
+    remove(PROFILER_TEST_REPORT);
+    char *hot_spots = strstr(report, "HOT SPOTS");
+    char *bne = strstr(report, "LOOP+1");
+    char *dex = strstr(report, "LOOP ");
+    assert(hot_spots != NULL && bne != NULL && dex != NULL && hot_spots < bne && bne < dex);
+    assert(strstr(bne, "BNE LOOP") != NULL && strstr(report, "     4  \tBNE LOOP") != NULL);
+    free(report);
+    free_profile(profile);
+    free_program(p);
+    free_table(labels);
+
+    // cost of counting, paid only by runs that ask for it
+    static const uint8_t program[] = {0xCA, 0xD0, 0xFD, 0xE8, 0x4C, 0x00, 0x06}; // LOOP: DEX; BNE LOOP; INX; JMP LOOP
+    memset(sf->memory, 0, MEMORY_SIZE);
+    memcpy(sf->memory + 0x0600, program, sizeof(program));
+    initialize_regs(sf, 0x0600);
+    reference = *sf;
+    profile = new_profile();
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    run_cycles(&reference, PROFILER_TEST_BENCHMARK);
+    double plain_time = seconds_since(&begin);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    profile_run_cycles(sf, PROFILER_TEST_BENCHMARK, profile);
+    double profile_time = seconds_since(&begin);
+    assert(profile->executions[0x0600] - profile->executions[0x0601] <= 1 && sf->cycles >= PROFILER_TEST_BENCHMARK);
+    free_profile(profile);
+    printf("run: %.1f Mcycles/s, profiled: %.1f Mcycles/s (%.2fx)\n", PROFILER_TEST_BENCHMARK / plain_time / 1e6,
+           PROFILER_TEST_BENCHMARK / profile_time / 1e6, plain_time / profile_time);
+    printf("PROFILER TESTS PASSED!\n");
+    return 0;
+}
+
+/* CALL GRAPH TESTS */
+
+#define CALLGRAPH_TEST_OUTPUT       "callgraph_test_output.txt"
+#define CALLGRAPH_TEST_BENCHMARK    100000000
+
+int callgraph_test(sf_t *sf) {
+    static sf_t reference;
+    // MAIN: JSR OUTER; JSR LEAF; LDY #$03; JSR REC; BRK; SPIN: JMP SPIN
+    static const uint8_t main_routine[] = {
+        0x20, 0x10, 0x06, 0x20, 0x20, 0x06, 0xA0, 0x03, 0x20, 0x30, 0x06, 0x00, 0x4C, 0x0C, 0x06
+    };
+    static const uint8_t outer[] = {0xA2, 0x03, 0x20, 0x20, 0x06, 0xCA, 0xD0, 0xFA, 0x60}; // LDX #$03; JSR LEAF x3
+    static const uint8_t leaf[] = {0xEA, 0xEA, 0x60}; // NOP; NOP; RTS
+    static const uint8_t rec[] = {0x88, 0xF0, 0x03, 0x20, 0x30, 0x06, 0x60}; // DEY; BEQ DONE; JSR REC; DONE: RTS
+    static const uint8_t irq[] = {0xEA, 0x40}; // NOP; RTI
+    memset(sf->memory, 0, MEMORY_SIZE);
+    memcpy(sf->memory + 0x0600, main_routine, sizeof(main_routine));
+    memcpy(sf->memory + 0x0610, outer, sizeof(outer));
+    memcpy(sf->memory + 0x0620, leaf, sizeof(leaf));
+    memcpy(sf->memory + 0x0630, rec, sizeof(rec));
+    memcpy(sf->memory + IRQ_ADDRESS, irq, sizeof(irq)); // BRK jumps to IRQ_ADDRESS itself
+    initialize_regs(sf, 0x0600);
+    Table_t *labels = new_table(8);
+    add_to_table(&labels, "MAIN", 0x0600);
+    add_to_table(&labels, "OUTER", 0x0610);
+    add_to_table(&labels, "LEAF", 0x0620);
+    add_to_table(&labels, "REC", 0x0630);
+    add_to_table(&labels, "IRQ", IRQ_ADDRESS);
+
+    // calls, cycles and depths, leaving sf as run_cycles does
+    reference = *sf;
+    CallGraph_t *graph = new_call_graph(sf);
+    assert(callgraph_run_cycles(graph, sf, 1 << 20, NULL) == RUN_BRK);
+    assert(run_cycles(&reference, 1 << 20) == RUN_BRK);
+    assert(same_state(sf, &reference));
+    const Routine_t *outer_routine = &graph->routines[0x0610];
+    const Routine_t *leaf_routine = &graph->routines[0x0620];
+    const Routine_t *rec_routine = &graph->routines[0x0630];
+    assert(outer_routine->calls == 1 && leaf_routine->calls == 4 && rec_routine->calls == 3);
+    assert(leaf_routine->self_cycles == 4 * 10 && leaf_routine->inclusive_cycles == leaf_routine->self_cycles);
+    assert(outer_routine->inclusive_cycles == outer_routine->self_cycles + 3 * 10);
+    assert(rec_routine->inclusive_cycles == rec_routine->self_cycles); // recursive calls counted once
+    assert(leaf_routine->max_depth == 3 && leaf_routine->max_stack == 4 && rec_routine->max_depth == 4);
+    assert(graph->depth == 2 && graph->nodes[graph->stack[1].node].entry == IRQ_ADDRESS); // BRK entered the handler
+
+    // RTI leaves the handler, the spin after it is charged to MAIN
+    assert(callgraph_run_cycles(graph, sf, 1000, NULL) == RUN_BUDGET);
+    assert(graph->depth == 1 && graph->routines[IRQ_ADDRESS].inclusive_cycles == 2 + 6);
+    uint64_t total = 0;
+    for (uint32_t entry = 0; entry < MEMORY_SIZE; entry++) {
+        total += graph->routines[entry].self_cycles;
+    }
+    assert(total == sf->cycles);
+
+    // one folded stack per path of calls
+    write_folded_stacks(graph, CALLGRAPH_TEST_OUTPUT, labels);
+    char *folded = (char *)read_file(CALLGRAPH_TEST_OUTPUT);
+    assert(strstr(folded, "MAIN;OUTER;LEAF 30\n") != NULL && strstr(folded, "MAIN;LEAF 10\n") != NULL);
+    assert(strstr(folded, "MAIN;REC;REC;REC ") != NULL && strstr(folded, "MAIN;IRQ 8\n") != NULL);
+    free(folded);
+    write_call_report(graph, CALLGRAPH_TEST_OUTPUT, labels);
+    char *report = (char *)read_file(CALLGRAPH_TEST_OUTPUT);
+    remove(CALLGRAPH_TEST_OUTPUT);
+    assert(strstr(report, "MAIN") < strstr(report, "OUTER") && strstr(report, "OUTER") < strstr(report, "LEAF"));
+    free(report);
+    free_call_graph(graph);
+    free_table(labels);
+
+    // cost of following calls, OUTER calling LEAF in a loop
+    sf->memory[0x0611] = 0x00; // LDX #$00, so 256 calls per pass
+    sf->memory[0x0618] = 0x4C; // JMP OUTER instead of RTS
+    sf->memory[0x0619] = 0x10;
+    sf->memory[0x061A] = 0x06;
+    initialize_regs(sf, 0x0610);
+    reference = *sf;
+    graph = new_call_graph(sf);
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    run_cycles(&reference, CALLGRAPH_TEST_BENCHMARK);
+    double plain_time = seconds_since(&begin);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    callgraph_run_cycles(graph, sf, CALLGRAPH_TEST_BENCHMARK, NULL);
+    double graph_time = seconds_since(&begin);
+    assert(graph->num_nodes == 2 && graph->routines[0x0620].calls > CALLGRAPH_TEST_BENCHMARK / 25);
+    free_call_graph(graph);
+    printf("run: %.1f Mcycles/s, following calls: %.1f Mcycles/s (%.2fx)\n",
+           CALLGRAPH_TEST_BENCHMARK / plain_time / 1e6, CALLGRAPH_TEST_BENCHMARK / graph_time / 1e6,
+           plain_time / graph_time);
+    printf("CALL GRAPH TESTS PASSED!\n");
+    return 0;
+}
+
+/* BREAKPOINT TESTS */
+
+#define BREAKPOINT_TEST_BENCHMARK   100000000
+
+int breakpoint_test(sf_t *sf) {
+    static sf_t reference;
+    // LOOP: LDA #$05; STA $0300; LDA $0301; INC $0302; LDA ($10),Y; INX; JMP LOOP
+    static const uint8_t loop[] = {
+        0xA9, 0x05, 0x8D, 0x00, 0x03, 0xAD, 0x01, 0x03, 0xEE, 0x02, 0x03, 0xB1, 0x10, 0xE8, 0x4C, 0x00, 0x06
+    };
+    memset(sf->memory, 0, MEMORY_SIZE);
+    memcpy(sf->memory + 0x0600, loop, sizeof(loop));
+    sf->memory[0x0011] = 0x04; // ($10),Y points at $0400
+    initialize_regs(sf, 0x0600);
+    Breakpoints_t *breakpoints = new_breakpoints();
+    use_breakpoints(breakpoints);
+
+    // watchpoints stop right after the instruction accessing the address
+    set_breakpoint(breakpoints, BREAK_WRITE, 0x0300);
+    assert(run_instructions(sf, 1000) == RUN_BREAKPOINT);
+    assert(breakpoints->hit_kind == BREAK_WRITE && breakpoints->hit_address == 0x0300);
+    assert(breakpoints->hit_pc == 0x0602 && sf->pc == 0x0605 && sf->memory[0x0300] == 0x05);
+    set_breakpoint(breakpoints, BREAK_READ, 0x0301);
+    assert(run_instructions(sf, 1000) == RUN_BREAKPOINT); // continues past the last hit
+    assert(breakpoints->hit_kind == BREAK_READ && breakpoints->hit_pc == 0x0605 && sf->pc == 0x0608);
+    clear_breakpoint(breakpoints, BREAK_READ | BREAK_WRITE, 0x0301);
+    clear_breakpoint(breakpoints, BREAK_WRITE, 0x0300);
+    set_breakpoint(breakpoints, BREAK_READ | BREAK_WRITE, 0x0302);
+    assert(run_until(sf, 0xFFF0, 1000) == RUN_BREAKPOINT); // INC reads and writes
+    assert(breakpoints->hit_kind == (BREAK_READ | BREAK_WRITE) && breakpoints->hit_pc == 0x0608);
+    assert(sf->memory[0x0302] == 0x01);
+    clear_breakpoint(breakpoints, BREAK_READ, 0x0302);
+    set_breakpoint(breakpoints, BREAK_READ, 0x0400);
+    assert(run_cycles(sf, 1000) == RUN_BREAKPOINT); // through the pointer
+    assert(breakpoints->hit_kind == BREAK_READ && breakpoints->hit_address == 0x0400 && breakpoints->hit_pc == 0x060B);
+    assert(run_cycles(sf, 1000) == RUN_BREAKPOINT); // next pass
+    assert(breakpoints->hit_kind == BREAK_WRITE && breakpoints->hit_address == 0x0302 && sf->memory[0x0302] == 0x02);
+    assert(breakpoints->num_execute == 0 && breakpoints->num_watch == 2);
+    clear_all_breakpoints(breakpoints);
+    assert(breakpoints->num_execute == 0 && breakpoints->num_watch == 0);
+
+    // breakpoints stop right before the instruction they are on, every pass
+    assert(toggle_breakpoint(breakpoints, BREAK_EXECUTE, 0x0600) == 1);
+    assert(run_instructions(sf, 1000) == RUN_BREAKPOINT);
+    assert(breakpoints->hit_kind == BREAK_EXECUTE && breakpoints->hit_address == 0x0600 && sf->pc == 0x0600);
+    uint8_t x_index = sf->x_index;
+    assert(run_instructions(sf, 1000) == RUN_BREAKPOINT && sf->pc == 0x0600 && sf->x_index == x_index + 1);
+    assert(step_instruction(sf) == RUN_BUDGET && sf->pc == 0x0602);
+    assert(toggle_breakpoint(breakpoints, BREAK_EXECUTE, 0x0600) == 0 && breakpoints->num_execute == 0);
+
+    // time travel stops where the breakpoint is, and stepping back returns to before the access
+    set_breakpoint(breakpoints, BREAK_WRITE, 0x0300);
+    TimeTravel_t *travel = new_time_travel(sf, 1024);
+    assert(travel_run_instructions(travel, sf, 1000) == RUN_BREAKPOINT && sf->pc == 0x0605);
+    assert(travel_step_back(travel, sf) == 0 && sf->pc == 0x0602);
+    free_time_travel(travel);
+
+    // the scheduler doesn't skip idle loops past a watchpoint
+    // LDA #$00; STA $10; LOOP: LDX #$00; LDA $10; BEQ LOOP
+    static const uint8_t idle[] = {0xA9, 0x00, 0x85, 0x10, 0xA2, 0x00, 0xA5, 0x10, 0xF0, 0xFA};
+    clear_all_breakpoints(breakpoints);
+    memset(sf->memory, 0, MEMORY_SIZE);
+    memcpy(sf->memory + 0x0600, idle, sizeof(idle));
+    initialize_regs(sf, 0x0600);
+    set_breakpoint(breakpoints, BREAK_WRITE, 0x0010);
+    Scheduler_t *scheduler = new_scheduler(sf);
+    assert(scheduler_run_cycles(scheduler, 100000) == RUN_BREAKPOINT);
+    assert(breakpoints->hit_address == 0x0010 && sf->pc == 0x0604);
+    free_scheduler(scheduler);
+    memcpy(sf->memory + 0x0600, loop, sizeof(loop));
+    sf->memory[0x0011] = 0x04;
+    initialize_regs(sf, 0x0600);
+
+    // checking a breakpoint that is never hit changes nothing but speed
+    clear_all_breakpoints(breakpoints);
+    set_breakpoint(breakpoints, BREAK_EXECUTE | BREAK_READ | BREAK_WRITE, 0xFFF0);
+    reference = *sf;
+    assert(run_instructions(sf, 100000) == RUN_BUDGET);
+    use_breakpoints(NULL);
+    assert(run_instructions(&reference, 100000) == RUN_BUDGET);
+    assert(same_state(sf, &reference));
+
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    assert(run_cycles(&reference, BREAKPOINT_TEST_BENCHMARK) == RUN_BUDGET);
+    double plain_time = seconds_since(&begin);
+    use_breakpoints(breakpoints);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    assert(run_cycles(sf, BREAKPOINT_TEST_BENCHMARK) == RUN_BUDGET);
+    double checked_time = seconds_since(&begin);
+    use_breakpoints(NULL);
+    free_breakpoints(breakpoints);
+    printf("run: %.1f Mcycles/s, checking breakpoints: %.1f Mcycles/s (%.2fx)\n",
+           BREAKPOINT_TEST_BENCHMARK / plain_time / 1e6, BREAKPOINT_TEST_BENCHMARK / checked_time / 1e6,
+           plain_time / checked_time);
+    printf("BREAKPOINT TESTS PASSED!\n");
+    return 0;
+}
+
+/* OPCODE TABLE TESTS */
+
+#define OPCODE_TABLE_TEST_SIZE  4096
+
+int opcode_table_test(sf_t *sf) {
+    // operand of every mode, as written and as assembled (the branch targets its own line, 2 bytes back)
+    static const char *operands[] = {
+        "", "A", "#$01", "$10", "$10,X", "$10,Y", "$1234", "$1234,X", "$1234,Y", "($10,X)", "($10),Y", "($1234)", NULL
+    };
+    static const uint16_t operand_values[] = {
+        0, 0, 0x01, 0x10, 0x10, 0x10, 0x1234, 0x1234, 0x1234, 0x10, 0x10, 0x1234, 0xFE
+    };
+    uint8_t *source = (uint8_t *)calloc(OPCODE_TABLE_TEST_SIZE, 1);
+    uint32_t used = 0;
+    uint32_t num_opcodes = 0;
+    for (int opcode = 0; opcode < 256; opcode++) {
+        assert((opcode_mnemonic[opcode] == NULL) == (opcode_mode[opcode] == OPCODE_MODE_NONE));
+        if (opcode_mnemonic[opcode] != NULL) {
+            uint8_t mode = opcode_mode[opcode];
+            if (mode == OPCODE_MODE_REL) {
+                used += snprintf((char *)source + used, OPCODE_TABLE_TEST_SIZE - used, "L%02X\t%s L%02X\n", opcode,
+                                 opcode_mnemonic[opcode], opcode);
+            } else {
+                used += snprintf((char *)source + used, OPCODE_TABLE_TEST_SIZE - used, "\t%s%s%s\n",
+                                 opcode_mnemonic[opcode], mode == OPCODE_MODE_IMP ? "" : " ", operands[mode]);
+            }
+            num_opcodes++;
+        }
+    }
+    snprintf((char *)source + used, OPCODE_TABLE_TEST_SIZE - used, "\t.END\n");
+    assert(num_opcodes == 151);
+    memset(sf->memory, 0, MEMORY_SIZE);
+    Table_t *labels = new_table(64);
+    Program_t *p = assembly_to_program(sf, source, &labels);
+    assert(p->index == 1);
+
+    // the assembler emits every opcode the CPU runs, in the length the CPU steps over
+    const uint8_t *code = p->start[0].start;
+    for (int opcode = 0; opcode < 256; opcode++) {
+        if (opcode_mnemonic[opcode] == NULL) {
+            continue;
+        }
+        uint16_t value = operand_values[opcode_mode[opcode]];
+        assert(code[0] == opcode);
+        assert(opcode_length[opcode] == 1 || code[1] == (value & 0xFF));
+        assert(opcode_length[opcode] < 3 || code[2] == value >> 8);
+        code += opcode_length[opcode];
+    }
+    assert(code == p->start[0].start + p->start[0].index);
+
+    free_program(p);
+    free_table(labels);
+    free(source);
+    printf("OPCODE TABLE TESTS PASSED!\n");
+    return 0;
+}
+
+/* ASSEMBLY CACHE TESTS */
+
+#define ASM_CACHE_TEST_SOURCE   "asm_cache_test.txt"
+
+int asm_cache_test(sf_t *sf) {
+    static sf_t cached;
+    uint8_t source[] = "\t.ORG\t$0600\n"
+                       "\t.WORD\t$FECA\n"
+                       "\t.ORG\t$0800\n"
+                       "START\tLDX #$05\n"
+                       "LOOP\tDEX\n"
+                       "\tBNE LOOP\n"
+                       "\tJMP START\n"
+                       "\t.END\n";
+    FILE *fp = fopen(ASM_CACHE_TEST_SOURCE, "w");
+    assert(fp != NULL);
+    fputs((char *)source, fp);
+    fclose(fp);
+    remove(ASM_CACHE_TEST_SOURCE ASM_CACHE_SUFFIX);
+
+    // no cache yet
+    Table_t *cached_labels = new_table(8);
+    assert(load_cached_program(&cached, ASM_CACHE_TEST_SOURCE, source, &cached_labels) == NULL);
+
+    memset(sf->memory, 0, MEMORY_SIZE);
+    Table_t *labels = new_table(8);
+    Program_t *p = assembly_to_program(sf, source, &labels);
+    for (int i = 0; i < p->index; i++) {
+        load_bytecode(sf, p->start + i, p->start[i].load_address, p->start[i].index);
+    }
+    assert(save_cached_program(sf, ASM_CACHE_TEST_SOURCE, source, p, labels) == 0);
+
+    // the cache gives back the same segments, memory (with what .WORD wrote), line map and labels
+    Program_t *cached_p = load_cached_program(&cached, ASM_CACHE_TEST_SOURCE, source, &cached_labels);
+    assert(cached_p != NULL && cached_p->index == p->index);
+    for (int i = 0; i < p->index; i++) {
+        assert(cached_p->start[i].load_address == p->start[i].load_address);
+        assert(cached_p->start[i].index == p->start[i].index);
+        assert(memcmp(cached_p->start[i].start, p->start[i].start, p->start[i].index) == 0);
+    }
+    assert(memcmp(cached.memory, sf->memory, MEMORY_SIZE) == 0 && cached.memory[0x0600] == 0xCA);
+    assert(memcmp(cached_p->lines, p->lines, PROGRAM_ADDRESSES * sizeof(uint32_t)) == 0);
+    assert(get_value(cached_labels, "START") == 0x0800 && get_value(cached_labels, "LOOP") == 0x0802);
+    free_program(cached_p);
+    free_table(cached_labels);
+
+    // any change to the source misses
+    strstr((char *)source, "#$05")[3] = '6';
+    cached_labels = new_table(8);
+    assert(load_cached_program(&cached, ASM_CACHE_TEST_SOURCE, source, &cached_labels) == NULL);
+    assert(cached_labels->occupied == 0);
+
+    remove(ASM_CACHE_TEST_SOURCE ASM_CACHE_SUFFIX);
+    remove(ASM_CACHE_TEST_SOURCE);
+    free_table(cached_labels);
+    free_program(p);
+    free_table(labels);
+    printf("ASSEMBLY CACHE TESTS PASSED!\n");
+    return 0;
+}
+
+/* FIXUP TESTS */
+
+int fixup_test(sf_t *sf) {
+    uint8_t source[] = "\t.ORG\t$0600\n"
+                       "START\tJMP END\n"          // forward absolute
+                       "\tLDA TABLE,X\n"           // forward absolute x-indexed
+                       "\tLDA (PTR),Y\n"           // forward zero page
+                       "\tJMP (VECTOR)\n"          // forward indirect
+                       "\tBNE END\n"               // forward branch
+                       "\tBEQ START\n"             // backward branch, generated straight away
+                       "END\tJSR START\n"
+                       "\tBRK\n"
+                       "TABLE\t.WORD\t$BEEF\n"
+                       "\t.ORG\t$0080\n"
+                       "PTR\t.WORD\t$0400\n"
+                       "VECTOR\t.WORD\t$0600\n"
+                       "\t.END\n";
+    static const uint8_t expected[] = {
+        0x4C, 0x0F, 0x06, 0xBD, 0x13, 0x06, 0xB1, 0x80, 0x6C, 0x82, 0x00, 0xD0, 0x02, 0xF0, 0xF1, 0x20, 0x00, 0x06,
+        0x00
+    };
+    memset(sf->memory, 0, MEMORY_SIZE);
+    Table_t *labels = new_table(8);
+    Program_t *p = assembly_to_program(sf, source, &labels);
+
+    // forward references are patched to what they would have been had their labels come first
+    assert(p->index == 1 && p->start[0].load_address == 0x0600);
+    assert(p->start[0].index == sizeof(expected) && memcmp(p->start[0].start, expected, sizeof(expected)) == 0);
+    assert(get_value(labels, "END") == 0x060F && get_value(labels, "PTR") == 0x0080);
+    assert(p->lines[0x0600] == 2 && p->lines[0x060B] == 6 && p->lines[0x060F] == 8 && p->lines[0x0601] == 0);
+    assert(sf->memory[0x0613] == 0xEF && sf->memory[0x0082] == 0x00 && sf->memory[0x0083] == 0x06);
+    free_program(p);
+    free_table(labels);
+
+    // branches reach 127 bytes forward and 128 back, whichever way round they are generated
+    uint8_t *branches = (uint8_t *)calloc(1024, 1);
+    uint32_t used = snprintf((char *)branches, 1024, "\t.ORG\t$0600\n\tBEQ FORWARD\n\tNOP\nBACK\tNOP\n");
+    for (int i = 0; i < 125; i++) {
+        used += snprintf((char *)branches + used, 1024 - used, "\tNOP\n");
+    }
+    snprintf((char *)branches + used, 1024 - used, "FORWARD\tBNE BACK\n\t.END\n");
+    labels = new_table(8);
+    p = assembly_to_program(sf, branches, &labels);
+    assert(p->start[0].start[1] == 0x7F && p->start[0].start[0x82] == 0x80);
+    free_program(p);
+    free_table(labels);
+    free(branches);
+    printf("FIXUP TESTS PASSED!\n");
+    return 0;
+}
+
+/* MNEMONIC LOOKUP TESTS */
+
+int mnemonic_test(sf_t *sf) {
+    // every name of three letters finds exactly the mnemonics the CPU has, in either case
+    uint32_t num_mnemonics = 0;
+    uint32_t num_branches = 0;
+    for (uint8_t a = 'A'; a <= 'Z'; a++) {
+        for (uint8_t b = 'A'; b <= 'Z'; b++) {
+            for (uint8_t c = 'A'; c <= 'Z'; c++) {
+                uint8_t name[] = {a, b, c};
+                uint8_t lower[] = {a + 'a' - 'A', b, c + 'a' - 'A'};
+                const Mnemonic_t *mnemonic = find_mnemonic(name);
+                assert(find_mnemonic(lower) == mnemonic);
+                int named = 0;
+                for (int opcode = 0; opcode < 256; opcode++) {
+                    named |= opcode_mnemonic[opcode] != NULL && memcmp(opcode_mnemonic[opcode], name, 3) == 0;
+                }
+                assert(named == (mnemonic != NULL));
+                if (mnemonic != NULL) {
+                    num_mnemonics++;
+                    num_branches += mnemonic->branch;
+                    assert(mnemonic->branch == (HAS_MODE(mnemonic, ADDR_MODE_REL) != 0));
+                }
+            }
+        }
+    }
+    assert(num_mnemonics == 56 && num_branches == 8);
+    assert(find_mnemonic((uint8_t *)"LD1") == NULL && find_mnemonic((uint8_t *)"   ") == NULL);
+
+    // and assemble the same either way
+    uint8_t upper_source[] = "\t.ORG\t$0600\nLOOP\tLDA #$01\n\tSTA $0200,X\n\tBNE LOOP\n\tJMP LOOP\n\t.END\n";
+    uint8_t lower_source[] = "\t.org\t$0600\nLOOP\tlda #$01\n\tsta $0200,x\n\tbNe LOOP\n\tJmp LOOP\n\t.end\n";
+    Table_t *upper_labels = new_table(8);
+    Table_t *lower_labels = new_table(8);
+    Program_t *upper = assembly_to_program(sf, upper_source, &upper_labels);
+    Program_t *lower = assembly_to_program(sf, lower_source, &lower_labels);
+    assert(upper->index == 1 && lower->index == 1 && upper->start[0].index == 10);
+    assert(lower->start[0].index == upper->start[0].index);
+    assert(memcmp(lower->start[0].start, upper->start[0].start, upper->start[0].index) == 0);
+    free_program(upper);
+    free_program(lower);
+    free_table(upper_labels);
+    free_table(lower_labels);
+    printf("MNEMONIC LOOKUP TESTS PASSED!\n");
+    return 0;
+}
+
+/* ARITHMETIC BENCHMARK */
+
+#define ARITHMETIC_INPUTS   (2 * 2 * 256 * 256)
+#define ARITHMETIC_PASSES   16
+#define ARITHMETIC_STRIDE   0x9E37 // odd, so stepping by it visits every input once in a scattered order
+
+/* set_arithmetic_input
+ *      DESCRIPTION: loads accumulator, carry and decimal flags from input number, returns operand
+ */
+static uint8_t set_arithmetic_input(sf_t *sf, uint32_t input) {
+    sf->accumulator = (input >> 8) & 0xFF;
+    sf->status = (((input >> 16) & 1) << CARRY_INDEX) | (((input >> 17) & 1) << DECIMAL_INDEX);
+    return input & 0xFF;
+}
+
+/* time_arithmetic
+ *      DESCRIPTION: runs operation over every input ARITHMETIC_PASSES times, returns nanoseconds per operation
+ */
+static double time_arithmetic(sf_t *sf, void (*operation)(sf_t *sf, uint8_t *operand)) {
+    volatile uint8_t sink = 0;
+    clock_t start = clock();
+    for (int pass = 0; pass < ARITHMETIC_PASSES; pass++) {
+        uint32_t input = 0;
+        for (uint32_t i = 0; i < ARITHMETIC_INPUTS; i++) {
+            uint8_t operand = set_arithmetic_input(sf, input);
+            (*operation)(sf, &operand);
+            sink ^= sf->accumulator ^ sf->status;
+            input = (input + ARITHMETIC_STRIDE) & (ARITHMETIC_INPUTS - 1);
+        }
+    }
+    clock_t end = clock();
+    (void)sink;
+    return (double)(end - start) * 1e9 / CLOCKS_PER_SEC / ((double)ARITHMETIC_PASSES * ARITHMETIC_INPUTS);
+}
+
+int arithmetic_benchmark(sf_t *sf) {
+    // table path must match arithmetic path on every input, hex and BCD
+    initialize_regs(sf, ROM_START);
+    for (uint32_t input = 0; input < ARITHMETIC_INPUTS; input++) {
+        uint8_t operand = set_arithmetic_input(sf, input);
+        ADC_arithmetic(sf, &operand);
+        sf_t expected = *sf;
+        operand = set_arithmetic_input(sf, input);
+        ADC_lookup(sf, &operand);
+        assert(sf->accumulator == expected.accumulator && sf->status == expected.status && sf->nz_result == expected.nz_result);
+
+        operand = set_arithmetic_input(sf, input);
+        SBC_arithmetic(sf, &operand);
+        expected = *sf;
+        operand = set_arithmetic_input(sf, input);
+        SBC_lookup(sf, &operand);
+        assert(sf->accumulator == expected.accumulator && sf->status == expected.status && sf->nz_result == expected.nz_result);
+    }
+
+    printf("ADC arithmetic: %.2f ns/op, lookup: %.2f ns/op\n", time_arithmetic(sf, ADC_arithmetic), time_arithmetic(sf, ADC_lookup));
+    printf("SBC arithmetic: %.2f ns/op, lookup: %.2f ns/op\n", time_arithmetic(sf, SBC_arithmetic), time_arithmetic(sf, SBC_lookup));
+    printf("ARITHMETIC BENCHMARK PASSED!\n");
+    return 0;
+}
+
+/* JIT BENCHMARK */
+
+#define JIT_BENCHMARK_INSTRUCTIONS  50000000
+
+/* run_timed
+ *      DESCRIPTION: runs JIT_BENCHMARK_INSTRUCTIONS instructions with passed run function, returns MIPS
+ */
+static double run_timed(sf_t *sf, RunExit_t (*run)(sf_t *sf, uint64_t num_instr)) {
+    clock_t start = clock();
+    for (uint64_t i = 0; i < JIT_BENCHMARK_INSTRUCTIONS; i += 1000000) {
+        (*run)(sf, 1000000);
+    }
+    clock_t end = clock();
+    return JIT_BENCHMARK_INSTRUCTIONS / ((double)(end - start) / CLOCKS_PER_SEC) / 1e6;
+}
+
+int jit_benchmark(sf_t *sf) {
+    // TOLOWER: LDY #$00; LOOP: LDA $0400,Y; CMP #$41; BCC SKIP; CMP #$5B; BCS SKIP; ORA #$20;
+    // SKIP: STA $0500,Y; INY; BNE LOOP; JMP TOLOWER
+    static const uint8_t program[] = {
+        0xA0, 0x00, 0xB9, 0x00, 0x04, 0xC9, 0x41, 0x90, 0x06, 0xC9, 0x5B, 0xB0, 0x02, 0x09, 0x20,
+        0x99, 0x00, 0x05, 0xC8, 0xD0, 0xEB, 0x4C, 0x00, 0x06
+    };
+    static sf_t reference;
+    static sf_t threaded;
+    static sf_t blocks;
+
+    memset(sf->memory, 0, MEMORY_SIZE);
+    for (int i = 0; i < 0x100; i++) {
+        sf->memory[0x0400 + i] = i;
+    }
+    memcpy(sf->memory + 0x0600, program, sizeof(program));
+    initialize_regs(sf, 0x0600);
+    reference = *sf;
+    threaded = *sf;
+    blocks = *sf;
+
+    double interpreted = run_timed(&reference, run_instructions);
+    double dispatched = run_timed(&threaded, threaded_run_instructions);
+    double decoded = run_timed(&blocks, block_run_instructions);
+    double translated = run_timed(sf, jit_run_instructions);
+    assert(sf->accumulator == reference.accumulator && sf->x_index == reference.x_index &&
+            sf->y_index == reference.y_index && sf->status == reference.status && sf->esp == reference.esp &&
+            sf->pc == reference.pc && sf->cycles == reference.cycles &&
+            memcmp(sf->memory, reference.memory, MEMORY_SIZE) == 0);
+    assert(threaded.accumulator == reference.accumulator && threaded.x_index == reference.x_index &&
+            threaded.y_index == reference.y_index && threaded.status == reference.status &&
+            threaded.esp == reference.esp && threaded.pc == reference.pc && threaded.cycles == reference.cycles &&
+            memcmp(threaded.memory, reference.memory, MEMORY_SIZE) == 0);
+    assert(same_state(&blocks, &reference));
+
+    printf("interpreter: %.1f MIPS, threaded: %.1f MIPS (%.2fx), blocks: %.1f MIPS (%.2fx), JIT: %.1f MIPS (%.2fx)\n",
+           interpreted, dispatched, dispatched / interpreted, decoded, decoded / interpreted, translated,
+           translated / interpreted);
+    printf("JIT BENCHMARK PASSED!\n");
+    return 0;
+}
@@ -12,6 +12,29 @@
 #define MAGIC_SIZ   0x09
 
 int run_opcode_tests(sf_t *sf);
+int run_threaded_opcode_tests(sf_t *sf);
+int run_jit_opcode_tests(sf_t *sf);
 int table_test();
+int batch_run_test(sf_t *sf);
+int bus_test(sf_t *sf);
+int batch_engine_test(sf_t *sf);
+int lockstep_test(sf_t *sf);
+int block_engine_test(sf_t *sf);
+int jit_test(sf_t *sf);
+int threaded_engine_test(sf_t *sf);
+int paged_memory_test(sf_t *sf);
+int snapshot_test(sf_t *sf);
+int time_travel_test(sf_t *sf);
+int scheduler_test(sf_t *sf);
+int idle_loop_test(sf_t *sf);
+int profiler_test(sf_t *sf);
+int callgraph_test(sf_t *sf);
+int breakpoint_test(sf_t *sf);
+int opcode_table_test(sf_t *sf);
+int asm_cache_test(sf_t *sf);
+int fixup_test(sf_t *sf);
+int mnemonic_test(sf_t *sf);
+int arithmetic_benchmark(sf_t *sf);
+int jit_benchmark(sf_t *sf);
 
 #endif